@@ -0,0 +1,49 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Built by make check against the installed libmcus-core headers and library, with abi-check-symbols.h generated from libmcus-core.symbols.
+ * Every listed symbol is referenced, so one which the headers don't declare fails to compile, and one which the library doesn't export fails
+ * to link (or, if it's weak, to resolve when run). */
+
+#include <mcus-core.h>
+
+#define SYMBOL(S) { G_STRINGIFY (S), (gconstpointer) &S },
+
+static const struct {
+	const gchar *name;
+	gconstpointer address;
+} symbols[] = {
+#include "abi-check-symbols.h"
+};
+
+int
+main (int argc, char *argv[])
+{
+	guint i;
+	int status = 0;
+
+	for (i = 0; i < G_N_ELEMENTS (symbols); i++) {
+		if (symbols[i].address == NULL) {
+			g_printerr ("Symbol \"%s\" couldn't be resolved.\n", symbols[i].name);
+			status = 1;
+		}
+	}
+
+	return status;
+}
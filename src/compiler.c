@@ -49,42 +49,42 @@ typedef struct {
 } MCUSInstruction;
 
 const MCUSInstructionData const mcus_instruction_data[] = {
-	/* Opcode,	name,		arity,	size (bytes),		operand types */
-	{ OPCODE_HALT,	"HALT",		0,	1,			{  },
+	/* Opcode,	name,		arity,	size (bytes),		operand types,					cycles */
+	{ OPCODE_HALT,	"HALT",		0,	1,			{  },						1,
 		N_("HALT — halts simulation of the program.") },
-	{ OPCODE_MOVI,	"MOVI",		2,	3,			{ OPERAND_REGISTER,	OPERAND_CONSTANT },
+	{ OPCODE_MOVI,	"MOVI",		2,	3,			{ OPERAND_REGISTER,	OPERAND_CONSTANT },	1,
 		N_("MOVI Sx, 00 — move the second operand into the register specified by the first.") },
-	{ OPCODE_MOV,	"MOV",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },
+	{ OPCODE_MOV,	"MOV",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },	1,
 		N_("MOV Sx, Sy — move the second register into the first.") },
-	{ OPCODE_ADD,	"ADD",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },
+	{ OPCODE_ADD,	"ADD",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },	1,
 		N_("ADD Sx, Sy — add the second register to the first and store the result in the first.") },
-	{ OPCODE_SUB,	"SUB",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },
+	{ OPCODE_SUB,	"SUB",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },	1,
 		N_("SUB Sx, Sy — subtract the second register from the first and store the result in the first.") },
-	{ OPCODE_AND,	"AND",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },
+	{ OPCODE_AND,	"AND",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },	1,
 		N_("AND Sx, Sy — logically AND the two registers, storing the result in the first.") },
-	{ OPCODE_EOR,	"EOR",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },
+	{ OPCODE_EOR,	"EOR",		2,	3,			{ OPERAND_REGISTER,	OPERAND_REGISTER },	1,
 		N_("EOR Sx, Sy — logically EOR the two registers, storing the result in the first.") },
-	{ OPCODE_INC,	"INC",		1,	2,			{ OPERAND_REGISTER, },
+	{ OPCODE_INC,	"INC",		1,	2,			{ OPERAND_REGISTER, },				1,
 		N_("INC Sx — increment the register by 1.") },
-	{ OPCODE_DEC,	"DEC",		1,	2,			{ OPERAND_REGISTER, },
+	{ OPCODE_DEC,	"DEC",		1,	2,			{ OPERAND_REGISTER, },				1,
 		N_("DEC Sx — decrement the register by 1.") },
-	{ OPCODE_IN,	"IN",		2,	2, /* <-- special */	{ OPERAND_REGISTER,	OPERAND_INPUT },
+	{ OPCODE_IN,	"IN",		2,	2, /* <-- special */	{ OPERAND_REGISTER,	OPERAND_INPUT },	1,
 		N_("IN Sx, I — move the value at the input port into the register.") },
-	{ OPCODE_OUT,	"OUT",		2,	2, /* <-- special */	{ OPERAND_OUTPUT,	OPERAND_REGISTER },
+	{ OPCODE_OUT,	"OUT",		2,	2, /* <-- special */	{ OPERAND_OUTPUT,	OPERAND_REGISTER },	1,
 		N_("OUT Q, Sx — move the value in the register to the output port.") },
-	{ OPCODE_JP,	"JP",		1,	2,			{ OPERAND_LABEL, },
+	{ OPCODE_JP,	"JP",		1,	2,			{ OPERAND_LABEL, },				1,
 		N_("JP label — unconditionally jump to the instruction after the label.") },
-	{ OPCODE_JZ,	"JZ",		1,	2,			{ OPERAND_LABEL, },
+	{ OPCODE_JZ,	"JZ",		1,	2,			{ OPERAND_LABEL, },				1,
 		N_("JZ label — jump to the instruction after the label if the result of the last operation was zero.") },
-	{ OPCODE_JNZ,	"JNZ",		1,	2,			{ OPERAND_LABEL, },
+	{ OPCODE_JNZ,	"JNZ",		1,	2,			{ OPERAND_LABEL, },				1,
 		N_("JNZ label — jump to the instruction after the label if the result of the last operation was not zero.") },
-	{ OPCODE_RCALL,	"RCALL",	1,	2,			{ OPERAND_LABEL, },
+	{ OPCODE_RCALL,	"RCALL",	1,	2,			{ OPERAND_LABEL, },				2,
 		N_("RCALL label — jump to the subroutine at label, storing the current program counter on the stack.") },
-	{ OPCODE_RET,	"RET",		0,	1,			{  },
+	{ OPCODE_RET,	"RET",		0,	1,			{  },						2,
 		N_("RET — return from the current subroutine call, popping the program counter off the stack.") },
-	{ OPCODE_SHL,	"SHL",		1,	2,			{ OPERAND_REGISTER, },
+	{ OPCODE_SHL,	"SHL",		1,	2,			{ OPERAND_REGISTER, },				1,
 		N_("SHL Sx — logically shift the bits in the register left one place.") },
-	{ OPCODE_SHR,	"SHR",		1,	2,			{ OPERAND_REGISTER, },
+	{ OPCODE_SHR,	"SHR",		1,	2,			{ OPERAND_REGISTER, },				1,
 		N_("SHR Sx — logically shift the bits in the register right one place.") }
 };
 
@@ -821,10 +821,13 @@ throw_error:
 }
 
 gboolean
-mcus_compiler_compile (MCUSCompiler *self, MCUSSimulation *simulation, MCUSInstructionOffset **offset_map, guchar *lookup_table_length, GError **error)
+mcus_compiler_compile (MCUSCompiler *self, MCUSSimulation *simulation, MCUSInstructionOffset **offset_map, MCUSInstructionAddress **address_map,
+                       guint *address_map_length, guchar *lookup_table_length, GError **error)
 {
 	guint i;
 	guchar *memory, *lookup_table;
+	MCUSInstructionOffset *offsets;
+	MCUSInstructionAddress *addresses;
 
 	self->priv->dirty = TRUE;
 
@@ -835,9 +838,22 @@ mcus_compiler_compile (MCUSCompiler *self, MCUSSimulation *simulation, MCUSInstr
 	memset (memory, 0, MEMORY_SIZE);
 	memset (lookup_table, 0, LOOKUP_TABLE_SIZE);
 
-	/* Allocate the line number map's memory */
-	g_free (*offset_map);
-	*offset_map = g_malloc (sizeof (MCUSInstructionOffset) * (self->priv->compiled_size + 1));
+	/* Allocate the line number map's memory, and the reverse map from source offsets to addresses */
+	offsets = g_malloc (sizeof (MCUSInstructionOffset) * (self->priv->compiled_size + 1));
+	addresses = g_malloc (sizeof (MCUSInstructionAddress) * MAX (self->priv->instruction_count, 1));
+
+	if (offset_map != NULL) {
+		g_free (*offset_map);
+		*offset_map = offsets;
+	}
+
+	if (address_map != NULL) {
+		g_free (*address_map);
+		*address_map = addresses;
+	}
+
+	if (address_map_length != NULL)
+		*address_map_length = 0;
 
 	g_debug ("Allocating line number map of %lu bytes.", (gulong) (sizeof (guint) * self->priv->compiled_size));
 
@@ -863,12 +879,15 @@ mcus_compiler_compile (MCUSCompiler *self, MCUSSimulation *simulation, MCUSInstr
 			g_set_error (error, MCUS_COMPILER_ERROR, MCUS_COMPILER_ERROR_MEMORY_OVERFLOW,
 			             _("Instruction %u overflows the microcontroller memory."),
 			             i);
-			return FALSE;
+			goto error;
 		}
 
-		/* Store the line number mapping for the instruction */
-		(*offset_map)[self->priv->compiled_size].offset = instruction->offset;
-		(*offset_map)[self->priv->compiled_size].length = instruction->length;
+		/* Store the line number mapping for the instruction, and the reverse mapping. Instructions are compiled in the order they
+		 * appear in the source, so the reverse map's sorted by offset. */
+		offsets[self->priv->compiled_size].offset = instruction->offset;
+		offsets[self->priv->compiled_size].length = instruction->length;
+		addresses[i].offset = instruction->offset;
+		addresses[i].address = self->priv->compiled_size;
 
 		/* Store the opcode first, as that's easy */
 		memory[self->priv->compiled_size++] = instruction->opcode;
@@ -909,7 +928,7 @@ mcus_compiler_compile (MCUSCompiler *self, MCUSSimulation *simulation, MCUSInstr
 
 					if (child_error != NULL) {
 						g_propagate_error (error, child_error);
-						return FALSE;
+						goto error;
 					}
 				} else {
 					/* Just store the operand */
@@ -923,8 +942,15 @@ mcus_compiler_compile (MCUSCompiler *self, MCUSSimulation *simulation, MCUSInstr
 	}
 
 	/* Set the last element in the line number map to -1 for safety */
-	(*offset_map)[self->priv->compiled_size].offset = -1;
-	(*offset_map)[self->priv->compiled_size].length = 0;
+	offsets[self->priv->compiled_size].offset = -1;
+	offsets[self->priv->compiled_size].length = 0;
+
+	if (offset_map == NULL)
+		g_free (offsets);
+	if (address_map == NULL)
+		g_free (addresses);
+	if (address_map_length != NULL)
+		*address_map_length = self->priv->instruction_count;
 
 	/* Copy across the lookup table */
 	g_memmove (lookup_table, self->priv->lookup_table.table, sizeof (guchar) * self->priv->lookup_table.length);
@@ -938,6 +964,43 @@ mcus_compiler_compile (MCUSCompiler *self, MCUSSimulation *simulation, MCUSInstr
 	reset_state (self);
 
 	return TRUE;
+
+error:
+	if (offset_map == NULL)
+		g_free (offsets);
+	if (address_map == NULL)
+		g_free (addresses);
+
+	return FALSE;
+}
+
+/**
+ * mcus_address_map_lookup:
+ * @address_map: a map from source offsets to addresses, as returned by mcus_compiler_compile()
+ * @address_map_length: the number of entries in @address_map
+ * @offset: an offset into the source code
+ *
+ * Finds the first instruction in the source code which starts at or after @offset, by binary search of @address_map.
+ *
+ * Return value: the memory address the instruction was compiled to, or -1 if there are no instructions at or after @offset
+ **/
+gint
+mcus_address_map_lookup (const MCUSInstructionAddress *address_map, guint address_map_length, gint offset)
+{
+	guint lower = 0, upper = address_map_length;
+
+	g_return_val_if_fail (address_map != NULL || address_map_length == 0, -1);
+
+	while (lower < upper) {
+		guint middle = lower + (upper - lower) / 2;
+
+		if (address_map[middle].offset < offset)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+
+	return (lower < address_map_length) ? address_map[lower].address : -1;
 }
 
 void
@@ -32,6 +32,11 @@ typedef struct {
 	guint length;
 } MCUSInstructionOffset;
 
+typedef struct {
+	gint offset;
+	guchar address;
+} MCUSInstructionAddress;
+
 #define MCUS_TYPE_COMPILER		(mcus_compiler_get_type ())
 #define MCUS_COMPILER(o)		(G_TYPE_CHECK_INSTANCE_CAST ((o), MCUS_TYPE_COMPILER, MCUSCompiler))
 #define MCUS_COMPILER_CLASS(k)		(G_TYPE_CHECK_CLASS_CAST((k), MCUS_TYPE_COMPILER, MCUSCompilerClass))
@@ -72,9 +77,11 @@ GQuark mcus_compiler_error_quark (void) G_GNUC_CONST;
 MCUSCompiler *mcus_compiler_new (void) G_GNUC_WARN_UNUSED_RESULT;
 gboolean mcus_compiler_parse (MCUSCompiler *self, const gchar *code, GError **error);
 gboolean mcus_compiler_compile (MCUSCompiler *self, MCUSSimulation *simulation, MCUSInstructionOffset **offset_map,
-                                guchar *lookup_table_length, GError **error);
+                                MCUSInstructionAddress **address_map, guint *address_map_length, guchar *lookup_table_length, GError **error);
 void mcus_compiler_get_error_location (MCUSCompiler *self, guint *start, guint *end);
 
+gint mcus_address_map_lookup (const MCUSInstructionAddress *address_map, guint address_map_length, gint offset);
+
 G_END_DECLS
 
 #endif /* !MCUS_COMPILER_H */
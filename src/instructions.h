@@ -70,6 +70,7 @@ typedef struct {
 	const guint arity;
 	const guint size;
 	const MCUSOperandType operand_types[MAX_ARITY];
+	const guint cycles; /* clock cycles taken to execute the instruction */
 	const gchar *help;
 } MCUSInstructionData;
 
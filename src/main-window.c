@@ -24,17 +24,19 @@
 #include <gdk/gdkkeysyms.h>
 #include <gtk/gtk.h>
 #include <gtksourceview/gtksourceview.h>
+#include <gtksourceview/gtksourcemark.h>
 #include <gtksourceview/gtksourceprintcompositor.h>
 #include <gtksourceview/gtksourcelanguagemanager.h>
-#include <math.h>
 #include <stdlib.h>
 
 #include "main-window.h"
 #include "config.h"
 #include "main.h"
 #include "compiler.h"
+#include "instructions.h"
 #include "simulation.h"
-#include "widgets/led.h"
+#include "stack-model.h"
+#include "widgets/led-bar.h"
 #include "widgets/seven-segment-display.h"
 #include "widgets/byte-array.h"
 
@@ -59,7 +61,7 @@ static void tag_range (MCUSMainWindow *self, GtkTextTag *tag, guint start_offset
 /* Normal callbacks */
 static void stack_program_counter_data_cb (GtkTreeViewColumn *column, GtkCellRenderer *cell,
                                            GtkTreeModel *model, GtkTreeIter *iter, gpointer user_data);
-static void simulation_iteration_started_cb (MCUSSimulation *self, MCUSMainWindow *main_window);
+static void function_generator_changed_cb (GObject *object, MCUSMainWindow *main_window);
 static void simulation_iteration_finished_cb (MCUSSimulation *self, GError *error, MCUSMainWindow *main_window);
 static void simulation_stack_pushed_cb (MCUSSimulation *self, MCUSStackFrame *stack_frame, MCUSMainWindow *main_window);
 static void simulation_stack_popped_cb (MCUSSimulation *self, MCUSStackFrame *stack_frame, MCUSMainWindow *main_window);
@@ -68,14 +70,13 @@ static void notify_simulation_state_cb (GObject *object, GParamSpec *param_spec,
 static void notify_can_undo_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
 static void notify_can_redo_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
 static void notify_has_selection_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
-static void notify_program_counter_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
-static void notify_zero_flag_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
+static void simulation_changed_cb (MCUSSimulation *self, const MCUSSimulationChangeSet *change_set, MCUSMainWindow *main_window);
 static void notify_input_port_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
-static void notify_output_port_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
 static void notify_analogue_input_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
 static void notify_memory_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
 static void notify_lookup_table_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
-static void notify_registers_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window);
+static gboolean window_state_event_cb (GtkWidget *widget, GdkEventWindowState *event, MCUSMainWindow *main_window);
+static void display_map_cb (GtkWidget *widget, MCUSMainWindow *main_window);
 
 /* GtkBuilder callbacks */
 G_MODULE_EXPORT void mw_stack_list_store_row_activated (GtkTreeView *tree_view, GtkTreePath *path,
@@ -100,7 +101,17 @@ G_MODULE_EXPORT void mw_fullscreen_activate_cb (GtkAction *self, MCUSMainWindow
 G_MODULE_EXPORT void mw_run_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
 G_MODULE_EXPORT void mw_pause_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
 G_MODULE_EXPORT void mw_stop_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
+G_MODULE_EXPORT void mw_step_backward_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
 G_MODULE_EXPORT void mw_step_forward_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
+G_MODULE_EXPORT void mw_step_over_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
+G_MODULE_EXPORT void mw_step_out_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
+G_MODULE_EXPORT void mw_run_to_cursor_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
+G_MODULE_EXPORT void mw_record_history_toggled_cb (GtkToggleAction *self, MCUSMainWindow *main_window);
+G_MODULE_EXPORT void mw_toggle_breakpoint_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
+G_MODULE_EXPORT void mw_add_watchpoint_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
+G_MODULE_EXPORT void mw_clear_watchpoints_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
+G_MODULE_EXPORT gboolean mw_code_view_button_press_event_cb (GtkWidget *widget, GdkEventButton *event, MCUSMainWindow *main_window);
+G_MODULE_EXPORT void mw_history_scale_value_changed_cb (GtkRange *self, MCUSMainWindow *main_window);
 G_MODULE_EXPORT void mw_clock_speed_spin_button_value_changed_cb (GtkSpinButton *self, MCUSMainWindow *main_window);
 G_MODULE_EXPORT void mw_contents_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
 G_MODULE_EXPORT void mw_about_activate_cb (GtkAction *self, MCUSMainWindow *main_window);
@@ -125,9 +136,46 @@ typedef enum {
 /* The registers get special treatment, as there's free space around them, and they're particularly important */
 #define FULLSCREEN_REGISTERS_FONT_SCALE 2.0
 
+/* The source mark category and line background colour used to mark the next instruction to be executed */
+#define CURRENT_INSTRUCTION_MARK_CATEGORY "current-instruction"
+#define CURRENT_INSTRUCTION_BACKGROUND "#fce94f" /* Tango's lightest "butter" */
+
+/* The source mark category and gutter icon used to mark lines with breakpoints on them */
+#define BREAKPOINT_MARK_CATEGORY "breakpoint"
+#define BREAKPOINT_STOCK_ID GTK_STOCK_MEDIA_RECORD
+
+/* However fast the simulation runs, the displays are refreshed at most once in this interval (in milliseconds) */
+#define REFRESH_INTERVAL 16
+/* The simulation's maximum batch time is cut back no further than this (in microseconds) while the main loop is struggling to refresh */
+#define MIN_BATCH_TIME 1000
+
+/* While running to a target (such as when stepping over a subroutine call), the simulation's run at full speed in batches of this many
+ * instructions, for up to this long (in microseconds) before the main loop's given a chance to refresh the displays */
+#define RUN_TO_BATCH_INSTRUCTIONS 10000
+#define RUN_TO_SLICE_TIME (REFRESH_INTERVAL * 1000 / 2)
+
+/* Size of the simulation's journal of executed instructions (in bytes), which holds the history shown in the timeline scrubber; enough for a
+ * few hundred thousand instructions. It's only kept while the user's turned on recording the history, since every instruction has to be
+ * interpreted to be journalled, which rules out the faster execution engines. */
+#define HISTORY_SIZE (4 * 1024 * 1024)
+
+/* Parts of the display which are out of date with the simulation */
+typedef enum {
+	REFRESH_PROGRAM_COUNTER = 1 << 0,
+	REFRESH_ZERO_FLAG = 1 << 1,
+	REFRESH_REGISTERS = 1 << 2,
+	REFRESH_OUTPUTS = 1 << 3,
+	REFRESH_STACK = 1 << 4,
+	REFRESH_ANALOGUE_INPUT = 1 << 5,
+	REFRESH_HISTORY = 1 << 6
+} RefreshFlags;
+
+static void queue_refresh (MCUSMainWindow *self, RefreshFlags flags);
+
 struct _MCUSMainWindowPrivate {
 	/* Simulation */
 	MCUSSimulation *simulation;
+	gboolean native_loaded; /* TRUE if a translated program has been loaded for the native engine */
 
 	/* Displays */
 	MCUSByteArray *registers_array;
@@ -138,9 +186,14 @@ struct _MCUSMainWindowPrivate {
 	GtkLabel *zero_flag_label;
 	GtkLabel *output_port_label;
 	GtkLabel *analogue_input_label;
-	GtkListStore *stack_list_store;
+	MCUSStackModel *stack_model;
 	GtkTreeView *stack_tree_view;
 
+	/* Timeline scrubber */
+	GtkAdjustment *history_adjustment;
+	GtkWidget *history_scale;
+	gboolean updating_history; /* TRUE while the scrubber's being updated to match the simulation, rather than by the user */
+
 	/* Analogue input interface */
 	GtkAdjustment *adc_frequency_adjustment;
 	GtkAdjustment *adc_amplitude_adjustment;
@@ -172,13 +225,15 @@ struct _MCUSMainWindowPrivate {
 	MCUSSevenSegmentDisplay *output_multi_ssd[16];
 
 	/* LED output */
-	MCUSLED *output_led[8];
+	MCUSLEDBar *output_led_bar;
 
 	/* Code editing/highlighting */
 	GtkWidget *code_view;
 	GtkTextBuffer *code_buffer;
 	MCUSInstructionOffset *offset_map; /* maps memory locations to the text buffer offsets where the corresponding instructions are */
-	GtkTextTag *current_instruction_tag;
+	MCUSInstructionAddress *address_map; /* maps text buffer offsets back to the memory locations of the instructions there */
+	guint address_map_length;
+	GtkTextMark *current_instruction_mark; /* marks the line of the next instruction to be executed; NULL while stopped */
 	GtkTextTag *error_tag;
 	GtkSourceLanguageManager *language_manager;
 	guchar lookup_table_length; /* number of bytes defined for the lookup table */
@@ -207,8 +262,23 @@ struct _MCUSMainWindowPrivate {
 	GtkAction *run_action;
 	GtkAction *pause_action;
 	GtkAction *stop_action;
+	GtkAction *step_backward_action;
 	GtkAction *step_forward_action;
+	GtkAction *step_over_action;
+	GtkAction *step_out_action;
+	GtkAction *run_to_cursor_action;
+	GtkAction *toggle_breakpoint_action;
 	GtkAction *fullscreen_action;
+
+	/* Running to a target at full speed; see run_to_target() */
+	guint run_to_event;
+
+	/* Display refreshing: changes to the simulation are accumulated, and the displays are refreshed together once a frame */
+	RefreshFlags pending_refresh;
+	guint refresh_event;
+	gint64 refresh_due_time; /* monotonic time, in microseconds */
+	gboolean iconified;
+	gulong max_batch_time; /* the simulation's maximum batch time when it isn't being cut back */
 };
 
 G_DEFINE_TYPE (MCUSMainWindow, mcus_main_window, GTK_TYPE_WINDOW)
@@ -236,6 +306,13 @@ mcus_main_window_init (MCUSMainWindow *self)
 
 	/* Set up the simulation */
 	self->priv->simulation = mcus_simulation_new ();
+	self->priv->max_batch_time = mcus_simulation_get_max_batch_time (self->priv->simulation);
+
+	/* The interpreter engine's only there as a reference for the others, so run with one which executes common sequences at full speed */
+	mcus_simulation_set_engine (self->priv->simulation, MCUS_SIMULATION_ENGINE_BASIC_BLOCK);
+
+	/* Keep the simulated clock running smoothly while the displays are redrawn */
+	mcus_simulation_set_threaded (self->priv->simulation, TRUE);
 }
 
 static void
@@ -251,10 +328,22 @@ mcus_main_window_dispose (GObject *object)
 		g_object_unref (priv->filter);
 	priv->filter = NULL;
 
+	if (priv->stack_model != NULL)
+		g_object_unref (priv->stack_model);
+	priv->stack_model = NULL;
+
 	if (priv->simulation != NULL)
 		g_object_unref (priv->simulation);
 	priv->simulation = NULL;
 
+	if (priv->refresh_event != 0)
+		g_source_remove (priv->refresh_event);
+	priv->refresh_event = 0;
+
+	if (priv->run_to_event != 0)
+		g_source_remove (priv->run_to_event);
+	priv->run_to_event = 0;
+
 	/* Chain up to the parent class */
 	G_OBJECT_CLASS (mcus_main_window_parent_class)->dispose (object);
 }
@@ -266,6 +355,7 @@ mcus_main_window_finalize (GObject *object)
 
 	g_free (priv->current_filename);
 	g_free (priv->offset_map);
+	g_free (priv->address_map);
 
 	/* Chain up to the parent class */
 	G_OBJECT_CLASS (mcus_main_window_parent_class)->finalize (object);
@@ -278,6 +368,8 @@ mcus_main_window_new (void)
 	MCUSMainWindow *main_window;
 	MCUSMainWindowPrivate *priv;
 	GError *error = NULL;
+	GdkColor colour;
+	GdkPixbuf *pixbuf;
 	GtkTextBuffer *text_buffer;
 	GtkSourceLanguage *language;
 	GtkTreeViewColumn *tree_column;
@@ -334,8 +426,13 @@ mcus_main_window_new (void)
 	priv->zero_flag_label = GTK_LABEL (gtk_builder_get_object (builder, "mw_zero_flag_label"));
 	priv->output_port_label = GTK_LABEL (gtk_builder_get_object (builder, "mw_output_port_label"));
 	priv->analogue_input_label = GTK_LABEL (gtk_builder_get_object (builder, "mw_analogue_input_label"));
-	priv->stack_list_store = GTK_LIST_STORE (gtk_builder_get_object (builder, "mw_stack_list_store"));
 	priv->stack_tree_view = GTK_TREE_VIEW (gtk_builder_get_object (builder, "mw_stack_tree_view"));
+	priv->history_adjustment = GTK_ADJUSTMENT (gtk_builder_get_object (builder, "mw_history_adjustment"));
+	priv->history_scale = GTK_WIDGET (gtk_builder_get_object (builder, "mw_history_scale"));
+
+	/* Display the simulation's stack */
+	priv->stack_model = mcus_stack_model_new (priv->simulation);
+	gtk_tree_view_set_model (priv->stack_tree_view, GTK_TREE_MODEL (priv->stack_model));
 
 	/* Set a custom data function on the program counter column of the stack list tree view */
 	tree_column = gtk_tree_view_get_column (priv->stack_tree_view, 1);
@@ -363,7 +460,12 @@ mcus_main_window_new (void)
 	priv->run_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_run_action"));
 	priv->pause_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_pause_action"));
 	priv->stop_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_stop_action"));
+	priv->step_backward_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_step_backward_action"));
 	priv->step_forward_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_step_forward_action"));
+	priv->step_over_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_step_over_action"));
+	priv->step_out_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_step_out_action"));
+	priv->run_to_cursor_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_run_to_cursor_action"));
+	priv->toggle_breakpoint_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_toggle_breakpoint_action"));
 	priv->fullscreen_action = GTK_ACTION (gtk_builder_get_object (builder, "mcus_fullscreen_action"));
 
 	/* Grab the ADC controls */
@@ -400,12 +502,7 @@ mcus_main_window_new (void)
 	}
 
 	/* Grab the LED outputs */
-	for (i = 0; i < 8; i++) {
-		gchar led_id[16];
-
-		g_sprintf (led_id, "mw_output_led_%u", i);
-		priv->output_led[i] = MCUS_LED (gtk_builder_get_object (builder, led_id));
-	}
+	priv->output_led_bar = MCUS_LED_BAR (gtk_builder_get_object (builder, "mw_output_led_bar"));
 
 	/* Grab the input port */
 	priv->input_port_entry = GTK_ENTRY (gtk_builder_get_object (builder, "mw_input_port_entry"));
@@ -415,7 +512,6 @@ mcus_main_window_new (void)
 	priv->output_single_ssd_segment_option = GTK_TOGGLE_BUTTON (gtk_builder_get_object (builder, "mw_output_single_ssd_segment_option"));
 
 	/* Set up the simulation state */
-	g_signal_connect (priv->simulation, "iteration-started", (GCallback) simulation_iteration_started_cb, main_window);
 	g_signal_connect (priv->simulation, "iteration-finished", (GCallback) simulation_iteration_finished_cb, main_window);
 	g_signal_connect (priv->simulation, "stack-pushed", (GCallback) simulation_stack_pushed_cb, main_window);
 	g_signal_connect (priv->simulation, "stack-popped", (GCallback) simulation_stack_popped_cb, main_window);
@@ -431,11 +527,18 @@ mcus_main_window_new (void)
 	mcus_byte_array_set_array (priv->registers_array, mcus_simulation_get_registers (priv->simulation), REGISTER_COUNT);
 	mcus_byte_array_set_display_length (priv->registers_array, REGISTER_COUNT);
 
-	/* Create the highlighting tags */
+	/* Create the highlighting tags. The current instruction is marked with a source mark instead, which is much cheaper to move around
+	 * the buffer while running than re-tagging. */
 	text_buffer = GTK_TEXT_BUFFER (gtk_builder_get_object (builder, "mw_code_buffer"));
-	priv->current_instruction_tag = gtk_text_buffer_create_tag (text_buffer, "current-instruction",
-	                                                            "weight", PANGO_WEIGHT_BOLD,
-	                                                            NULL);
+	gdk_color_parse (CURRENT_INSTRUCTION_BACKGROUND, &colour);
+	gtk_source_view_set_mark_category_background (GTK_SOURCE_VIEW (priv->code_view), CURRENT_INSTRUCTION_MARK_CATEGORY, &colour);
+
+	/* Breakpoints are shown in the gutter, in front of the current instruction mark */
+	pixbuf = gtk_widget_render_icon (priv->code_view, BREAKPOINT_STOCK_ID, GTK_ICON_SIZE_MENU, NULL);
+	gtk_source_view_set_mark_category_pixbuf (GTK_SOURCE_VIEW (priv->code_view), BREAKPOINT_MARK_CATEGORY, pixbuf);
+	gtk_source_view_set_mark_category_priority (GTK_SOURCE_VIEW (priv->code_view), BREAKPOINT_MARK_CATEGORY, 1);
+	g_object_unref (pixbuf);
+
 	priv->error_tag = gtk_text_buffer_create_tag (text_buffer, "error",
 	                                              "background", "pink",
 	                                              NULL);
@@ -446,14 +549,27 @@ mcus_main_window_new (void)
 	g_signal_connect (text_buffer, "notify::has-selection", (GCallback) notify_has_selection_cb, main_window);
 
 	/* Watch for changes in the simulation */
-	g_signal_connect (priv->simulation, "notify::program-counter", (GCallback) notify_program_counter_cb, main_window);
-	g_signal_connect (priv->simulation, "notify::zero-flag", (GCallback) notify_zero_flag_cb, main_window);
+	g_signal_connect (priv->simulation, "changed", (GCallback) simulation_changed_cb, main_window);
 	g_signal_connect (priv->simulation, "notify::input-port", (GCallback) notify_input_port_cb, main_window);
-	g_signal_connect (priv->simulation, "notify::output-port", (GCallback) notify_output_port_cb, main_window);
 	g_signal_connect (priv->simulation, "notify::analogue-input", (GCallback) notify_analogue_input_cb, main_window);
 	g_signal_connect (priv->simulation, "notify::memory", (GCallback) notify_memory_cb, main_window);
 	g_signal_connect (priv->simulation, "notify::lookup-table", (GCallback) notify_lookup_table_cb, main_window);
-	g_signal_connect (priv->simulation, "notify::registers", (GCallback) notify_registers_cb, main_window);
+
+	/* Drive the analogue input from the function generator controls */
+	g_signal_connect (priv->adc_frequency_adjustment, "value-changed", (GCallback) function_generator_changed_cb, main_window);
+	g_signal_connect (priv->adc_amplitude_adjustment, "value-changed", (GCallback) function_generator_changed_cb, main_window);
+	g_signal_connect (priv->adc_offset_adjustment, "value-changed", (GCallback) function_generator_changed_cb, main_window);
+	g_signal_connect (priv->adc_phase_adjustment, "value-changed", (GCallback) function_generator_changed_cb, main_window);
+	g_signal_connect (priv->adc_constant_option, "toggled", (GCallback) function_generator_changed_cb, main_window);
+	g_signal_connect (priv->adc_sine_wave_option, "toggled", (GCallback) function_generator_changed_cb, main_window);
+	g_signal_connect (priv->adc_square_wave_option, "toggled", (GCallback) function_generator_changed_cb, main_window);
+	g_signal_connect (priv->adc_triangle_wave_option, "toggled", (GCallback) function_generator_changed_cb, main_window);
+	function_generator_changed_cb (NULL, main_window);
+
+	/* Stop refreshing the displays while they can't be seen, and catch up once they can */
+	g_signal_connect (main_window, "window-state-event", (GCallback) window_state_event_cb, main_window);
+	g_signal_connect (priv->registers_array, "map", (GCallback) display_map_cb, main_window);
+	g_signal_connect (priv->stack_tree_view, "map", (GCallback) display_map_cb, main_window);
 
 	/* Make some widgets monospaced */
 	style = gtk_widget_get_style (priv->code_view);
@@ -519,6 +635,74 @@ mcus_main_window_new (void)
 	return GTK_WINDOW (main_window);
 }
 
+/* Breakpoints are kept as source marks on the lines they're set on, so that they move with the code as it's edited. They're only set on the
+ * simulation once the code's been compiled, on the first instruction on each marked line. */
+static void
+remove_breakpoint_marks (MCUSMainWindow *self)
+{
+	GtkTextIter start_iter, end_iter;
+
+	gtk_text_buffer_get_bounds (self->priv->code_buffer, &start_iter, &end_iter);
+	gtk_source_buffer_remove_source_marks (GTK_SOURCE_BUFFER (self->priv->code_buffer), &start_iter, &end_iter, BREAKPOINT_MARK_CATEGORY);
+}
+
+/* Set a breakpoint on the simulation for each line with a breakpoint mark which has an instruction on it */
+static void
+sync_breakpoints (MCUSMainWindow *self)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+	GtkSourceBuffer *source_buffer = GTK_SOURCE_BUFFER (priv->code_buffer);
+	gint line, line_count;
+
+	mcus_simulation_clear_breakpoints (priv->simulation);
+
+	line_count = gtk_text_buffer_get_line_count (priv->code_buffer);
+	for (line = 0; line < line_count; line++) {
+		GSList *marks;
+		GtkTextIter iter;
+		gint address;
+
+		marks = gtk_source_buffer_get_source_marks_at_line (source_buffer, line, BREAKPOINT_MARK_CATEGORY);
+		if (marks == NULL)
+			continue;
+		g_slist_free (marks);
+
+		/* Find the first instruction on or after the start of the line, and check it's actually on the line */
+		gtk_text_buffer_get_iter_at_line (priv->code_buffer, &iter, line);
+		address = mcus_address_map_lookup (priv->address_map, priv->address_map_length, gtk_text_iter_get_offset (&iter));
+		gtk_text_iter_forward_line (&iter);
+
+		if (address >= 0 &&
+		    (gtk_text_iter_is_end (&iter) == TRUE || priv->offset_map[address].offset < gtk_text_iter_get_offset (&iter)))
+			mcus_simulation_set_breakpoint (priv->simulation, address, TRUE);
+	}
+}
+
+/* Set or clear a breakpoint on the line containing @iter */
+static void
+toggle_breakpoint (MCUSMainWindow *self, GtkTextIter *iter)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+	GtkSourceBuffer *source_buffer = GTK_SOURCE_BUFFER (priv->code_buffer);
+	GSList *marks, *i;
+
+	marks = gtk_source_buffer_get_source_marks_at_line (source_buffer, gtk_text_iter_get_line (iter), BREAKPOINT_MARK_CATEGORY);
+
+	if (marks == NULL) {
+		gtk_text_iter_set_line_offset (iter, 0);
+		gtk_source_buffer_create_source_mark (source_buffer, NULL, BREAKPOINT_MARK_CATEGORY, iter);
+	} else {
+		for (i = marks; i != NULL; i = i->next)
+			gtk_text_buffer_delete_mark (priv->code_buffer, GTK_TEXT_MARK (i->data));
+		g_slist_free (marks);
+	}
+
+	/* If the simulation's stopped, the breakpoints will be synchronised when the code's next compiled; otherwise, it's paused, and the code
+	 * can't have been changed since it was compiled */
+	if (mcus_simulation_get_state (priv->simulation) != MCUS_SIMULATION_STOPPED)
+		sync_breakpoints (self);
+}
+
 /* Returns TRUE if changes were saved, or FALSE if the operation was cancelled */
 /* @open_or_close is %TRUE if we're opening a new file over the top of the current one and %FALSE if we're closing the program altogether */
 static gboolean
@@ -564,6 +748,7 @@ mcus_main_window_new_program (MCUSMainWindow *self)
 		return;
 
 	/* Wipe the code buffer */
+	remove_breakpoint_marks (self);
 	gtk_text_buffer_set_text (text_buffer, "", -1);
 	gtk_text_buffer_set_modified (text_buffer, FALSE);
 
@@ -709,6 +894,7 @@ mcus_main_window_open_file (MCUSMainWindow *self, const gchar *filename)
 		goto file_error;
 
 	/* Load the program text */
+	remove_breakpoint_marks (self);
 	gtk_text_buffer_set_text (text_buffer, file_contents, -1);
 	gtk_text_buffer_set_modified (text_buffer, FALSE);
 	g_free (file_contents);
@@ -740,6 +926,31 @@ file_error:
 	g_free (file_contents);
 }
 
+/* Loads a program translated with --translate and compiled to a module, and switches to the native engine to run it */
+void
+mcus_main_window_load_native (MCUSMainWindow *self, const gchar *filename)
+{
+	GtkWidget *dialog;
+	GError *error = NULL;
+
+	if (mcus_simulation_load_native (self->priv->simulation, filename, &error) == TRUE) {
+		self->priv->native_loaded = TRUE;
+		mcus_simulation_set_engine (self->priv->simulation, MCUS_SIMULATION_ENGINE_NATIVE);
+		return;
+	}
+
+	dialog = gtk_message_dialog_new (GTK_WINDOW (self),
+	                                 GTK_DIALOG_MODAL,
+	                                 GTK_MESSAGE_ERROR,
+	                                 GTK_BUTTONS_OK,
+	                                 _("Translated program could not be loaded from \"%s\""), filename);
+	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog), "%s", error->message);
+	gtk_dialog_run (GTK_DIALOG (dialog));
+	gtk_widget_destroy (dialog);
+
+	g_error_free (error);
+}
+
 gboolean
 mcus_main_window_quit (MCUSMainWindow *self)
 {
@@ -794,64 +1005,101 @@ tag_range (MCUSMainWindow *self, GtkTextTag *tag, guint start_offset, guint end_
 	}
 }
 
+/* The segments lit by a BCD-encoded digit; values above 9 are displayed as 0 */
+static guint8
+get_digit_segment_mask (guint digit)
+{
+	if (digit > 9)
+		digit = 0;
+
+	return mcus_seven_segment_display_digit_to_segment_mask (digit);
+}
+
+/* Work out the brightness of each of eight outputs (LEDs or segments) from the duty cycle of each output port value, given the outputs which
+ * are lit by each value */
+static void
+get_brightnesses (const gdouble *duty_cycles, const guint8 *masks, gdouble *brightnesses)
+{
+	guint value, i;
+
+	for (i = 0; i < 8; i++)
+		brightnesses[i] = 0.0;
+
+	for (value = 0; value < OUTPUT_PORT_VALUES; value++) {
+		if (duty_cycles[value] == 0.0 || masks[value] == 0)
+			continue;
+
+		for (i = 0; i < 8; i++) {
+			if (masks[value] & (1 << i))
+				brightnesses[i] += duty_cycles[value];
+		}
+	}
+}
+
 static void
 update_outputs (MCUSMainWindow *self)
 {
 	MCUSMainWindowPrivate *priv = self->priv;
-	guint i;
-	guchar output_port = mcus_simulation_get_output_port (priv->simulation);
+	gdouble duty_cycles[OUTPUT_PORT_VALUES], brightnesses[MAX_SEGMENTS];
+	guint8 masks[OUTPUT_PORT_VALUES];
+	guint i, value;
+
+	/* While running, the outputs are shown at the brightness they'd have from persistence of vision, so that multiplexed and PWM outputs
+	 * look as they would on the real hardware. Otherwise, the output port's shown exactly, so that stepping through a program's clear. */
+	if (mcus_simulation_get_state (priv->simulation) == MCUS_SIMULATION_RUNNING || priv->run_to_event != 0) {
+		mcus_simulation_get_output_duty_cycles (priv->simulation, duty_cycles);
+	} else {
+		for (value = 0; value < OUTPUT_PORT_VALUES; value++)
+			duty_cycles[value] = 0.0;
+		duty_cycles[mcus_simulation_get_output_port (priv->simulation)] = 1.0;
+	}
 
 	/* Only update outputs if they're visible */
 	switch (priv->output_device) {
 	case OUTPUT_LED_DEVICE:
-		/* Update the LED outputs */
-		for (i = 0; i < 8; i++)
-			mcus_led_set_enabled (priv->output_led[i], output_port & (1 << i));
+		/* Update the LED outputs; each bit in the output corresponds to one LED */
+		for (value = 0; value < OUTPUT_PORT_VALUES; value++)
+			masks[value] = value;
+		get_brightnesses (duty_cycles, masks, brightnesses);
+
+		/* Only the LEDs which have changed are redrawn */
+		mcus_led_bar_set_brightnesses (priv->output_led_bar, brightnesses);
 		break;
 	case OUTPUT_SINGLE_SSD_DEVICE:
 		/* Update the single SSD output */
 		if (gtk_toggle_button_get_active (priv->output_single_ssd_segment_option) == TRUE) {
 			/* Each bit in the output corresponds to one segment */
-			mcus_seven_segment_display_set_segment_mask (priv->output_single_ssd, output_port);
+			for (value = 0; value < OUTPUT_PORT_VALUES; value++)
+				masks[value] = value;
 		} else {
 			/* The output is BCD-encoded, and we should display that number */
-			guint digit = output_port & 0x0F;
-
-			if (digit > 9)
-				digit = 0;
-
-			mcus_seven_segment_display_set_digit (priv->output_single_ssd, digit);
+			for (value = 0; value < OUTPUT_PORT_VALUES; value++)
+				masks[value] = get_digit_segment_mask (value & 0x0F);
 		}
+
+		get_brightnesses (duty_cycles, masks, brightnesses);
+		mcus_seven_segment_display_set_segment_brightnesses (priv->output_single_ssd, brightnesses);
 		break;
 	case OUTPUT_DUAL_SSD_DEVICE:
 		/* Update the dual-SSD output */
-		i = output_port >> 4;
-		if (i > 9)
-			i = 0;
-		mcus_seven_segment_display_set_digit (priv->output_dual_ssd[1], i);
-
-		i = output_port & 0x0F;
-		if (i > 9)
-			i = 0;
-		mcus_seven_segment_display_set_digit (priv->output_dual_ssd[0], i);
+		for (value = 0; value < OUTPUT_PORT_VALUES; value++)
+			masks[value] = get_digit_segment_mask (value >> 4);
+		get_brightnesses (duty_cycles, masks, brightnesses);
+		mcus_seven_segment_display_set_segment_brightnesses (priv->output_dual_ssd[1], brightnesses);
+
+		for (value = 0; value < OUTPUT_PORT_VALUES; value++)
+			masks[value] = get_digit_segment_mask (value & 0x0F);
+		get_brightnesses (duty_cycles, masks, brightnesses);
+		mcus_seven_segment_display_set_segment_brightnesses (priv->output_dual_ssd[0], brightnesses);
 		break;
 	case OUTPUT_MULTIPLEXED_SSD_DEVICE:
-		/* Update the multi-SSD output */
+		/* Update the multi-SSD output. The top nibble selects the SSD, and the bottom nibble is the digit it displays; the others are
+		 * blank. Every SSD which was selected during the persistence-of-vision window is lit accordingly. */
 		for (i = 0; i < 16; i++) {
-			/* Work out which SSD we're setting */
-			if (i == output_port >> 4) {
-				guint digit;
-
-				/* Get the new value */
-				digit = output_port & 0x0F;
-				if (digit > 9)
-					digit = 0;
-
-				mcus_seven_segment_display_set_digit (priv->output_multi_ssd[i], digit);
-			} else {
-				/* Blank the display */
-				mcus_seven_segment_display_set_segment_mask (priv->output_multi_ssd[i], 0);
-			}
+			for (value = 0; value < OUTPUT_PORT_VALUES; value++)
+				masks[value] = (value >> 4 == i) ? get_digit_segment_mask (value & 0x0F) : 0;
+			get_brightnesses (duty_cycles, masks, brightnesses);
+			mcus_seven_segment_display_set_segment_brightnesses (priv->output_multi_ssd[i], brightnesses);
 		}
 		break;
 	default:
@@ -867,80 +1115,67 @@ stack_program_counter_data_cb (GtkTreeViewColumn *column, GtkCellRenderer *cell,
 	/* 2 characters and one \0 */
 	gchar byte_text[3];
 
-	gtk_tree_model_get (model, iter, 1, &program_counter, -1);
+	gtk_tree_model_get (model, iter, MCUS_STACK_MODEL_COLUMN_PROGRAM_COUNTER, &program_counter, -1);
 	g_sprintf (byte_text, "%02X", program_counter);
 	g_object_set (G_OBJECT (cell), "text", byte_text, NULL);
 }
 
+/* Push the function generator settings to the simulation, which samples the waveform itself whenever the ADC's read */
 static void
-simulation_iteration_started_cb (MCUSSimulation *self, MCUSMainWindow *main_window)
+function_generator_changed_cb (GObject *object, MCUSMainWindow *main_window)
 {
 	MCUSMainWindowPrivate *priv = main_window->priv;
-	gdouble amplitude, frequency, phase, offset, analogue_input;
-	guint iteration;
-	gulong clock_speed;
-
-	iteration = mcus_simulation_get_iteration (self);
-	clock_speed = mcus_simulation_get_clock_speed (self);
-
-	/* Update the analogue input from the function generator */
-	amplitude = gtk_adjustment_get_value (priv->adc_amplitude_adjustment);
-	frequency = gtk_adjustment_get_value (priv->adc_frequency_adjustment);
-	phase = gtk_adjustment_get_value (priv->adc_phase_adjustment);
-	offset = gtk_adjustment_get_value (priv->adc_offset_adjustment);
-
-	if (gtk_toggle_button_get_active (priv->adc_constant_option) == TRUE) {
-		/* Constant signal */
-		analogue_input = offset;
-	} else if (gtk_toggle_button_get_active (priv->adc_sine_wave_option) == TRUE) {
-		/* Sine wave */
-		analogue_input = amplitude * sin (2.0 * M_PI * frequency * ((gdouble)(iteration) / clock_speed) + phase) + offset;
-	} else if (gtk_toggle_button_get_active (priv->adc_square_wave_option) == TRUE) {
-		/* Square wave */
-		gdouble sine = sin (2.0 * M_PI * frequency * ((gdouble)(iteration) / clock_speed) + phase);
-		analogue_input = (sine > 0) ? 1.0 : (sine == 0) ? 0.0 : -1.0;
-		analogue_input = amplitude * analogue_input + offset;
-	} else if (gtk_toggle_button_get_active (priv->adc_triangle_wave_option) == TRUE) {
-		/* Triangle wave */
-		analogue_input = amplitude * asin (sin (2.0 * M_PI * frequency *
-		                                        ((gdouble)(iteration) / clock_speed) + phase)) + offset;
-	} else {
-		/* Sawtooth wave */
-		gdouble t = ((gdouble)(iteration) / clock_speed) * frequency;
-		analogue_input = amplitude * 2.0 * (t - floor (t + 0.5)) + offset;
-	}
-
-	/* Clamp the value to 0--5V and set it */
-	mcus_simulation_set_analogue_input (self, CLAMP (analogue_input, 0.0, 5.0));
+	MCUSSimulationWaveform waveform;
+
+	if (gtk_toggle_button_get_active (priv->adc_constant_option) == TRUE)
+		waveform = MCUS_SIMULATION_WAVEFORM_CONSTANT;
+	else if (gtk_toggle_button_get_active (priv->adc_sine_wave_option) == TRUE)
+		waveform = MCUS_SIMULATION_WAVEFORM_SINE;
+	else if (gtk_toggle_button_get_active (priv->adc_square_wave_option) == TRUE)
+		waveform = MCUS_SIMULATION_WAVEFORM_SQUARE;
+	else if (gtk_toggle_button_get_active (priv->adc_triangle_wave_option) == TRUE)
+		waveform = MCUS_SIMULATION_WAVEFORM_TRIANGLE;
+	else
+		waveform = MCUS_SIMULATION_WAVEFORM_SAWTOOTH;
 
-	g_debug ("Analogue input: %f", analogue_input);
+	mcus_simulation_set_function_generator (priv->simulation, waveform,
+	                                        gtk_adjustment_get_value (priv->adc_frequency_adjustment),
+	                                        gtk_adjustment_get_value (priv->adc_amplitude_adjustment),
+	                                        gtk_adjustment_get_value (priv->adc_offset_adjustment),
+	                                        gtk_adjustment_get_value (priv->adc_phase_adjustment));
 }
 
+/* Highlight the instruction which caused @error, and display it */
 static void
-simulation_iteration_finished_cb (MCUSSimulation *self, GError *error, MCUSMainWindow *main_window)
+report_simulation_error (MCUSMainWindow *self, GError *error)
 {
-	if (error != NULL) {
-		GtkWidget *dialog;
-		guchar program_counter;
+	GtkWidget *dialog;
+	guchar program_counter;
+
+	program_counter = mcus_simulation_get_program_counter (self->priv->simulation);
 
-		program_counter = mcus_simulation_get_program_counter (main_window->priv->simulation);
+	/* Highlight the offending line */
+	tag_range (self, self->priv->error_tag,
+	           self->priv->offset_map[program_counter].offset,
+	           self->priv->offset_map[program_counter].offset + self->priv->offset_map[program_counter].length,
+	           FALSE, TRUE);
 
-		/* Highlight the offending line */
-		tag_range (main_window, main_window->priv->error_tag,
-		           main_window->priv->offset_map[program_counter].offset,
-		           main_window->priv->offset_map[program_counter].offset + main_window->priv->offset_map[program_counter].length,
-		           FALSE, TRUE);
+	/* Display an error message */
+	dialog = gtk_message_dialog_new (GTK_WINDOW (self),
+	                                 GTK_DIALOG_MODAL,
+	                                 GTK_MESSAGE_ERROR,
+	                                 GTK_BUTTONS_OK,
+	                                 _("Error iterating simulation"));
+	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog), "%s", error->message);
+	gtk_dialog_run (GTK_DIALOG (dialog));
+	gtk_widget_destroy (dialog);
+}
 
-		/* Display an error message */
-		dialog = gtk_message_dialog_new (GTK_WINDOW (main_window),
-		                                 GTK_DIALOG_MODAL,
-		                                 GTK_MESSAGE_ERROR,
-		                                 GTK_BUTTONS_OK,
-		                                 _("Error iterating simulation"));
-		gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog), "%s", error->message);
-		gtk_dialog_run (GTK_DIALOG (dialog));
-		gtk_widget_destroy (dialog);
-	}
+static void
+simulation_iteration_finished_cb (MCUSSimulation *self, GError *error, MCUSMainWindow *main_window)
+{
+	if (error != NULL)
+		report_simulation_error (main_window, error);
 }
 
 static void
@@ -954,77 +1189,55 @@ update_stack_pointer_label (MCUSMainWindow *self, MCUSStackFrame *stack_frame)
 	gtk_label_set_text (self->priv->stack_pointer_label, byte_text);
 }
 
+/* Bring the displayed stack up to date with the simulation's; only the rows which have changed since the last refresh are touched */
 static void
-simulation_stack_pushed_cb (MCUSSimulation *self, MCUSStackFrame *stack_frame, MCUSMainWindow *main_window)
+update_stack (MCUSMainWindow *self)
 {
-	GtkTreeIter iter;
-	GtkTreePath *path;
-	guint i;
-	gchar register_text[3 * REGISTER_COUNT], *f;
-
-	/* Build a string representing the registers; 3 characters for each register */
-	f = register_text;
-	for (i = 0; i < REGISTER_COUNT; i++) {
-		g_sprintf (f, "%02X", stack_frame->registers[i]);
-		*(f + 2) = ' ';
-		f += 3;
-	}
-	*(f - 1) = '\0';
+	MCUSMainWindowPrivate *priv = self->priv;
 
-	/* Add the new stack frame to the top of the stack list */
-	gtk_list_store_prepend (main_window->priv->stack_list_store, &iter);
-	gtk_list_store_set (main_window->priv->stack_list_store, &iter,
-	                    0, gtk_tree_model_iter_n_children (GTK_TREE_MODEL (main_window->priv->stack_list_store), NULL) - 1,
-	                    1, stack_frame->program_counter,
-	                    2, register_text,
-	                    -1);
+	mcus_stack_model_update (priv->stack_model);
 
 	/* Scroll to the top of the tree view */
-	path = gtk_tree_model_get_path (GTK_TREE_MODEL (main_window->priv->stack_list_store), &iter);
-	gtk_tree_view_scroll_to_cell (main_window->priv->stack_tree_view, path, NULL, TRUE, 0.0, 0.0);
-	gtk_tree_path_free (path);
+	if (mcus_simulation_get_stack_depth (priv->simulation) > 0) {
+		GtkTreePath *path = gtk_tree_path_new_first ();
+		gtk_tree_view_scroll_to_cell (priv->stack_tree_view, path, NULL, TRUE, 0.0, 0.0);
+		gtk_tree_path_free (path);
+	}
 
 	/* Update the stack pointer label */
-	update_stack_pointer_label (main_window, stack_frame);
+	update_stack_pointer_label (self, mcus_simulation_get_stack_head (priv->simulation));
 }
 
 static void
-simulation_stack_popped_cb (MCUSSimulation *self, MCUSStackFrame *stack_frame, MCUSMainWindow *main_window)
+simulation_stack_pushed_cb (MCUSSimulation *self, MCUSStackFrame *stack_frame, MCUSMainWindow *main_window)
 {
-	GtkTreeIter iter;
-
-	/* Remove a stack frame from the top of the stack list */
-	if (gtk_tree_model_get_iter_first (GTK_TREE_MODEL (main_window->priv->stack_list_store), &iter) == TRUE)
-		gtk_list_store_remove (main_window->priv->stack_list_store, &iter);
-
-	/* Scroll to the top of the tree view */
-	if (gtk_tree_model_get_iter_first (GTK_TREE_MODEL (main_window->priv->stack_list_store), &iter) == TRUE) {
-		GtkTreePath *path = gtk_tree_model_get_path (GTK_TREE_MODEL (main_window->priv->stack_list_store), &iter);
-		gtk_tree_view_scroll_to_cell (main_window->priv->stack_tree_view, path, NULL, TRUE, 0.0, 0.0);
-		gtk_tree_path_free (path);
-	}
+	queue_refresh (main_window, REFRESH_STACK);
+}
 
-	/* Update the stack pointer label */
-	update_stack_pointer_label (main_window, stack_frame);
+static void
+simulation_stack_popped_cb (MCUSSimulation *self, MCUSStackFrame *stack_frame, MCUSMainWindow *main_window)
+{
+	queue_refresh (main_window, REFRESH_STACK);
 }
 
 static void
 simulation_stack_emptied_cb (MCUSSimulation *self, MCUSMainWindow *main_window)
 {
-	/* Empty the displayed stack */
-	gtk_list_store_clear (main_window->priv->stack_list_store);
+	queue_refresh (main_window, REFRESH_STACK);
 }
 
 static void
 notify_simulation_state_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window)
 {
 	GtkSourceBuffer *source_buffer;
-	gboolean stopped, not_running, has_selection;
+	gboolean stopped, not_running, stepping, has_selection;
 	MCUSMainWindowPrivate *priv = main_window->priv;
 	MCUSSimulationState state = mcus_simulation_get_state (priv->simulation);
 
+	/* The simulation's paused while it's run to a target, but it's treated as running */
 	stopped = (state == MCUS_SIMULATION_STOPPED);
-	not_running = (state != MCUS_SIMULATION_RUNNING);
+	not_running = (state != MCUS_SIMULATION_RUNNING && priv->run_to_event == 0);
+	stepping = (state == MCUS_SIMULATION_PAUSED && not_running);
 	has_selection = gtk_text_buffer_get_has_selection (main_window->priv->code_buffer);
 	source_buffer = GTK_SOURCE_BUFFER (main_window->priv->code_buffer);
 
@@ -1033,8 +1246,9 @@ notify_simulation_state_cb (GObject *object, GParamSpec *param_spec, MCUSMainWin
 #define SET_SENSITIVITY_W(W,S) \
 	gtk_widget_set_sensitive (GTK_WIDGET (priv->W), (S))
 
-	/* Update the UI */
-	SET_SENSITIVITY_W (code_view, stopped);
+	/* Update the UI. The code view's left sensitive while paused, so that the cursor can be moved for running to it. */
+	gtk_text_view_set_editable (GTK_TEXT_VIEW (priv->code_view), stopped);
+	SET_SENSITIVITY_W (code_view, not_running);
 	SET_SENSITIVITY_W (input_port_entry, not_running);
 	SET_SENSITIVITY_W (clock_speed_spin_button, not_running);
 	SET_SENSITIVITY_W (adc_hbox, not_running);
@@ -1050,17 +1264,27 @@ notify_simulation_state_cb (GObject *object, GParamSpec *param_spec, MCUSMainWin
 	SET_SENSITIVITY_A (delete_action, not_running && has_selection);
 
 	SET_SENSITIVITY_A (run_action, not_running);
-	SET_SENSITIVITY_A (pause_action, state == MCUS_SIMULATION_RUNNING);
+	SET_SENSITIVITY_A (pause_action, !not_running);
 	SET_SENSITIVITY_A (stop_action, state != MCUS_SIMULATION_STOPPED);
-	SET_SENSITIVITY_A (step_forward_action, state == MCUS_SIMULATION_PAUSED);
+	SET_SENSITIVITY_A (step_forward_action, stepping);
+	SET_SENSITIVITY_A (step_over_action, stepping);
+	SET_SENSITIVITY_A (step_out_action, stepping);
+	SET_SENSITIVITY_A (run_to_cursor_action, stepping);
+	SET_SENSITIVITY_A (toggle_breakpoint_action, not_running);
 
 #undef SET_SENSITIVITY_A
 #undef SET_SENSITIVITY_W
 
-	if (stopped) {
-		/* If we're finished, remove the current instruction tag */
-		remove_tag (main_window, priv->current_instruction_tag);
-	}
+	/* Batches of instructions are only cut back while running */
+	if (state != MCUS_SIMULATION_RUNNING)
+		mcus_simulation_set_max_batch_time (priv->simulation, priv->max_batch_time);
+
+	/* Outputs are only shown with persistence of vision while running; see update_outputs() */
+	queue_refresh (main_window, REFRESH_OUTPUTS);
+
+	/* Move the current instruction mark to wherever the simulation's paused, or remove it if it's stopped; and let the history be seeked
+	 * through (and stepped back through) only while it's not running */
+	queue_refresh (main_window, REFRESH_PROGRAM_COUNTER | REFRESH_HISTORY);
 }
 
 static void
@@ -1090,14 +1314,50 @@ notify_has_selection_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow
 	gtk_action_set_sensitive (main_window->priv->delete_action, sensitive);
 }
 
+/* Move the current instruction mark to the line containing @offset, creating it if necessary, and scroll to it if it's left the visible part
+ * of the code view. The view's only scrolled when needed, since doing so every time the program counter changes is expensive. */
 static void
-notify_program_counter_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window)
+move_current_instruction_mark (MCUSMainWindow *self, guint offset)
 {
-	MCUSMainWindowPrivate *priv = main_window->priv;
+	MCUSMainWindowPrivate *priv = self->priv;
+	GtkTextView *text_view = GTK_TEXT_VIEW (priv->code_view);
+	GtkTextIter iter;
+	GdkRectangle visible_rect;
+	gint line_y, line_height;
+
+	gtk_text_buffer_get_iter_at_offset (priv->code_buffer, &iter, offset);
+	gtk_text_iter_set_line_offset (&iter, 0);
+
+	if (priv->current_instruction_mark == NULL) {
+		GtkSourceMark *mark = gtk_source_buffer_create_source_mark (GTK_SOURCE_BUFFER (priv->code_buffer), NULL,
+		                                                            CURRENT_INSTRUCTION_MARK_CATEGORY, &iter);
+		priv->current_instruction_mark = GTK_TEXT_MARK (mark);
+	} else {
+		GtkTextIter old_iter;
+
+		/* Moving the mark within the same line would only cause a needless redraw */
+		gtk_text_buffer_get_iter_at_mark (priv->code_buffer, &old_iter, priv->current_instruction_mark);
+		if (gtk_text_iter_equal (&iter, &old_iter) == TRUE)
+			return;
+
+		gtk_text_buffer_move_mark (priv->code_buffer, priv->current_instruction_mark, &iter);
+	}
+
+	/* Scroll to the mark if it's not fully visible */
+	gtk_text_view_get_visible_rect (text_view, &visible_rect);
+	gtk_text_view_get_line_yrange (text_view, &iter, &line_y, &line_height);
+
+	if (line_y < visible_rect.y || line_y + line_height > visible_rect.y + visible_rect.height)
+		gtk_text_view_scroll_to_mark (text_view, priv->current_instruction_mark, 0.25, TRUE, 0.5, 0.5);
+}
+
+static void
+update_program_counter (MCUSMainWindow *self, guchar program_counter)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
 
 	/* 3 characters for two hexadecimal characters and one \0 */
 	gchar byte_text[3];
-	guchar program_counter = mcus_simulation_get_program_counter (MCUS_SIMULATION (object));
 
 	/* Update the program counter label */
 	g_sprintf (byte_text, "%02X", program_counter);
@@ -1108,19 +1368,196 @@ notify_program_counter_cb (GObject *object, GParamSpec *param_spec, MCUSMainWind
 
 	/* Move the current line mark */
 	if (priv->offset_map != NULL && mcus_simulation_get_state (priv->simulation) != MCUS_SIMULATION_STOPPED) {
-		tag_range (main_window, priv->current_instruction_tag,
-		           priv->offset_map[program_counter].offset,
-		           priv->offset_map[program_counter].offset + priv->offset_map[program_counter].length,
-		           TRUE, TRUE);
+		move_current_instruction_mark (self, priv->offset_map[program_counter].offset);
+	} else if (priv->current_instruction_mark != NULL) {
+		gtk_text_buffer_delete_mark (priv->code_buffer, priv->current_instruction_mark);
+		priv->current_instruction_mark = NULL;
+	}
+}
+
+static void
+update_output_port (MCUSMainWindow *self, guchar output_port)
+{
+	/* 3 characters for two hexadecimal characters and one \0 */
+	gchar byte_text[3];
+
+	/* Update the output port label */
+	g_sprintf (byte_text, "%02X", output_port);
+	gtk_label_set_text (self->priv->output_port_label, byte_text);
+
+	/* Update the other outputs */
+	update_outputs (self);
+}
+
+static void
+update_analogue_input (MCUSMainWindow *self)
+{
+	gchar *text;
+	gdouble analogue_input = mcus_simulation_get_analogue_input (self->priv->simulation);
+
+	/* Update the analogue input label */
+	/* Translators: This is the analogue input label, a value in Volts. */
+	text = g_strdup_printf (_("%.2fV"), analogue_input);
+	gtk_label_set_text (self->priv->analogue_input_label, text);
+	g_free (text);
+}
+
+/* Update the timeline scrubber to cover the simulation's history, which can only be seeked through while it's not running */
+static void
+update_history (MCUSMainWindow *self)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+	guint64 iteration, start_iteration = 0, end_iteration = 0;
+	gboolean has_history = FALSE;
+
+	iteration = mcus_simulation_get_iteration (priv->simulation);
+
+	if (mcus_simulation_get_state (priv->simulation) != MCUS_SIMULATION_RUNNING && priv->run_to_event == 0)
+		has_history = mcus_simulation_get_history_range (priv->simulation, &start_iteration, &end_iteration);
+
+	if (has_history == FALSE)
+		start_iteration = end_iteration = iteration;
+
+	/* Don't seek to where we already are */
+	priv->updating_history = TRUE;
+	gtk_adjustment_configure (priv->history_adjustment, iteration, start_iteration, end_iteration,
+	                          gtk_adjustment_get_step_increment (priv->history_adjustment),
+	                          gtk_adjustment_get_page_increment (priv->history_adjustment), 0.0);
+	priv->updating_history = FALSE;
+
+	gtk_widget_set_sensitive (priv->history_scale, has_history == TRUE && start_iteration < end_iteration);
+	gtk_action_set_sensitive (priv->step_backward_action, has_history == TRUE && iteration > start_iteration);
+}
+
+/* Refresh the parts of the display which are out of date, other than those which can't currently be seen. Those are left out of date until
+ * they're next shown. */
+static void
+refresh (MCUSMainWindow *self)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+	RefreshFlags flags = priv->pending_refresh;
+
+	if (priv->iconified == TRUE)
+		return;
+
+	if (GTK_WIDGET_DRAWABLE (priv->registers_array) == FALSE)
+		flags &= ~REFRESH_REGISTERS;
+	if (GTK_WIDGET_DRAWABLE (priv->stack_tree_view) == FALSE)
+		flags &= ~REFRESH_STACK;
+
+	priv->pending_refresh &= ~flags;
+
+	if (flags & REFRESH_PROGRAM_COUNTER)
+		update_program_counter (self, mcus_simulation_get_program_counter (priv->simulation));
+	if (flags & REFRESH_ZERO_FLAG)
+		gtk_label_set_text (priv->zero_flag_label, mcus_simulation_get_zero_flag (priv->simulation) ? "1" : "0");
+	if (flags & REFRESH_REGISTERS)
+		mcus_byte_array_update (priv->registers_array);
+	if (flags & REFRESH_OUTPUTS)
+		update_output_port (self, mcus_simulation_get_output_port (priv->simulation));
+	if (flags & REFRESH_STACK)
+		update_stack (self);
+	if (flags & REFRESH_ANALOGUE_INPUT)
+		update_analogue_input (self);
+	if (flags & REFRESH_HISTORY)
+		update_history (self);
+}
+
+/* Cut the simulation's batches of instructions back if the main loop's too busy to refresh the displays on time, and let them grow back
+ * towards their normal length once it's keeping up again */
+static void
+adapt_batch_time (MCUSMainWindow *self, gint64 lateness)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+	gulong batch_time, new_batch_time;
+
+	if (mcus_simulation_get_state (priv->simulation) != MCUS_SIMULATION_RUNNING)
+		return;
+
+	batch_time = mcus_simulation_get_max_batch_time (priv->simulation);
+
+	if (lateness > REFRESH_INTERVAL * 1000 / 2)
+		new_batch_time = MAX (batch_time / 2, MIN (MIN_BATCH_TIME, priv->max_batch_time));
+	else
+		new_batch_time = MIN (batch_time + batch_time / 8 + 1, priv->max_batch_time);
+
+	if (new_batch_time != batch_time)
+		mcus_simulation_set_max_batch_time (priv->simulation, new_batch_time);
+}
+
+static gboolean
+refresh_cb (MCUSMainWindow *self)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+
+	priv->refresh_event = 0;
+
+	adapt_batch_time (self, g_get_monotonic_time () - priv->refresh_due_time);
+	refresh (self);
+
+	return FALSE;
+}
+
+/* Mark @flags as out of date, and schedule a refresh for the next frame if one isn't already scheduled */
+static void
+queue_refresh (MCUSMainWindow *self, RefreshFlags flags)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+
+	priv->pending_refresh |= flags;
+
+	if (priv->refresh_event != 0 || priv->pending_refresh == 0 || priv->iconified == TRUE)
+		return;
+
+	priv->refresh_due_time = g_get_monotonic_time () + REFRESH_INTERVAL * 1000;
+	priv->refresh_event = g_timeout_add (REFRESH_INTERVAL, (GSourceFunc) refresh_cb, self);
+}
+
+static void
+simulation_changed_cb (MCUSSimulation *self, const MCUSSimulationChangeSet *change_set, MCUSMainWindow *main_window)
+{
+	RefreshFlags flags = 0;
+
+	if (change_set->flags & MCUS_SIMULATION_CHANGED_PROGRAM_COUNTER)
+		flags |= REFRESH_PROGRAM_COUNTER;
+	if (change_set->flags & MCUS_SIMULATION_CHANGED_ZERO_FLAG)
+		flags |= REFRESH_ZERO_FLAG;
+	if (change_set->flags & MCUS_SIMULATION_CHANGED_REGISTERS)
+		flags |= REFRESH_REGISTERS;
+	/* The brightness of the outputs changes as time passes, even if the output port doesn't */
+	if (change_set->flags & (MCUS_SIMULATION_CHANGED_OUTPUT_PORT | MCUS_SIMULATION_CHANGED_CYCLES))
+		flags |= REFRESH_OUTPUTS;
+	if (change_set->flags & MCUS_SIMULATION_CHANGED_ITERATION)
+		flags |= REFRESH_HISTORY;
+
+	queue_refresh (main_window, flags);
+}
+
+static gboolean
+window_state_event_cb (GtkWidget *widget, GdkEventWindowState *event, MCUSMainWindow *main_window)
+{
+	MCUSMainWindowPrivate *priv = main_window->priv;
+
+	priv->iconified = (event->new_window_state & GDK_WINDOW_STATE_ICONIFIED) ? TRUE : FALSE;
+
+	if (priv->iconified == TRUE) {
+		/* Stop refreshing until we're deiconified */
+		if (priv->refresh_event != 0)
+			g_source_remove (priv->refresh_event);
+		priv->refresh_event = 0;
 	} else {
-		remove_tag (main_window, priv->current_instruction_tag);
+		/* Catch up with everything which changed in the meantime */
+		queue_refresh (main_window, 0);
 	}
+
+	return FALSE;
 }
 
 static void
-notify_zero_flag_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window)
+display_map_cb (GtkWidget *widget, MCUSMainWindow *main_window)
 {
-	gtk_label_set_text (main_window->priv->zero_flag_label, mcus_simulation_get_zero_flag (MCUS_SIMULATION (object)) ? "1" : "0");
+	/* Catch up with any changes made while the display was hidden */
+	queue_refresh (main_window, 0);
 }
 
 static void
@@ -1168,33 +1605,10 @@ notify_input_port_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *m
 	disable_input_signals (main_window, FALSE);
 }
 
-static void
-notify_output_port_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window)
-{
-	/* 3 characters for two hexadecimal characters and one \0 */
-	gchar byte_text[3];
-	guchar output_port = mcus_simulation_get_output_port (MCUS_SIMULATION (object));
-
-	/* Update the output port label */
-	g_sprintf (byte_text, "%02X", output_port);
-	gtk_label_set_text (main_window->priv->output_port_label, byte_text);
-
-	/* Update the other outputs */
-	update_outputs (main_window);
-}
-
 static void
 notify_analogue_input_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window)
 {
-	/* 3 characters for two hexadecimal characters and one \0 */
-	gchar *text;
-	gdouble analogue_input = mcus_simulation_get_analogue_input (MCUS_SIMULATION (object));
-
-	/* Update the output port label */
-	/* Translators: This is the analogue input label, a value in Volts. */
-	text = g_strdup_printf (_("%.2fV"), analogue_input);
-	gtk_label_set_text (main_window->priv->analogue_input_label, text);
-	g_free (text);
+	queue_refresh (main_window, REFRESH_ANALOGUE_INPUT);
 }
 
 static void
@@ -1213,12 +1627,6 @@ notify_lookup_table_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow
 	                                    MIN (main_window->priv->lookup_table_length + 2, LOOKUP_TABLE_SIZE));
 }
 
-static void
-notify_registers_cb (GObject *object, GParamSpec *param_spec, MCUSMainWindow *main_window)
-{
-	mcus_byte_array_update (main_window->priv->registers_array);
-}
-
 G_MODULE_EXPORT gboolean
 mw_delete_event_cb (GtkWidget *widget, GdkEvent *event, MCUSMainWindow *main_window)
 {
@@ -1412,13 +1820,29 @@ mw_run_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
 		goto compiler_error;
 
 	/* Compile it */
-	mcus_compiler_compile (compiler, priv->simulation, &(priv->offset_map),
+	mcus_compiler_compile (compiler, priv->simulation, &(priv->offset_map), &(priv->address_map), &(priv->address_map_length),
 	                       &(priv->lookup_table_length), &error);
 
 	if (error != NULL)
 		goto compiler_error;
 	g_object_unref (compiler);
 
+	sync_breakpoints (main_window);
+
+	/* Warn if a translated program was loaded, but it won't be used because the program's been changed since */
+	if (priv->native_loaded == TRUE && mcus_simulation_check_native (priv->simulation, &error) == FALSE) {
+		dialog = gtk_message_dialog_new (GTK_WINDOW (main_window),
+		                                 GTK_DIALOG_MODAL,
+		                                 GTK_MESSAGE_WARNING,
+		                                 GTK_BUTTONS_OK,
+		                                 _("Translated program can't be used, so the program will be interpreted instead"));
+		gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog), "%s", error->message);
+		gtk_dialog_run (GTK_DIALOG (dialog));
+
+		gtk_widget_destroy (dialog);
+		g_clear_error (&error);
+	}
+
 	/* Start the simulator! */
 	mcus_simulation_start (priv->simulation);
 
@@ -1443,18 +1867,110 @@ compiler_error:
 	g_object_unref (compiler);
 }
 
+/* Stop running to a target, leaving the simulation paused wherever it's got to (or stopped, if it's finished) */
+static void
+stop_running_to_target (MCUSMainWindow *self)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+
+	if (priv->run_to_event != 0)
+		g_source_remove (priv->run_to_event);
+	priv->run_to_event = 0;
+
+	mcus_simulation_set_run_target (priv->simulation, -1, 0);
+
+	/* Update the UI for the simulation no longer running */
+	notify_simulation_state_cb (NULL, NULL, self);
+}
+
+static gboolean
+run_to_target_cb (MCUSMainWindow *self)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+	MCUSSimulationRunSummary summary;
+	GError *error = NULL;
+	gint64 end_time;
+
+	/* Run as many batches as possible in this slice; no signals are emitted for individual instructions, and the displays are only
+	 * refreshed once the main loop gets a chance to, so this runs at full speed. Only the instruction the run started from is executed
+	 * without being checked, so a batch which runs out exactly at the target (or a breakpoint) stops there at the start of the next one. */
+	end_time = g_get_monotonic_time () + RUN_TO_SLICE_TIME;
+	summary.stop_reason = MCUS_SIMULATION_STOP_REASON_LIMIT;
+
+	while (mcus_simulation_get_state (priv->simulation) == MCUS_SIMULATION_PAUSED) {
+		if (mcus_simulation_run (priv->simulation, RUN_TO_BATCH_INSTRUCTIONS,
+		                         MCUS_SIMULATION_STOP_ON_BREAKPOINT | MCUS_SIMULATION_STOP_ON_WATCHPOINT | MCUS_SIMULATION_STOP_ON_TARGET,
+		                         &summary, &error) == FALSE) {
+			/* The simulation's been finished */
+			priv->run_to_event = 0;
+			stop_running_to_target (self);
+			report_simulation_error (self, error);
+			g_error_free (error);
+
+			return FALSE;
+		}
+
+		if (summary.stop_reason != MCUS_SIMULATION_STOP_REASON_LIMIT || g_get_monotonic_time () >= end_time)
+			break;
+	}
+
+	/* Carry on in the next slice if we haven't reached the target (or a breakpoint or watchpoint) yet, and the simulation hasn't halted */
+	if (summary.stop_reason == MCUS_SIMULATION_STOP_REASON_LIMIT && mcus_simulation_get_state (priv->simulation) == MCUS_SIMULATION_PAUSED)
+		return TRUE;
+
+	priv->run_to_event = 0;
+	stop_running_to_target (self);
+
+	return FALSE;
+}
+
+/* Run the paused simulation at full speed until it's just about to execute the instruction at @address with at most @max_stack_depth frames
+ * on the stack, it hits a breakpoint or it halts. This is done in slices from the main loop, so the UI stays responsive, and the run can be
+ * cancelled by pausing or stopping the simulation. */
+static void
+run_to_target (MCUSMainWindow *self, guchar address, guint max_stack_depth)
+{
+	MCUSMainWindowPrivate *priv = self->priv;
+
+	g_return_if_fail (mcus_simulation_get_state (priv->simulation) == MCUS_SIMULATION_PAUSED);
+
+	mcus_simulation_set_run_target (priv->simulation, address, max_stack_depth);
+
+	if (priv->run_to_event == 0)
+		priv->run_to_event = g_idle_add ((GSourceFunc) run_to_target_cb, self);
+
+	/* Update the UI for the simulation running */
+	notify_simulation_state_cb (NULL, NULL, self);
+}
+
 G_MODULE_EXPORT void
 mw_pause_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
 {
-	mcus_simulation_pause (main_window->priv->simulation);
+	if (main_window->priv->run_to_event != 0)
+		stop_running_to_target (main_window);
+	else
+		mcus_simulation_pause (main_window->priv->simulation);
 }
 
 G_MODULE_EXPORT void
 mw_stop_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
 {
+	if (main_window->priv->run_to_event != 0)
+		stop_running_to_target (main_window);
 	mcus_simulation_finish (main_window->priv->simulation);
 }
 
+G_MODULE_EXPORT void
+mw_step_backward_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
+{
+	MCUSSimulation *simulation = main_window->priv->simulation;
+	guint64 iteration = mcus_simulation_get_iteration (simulation);
+
+	/* We can't step back past the start of the history */
+	if (iteration == 0 || mcus_simulation_seek (simulation, iteration - 1) == FALSE)
+		gtk_widget_error_bell (GTK_WIDGET (main_window));
+}
+
 G_MODULE_EXPORT void
 mw_step_forward_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
 {
@@ -1462,6 +1978,157 @@ mw_step_forward_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
 	mcus_simulation_iterate (main_window->priv->simulation, NULL);
 }
 
+G_MODULE_EXPORT void
+mw_step_over_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
+{
+	MCUSMainWindowPrivate *priv = main_window->priv;
+	guchar program_counter = mcus_simulation_get_program_counter (priv->simulation);
+
+	/* Anything other than a subroutine call is just stepped */
+	if (mcus_simulation_get_memory (priv->simulation)[program_counter] != OPCODE_RCALL) {
+		mcus_simulation_iterate (priv->simulation, NULL);
+		return;
+	}
+
+	/* Run until the subroutine's returned to the instruction after the call, at the same stack depth (in case it's recursive) */
+	run_to_target (main_window, program_counter + mcus_instruction_data[OPCODE_RCALL].size, mcus_simulation_get_stack_depth (priv->simulation));
+}
+
+G_MODULE_EXPORT void
+mw_step_out_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
+{
+	MCUSMainWindowPrivate *priv = main_window->priv;
+	MCUSStackFrame *stack_frame = mcus_simulation_get_stack_head (priv->simulation);
+
+	/* We can't step out of the top level of the program */
+	if (stack_frame == NULL) {
+		gtk_widget_error_bell (GTK_WIDGET (main_window));
+		return;
+	}
+
+	/* Run until the current subroutine's returned to its caller, which is when the stack's one frame shallower */
+	run_to_target (main_window, stack_frame->program_counter, mcus_simulation_get_stack_depth (priv->simulation) - 1);
+}
+
+G_MODULE_EXPORT void
+mw_record_history_toggled_cb (GtkToggleAction *self, MCUSMainWindow *main_window)
+{
+	/* Turning the history off frees the journal, so that runs can use the execution engine at full speed again */
+	mcus_simulation_set_history_size (main_window->priv->simulation, (gtk_toggle_action_get_active (self) == TRUE) ? HISTORY_SIZE : 0);
+	queue_refresh (main_window, REFRESH_HISTORY);
+}
+
+G_MODULE_EXPORT void
+mw_history_scale_value_changed_cb (GtkRange *self, MCUSMainWindow *main_window)
+{
+	if (main_window->priv->updating_history == TRUE)
+		return;
+
+	mcus_simulation_seek (main_window->priv->simulation, (guint64) (gtk_range_get_value (self) + 0.5));
+}
+
+G_MODULE_EXPORT gboolean
+mw_code_view_button_press_event_cb (GtkWidget *widget, GdkEventButton *event, MCUSMainWindow *main_window)
+{
+	GtkTextView *text_view = GTK_TEXT_VIEW (widget);
+	GtkTextIter iter;
+	gint buffer_x, buffer_y;
+
+	/* Toggle breakpoints by clicking in the gutter */
+	if (event->type != GDK_BUTTON_PRESS || event->button != 1 || event->window != gtk_text_view_get_window (text_view, GTK_TEXT_WINDOW_LEFT))
+		return FALSE;
+
+	gtk_text_view_window_to_buffer_coords (text_view, GTK_TEXT_WINDOW_LEFT, event->x, event->y, &buffer_x, &buffer_y);
+	gtk_text_view_get_line_at_y (text_view, &iter, buffer_y, NULL);
+	toggle_breakpoint (main_window, &iter);
+
+	return TRUE;
+}
+
+G_MODULE_EXPORT void
+mw_toggle_breakpoint_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
+{
+	GtkTextIter iter;
+
+	gtk_text_buffer_get_iter_at_mark (main_window->priv->code_buffer, &iter, gtk_text_buffer_get_insert (main_window->priv->code_buffer));
+	toggle_breakpoint (main_window, &iter);
+}
+
+G_MODULE_EXPORT void
+mw_add_watchpoint_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
+{
+	GtkWidget *dialog, *label, *entry, *vbox;
+
+	dialog = gtk_dialog_new_with_buttons (_("Add Watchpoint"), GTK_WINDOW (main_window), GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+	                                      "gtk-cancel", GTK_RESPONSE_CANCEL,
+	                                      "gtk-add", GTK_RESPONSE_OK,
+	                                      NULL);
+	gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_OK);
+	gtk_dialog_set_has_separator (GTK_DIALOG (dialog), FALSE);
+
+	label = gtk_label_new (_("Pause the simulation when a register (S0–S7), the zero flag (Z), the output port (Q) or the stack depth (SP) "
+	                         "changes, optionally only to values satisfying a condition such as “S3 == 7F”."));
+	gtk_label_set_line_wrap (GTK_LABEL (label), TRUE);
+	gtk_misc_set_alignment (GTK_MISC (label), 0.0, 0.5);
+
+	entry = gtk_entry_new ();
+	gtk_entry_set_activates_default (GTK_ENTRY (entry), TRUE);
+
+	vbox = gtk_vbox_new (FALSE, 6);
+	gtk_container_set_border_width (GTK_CONTAINER (vbox), 5);
+	gtk_box_pack_start (GTK_BOX (vbox), label, FALSE, FALSE, 0);
+	gtk_box_pack_start (GTK_BOX (vbox), entry, FALSE, FALSE, 0);
+	gtk_box_pack_start (GTK_BOX (gtk_dialog_get_content_area (GTK_DIALOG (dialog))), vbox, TRUE, TRUE, 0);
+	gtk_widget_show_all (vbox);
+
+	/* Keep asking until we get a valid watchpoint, or the user gives up */
+	while (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_OK) {
+		GtkWidget *error_dialog;
+		GError *error = NULL;
+
+		if (mcus_simulation_add_watchpoint (main_window->priv->simulation, gtk_entry_get_text (GTK_ENTRY (entry)), &error) != 0)
+			break;
+
+		error_dialog = gtk_message_dialog_new (GTK_WINDOW (dialog),
+		                                       GTK_DIALOG_MODAL,
+		                                       GTK_MESSAGE_ERROR,
+		                                       GTK_BUTTONS_OK,
+		                                       _("Error adding watchpoint"));
+		gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (error_dialog), "%s", error->message);
+		gtk_dialog_run (GTK_DIALOG (error_dialog));
+		gtk_widget_destroy (error_dialog);
+		g_error_free (error);
+	}
+
+	gtk_widget_destroy (dialog);
+}
+
+G_MODULE_EXPORT void
+mw_clear_watchpoints_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
+{
+	mcus_simulation_clear_watchpoints (main_window->priv->simulation);
+}
+
+G_MODULE_EXPORT void
+mw_run_to_cursor_activate_cb (GtkAction *self, MCUSMainWindow *main_window)
+{
+	MCUSMainWindowPrivate *priv = main_window->priv;
+	GtkTextIter iter;
+	gint address;
+
+	/* Find the first instruction on or after the cursor's line */
+	gtk_text_buffer_get_iter_at_mark (priv->code_buffer, &iter, gtk_text_buffer_get_insert (priv->code_buffer));
+	gtk_text_iter_set_line_offset (&iter, 0);
+	address = mcus_address_map_lookup (priv->address_map, priv->address_map_length, gtk_text_iter_get_offset (&iter));
+
+	if (address < 0) {
+		gtk_widget_error_bell (GTK_WIDGET (main_window));
+		return;
+	}
+
+	run_to_target (main_window, address, G_MAXUINT);
+}
+
 G_MODULE_EXPORT void
 mw_clock_speed_spin_button_value_changed_cb (GtkSpinButton *self, MCUSMainWindow *main_window)
 {
@@ -1745,7 +2412,7 @@ mw_stack_list_store_row_activated (GtkTreeView *tree_view, GtkTreePath *path, Gt
 		return;
 
 	/* Get the program counter from the stack frame which was activated */
-	gtk_tree_model_get (model, &tree_iter, 1, &program_counter, -1);
+	gtk_tree_model_get (model, &tree_iter, MCUS_STACK_MODEL_COLUMN_PROGRAM_COUNTER, &program_counter, -1);
 
 	/* Scroll to the instruction in the code view which compiled to that memory address */
 	offset = priv->offset_map[program_counter].offset;
@@ -60,6 +60,7 @@ void mcus_main_window_open_program (MCUSMainWindow *self);
 void mcus_main_window_save_program (MCUSMainWindow *self);
 gboolean mcus_main_window_save_program_as (MCUSMainWindow *self);
 void mcus_main_window_open_file (MCUSMainWindow *self, const gchar *filename);
+void mcus_main_window_load_native (MCUSMainWindow *self, const gchar *filename);
 gboolean mcus_main_window_quit (MCUSMainWindow *self);
 
 G_END_DECLS
@@ -30,6 +30,9 @@
 #include "config.h"
 #include "main.h"
 #include "main-window.h"
+#include "compiler.h"
+#include "simulation.h"
+#include "translator.h"
 
 #ifdef G_OS_WIN32
 static void
@@ -149,17 +152,68 @@ debug_handler (const char *log_domain, GLogLevelFlags log_level, const char *mes
 		g_log_default_handler (log_domain, log_level, message, NULL);
 }
 
+/* Assembles the program in @input_filename and writes its translation to C to @output_filename, without touching the GUI. Returns the exit
+ * status for the process. */
+static int
+translate_program (const gchar *input_filename, const gchar *output_filename)
+{
+	MCUSSimulation *simulation;
+	MCUSCompiler *compiler;
+	gchar *code, *translation;
+	GError *error = NULL;
+
+	if (g_file_get_contents (input_filename, &code, NULL, &error) == FALSE)
+		goto error;
+
+	simulation = mcus_simulation_new ();
+	compiler = mcus_compiler_new ();
+
+	if (mcus_compiler_parse (compiler, code, &error) == FALSE ||
+	    mcus_compiler_compile (compiler, simulation, NULL, NULL, NULL, NULL, &error) == FALSE) {
+		g_object_unref (compiler);
+		g_object_unref (simulation);
+		g_free (code);
+		goto error;
+	}
+
+	g_object_unref (compiler);
+	g_free (code);
+
+	translation = mcus_translate_to_c (mcus_simulation_get_memory (simulation));
+	g_object_unref (simulation);
+
+	if (g_file_set_contents (output_filename, translation, -1, &error) == FALSE) {
+		g_free (translation);
+		goto error;
+	}
+
+	g_free (translation);
+
+	return 0;
+
+error:
+	/* Translators: the first parameter is a filename, and the second is an error message. */
+	g_printerr (_("Error translating \"%s\": %s\n"), input_filename, error->message);
+	g_error_free (error);
+
+	return 1;
+}
+
 int
 main (int argc, char *argv[])
 {
 	GOptionContext *context;
 	GError *error = NULL;
 	gboolean debug = FALSE;
-	gchar **filenames = NULL;
+	gchar **filenames = NULL, *translate_filename = NULL, *native_filename = NULL;
 	GtkWindow *main_window;
 
 	const GOptionEntry options[] = {
 		{ "debug", 0, 0, G_OPTION_ARG_NONE, &debug, N_("Enable debug mode"), NULL },
+		{ "translate", 0, 0, G_OPTION_ARG_FILENAME, &translate_filename,
+		  N_("Translate the program in FILE to C, and write it to OUTPUT without starting the interface"), N_("OUTPUT") },
+		{ "native", 0, 0, G_OPTION_ARG_FILENAME, &native_filename,
+		  N_("Run programs using MODULE, compiled from the output of --translate, instead of interpreting them"), N_("MODULE") },
 		{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL, N_("[FILE]") },
 		{ NULL }
 	};
@@ -172,21 +226,31 @@ main (int argc, char *argv[])
 
 	gtk_set_locale ();
 	g_thread_init (NULL);
-	gtk_init (&argc, &argv);
 	g_set_application_name (_("Microcontroller Simulator"));
 
-	/* Options */
+	/* Options. GTK+'s options are parsed along with ours, but the display isn't opened until after parsing, so that --translate can be used
+	 * without one. */
 	context = g_option_context_new (_("- Simulate the 2008 OCR A-level electronics microcontroller"));
 	g_option_context_set_translation_domain (context, GETTEXT_PACKAGE);
 	g_option_context_add_main_entries (context, options, GETTEXT_PACKAGE);
+	g_option_context_add_group (context, gtk_get_option_group (FALSE));
 
 	if (g_option_context_parse (context, &argc, &argv, &error) == FALSE) {
-		/* Show an error */
-		GtkWidget *dialog = gtk_message_dialog_new (NULL,
-		                                            GTK_DIALOG_MODAL,
-		                                            GTK_MESSAGE_ERROR,
-		                                            GTK_BUTTONS_OK,
-		                                            _("Command-line options could not be parsed"));
+		/* Show an error, on the terminal if there's no display to show it on */
+		GtkWidget *dialog;
+
+		if (gtk_init_check (&argc, &argv) == FALSE) {
+			/* Translators: the parameter is an error message. */
+			g_printerr (_("Command-line options could not be parsed: %s\n"), error->message);
+			g_error_free (error);
+			exit (1);
+		}
+
+		dialog = gtk_message_dialog_new (NULL,
+		                                 GTK_DIALOG_MODAL,
+		                                 GTK_MESSAGE_ERROR,
+		                                 GTK_BUTTONS_OK,
+		                                 _("Command-line options could not be parsed"));
 		gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog), "%s", error->message);
 		gtk_dialog_run (GTK_DIALOG (dialog));
 		gtk_widget_destroy (dialog);
@@ -200,6 +264,23 @@ main (int argc, char *argv[])
 	/* Debug log handling */
 	g_log_set_handler (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, (GLogFunc) debug_handler, GUINT_TO_POINTER (debug));
 
+	/* Tool mode */
+	if (translate_filename != NULL) {
+		if (filenames == NULL || filenames[0] == NULL) {
+			g_printerr (_("A program to translate must be specified.\n"));
+			exit (1);
+		}
+
+		g_type_init ();
+		exit (translate_program (filenames[0], translate_filename));
+	}
+
+	/* Open the display; GTK+'s options have already been parsed */
+	if (gtk_init_check (&argc, &argv) == FALSE) {
+		g_printerr (_("The display could not be opened.\n"));
+		exit (1);
+	}
+
 	/* Set up */
 #ifdef G_OS_WIN32
 	set_paths ();
@@ -217,6 +298,9 @@ main (int argc, char *argv[])
 	if (filenames != NULL && filenames[0] != NULL)
 		mcus_main_window_open_file (MCUS_MAIN_WINDOW (main_window), filenames[0]);
 
+	if (native_filename != NULL)
+		mcus_main_window_load_native (MCUS_MAIN_WINDOW (main_window), native_filename);
+
 	gtk_main ();
 
 	return 0;
@@ -0,0 +1,32 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The public interface to libmcus-core: the compiler and simulation, without any dependency on GTK+. Programs using the library should
+ * include only this header; the symbols it exports are listed in libmcus-core.symbols. */
+
+#ifndef MCUS_CORE_H
+#define MCUS_CORE_H
+
+#include "instructions.h"
+#include "simulation.h"
+#include "simulation-enums.h"
+#include "compiler.h"
+#include "translator.h"
+
+#endif /* !MCUS_CORE_H */
@@ -0,0 +1,624 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A headless runner for MCUS programs: assembles a program (or restores a snapshot), runs it for a cycle or instruction budget or until it
+ * halts with a script of input changes, optionally seeks back through its history, and prints the final state. It links only against GLib
+ * and the simulation core, so that it's quick to start and can be used for marking and regression testing without a display. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gi18n.h>
+
+#include "config.h"
+#include "compiler.h"
+#include "instructions.h"
+#include "simulation.h"
+#include "simulation-enums.h"
+
+/* The largest batch to run before checking the engine against the interpreter with --lockstep */
+#define LOCKSTEP_MAX_BATCH 64
+
+typedef enum {
+	EVENT_INPUT_PORT,
+	EVENT_ANALOGUE_INPUT
+} EventType;
+
+typedef struct {
+	guint64 cycles;
+	EventType type;
+	union {
+		guchar input_port;
+		gdouble analogue_input;
+	} value;
+} Event;
+
+/* Debug log message handler: discards debug messages unless mcus-run is run with the --debug flag. */
+static void
+debug_handler (const char *log_domain, GLogLevelFlags log_level, const char *message, gpointer user_data)
+{
+	gboolean debug = GPOINTER_TO_UINT (user_data);
+
+	if (debug == TRUE)
+		g_log_default_handler (log_domain, log_level, message, NULL);
+}
+
+static gint
+event_compare (const Event *a, const Event *b)
+{
+	if (a->cycles < b->cycles)
+		return -1;
+	else if (a->cycles > b->cycles)
+		return 1;
+	return 0;
+}
+
+/* Parses each of the CYCLES:VALUE strings in @specs as an event of the given @type, and appends them to @events. */
+static gboolean
+parse_events (GArray *events, gchar **specs, EventType type)
+{
+	guint i;
+
+	for (i = 0; specs != NULL && specs[i] != NULL; i++) {
+		Event event;
+		gchar *end;
+		const gchar *value;
+
+		event.type = type;
+		event.cycles = g_ascii_strtoull (specs[i], &end, 10);
+		if (end == specs[i] || *end != ':')
+			goto error;
+
+		value = end + 1;
+
+		if (type == EVENT_INPUT_PORT) {
+			guint64 input_port = g_ascii_strtoull (value, &end, 16);
+
+			if (end == value || *end != '\0' || input_port > 0xff)
+				goto error;
+			event.value.input_port = input_port;
+		} else {
+			gdouble analogue_input = g_ascii_strtod (value, &end);
+
+			if (end == value || *end != '\0' || analogue_input < 0.0 || analogue_input > 5.0)
+				goto error;
+			event.value.analogue_input = analogue_input;
+		}
+
+		g_array_append_val (events, event);
+	}
+
+	return TRUE;
+
+error:
+	/* Translators: the parameter is an input event given on the command line, such as "1000:FF". */
+	g_printerr (_("Invalid input event \"%s\".\n"), specs[i]);
+	return FALSE;
+}
+
+static void
+apply_event (MCUSSimulation *simulation, const Event *event)
+{
+	if (event->type == EVENT_INPUT_PORT)
+		mcus_simulation_set_input_port (simulation, event->value.input_port);
+	else
+		mcus_simulation_set_analogue_input (simulation, event->value.analogue_input);
+}
+
+/* Returns the largest number of cycles a single instruction can take at the simulation's current clock speed, so that batches can be sized to
+ * never overshoot a cycle target by more than one instruction. */
+static guint64
+get_max_instruction_cycles (MCUSSimulation *simulation)
+{
+	guint64 max_cycles;
+	guint i;
+
+	/* wait1ms takes one millisecond, however long that is in cycles */
+	max_cycles = (mcus_simulation_get_clock_speed (simulation) + 999) / 1000;
+
+	for (i = 0; i <= OPCODE_SHR; i++)
+		max_cycles = MAX (max_cycles, mcus_instruction_data[i].cycles);
+
+	return MAX (max_cycles, 1);
+}
+
+/* Prints the simulation's state in a format which is easy to parse from scripts; for this reason, it isn't translated. */
+static void
+print_state (MCUSSimulation *simulation, const gchar *stop_reason)
+{
+	gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+	gdouble duty_cycles[8];
+	guchar *registers;
+	guint i, j, stack_depth;
+
+	g_print ("stop-reason: %s\n", stop_reason);
+	g_print ("iteration: %" G_GUINT64_FORMAT "\n", mcus_simulation_get_iteration (simulation));
+	g_print ("cycles: %" G_GUINT64_FORMAT "\n", mcus_simulation_get_cycles (simulation));
+	g_print ("program-counter: %02X\n", mcus_simulation_get_program_counter (simulation));
+	g_print ("zero-flag: %u\n", (mcus_simulation_get_zero_flag (simulation) == TRUE) ? 1 : 0);
+
+	registers = mcus_simulation_get_registers (simulation);
+	g_print ("registers:");
+	for (i = 0; i < REGISTER_COUNT; i++)
+		g_print (" %02X", registers[i]);
+	g_print ("\n");
+
+	g_print ("input-port: %02X\n", mcus_simulation_get_input_port (simulation));
+	g_print ("analogue-input: %s\n", g_ascii_formatd (buffer, sizeof (buffer), "%.3f", mcus_simulation_get_analogue_input (simulation)));
+	g_print ("output-port: %02X\n", mcus_simulation_get_output_port (simulation));
+
+	/* Output history, as the proportion of time each bit of the output port has been high, from bit 0 upwards */
+	mcus_simulation_get_output_bit_duty_cycles (simulation, duty_cycles);
+	g_print ("output-duty-cycles:");
+	for (i = 0; i < G_N_ELEMENTS (duty_cycles); i++)
+		g_print (" %s", g_ascii_formatd (buffer, sizeof (buffer), "%.3f", duty_cycles[i]));
+	g_print ("\n");
+
+	/* Stack frames, from the bottom of the stack upwards */
+	stack_depth = mcus_simulation_get_stack_depth (simulation);
+	g_print ("stack-depth: %u\n", stack_depth);
+	for (i = 0; i < stack_depth; i++) {
+		MCUSStackFrame *frame = mcus_simulation_get_stack_frame (simulation, i);
+
+		g_print ("stack-frame: %02X", frame->program_counter);
+		for (j = 0; j < REGISTER_COUNT; j++)
+			g_print (" %02X", frame->registers[j]);
+		g_print ("\n");
+	}
+}
+
+/* Assembles the program in @filename and loads it into @simulation, then starts the simulation and immediately pauses it, so that it's only
+ * ever advanced by explicit calls to mcus_simulation_run(). */
+static gboolean
+load_program (MCUSSimulation *simulation, const gchar *filename, GError **error)
+{
+	MCUSCompiler *compiler;
+	gchar *code;
+
+	if (g_file_get_contents (filename, &code, NULL, error) == FALSE)
+		return FALSE;
+
+	compiler = mcus_compiler_new ();
+
+	if (mcus_compiler_parse (compiler, code, error) == FALSE ||
+	    mcus_compiler_compile (compiler, simulation, NULL, NULL, NULL, NULL, error) == FALSE) {
+		g_object_unref (compiler);
+		g_free (code);
+		return FALSE;
+	}
+
+	g_object_unref (compiler);
+	g_free (code);
+
+	mcus_simulation_start (simulation);
+	mcus_simulation_pause (simulation);
+
+	return TRUE;
+}
+
+/* Checks that @simulation and @reference are in the same state, as far as the program can tell. */
+static gboolean
+states_match (MCUSSimulation *simulation, MCUSSimulation *reference)
+{
+	guint i, stack_depth;
+
+	stack_depth = mcus_simulation_get_stack_depth (simulation);
+
+	if (mcus_simulation_get_iteration (simulation) != mcus_simulation_get_iteration (reference) ||
+	    mcus_simulation_get_cycles (simulation) != mcus_simulation_get_cycles (reference) ||
+	    mcus_simulation_get_program_counter (simulation) != mcus_simulation_get_program_counter (reference) ||
+	    mcus_simulation_get_zero_flag (simulation) != mcus_simulation_get_zero_flag (reference) ||
+	    mcus_simulation_get_output_port (simulation) != mcus_simulation_get_output_port (reference) ||
+	    memcmp (mcus_simulation_get_registers (simulation), mcus_simulation_get_registers (reference), REGISTER_COUNT) != 0 ||
+	    stack_depth != mcus_simulation_get_stack_depth (reference))
+		return FALSE;
+
+	for (i = 0; i < stack_depth; i++) {
+		if (memcmp (mcus_simulation_get_stack_frame (simulation, i), mcus_simulation_get_stack_frame (reference, i),
+		            sizeof (MCUSStackFrame)) != 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Brings @reference up to date with a batch which has just been run on the simulation, as described by @summary, by calling
+ * mcus_simulation_iterate() once per instruction. Returns FALSE if the reference didn't stop in the same way as the batch. */
+static gboolean
+step_reference (MCUSSimulation *reference, const MCUSSimulationRunSummary *summary)
+{
+	GError *error = NULL;
+	gboolean stopped;
+	guint64 i;
+
+	for (i = 0; i < summary->instructions_retired; i++) {
+		if (mcus_simulation_iterate (reference, NULL) == FALSE)
+			return FALSE;
+	}
+
+	if (summary->stop_reason != MCUS_SIMULATION_STOP_REASON_HALT && summary->stop_reason != MCUS_SIMULATION_STOP_REASON_ERROR)
+		return TRUE;
+
+	/* The batch stopped on a HALT or an error, so the next iteration should too (and give an error only in the latter case) */
+	stopped = !mcus_simulation_iterate (reference, &error);
+	if (stopped == FALSE || (error != NULL) != (summary->stop_reason == MCUS_SIMULATION_STOP_REASON_ERROR)) {
+		g_clear_error (&error);
+		return FALSE;
+	}
+
+	g_clear_error (&error);
+
+	return TRUE;
+}
+
+/* Runs @simulation until it halts, an error occurs, or it's used up @max_cycles cycles or run @max_iterations instructions (if non-zero),
+ * applying @events at their scheduled cycles. If @reference is non-%NULL, it's run in lockstep with @simulation one mcus_simulation_iterate()
+ * at a time, and the run fails if the two ever disagree at the end of a batch. Once it's stopped, @simulation is seeked to each of the
+ * iterations in @seeks in turn. Returns the exit status for the process. */
+static int
+run_simulation (MCUSSimulation *simulation, MCUSSimulation *reference, guint64 max_cycles, guint64 max_iterations, GArray *events,
+                GArray *seeks, gboolean trace_outputs)
+{
+	MCUSSimulationRunSummary summary;
+	const gchar *stop_reason;
+	guint64 max_instruction_cycles, batch = 0, end_iteration;
+	gboolean succeeded;
+	guint next_event = 0, i;
+	guchar output_port;
+	GError *error = NULL;
+
+	max_instruction_cycles = get_max_instruction_cycles (simulation);
+	output_port = mcus_simulation_get_output_port (simulation);
+	end_iteration = mcus_simulation_get_iteration (simulation) + max_iterations;
+
+	while (TRUE) {
+		guint64 cycles, iteration, target, max_instructions;
+
+		/* Apply all the input events which have come due */
+		cycles = mcus_simulation_get_cycles (simulation);
+		for (; next_event < events->len && g_array_index (events, Event, next_event).cycles <= cycles; next_event++) {
+			apply_event (simulation, &g_array_index (events, Event, next_event));
+			if (reference != NULL)
+				apply_event (reference, &g_array_index (events, Event, next_event));
+		}
+
+		iteration = mcus_simulation_get_iteration (simulation);
+		if ((max_cycles != 0 && cycles >= max_cycles) || (max_iterations != 0 && iteration >= end_iteration)) {
+			stop_reason = "limit";
+			break;
+		}
+
+		/* Run until the next event or the end of the budget, whichever's sooner. Tracing needs to see each write to the output port, so
+		 * runs an instruction at a time. */
+		target = (max_cycles != 0) ? max_cycles : G_MAXUINT64;
+		if (next_event < events->len)
+			target = MIN (target, g_array_index (events, Event, next_event).cycles);
+
+		if (trace_outputs == TRUE)
+			max_instructions = 1;
+		else
+			max_instructions = MAX ((target - cycles) / max_instruction_cycles, 1);
+
+		if (max_iterations != 0)
+			max_instructions = MIN (max_instructions, end_iteration - iteration);
+
+		/* Vary the batch size when checking against the reference, so that the engine's exits are exercised at as many points in the
+		 * program as possible */
+		if (reference != NULL) {
+			max_instructions = MIN (max_instructions, batch % LOCKSTEP_MAX_BATCH + 1);
+			batch++;
+		}
+
+		succeeded = mcus_simulation_run (simulation, max_instructions, 0, &summary, &error);
+
+		if (reference != NULL && (step_reference (reference, &summary) == FALSE || states_match (simulation, reference) == FALSE)) {
+			/* Translators: the parameter is a number of instructions. */
+			g_printerr (_("The execution engine disagreed with the interpreter after %" G_GUINT64_FORMAT " instructions.\n"),
+			            mcus_simulation_get_iteration (reference));
+			g_clear_error (&error);
+
+			print_state (simulation, "diverged");
+			print_state (reference, "reference");
+			return 1;
+		}
+
+		if (succeeded == FALSE) {
+			/* Translators: the parameter is an error message. */
+			g_printerr (_("Error running program: %s\n"), error->message);
+			g_error_free (error);
+
+			print_state (simulation, "error");
+			return 1;
+		}
+
+		if (trace_outputs == TRUE && mcus_simulation_get_output_port (simulation) != output_port) {
+			output_port = mcus_simulation_get_output_port (simulation);
+			g_print ("output: %" G_GUINT64_FORMAT " %02X\n", mcus_simulation_get_cycles (simulation), output_port);
+		}
+
+		if (summary.stop_reason == MCUS_SIMULATION_STOP_REASON_HALT) {
+			stop_reason = "halt";
+			break;
+		}
+	}
+
+	for (i = 0; i < seeks->len; i++) {
+		guint64 iteration = g_array_index (seeks, guint64, i);
+
+		if (mcus_simulation_seek (simulation, iteration) == FALSE) {
+			/* Translators: the parameter is an iteration number given on the command line. */
+			g_printerr (_("Iteration %" G_GUINT64_FORMAT " isn't in the simulation's history.\n"), iteration);
+			print_state (simulation, stop_reason);
+			return 1;
+		}
+
+		stop_reason = "seek";
+	}
+
+	print_state (simulation, stop_reason);
+
+	return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *context;
+	MCUSSimulation *simulation;
+	GArray *events, *seeks;
+	GError *error = NULL;
+	MCUSSimulation *reference = NULL;
+	gboolean debug = FALSE, trace_outputs = FALSE, lockstep = FALSE;
+	gchar **filenames = NULL, **input_events = NULL, **analogue_input_events = NULL, **seek_iterations = NULL, *engine_nick = NULL;
+	gchar *restore_filename = NULL, *save_filename = NULL, *native_filename = NULL;
+	guint64 max_cycles = 0;
+	gint64 cycles_option = 0, iterations_option = 0, clock_speed_option = 0, history_size_option = 0;
+	guint i;
+	int status;
+
+	const GOptionEntry options[] = {
+		{ "debug", 0, 0, G_OPTION_ARG_NONE, &debug, N_("Enable debug mode"), NULL },
+		{ "cycles", 0, 0, G_OPTION_ARG_INT64, &cycles_option,
+		  N_("Stop after running for CYCLES clock cycles, rather than when the program halts"), N_("CYCLES") },
+		{ "iterations", 0, 0, G_OPTION_ARG_INT64, &iterations_option,
+		  N_("Stop after running ITERATIONS instructions, rather than when the program halts"), N_("ITERATIONS") },
+		{ "clock-speed", 0, 0, G_OPTION_ARG_INT64, &clock_speed_option, N_("Set the clock speed of the microcontroller"), N_("HZ") },
+		{ "engine", 0, 0, G_OPTION_ARG_STRING, &engine_nick, N_("Choose the execution engine to use"), N_("ENGINE") },
+		{ "native", 0, 0, G_OPTION_ARG_FILENAME, &native_filename,
+		  N_("Run the program using MODULE, compiled from the output of mcus --translate, with the native engine"), N_("MODULE") },
+		{ "input", 0, 0, G_OPTION_ARG_STRING_ARRAY, &input_events,
+		  N_("Set the input port to the hexadecimal VALUE once CYCLES clock cycles have elapsed; may be repeated"), N_("CYCLES:VALUE") },
+		{ "analogue-input", 0, 0, G_OPTION_ARG_STRING_ARRAY, &analogue_input_events,
+		  N_("Set the analogue input to VOLTS once CYCLES clock cycles have elapsed; may be repeated"), N_("CYCLES:VOLTS") },
+		{ "trace-outputs", 0, 0, G_OPTION_ARG_NONE, &trace_outputs, N_("Print each change to the output port as it happens"), NULL },
+		{ "lockstep", 0, 0, G_OPTION_ARG_NONE, &lockstep,
+		  N_("Check the execution engine against the interpreter as the program runs, and fail if they ever disagree"), NULL },
+		{ "restore", 0, 0, G_OPTION_ARG_FILENAME, &restore_filename,
+		  N_("Restore the simulation from the snapshot in SNAPSHOT instead of assembling a program"), N_("SNAPSHOT") },
+		{ "save", 0, 0, G_OPTION_ARG_FILENAME, &save_filename, N_("Save a snapshot of the simulation to SNAPSHOT when it stops"),
+		  N_("SNAPSHOT") },
+		{ "history-size", 0, 0, G_OPTION_ARG_INT64, &history_size_option,
+		  N_("Keep a journal of up to BYTES of the simulation's history, so that it can be seeked through with --seek"), N_("BYTES") },
+		{ "seek", 0, 0, G_OPTION_ARG_STRING_ARRAY, &seek_iterations,
+		  N_("Once the simulation stops, seek through its history to the start of ITERATION; may be repeated"), N_("ITERATION") },
+		{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL, N_("[FILE]") },
+		{ NULL }
+	};
+
+#ifdef ENABLE_NLS
+	bindtextdomain (GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR);
+	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+	textdomain (GETTEXT_PACKAGE);
+#endif
+
+	g_thread_init (NULL);
+	g_type_init ();
+	g_set_application_name (_("Microcontroller Simulator"));
+
+	/* Options */
+	context = g_option_context_new (_("- Run a program for the 2008 OCR A-level electronics microcontroller without an interface"));
+	g_option_context_set_translation_domain (context, GETTEXT_PACKAGE);
+	g_option_context_add_main_entries (context, options, GETTEXT_PACKAGE);
+
+	if (g_option_context_parse (context, &argc, &argv, &error) == FALSE) {
+		/* Translators: the parameter is an error message. */
+		g_printerr (_("Command-line options could not be parsed: %s\n"), error->message);
+		g_error_free (error);
+		exit (1);
+	}
+
+	g_option_context_free (context);
+
+	/* Debug log handling */
+	g_log_set_handler (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, (GLogFunc) debug_handler, GUINT_TO_POINTER (debug));
+
+	/* Check the options */
+	if ((filenames == NULL || filenames[0] == NULL) == (restore_filename == NULL)) {
+		g_printerr (_("Exactly one of a program to run or a snapshot to restore must be specified.\n"));
+		exit (1);
+	}
+
+	if (cycles_option < 0) {
+		g_printerr (_("The number of cycles to run for must not be negative.\n"));
+		exit (1);
+	}
+	max_cycles = cycles_option;
+
+	if (iterations_option < 0) {
+		g_printerr (_("The number of iterations to run for must not be negative.\n"));
+		exit (1);
+	}
+
+	if (history_size_option < 0 || history_size_option > G_MAXUINT) {
+		/* Translators: the parameter is the maximum history size, in bytes. */
+		g_printerr (_("The history size must be between 0 and %u bytes.\n"), G_MAXUINT);
+		exit (1);
+	}
+
+	if (seek_iterations != NULL && history_size_option == 0) {
+		g_printerr (_("Seeking needs a history, set with --history-size.\n"));
+		exit (1);
+	}
+
+	if (clock_speed_option != 0 && (clock_speed_option < 1 || clock_speed_option > MAX_CLOCK_SPEED)) {
+		/* Translators: the parameter is the maximum clock speed, in Hertz. */
+		g_printerr (_("The clock speed must be between 1 and %lu Hz.\n"), (gulong) MAX_CLOCK_SPEED);
+		exit (1);
+	}
+
+	simulation = mcus_simulation_new ();
+
+	if (engine_nick != NULL) {
+		GEnumClass *enum_class;
+		GEnumValue *value;
+
+		enum_class = g_type_class_ref (MCUS_TYPE_SIMULATION_ENGINE);
+		value = g_enum_get_value_by_nick (enum_class, engine_nick);
+
+		if (value == NULL) {
+			/* Translators: the parameter is the name of an execution engine given on the command line. */
+			g_printerr (_("Unknown execution engine \"%s\".\n"), engine_nick);
+			g_type_class_unref (enum_class);
+			g_object_unref (simulation);
+			exit (1);
+		}
+
+		mcus_simulation_set_engine (simulation, value->value);
+		g_type_class_unref (enum_class);
+	}
+
+	/* The native engine needs a translated module; rather than silently falling back to the interpreter without one, refuse to run */
+	if (native_filename != NULL && engine_nick == NULL) {
+		mcus_simulation_set_engine (simulation, MCUS_SIMULATION_ENGINE_NATIVE);
+	} else if ((native_filename != NULL) != (mcus_simulation_get_engine (simulation) == MCUS_SIMULATION_ENGINE_NATIVE)) {
+		g_printerr (_("The native execution engine must be used with a program loaded with --native, and vice versa.\n"));
+		g_object_unref (simulation);
+		exit (1);
+	}
+
+	/* Gather the input events in the order they're due */
+	events = g_array_new (FALSE, FALSE, sizeof (Event));
+
+	if (parse_events (events, input_events, EVENT_INPUT_PORT) == FALSE ||
+	    parse_events (events, analogue_input_events, EVENT_ANALOGUE_INPUT) == FALSE) {
+		g_array_free (events, TRUE);
+		g_object_unref (simulation);
+		exit (1);
+	}
+
+	g_array_sort (events, (GCompareFunc) event_compare);
+
+	/* Gather the iterations to seek to, in the order they were given */
+	seeks = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+	for (i = 0; seek_iterations != NULL && seek_iterations[i] != NULL; i++) {
+		guint64 iteration;
+		gchar *end;
+
+		iteration = g_ascii_strtoull (seek_iterations[i], &end, 10);
+		if (end == seek_iterations[i] || *end != '\0') {
+			/* Translators: the parameter is an iteration number given on the command line, such as "1000". */
+			g_printerr (_("Invalid iteration \"%s\".\n"), seek_iterations[i]);
+			g_array_free (seeks, TRUE);
+			g_array_free (events, TRUE);
+			g_object_unref (simulation);
+			exit (1);
+		}
+
+		g_array_append_val (seeks, iteration);
+	}
+
+	/* Nothing should run except when we ask it to */
+	mcus_simulation_set_threaded (simulation, FALSE);
+
+	if (history_size_option != 0)
+		mcus_simulation_set_history_size (simulation, history_size_option);
+
+	if (restore_filename != NULL) {
+		/* Restoring leaves the simulation paused */
+		if (mcus_simulation_load_snapshot (simulation, restore_filename, &error) == FALSE) {
+			/* Translators: the first parameter is a filename, and the second is an error message. */
+			g_printerr (_("Error restoring snapshot \"%s\": %s\n"), restore_filename, error->message);
+			goto error;
+		}
+	} else if (load_program (simulation, filenames[0], &error) == FALSE) {
+		/* Translators: the first parameter is a filename, and the second is an error message. */
+		g_printerr (_("Error loading \"%s\": %s\n"), filenames[0], error->message);
+		goto error;
+	}
+
+	/* Snapshots carry their clock speed, so only override it once the simulation's been restored */
+	if (clock_speed_option != 0)
+		mcus_simulation_set_clock_speed (simulation, clock_speed_option);
+
+	if (native_filename != NULL &&
+	    (mcus_simulation_load_native (simulation, native_filename, &error) == FALSE ||
+	     mcus_simulation_check_native (simulation, &error) == FALSE)) {
+		/* Translators: the first parameter is a filename, and the second is an error message. */
+		g_printerr (_("Error loading translated program \"%s\": %s\n"), native_filename, error->message);
+		goto error;
+	}
+
+	/* The reference for --lockstep starts from a copy of the simulation's state, and is only ever stepped by the interpreter */
+	if (lockstep == TRUE) {
+		guchar *snapshot;
+		gsize length;
+
+		reference = mcus_simulation_new ();
+		mcus_simulation_set_threaded (reference, FALSE);
+
+		snapshot = mcus_simulation_snapshot (simulation, &length);
+		if (mcus_simulation_restore (reference, snapshot, length, &error) == FALSE) {
+			/* Translators: the parameter is an error message. */
+			g_printerr (_("Error copying the simulation for --lockstep: %s\n"), error->message);
+			g_free (snapshot);
+			g_object_unref (reference);
+			goto error;
+		}
+
+		g_free (snapshot);
+	}
+
+	status = run_simulation (simulation, reference, max_cycles, iterations_option, events, seeks, trace_outputs);
+
+	if (reference != NULL)
+		g_object_unref (reference);
+
+	if (save_filename != NULL && mcus_simulation_save_snapshot (simulation, save_filename, &error) == FALSE) {
+		/* Translators: the first parameter is a filename, and the second is an error message. */
+		g_printerr (_("Error saving snapshot \"%s\": %s\n"), save_filename, error->message);
+		g_error_free (error);
+		status = 1;
+	}
+
+	g_array_free (seeks, TRUE);
+	g_array_free (events, TRUE);
+	g_object_unref (simulation);
+
+	return status;
+
+error:
+	g_error_free (error);
+	g_array_free (seeks, TRUE);
+	g_array_free (events, TRUE);
+	g_object_unref (simulation);
+
+	return 1;
+}
@@ -0,0 +1,446 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A just-in-time translator from the decoded memory image to native x86-64 code.
+ *
+ * Every address in memory is translated, so that jumps into the middle of an instruction behave as they do in the interpreter. The simple
+ * instructions (moves, arithmetic and jumps) are translated to native code which keeps the simulated registers S0--S7 in the host registers
+ * r8--r15 and the zero flag in dl. Everything else (I/O, the built-in subroutines, the stack instructions, HALT and invalid opcodes), and any
+ * instruction which execution may stop at (such as one with a breakpoint on it), is translated to an exit back to the interpreter, which
+ * executes that instruction and re-enters the translated code afterwards. The translated code also exits when its instruction budget (held in
+ * rsi) runs out.
+ *
+ * The translated code is entered through a small trampoline which loads the simulated state from a context structure, and left through a
+ * common exit sequence which stores it back again. Memory is never modified while the simulation is running, so the translation is only
+ * redone when the memory, breakpoints or run target change.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "simulation-private.h"
+#include "simulation-jit.h"
+
+#if defined (__x86_64__) && !defined (G_OS_WIN32)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#endif
+
+#ifdef JIT_SUPPORTED
+
+/* Enough for the longest translation of every address, plus the exit stubs and trampolines */
+#define CODE_SIZE 65536
+
+/* The layout of this is relied upon by the trampoline and exit code */
+typedef struct {
+	guchar registers[REGISTER_COUNT]; /* offset 0 */
+	guchar zero_flag; /* offset 8 */
+	guchar program_counter; /* offset 9 */
+	guint64 budget; /* offset 16 */
+} JitContext;
+
+#define CONTEXT_ZERO_FLAG_OFFSET 8
+#define CONTEXT_PROGRAM_COUNTER_OFFSET 9
+#define CONTEXT_BUDGET_OFFSET 16
+
+typedef void (*JitEntryFunc) (JitContext *context, guint64 budget, gconstpointer entry);
+
+/* A rel32 jump which needs patching once all the addresses have been translated */
+typedef struct {
+	guint code_offset; /* of the rel32 operand */
+	guchar target_address;
+} JitFixup;
+
+struct _MCUSJit {
+	guchar *code;
+	guint code_length;
+	guint entry_offsets[MEMORY_SIZE]; /* offset of the translation of each address */
+	guint32 translated[MEMORY_SIZE / 32]; /* bitmap of addresses which translate to native code, rather than an exit */
+	JitEntryFunc trampoline;
+	JitFixup fixups[MEMORY_SIZE * 2];
+	guint n_fixups;
+};
+
+MCUSJit *
+mcus_jit_new (void)
+{
+	MCUSJit *self;
+	gpointer code;
+
+	code = mmap (NULL, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+		return NULL;
+
+	self = g_slice_new0 (MCUSJit);
+	self->code = code;
+
+	return self;
+}
+
+void
+mcus_jit_free (MCUSJit *self)
+{
+	if (self == NULL)
+		return;
+
+	munmap (self->code, CODE_SIZE);
+	g_slice_free (MCUSJit, self);
+}
+
+static inline void
+emit (MCUSJit *self, guint length, const guchar *bytes)
+{
+	g_assert (self->code_length + length <= CODE_SIZE);
+	memcpy (self->code + self->code_length, bytes, length);
+	self->code_length += length;
+}
+
+#define EMIT(...) G_STMT_START { \
+	const guchar __bytes[] = { __VA_ARGS__ }; \
+	emit (self, sizeof (__bytes), __bytes); \
+} G_STMT_END
+
+/* Emit the opcode bytes of a jump with a rel32 operand to the translation of @target_address, and record it for fixing up later */
+static void
+emit_jump (MCUSJit *self, guint opcode_length, const guchar *opcode, guchar target_address)
+{
+	const guchar placeholder[4] = { 0, 0, 0, 0 };
+
+	emit (self, opcode_length, opcode);
+
+	g_assert (self->n_fixups < G_N_ELEMENTS (self->fixups));
+	self->fixups[self->n_fixups].code_offset = self->code_length;
+	self->fixups[self->n_fixups].target_address = target_address;
+	self->n_fixups++;
+
+	emit (self, 4, placeholder);
+}
+
+static void
+emit_jmp (MCUSJit *self, guchar target_address)
+{
+	const guchar opcode[] = { 0xe9 }; /* jmp rel32 */
+	emit_jump (self, sizeof (opcode), opcode, target_address);
+}
+
+static void
+emit_jz (MCUSJit *self, guchar target_address)
+{
+	const guchar opcode[] = { 0x0f, 0x84 }; /* jz rel32 */
+	emit_jump (self, sizeof (opcode), opcode, target_address);
+}
+
+static void
+emit_jnz (MCUSJit *self, guchar target_address)
+{
+	const guchar opcode[] = { 0x0f, 0x85 }; /* jnz rel32 */
+	emit_jump (self, sizeof (opcode), opcode, target_address);
+}
+
+static void
+emit_rel32_to (MCUSJit *self, guint opcode_length, const guchar *opcode, guint target_offset)
+{
+	gint32 rel;
+
+	emit (self, opcode_length, opcode);
+	rel = (gint32) target_offset - (gint32) (self->code_length + 4);
+	emit (self, 4, (const guchar*) &rel);
+}
+
+/* Emit a byte-sized register-to-register ALU operation: op Sd, Ss (where r/m is Sd and reg is Ss) */
+static void
+emit_alu (MCUSJit *self, guchar opcode, guchar destination, guchar source)
+{
+	EMIT (0x45, opcode, 0xc0 | (source << 3) | destination);
+}
+
+static gboolean
+operation_is_translatable (guchar operation)
+{
+	switch (operation) {
+	case DECODED_MOVI:
+	case DECODED_MOV:
+	case DECODED_ADD:
+	case DECODED_SUB:
+	case DECODED_AND:
+	case DECODED_EOR:
+	case DECODED_INC:
+	case DECODED_DEC:
+	case DECODED_JP:
+	case DECODED_JZ:
+	case DECODED_JNZ:
+	case DECODED_SHL:
+	case DECODED_SHR:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* Translate the instruction at @address. @exit_offset is the offset of the common exit sequence. */
+static void
+translate_instruction (MCUSJit *self, const DecodedInstruction *instruction, guchar address, guint exit_offset)
+{
+	const guchar jz_opcode[] = { 0x0f, 0x84 };
+	gboolean sets_zero_flag = TRUE;
+	guint budget_exit_offset;
+
+	self->entry_offsets[address] = self->code_length;
+
+	if (!BITMAP_IS_SET (self->translated, address)) {
+		/* Exit to the interpreter: mov byte [rdi + 9], address; jmp exit */
+		const guchar jmp_opcode[] = { 0xe9 };
+
+		EMIT (0xc6, 0x47, CONTEXT_PROGRAM_COUNTER_OFFSET, address);
+		emit_rel32_to (self, sizeof (jmp_opcode), jmp_opcode, exit_offset);
+		return;
+	}
+
+	/* Check and decrement the budget: test rsi, rsi; jz budget_exit; dec rsi. The budget exit stub for this address is placed after the
+	 * instruction's translation, so jump forward to it and fix it up once it's been emitted. */
+	EMIT (0x48, 0x85, 0xf6);
+	emit (self, sizeof (jz_opcode), jz_opcode);
+	budget_exit_offset = self->code_length;
+	EMIT (0x00, 0x00, 0x00, 0x00);
+	EMIT (0x48, 0xff, 0xce);
+
+	switch (instruction->operation) {
+	case DECODED_MOVI:
+		/* mov Sd, imm8 */
+		EMIT (0x41, 0xb0 | instruction->operand1, instruction->operand2);
+		sets_zero_flag = FALSE;
+		break;
+	case DECODED_MOV:
+		/* mov Sd, Ss */
+		if (instruction->operand1 != instruction->operand2)
+			emit_alu (self, 0x88, instruction->operand1, instruction->operand2);
+		sets_zero_flag = FALSE;
+		break;
+	case DECODED_ADD:
+		emit_alu (self, 0x00, instruction->operand1, instruction->operand2);
+		break;
+	case DECODED_SUB:
+		emit_alu (self, 0x28, instruction->operand1, instruction->operand2);
+		break;
+	case DECODED_AND:
+		emit_alu (self, 0x20, instruction->operand1, instruction->operand2);
+		break;
+	case DECODED_EOR:
+		emit_alu (self, 0x30, instruction->operand1, instruction->operand2);
+		break;
+	case DECODED_INC:
+		/* inc Sd */
+		EMIT (0x41, 0xfe, 0xc0 | instruction->operand1);
+		break;
+	case DECODED_DEC:
+		/* dec Sd */
+		EMIT (0x41, 0xfe, 0xc8 | instruction->operand1);
+		break;
+	case DECODED_SHL:
+		/* shl Sd, 1 */
+		EMIT (0x41, 0xd0, 0xe0 | instruction->operand1);
+		break;
+	case DECODED_SHR:
+		/* shr Sd, 1 */
+		EMIT (0x41, 0xd0, 0xe8 | instruction->operand1);
+		break;
+	case DECODED_JP:
+		emit_jmp (self, instruction->operand1);
+		goto budget_exit;
+	case DECODED_JZ:
+		/* test dl, dl; jnz target */
+		EMIT (0x84, 0xd2);
+		emit_jnz (self, instruction->operand1);
+		sets_zero_flag = FALSE;
+		break;
+	case DECODED_JNZ:
+		/* test dl, dl; jz target */
+		EMIT (0x84, 0xd2);
+		emit_jz (self, instruction->operand1);
+		sets_zero_flag = FALSE;
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	/* setz dl */
+	if (sets_zero_flag == TRUE)
+		EMIT (0x0f, 0x94, 0xc2);
+
+	/* Continue with the next instruction */
+	emit_jmp (self, instruction->next_program_counter);
+
+budget_exit:
+	/* Budget exit stub: mov byte [rdi + 9], address; jmp exit */
+	{
+		gint32 rel = (gint32) self->code_length - (gint32) (budget_exit_offset + 4);
+		const guchar jmp_opcode[] = { 0xe9 };
+
+		memcpy (self->code + budget_exit_offset, &rel, 4);
+		EMIT (0xc6, 0x47, CONTEXT_PROGRAM_COUNTER_OFFSET, address);
+		emit_rel32_to (self, sizeof (jmp_opcode), jmp_opcode, exit_offset);
+	}
+}
+
+/**
+ * mcus_jit_translate:
+ * @self: an #MCUSJit
+ * @decoded: the decoded memory image, with %MEMORY_SIZE entries
+ * @stops: bitmap of the addresses the simulation may stop at, such as those with breakpoints
+ *
+ * Translates the whole of the decoded memory image to native code, replacing any previous translation. Instructions at addresses in @stops
+ * are translated to exits, so that the interpreter can stop on them.
+ **/
+void
+mcus_jit_translate (MCUSJit *self, const DecodedInstruction *decoded, const guint32 *stops)
+{
+	guint address, exit_offset, i;
+
+	mprotect (self->code, CODE_SIZE, PROT_READ | PROT_WRITE);
+
+	self->code_length = 0;
+	self->n_fixups = 0;
+
+	/* Work out which addresses are translated to native code. The translated code only counts instructions, so instructions taking more than
+	 * one cycle are left to the interpreter. */
+	memset (self->translated, 0, sizeof (self->translated));
+	for (address = 0; address < MEMORY_SIZE; address++) {
+		if (operation_is_translatable (decoded[address].operation) && decoded[address].cycles == 1 && !BITMAP_IS_SET (stops, address))
+			self->translated[address / 32] |= (1U << (address % 32));
+	}
+
+	/* Trampoline: save the callee-saved registers we use, load the simulated state from the context in rdi, and jump to the entry point in
+	 * rdx. The budget is already in rsi. */
+	self->trampoline = (JitEntryFunc) self->code;
+	EMIT (0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57); /* push r12--r15 */
+	EMIT (0x48, 0x89, 0xd0); /* mov rax, rdx */
+	for (i = 0; i < REGISTER_COUNT; i++)
+		EMIT (0x44, 0x0f, 0xb6, 0x47 | (i << 3), i); /* movzx r(8+i)d, byte [rdi + i] */
+	EMIT (0x0f, 0xb6, 0x57, CONTEXT_ZERO_FLAG_OFFSET); /* movzx edx, byte [rdi + 8] */
+	EMIT (0xff, 0xe0); /* jmp rax */
+
+	/* Common exit: store the simulated state back into the context (the program counter has already been stored by the exit stub) and
+	 * return */
+	exit_offset = self->code_length;
+	for (i = 0; i < REGISTER_COUNT; i++)
+		EMIT (0x44, 0x88, 0x47 | (i << 3), i); /* mov byte [rdi + i], r(8+i)b */
+	EMIT (0x88, 0x57, CONTEXT_ZERO_FLAG_OFFSET); /* mov byte [rdi + 8], dl */
+	EMIT (0x48, 0x89, 0x77, CONTEXT_BUDGET_OFFSET); /* mov [rdi + 16], rsi */
+	EMIT (0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c); /* pop r15--r12 */
+	EMIT (0xc3); /* ret */
+
+	/* Translate each instruction */
+	for (address = 0; address < MEMORY_SIZE; address++)
+		translate_instruction (self, &(decoded[address]), address, exit_offset);
+
+	/* Fix up the jumps between instructions */
+	for (i = 0; i < self->n_fixups; i++) {
+		const JitFixup *fixup = &(self->fixups[i]);
+		gint32 rel = (gint32) self->entry_offsets[fixup->target_address] - (gint32) (fixup->code_offset + 4);
+		memcpy (self->code + fixup->code_offset, &rel, 4);
+	}
+
+	mprotect (self->code, CODE_SIZE, PROT_READ | PROT_EXEC);
+}
+
+/**
+ * mcus_jit_is_translated:
+ * @self: an #MCUSJit
+ * @address: a memory address
+ *
+ * Returns whether the instruction at @address was translated to native code. If it wasn't, entering the translated code at @address would
+ * immediately exit, so the instruction should be executed by the interpreter instead.
+ *
+ * Return value: %TRUE if the instruction at @address can be executed by mcus_jit_execute()
+ **/
+gboolean
+mcus_jit_is_translated (MCUSJit *self, guchar address)
+{
+	return BITMAP_IS_SET (self->translated, address);
+}
+
+/**
+ * mcus_jit_execute:
+ * @self: an #MCUSJit
+ * @program_counter: the simulated program counter, updated on return
+ * @registers: the simulated registers, updated on return
+ * @zero_flag: the simulated zero flag, updated on return
+ * @max_instructions: the maximum number of instructions to execute
+ *
+ * Executes translated code from @program_counter until an instruction which needs the interpreter is reached, or @max_instructions have
+ * been executed. On return, @program_counter is the address of the next instruction to execute.
+ *
+ * Return value: the number of instructions executed
+ **/
+guint64
+mcus_jit_execute (MCUSJit *self, guchar *program_counter, guchar *registers, gboolean *zero_flag, guint64 max_instructions)
+{
+	JitContext context;
+
+	memcpy (context.registers, registers, sizeof (guchar) * REGISTER_COUNT);
+	context.zero_flag = (*zero_flag == TRUE) ? 1 : 0;
+	context.program_counter = *program_counter;
+	context.budget = max_instructions;
+
+	self->trampoline (&context, max_instructions, self->code + self->entry_offsets[*program_counter]);
+
+	memcpy (registers, context.registers, sizeof (guchar) * REGISTER_COUNT);
+	*zero_flag = (context.zero_flag != 0) ? TRUE : FALSE;
+	*program_counter = context.program_counter;
+
+	return max_instructions - context.budget;
+}
+
+#else /* !JIT_SUPPORTED */
+
+/* The JIT isn't supported on this platform, so mcus_jit_new() always fails and the interpreter is always used */
+
+MCUSJit *
+mcus_jit_new (void)
+{
+	return NULL;
+}
+
+void
+mcus_jit_free (MCUSJit *self)
+{
+	/* Nothing to do */
+}
+
+void
+mcus_jit_translate (MCUSJit *self, const DecodedInstruction *decoded, const guint32 *stops)
+{
+	g_assert_not_reached ();
+}
+
+gboolean
+mcus_jit_is_translated (MCUSJit *self, guchar address)
+{
+	return FALSE;
+}
+
+guint64
+mcus_jit_execute (MCUSJit *self, guchar *program_counter, guchar *registers, gboolean *zero_flag, guint64 max_instructions)
+{
+	g_assert_not_reached ();
+	return 0;
+}
+
+#endif /* !JIT_SUPPORTED */
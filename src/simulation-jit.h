@@ -0,0 +1,40 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MCUS_SIMULATION_JIT_H
+#define MCUS_SIMULATION_JIT_H
+
+#include <glib.h>
+
+#include "simulation-private.h"
+
+G_BEGIN_DECLS
+
+typedef struct _MCUSJit MCUSJit;
+
+MCUSJit *mcus_jit_new (void) G_GNUC_WARN_UNUSED_RESULT;
+void mcus_jit_free (MCUSJit *self);
+
+void mcus_jit_translate (MCUSJit *self, const DecodedInstruction *decoded, const guint32 *stops);
+gboolean mcus_jit_is_translated (MCUSJit *self, guchar address);
+guint64 mcus_jit_execute (MCUSJit *self, guchar *program_counter, guchar *registers, gboolean *zero_flag, guint64 max_instructions);
+
+G_END_DECLS
+
+#endif /* !MCUS_SIMULATION_JIT_H */
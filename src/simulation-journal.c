@@ -0,0 +1,538 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A bounded journal of the changes made by each instruction executed, so that execution can be reversed, and the simulation seeked to any
+ * iteration which is still in the journal.
+ *
+ * The journal is a ring buffer of variable-length records. Each instruction is recorded as the XOR of the old and new values of the program
+ * counter, and of the zero flag, output port and each register it changed; so the same record can be applied to undo the instruction or to
+ * redo it. Stack pushes and pops also record the frame pushed or popped, and instructions which took longer than their decoded cycles (such as
+ * wait1ms) record the difference. Every record ends with its length, so the journal can be walked backwards as well as forwards.
+ *
+ * Every KEYFRAME_INTERVAL iterations, a keyframe record holding the whole state is added, so that a seek never has to walk further than from
+ * the nearest keyframe (or the current state). Keyframes are kept in the ring with everything else, so the size of the ring bounds the memory
+ * used by the journal; once it's full, the oldest records are dropped to make room for new ones.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "simulation-private.h"
+#include "simulation-journal.h"
+
+/* The number of iterations between keyframes */
+#define KEYFRAME_INTERVAL 1024
+/* Journals are never smaller than this, so that they can always hold plenty of records as well as a keyframe with a full stack */
+#define MIN_JOURNAL_SIZE 65536
+
+/* Flags in the first byte of each record */
+enum {
+	RECORD_ZERO_FLAG = 1 << 0, /* the zero flag was toggled */
+	RECORD_OUTPUT_PORT = 1 << 1, /* the output port changed */
+	RECORD_PUSH = 1 << 2, /* a frame was pushed onto the stack */
+	RECORD_POP = 1 << 3, /* a frame was popped off the stack */
+	RECORD_EXTRA_CYCLES = 1 << 4, /* the instruction took more cycles than its decoded cycles */
+	RECORD_KEYFRAME = 1 << 7 /* the record's a keyframe, rather than an instruction */
+};
+
+/* Instruction records are laid out as: flags, mask of the registers changed, program counter XOR, [output port XOR], [register XORs, in
+ * order], [frame pushed or popped], [extra cycles, as a guint32], length.
+ *
+ * Keyframe records are laid out as: flags, program counter, zero flag, output port, registers, iteration (as a guint64), cycles (as a
+ * guint64), stack depth (as a guint16), the frames on the stack (from the bottom), length.
+ *
+ * Frames are laid out as the program counter followed by the registers. Multi-byte values are little-endian, and the length (of the whole
+ * record, including the length itself) is a guint16. */
+#define INSTRUCTION_HEADER_LENGTH 3
+#define KEYFRAME_HEADER_LENGTH (4 + REGISTER_COUNT + 8 + 8 + 2)
+#define FRAME_LENGTH (1 + REGISTER_COUNT)
+#define FOOTER_LENGTH 2
+#define MAX_INSTRUCTION_LENGTH (INSTRUCTION_HEADER_LENGTH + 1 + REGISTER_COUNT + FRAME_LENGTH + 4 + FOOTER_LENGTH)
+#define MAX_KEYFRAME_LENGTH (KEYFRAME_HEADER_LENGTH + STACK_SIZE * FRAME_LENGTH + FOOTER_LENGTH)
+
+typedef struct {
+	guint64 position;
+	guint64 iteration;
+} Keyframe;
+
+struct _MCUSJournal {
+	guchar *data;
+	gsize size;
+
+	/* Absolute positions (in bytes) of the oldest record, of the end of the newest record, and of the record boundary which the simulation's
+	 * state corresponds to. They increase indefinitely, and are reduced modulo the size to index the data. */
+	guint64 start, end, position;
+
+	/* The iterations at those positions */
+	guint64 start_iteration, end_iteration, position_iteration;
+
+	/* The keyframes in the journal, oldest first */
+	GArray *keyframes;
+
+	/* Somewhere to build and read keyframes */
+	guchar keyframe_buffer[MAX_KEYFRAME_LENGTH];
+};
+
+MCUSJournal *
+mcus_journal_new (gsize size)
+{
+	MCUSJournal *self = g_slice_new0 (MCUSJournal);
+
+	self->size = MAX (size, MIN_JOURNAL_SIZE);
+	self->data = g_malloc (self->size);
+	self->keyframes = g_array_new (FALSE, FALSE, sizeof (Keyframe));
+
+	return self;
+}
+
+void
+mcus_journal_free (MCUSJournal *self)
+{
+	if (self == NULL)
+		return;
+
+	g_array_free (self->keyframes, TRUE);
+	g_free (self->data);
+	g_slice_free (MCUSJournal, self);
+}
+
+gsize
+mcus_journal_get_size (MCUSJournal *self)
+{
+	return self->size;
+}
+
+/* Forget everything in the journal */
+void
+mcus_journal_clear (MCUSJournal *self)
+{
+	self->start = self->end = self->position = 0;
+	self->start_iteration = self->end_iteration = self->position_iteration = 0;
+	g_array_set_size (self->keyframes, 0);
+}
+
+static inline guchar
+read_byte (MCUSJournal *self, guint64 position)
+{
+	return self->data[position % self->size];
+}
+
+static void
+read_bytes (MCUSJournal *self, guint64 position, guchar *buffer, guint length)
+{
+	gsize offset = position % self->size;
+
+	if (offset + length <= self->size) {
+		memcpy (buffer, self->data + offset, length);
+	} else {
+		memcpy (buffer, self->data + offset, self->size - offset);
+		memcpy (buffer + (self->size - offset), self->data, length - (self->size - offset));
+	}
+}
+
+static inline guint64
+read_uint (const guchar *buffer, guint length)
+{
+	guint64 value = 0;
+
+	while (length-- > 0)
+		value = (value << 8) | buffer[length];
+
+	return value;
+}
+
+static inline void
+write_uint (guchar *buffer, guint64 value, guint length)
+{
+	guint i;
+
+	for (i = 0; i < length; i++, value >>= 8)
+		buffer[i] = value & 0xff;
+}
+
+/* Returns the length of the record starting at @position */
+static guint
+get_record_length (MCUSJournal *self, guint64 position)
+{
+	guchar flags = read_byte (self, position), mask;
+	guint length, i;
+
+	if (flags & RECORD_KEYFRAME) {
+		guint stack_depth = read_byte (self, position + KEYFRAME_HEADER_LENGTH - 2) |
+		                    (read_byte (self, position + KEYFRAME_HEADER_LENGTH - 1) << 8);
+		return KEYFRAME_HEADER_LENGTH + stack_depth * FRAME_LENGTH + FOOTER_LENGTH;
+	}
+
+	length = INSTRUCTION_HEADER_LENGTH + FOOTER_LENGTH;
+	mask = read_byte (self, position + 1);
+
+	for (i = 0; i < REGISTER_COUNT; i++) {
+		if (mask & (1 << i))
+			length++;
+	}
+
+	if (flags & RECORD_OUTPUT_PORT)
+		length++;
+	if (flags & (RECORD_PUSH | RECORD_POP))
+		length += FRAME_LENGTH;
+	if (flags & RECORD_EXTRA_CYCLES)
+		length += 4;
+
+	return length;
+}
+
+/* Returns the length of the record ending at @position */
+static inline guint
+get_previous_record_length (MCUSJournal *self, guint64 position)
+{
+	return read_byte (self, position - 2) | (read_byte (self, position - 1) << 8);
+}
+
+static void
+drop_oldest_record (MCUSJournal *self)
+{
+	if (read_byte (self, self->start) & RECORD_KEYFRAME) {
+		g_assert (self->keyframes->len > 0 && g_array_index (self->keyframes, Keyframe, 0).position == self->start);
+		g_array_remove_index (self->keyframes, 0);
+	} else {
+		self->start_iteration++;
+	}
+
+	self->start += get_record_length (self, self->start);
+}
+
+/* Append @record to the journal, dropping the oldest records if there isn't room for it. @record must already end with its length. */
+static void
+append_record (MCUSJournal *self, const guchar *record, guint length)
+{
+	gsize offset;
+
+	while (self->end + length - self->start > self->size)
+		drop_oldest_record (self);
+
+	offset = self->end % self->size;
+
+	if (offset + length <= self->size) {
+		memcpy (self->data + offset, record, length);
+	} else {
+		memcpy (self->data + offset, record, self->size - offset);
+		memcpy (self->data, record + (self->size - offset), length - (self->size - offset));
+	}
+
+	self->end += length;
+}
+
+static void
+append_keyframe (MCUSJournal *self, const MCUSJournalState *state)
+{
+	guchar *record = self->keyframe_buffer;
+	Keyframe keyframe;
+	guint length, i;
+
+	record[0] = RECORD_KEYFRAME;
+	record[1] = state->program_counter;
+	record[2] = (state->zero_flag == TRUE) ? 1 : 0;
+	record[3] = state->output_port;
+	memcpy (record + 4, state->registers, REGISTER_COUNT);
+	write_uint (record + 4 + REGISTER_COUNT, state->iteration, 8);
+	write_uint (record + 4 + REGISTER_COUNT + 8, state->cycles, 8);
+	write_uint (record + 4 + REGISTER_COUNT + 16, state->stack_depth, 2);
+
+	length = KEYFRAME_HEADER_LENGTH;
+	for (i = 0; i < state->stack_depth; i++) {
+		record[length] = state->stack[i].program_counter;
+		memcpy (record + length + 1, state->stack[i].registers, REGISTER_COUNT);
+		length += FRAME_LENGTH;
+	}
+
+	length += FOOTER_LENGTH;
+	write_uint (record + length - FOOTER_LENGTH, length, FOOTER_LENGTH);
+
+	append_record (self, record, length);
+
+	keyframe.position = self->end - length;
+	keyframe.iteration = state->iteration;
+	g_array_append_val (self->keyframes, keyframe);
+}
+
+/* Restore @state from the keyframe at @keyframe, and move the journal's position to it */
+static void
+restore_keyframe (MCUSJournal *self, const Keyframe *keyframe, MCUSJournalState *state)
+{
+	guchar *record = self->keyframe_buffer;
+	guint length, i;
+
+	length = get_record_length (self, keyframe->position);
+	read_bytes (self, keyframe->position, record, length);
+
+	state->program_counter = record[1];
+	state->zero_flag = (record[2] != 0) ? TRUE : FALSE;
+	state->output_port = record[3];
+	memcpy (state->registers, record + 4, REGISTER_COUNT);
+	state->iteration = read_uint (record + 4 + REGISTER_COUNT, 8);
+	state->cycles = read_uint (record + 4 + REGISTER_COUNT + 8, 8);
+	state->stack_depth = read_uint (record + 4 + REGISTER_COUNT + 16, 2);
+
+	for (i = 0; i < state->stack_depth; i++) {
+		state->stack[i].program_counter = record[KEYFRAME_HEADER_LENGTH + i * FRAME_LENGTH];
+		memcpy (state->stack[i].registers, record + KEYFRAME_HEADER_LENGTH + i * FRAME_LENGTH + 1, REGISTER_COUNT);
+	}
+
+	self->position = keyframe->position;
+	self->position_iteration = keyframe->iteration;
+}
+
+/* Apply the instruction record at @position to @state, redoing the instruction if @forwards is %TRUE, or undoing it otherwise */
+static void
+apply_record (MCUSJournal *self, guint64 position, guint length, MCUSJournalState *state, const DecodedInstruction *decoded, gboolean forwards)
+{
+	guchar record[MAX_INSTRUCTION_LENGTH], flags;
+	guint i, j = INSTRUCTION_HEADER_LENGTH;
+	guint64 cycles;
+	const guchar *frame = NULL;
+
+	read_bytes (self, position, record, length);
+	flags = record[0];
+
+	/* The instruction's decoded cycles are those of the instruction at the old program counter */
+	if (forwards == FALSE)
+		state->program_counter ^= record[2];
+	cycles = decoded[state->program_counter].cycles;
+	if (forwards == TRUE)
+		state->program_counter ^= record[2];
+
+	if (flags & RECORD_ZERO_FLAG)
+		state->zero_flag = (state->zero_flag == TRUE) ? FALSE : TRUE;
+	if (flags & RECORD_OUTPUT_PORT)
+		state->output_port ^= record[j++];
+
+	for (i = 0; i < REGISTER_COUNT; i++) {
+		if (record[1] & (1 << i))
+			state->registers[i] ^= record[j++];
+	}
+
+	if (flags & (RECORD_PUSH | RECORD_POP)) {
+		frame = record + j;
+		j += FRAME_LENGTH;
+	}
+
+	if (flags & RECORD_EXTRA_CYCLES)
+		cycles += read_uint (record + j, 4);
+
+	/* Redoing a push or undoing a pop puts the frame back on the stack; anything else involving the stack takes it off again */
+	if (frame != NULL && ((flags & RECORD_PUSH) ? TRUE : FALSE) == forwards) {
+		MCUSStackFrame *stack_frame = &(state->stack[state->stack_depth++]);
+
+		stack_frame->program_counter = frame[0];
+		memcpy (stack_frame->registers, frame + 1, REGISTER_COUNT);
+	} else if (frame != NULL) {
+		state->stack_depth--;
+	}
+
+	if (forwards == TRUE) {
+		state->iteration++;
+		state->cycles += cycles;
+	} else {
+		state->iteration--;
+		state->cycles -= cycles;
+	}
+}
+
+/* Forget everything after the current position, as it's about to be rewritten */
+static void
+discard_future (MCUSJournal *self)
+{
+	guint len = self->keyframes->len;
+
+	self->end = self->position;
+	self->end_iteration = self->position_iteration;
+
+	while (len > 0 && g_array_index (self->keyframes, Keyframe, len - 1).position >= self->end)
+		len--;
+	g_array_set_size (self->keyframes, len);
+}
+
+/* Record the execution of a single instruction, which changed the state from @before to @after. @decoded must be the decoded memory the
+ * instruction was executed from, and must not change while the journal's in use, other than after mcus_journal_clear(). If the journal's been
+ * seeked back, everything after the current position is forgotten first. */
+void
+mcus_journal_record (MCUSJournal *self, const MCUSJournalState *before, const MCUSJournalState *after, const DecodedInstruction *decoded)
+{
+	guchar record[MAX_INSTRUCTION_LENGTH], flags = 0, mask = 0;
+	guint length = INSTRUCTION_HEADER_LENGTH, i;
+	const MCUSStackFrame *frame = NULL;
+	guint64 extra_cycles;
+
+	/* Start afresh if the state's moved on without being journalled */
+	if (self->start != self->end && before->iteration != self->position_iteration)
+		mcus_journal_clear (self);
+
+	if (self->position != self->end)
+		discard_future (self);
+
+	if (self->start == self->end)
+		self->start_iteration = self->end_iteration = self->position_iteration = before->iteration;
+
+	/* Keyframe the state regularly (and at the start of the journal, so that it's always possible to seek to the start) */
+	if (self->start == self->end ||
+	    (before->iteration % KEYFRAME_INTERVAL == 0 &&
+	     g_array_index (self->keyframes, Keyframe, self->keyframes->len - 1).iteration != before->iteration)) {
+		append_keyframe (self, before);
+	}
+
+	record[2] = before->program_counter ^ after->program_counter;
+
+	if (before->zero_flag != after->zero_flag)
+		flags |= RECORD_ZERO_FLAG;
+
+	if (before->output_port != after->output_port) {
+		flags |= RECORD_OUTPUT_PORT;
+		record[length++] = before->output_port ^ after->output_port;
+	}
+
+	for (i = 0; i < REGISTER_COUNT; i++) {
+		if (before->registers[i] != after->registers[i]) {
+			mask |= 1 << i;
+			record[length++] = before->registers[i] ^ after->registers[i];
+		}
+	}
+
+	/* The frame's still in the stack array after it's been popped */
+	if (after->stack_depth > before->stack_depth) {
+		flags |= RECORD_PUSH;
+		frame = &(after->stack[before->stack_depth]);
+	} else if (after->stack_depth < before->stack_depth) {
+		flags |= RECORD_POP;
+		frame = &(after->stack[after->stack_depth]);
+	}
+
+	if (frame != NULL) {
+		record[length] = frame->program_counter;
+		memcpy (record + length + 1, frame->registers, REGISTER_COUNT);
+		length += FRAME_LENGTH;
+	}
+
+	extra_cycles = after->cycles - before->cycles - decoded[before->program_counter].cycles;
+	if (extra_cycles != 0) {
+		flags |= RECORD_EXTRA_CYCLES;
+		write_uint (record + length, extra_cycles, 4);
+		length += 4;
+	}
+
+	record[0] = flags;
+	record[1] = mask;
+
+	length += FOOTER_LENGTH;
+	write_uint (record + length - FOOTER_LENGTH, length, FOOTER_LENGTH);
+
+	append_record (self, record, length);
+
+	self->position = self->end;
+	self->position_iteration = self->end_iteration = after->iteration;
+}
+
+/* Get the range of iterations which can be seeked to. Returns %FALSE if the journal's empty. */
+gboolean
+mcus_journal_get_range (MCUSJournal *self, guint64 *start_iteration, guint64 *end_iteration)
+{
+	if (self->start == self->end)
+		return FALSE;
+
+	if (start_iteration != NULL)
+		*start_iteration = self->start_iteration;
+	if (end_iteration != NULL)
+		*end_iteration = self->end_iteration;
+
+	return TRUE;
+}
+
+#define DISTANCE(A,B) (((A) > (B)) ? (A) - (B) : (B) - (A))
+
+/* Find the keyframe closest to @iteration, or %NULL if there are none */
+static const Keyframe *
+find_nearest_keyframe (MCUSJournal *self, guint64 iteration)
+{
+	guint low = 0, high = self->keyframes->len;
+	const Keyframe *before, *after;
+
+	if (high == 0)
+		return NULL;
+
+	/* Find the first keyframe after @iteration */
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
+
+		if (g_array_index (self->keyframes, Keyframe, middle).iteration <= iteration)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	before = (low > 0) ? &g_array_index (self->keyframes, Keyframe, low - 1) : NULL;
+	after = (low < self->keyframes->len) ? &g_array_index (self->keyframes, Keyframe, low) : NULL;
+
+	if (before == NULL)
+		return after;
+	else if (after == NULL)
+		return before;
+
+	return (DISTANCE (before->iteration, iteration) <= DISTANCE (after->iteration, iteration)) ? before : after;
+}
+
+/* Move @state, which must be the state at the journal's current position, to @iteration, by redoing or undoing the recorded instructions from
+ * whichever's nearer: the current position or a keyframe. Returns %FALSE if @iteration isn't in the journal. */
+gboolean
+mcus_journal_seek (MCUSJournal *self, guint64 iteration, MCUSJournalState *state, const DecodedInstruction *decoded)
+{
+	const Keyframe *keyframe;
+
+	if (self->start == self->end || iteration < self->start_iteration || iteration > self->end_iteration)
+		return FALSE;
+
+	g_return_val_if_fail (state->iteration == self->position_iteration, FALSE);
+
+	keyframe = find_nearest_keyframe (self, iteration);
+	if (keyframe != NULL && DISTANCE (keyframe->iteration, iteration) < DISTANCE (self->position_iteration, iteration))
+		restore_keyframe (self, keyframe, state);
+
+	while (self->position_iteration < iteration) {
+		guint length = get_record_length (self, self->position);
+
+		if ((read_byte (self, self->position) & RECORD_KEYFRAME) == 0) {
+			apply_record (self, self->position, length, state, decoded, TRUE);
+			self->position_iteration++;
+		}
+
+		self->position += length;
+	}
+
+	while (self->position_iteration > iteration) {
+		guint length = get_previous_record_length (self, self->position);
+
+		self->position -= length;
+
+		if ((read_byte (self, self->position) & RECORD_KEYFRAME) == 0) {
+			apply_record (self, self->position, length, state, decoded, FALSE);
+			self->position_iteration--;
+		}
+	}
+
+	return TRUE;
+}
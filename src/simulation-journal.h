@@ -0,0 +1,56 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MCUS_SIMULATION_JOURNAL_H
+#define MCUS_SIMULATION_JOURNAL_H
+
+#include <glib.h>
+
+#include "simulation-private.h"
+
+G_BEGIN_DECLS
+
+/* The parts of the simulated hardware which are recorded in the journal. The stack isn't copied; @stack points to the simulation's own
+ * STACK_SIZE frames. */
+typedef struct {
+	guchar program_counter;
+	gboolean zero_flag;
+	guchar registers[REGISTER_COUNT];
+	guchar output_port;
+	guint64 iteration;
+	guint64 cycles;
+	guint stack_depth;
+	MCUSStackFrame *stack;
+} MCUSJournalState;
+
+typedef struct _MCUSJournal MCUSJournal;
+
+MCUSJournal *mcus_journal_new (gsize size) G_GNUC_WARN_UNUSED_RESULT;
+void mcus_journal_free (MCUSJournal *self);
+gsize mcus_journal_get_size (MCUSJournal *self);
+
+void mcus_journal_clear (MCUSJournal *self);
+void mcus_journal_record (MCUSJournal *self, const MCUSJournalState *before, const MCUSJournalState *after, const DecodedInstruction *decoded);
+
+gboolean mcus_journal_get_range (MCUSJournal *self, guint64 *start_iteration, guint64 *end_iteration);
+gboolean mcus_journal_seek (MCUSJournal *self, guint64 iteration, MCUSJournalState *state, const DecodedInstruction *decoded);
+
+G_END_DECLS
+
+#endif /* !MCUS_SIMULATION_JOURNAL_H */
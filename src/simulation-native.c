@@ -0,0 +1,148 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loading and running of programs which have been translated ahead of time to C by mcus_translate_to_c(), and compiled to a shared module
+ * with the system C compiler.
+ *
+ * A translated module exports its ABI version, a copy of the memory image it was translated from (so that it's only used while the
+ * simulation's memory still matches), a table of the addresses at which it can be entered, and a function to run the program from one of
+ * those addresses until it reaches an instruction it can't execute itself, or its instruction budget runs out.
+ */
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <gmodule.h>
+#include <string.h>
+
+#include "simulation.h"
+#include "simulation-native.h"
+
+typedef guint64 (*NativeRunFunc) (MCUSNativeState *state);
+
+struct _MCUSNative {
+	GModule *module;
+	NativeRunFunc run;
+	const guchar *memory;
+	const guchar *entry_points;
+};
+
+/* Looks up a symbol in the module, setting @error if it's missing */
+static gboolean
+get_symbol (GModule *module, const gchar *filename, const gchar *symbol_name, gpointer *symbol, GError **error)
+{
+	if (g_module_symbol (module, symbol_name, symbol) == FALSE || *symbol == NULL) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_MODULE,
+		             _("The translated program \"%s\" is missing the symbol \"%s\"."),
+		             filename, symbol_name);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * mcus_native_load:
+ * @filename: the filename of a compiled translated module
+ * @error: a #GError, or %NULL
+ *
+ * Loads a module which was translated by mcus_translate_to_c() and compiled with the system C compiler.
+ *
+ * Return value: the loaded module, or %NULL on error; free with mcus_native_free()
+ **/
+MCUSNative *
+mcus_native_load (const gchar *filename, GError **error)
+{
+	MCUSNative *self;
+	GModule *module;
+	gpointer abi_version, run, memory, entry_points;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	if (g_module_supported () == FALSE) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_MODULE,
+		             _("Translated programs can't be loaded on this platform."));
+		return NULL;
+	}
+
+	module = g_module_open (filename, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+	if (module == NULL) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_MODULE,
+		             _("The translated program \"%s\" could not be loaded: %s"),
+		             filename, g_module_error ());
+		return NULL;
+	}
+
+	if (get_symbol (module, filename, "mcus_native_abi_version", &abi_version, error) == FALSE ||
+	    get_symbol (module, filename, "mcus_native_run", &run, error) == FALSE ||
+	    get_symbol (module, filename, "mcus_native_memory", &memory, error) == FALSE ||
+	    get_symbol (module, filename, "mcus_native_entry_points", &entry_points, error) == FALSE) {
+		g_module_close (module);
+		return NULL;
+	}
+
+	if (*((const guint *) abi_version) != MCUS_NATIVE_ABI_VERSION) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_MODULE,
+		             _("The translated program \"%s\" was translated by an incompatible version of MCUS."),
+		             filename);
+		g_module_close (module);
+		return NULL;
+	}
+
+	self = g_slice_new (MCUSNative);
+	self->module = module;
+	self->run = (NativeRunFunc) run;
+	self->memory = memory;
+	self->entry_points = entry_points;
+
+	return self;
+}
+
+void
+mcus_native_free (MCUSNative *self)
+{
+	if (self == NULL)
+		return;
+
+	g_module_close (self->module);
+	g_slice_free (MCUSNative, self);
+}
+
+/* Returns TRUE if the module was translated from the given memory image, and so can be used to execute it */
+gboolean
+mcus_native_matches_memory (MCUSNative *self, const guchar *memory)
+{
+	return (memcmp (self->memory, memory, MEMORY_SIZE) == 0) ? TRUE : FALSE;
+}
+
+/* Returns TRUE if the module can be entered at the given address */
+gboolean
+mcus_native_is_entry_point (MCUSNative *self, guchar address)
+{
+	return (self->entry_points[address] != 0) ? TRUE : FALSE;
+}
+
+/* Runs the module from state->program_counter until it reaches an instruction it can't execute, or the budget runs out. Returns the number of
+ * instructions executed, which may be 0 if the budget is too small for the basic block at the program counter. */
+guint64
+mcus_native_execute (MCUSNative *self, MCUSNativeState *state)
+{
+	return self->run (state);
+}
@@ -0,0 +1,63 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MCUS_SIMULATION_NATIVE_H
+#define MCUS_SIMULATION_NATIVE_H
+
+#include <glib.h>
+
+#include "simulation.h"
+
+G_BEGIN_DECLS
+
+/* Bumped whenever the layout of MCUSNativeState, or the symbols exported by translated modules, change */
+#define MCUS_NATIVE_ABI_VERSION 2
+
+/* The state shared between the simulation and a translated module. The layout of this must match the definition which mcus_translate_to_c()
+ * writes into every translated module. */
+typedef struct _MCUSNativeState MCUSNativeState;
+
+struct _MCUSNativeState {
+	guchar registers[REGISTER_COUNT];
+	guchar zero_flag;
+	guchar program_counter;
+	guint64 budget; /* instructions which may still be executed */
+	guint64 cycles; /* added to with the cycles taken by each instruction executed, other than by waiting in wait1ms */
+	const guchar *lookup_table;
+
+	/* Host interface, used for everything which touches the simulated hardware outside the processor */
+	gpointer host_data;
+	guchar (*read_input) (gpointer host_data);
+	void (*write_output) (gpointer host_data, guchar value);
+	guchar (*read_adc) (gpointer host_data);
+	void (*wait_1ms) (gpointer host_data);
+};
+
+typedef struct _MCUSNative MCUSNative;
+
+MCUSNative *mcus_native_load (const gchar *filename, GError **error) G_GNUC_WARN_UNUSED_RESULT;
+void mcus_native_free (MCUSNative *self);
+
+gboolean mcus_native_matches_memory (MCUSNative *self, const guchar *memory);
+gboolean mcus_native_is_entry_point (MCUSNative *self, guchar address);
+guint64 mcus_native_execute (MCUSNative *self, MCUSNativeState *state);
+
+G_END_DECLS
+
+#endif /* !MCUS_SIMULATION_NATIVE_H */
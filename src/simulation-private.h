@@ -0,0 +1,73 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MCUS_SIMULATION_PRIVATE_H
+#define MCUS_SIMULATION_PRIVATE_H
+
+#include <glib.h>
+
+#include "simulation.h"
+
+G_BEGIN_DECLS
+
+/* Internal operations which the memory image is decoded into. These mirror the opcodes, except that the built-in subroutines are resolved to
+ * their own operations at decode time, and anything which can't be executed is decoded to DECODED_INVALID (or DECODED_INVALID_REGISTER, for
+ * a valid opcode with a register operand which is out of range). */
+typedef enum {
+	DECODED_HALT,
+	DECODED_MOVI,
+	DECODED_MOV,
+	DECODED_ADD,
+	DECODED_SUB,
+	DECODED_AND,
+	DECODED_EOR,
+	DECODED_INC,
+	DECODED_DEC,
+	DECODED_IN,
+	DECODED_OUT,
+	DECODED_JP,
+	DECODED_JZ,
+	DECODED_JNZ,
+	DECODED_RCALL,
+	DECODED_RET,
+	DECODED_SHL,
+	DECODED_SHR,
+	DECODED_READTABLE,
+	DECODED_WAIT1MS,
+	DECODED_READADC,
+	DECODED_INVALID,
+	DECODED_INVALID_REGISTER
+} DecodedOperation;
+
+typedef struct {
+	guchar operation; /* DecodedOperation */
+	guchar opcode; /* raw opcode, for error reporting */
+	guchar operand1;
+	guchar operand2;
+	guchar next_program_counter; /* address of the following instruction */
+	guchar cycles; /* clock cycles taken, other than by waiting in wait1ms; see mcus_simulation_get_cycles() */
+} DecodedInstruction;
+
+void mcus_decode_memory (const guchar *memory, DecodedInstruction *decoded);
+
+#define BITMAP_IS_SET(B,A) (((B)[(A) / 32] & (1U << ((A) % 32))) != 0)
+
+G_END_DECLS
+
+#endif /* !MCUS_SIMULATION_PRIVATE_H */
@@ -21,17 +21,30 @@
 #include <glib/gi18n.h>
 #include <glib/gprintf.h>
 #include <limits.h>
+#include <math.h>
 
 #include "instructions.h"
 #include "simulation.h"
 #include "simulation-enums.h"
+#include "simulation-private.h"
+#include "simulation-jit.h"
+#include "simulation-journal.h"
+#include "simulation-native.h"
 
 /* This is also in the UI file (in Volts) */
 #define ANALOGUE_INPUT_MAX_VOLTAGE 5.0
 
 /* These are also in the UI file (in Hz) */
 #define DEFAULT_CLOCK_SPEED 1
-#define MAX_CLOCK_SPEED 1000
+#define DEFAULT_MAX_BATCH_TIME 20000 /* microseconds */
+#define PACING_INTERVAL 10 /* milliseconds; the shortest interval between batches of instructions */
+#define ACHIEVED_CLOCK_SPEED_WINDOW G_USEC_PER_SEC /* microseconds over which the achieved clock speed is measured */
+#define FRAME_INTERVAL 16 /* milliseconds; how often the state is read from the worker thread while it's running */
+#define REAL_TIME_STOP_FLAGS (MCUS_SIMULATION_STOP_ON_BREAKPOINT | MCUS_SIMULATION_STOP_ON_WATCHPOINT) /* the simulation's paused on these */
+#define PERSISTENCE_OF_VISION 20 /* milliseconds of virtual time over which the output port is averaged to give the brightness of its outputs */
+
+/* In frames */
+#define DEFAULT_MAX_STACK_DEPTH STACK_SIZE
 
 GQuark
 mcus_simulation_error_quark (void)
@@ -48,7 +61,90 @@ static void mcus_simulation_finalize (GObject *object);
 static void mcus_simulation_get_property (GObject *object, guint property_id, GValue *value, GParamSpec *pspec);
 static void mcus_simulation_set_property (GObject *object, guint property_id, const GValue *value, GParamSpec *pspec);
 
-static void free_stack (MCUSSimulation *self);
+static void empty_stack (MCUSSimulation *self);
+static void decode_memory (MCUSSimulation *self);
+static void fuse_memory (MCUSSimulation *self);
+static void find_basic_blocks (MCUSSimulation *self);
+static void find_counted_loops (MCUSSimulation *self);
+static void reset_output_history (MCUSSimulationPrivate *priv);
+
+/* Common sequences of instructions which can be executed as a single operation by mcus_simulation_run(). A fused operation is recorded at the
+ * address of the first instruction in its sequence; the instructions themselves are still decoded individually, so that single-stepping,
+ * jumps into the middle of a sequence and breakpoints work as normal. */
+typedef enum {
+	FUSED_NONE = 0,
+	FUSED_DEC_JNZ, /* DEC Sd / JNZ e */
+	FUSED_MOV_EOR_OUT, /* MOV Sd,Ss / EOR Sd,Sx / OUT Q,Sy */
+	FUSED_MOV_EOR_OUT_ADD /* MOV Sd,Ss / EOR Sd,Sx / OUT Q,Sy / ADD Sa,Sb */
+} FusedOperation;
+
+typedef struct {
+	guchar operation; /* FusedOperation */
+	guchar length; /* number of instructions in the sequence */
+	guchar cycles; /* clock cycles taken by the sequence */
+} FusedInstruction;
+
+/* A pure counted loop: a straight-line body of MOVI instructions and inner counted loops, followed by DEC Sc / JNZ back to the start of the body.
+ * Its only effects are on registers, and every pass has the same length and effects (other than on the counter), so any number of passes can
+ * be executed at once by mcus_simulation_run(). */
+typedef struct {
+	guint64 pass_length; /* instructions executed per pass, including the DEC and JNZ; 0 if there's no counted loop at this address */
+	guint64 pass_cycles; /* clock cycles taken per pass */
+	guchar counter; /* the register counting the passes */
+	guchar exit_address; /* address after the JNZ */
+	guchar effect_mask; /* bitmask of the other registers written by each pass */
+	guchar effect_values[REGISTER_COUNT]; /* values those registers are left with after each pass */
+} CountedLoop;
+
+/* Loops longer than this per pass (in instructions or cycles) aren't counted, so that the total length of a loop can't overflow */
+#define MAX_COUNTED_LOOP_PASS_LENGTH (G_MAXUINT64 >> 16)
+
+#define BREAKPOINT_IS_SET(P,A) BITMAP_IS_SET ((P)->breakpoints, (A))
+#define STOP_IS_SET(P,A) BITMAP_IS_SET ((P)->stops, (A))
+
+/* Maximum number of watchpoints which can be set at once */
+#define MAX_WATCHPOINTS 16
+
+typedef enum {
+	WATCH_REGISTER,
+	WATCH_ZERO_FLAG,
+	WATCH_OUTPUT_PORT,
+	WATCH_STACK_DEPTH
+} WatchLocation;
+
+typedef enum {
+	WATCH_ANY_CHANGE, /* no condition */
+	WATCH_EQUAL,
+	WATCH_NOT_EQUAL,
+	WATCH_LESS,
+	WATCH_LESS_EQUAL,
+	WATCH_GREATER,
+	WATCH_GREATER_EQUAL
+} WatchComparison;
+
+/* A watchpoint, in the predicate form its expression's compiled to when it's added; see mcus_simulation_add_watchpoint(). It triggers after
+ * any instruction which changes the value of its location, if the new value satisfies the comparison against its operand. */
+typedef struct {
+	guint id;
+	WatchLocation location;
+	guint register_number; /* for WATCH_REGISTER */
+	WatchComparison comparison;
+	guint operand;
+} Watchpoint;
+
+/* How long the output port has held each of its values, over the current window of virtual time and the whole window before it. The
+ * brightness of each output is the proportion of a sliding window of the same length, ending at last_change, for which it was lit. */
+typedef struct {
+	guint64 window_start; /* cycles */
+	guint64 window_length; /* cycles */
+	guint64 last_change; /* cycles; the time up to which the output port's been accounted for */
+	guint64 cycles[OUTPUT_PORT_VALUES]; /* cycles for which each value was held in the current window */
+	guint64 previous_window_length; /* cycles */
+	guint64 previous_cycles[OUTPUT_PORT_VALUES]; /* cycles for which each value was held in the previous window */
+} OutputHistory;
+
+/* Worker thread executing instructions while the simulation's running; see start_worker() */
+typedef struct _Worker Worker;
 
 struct _MCUSSimulationPrivate {
 	/* Simulated hardware */
@@ -57,16 +153,81 @@ struct _MCUSSimulationPrivate {
 	guchar registers[REGISTER_COUNT];
 	guchar input_port;
 	guchar output_port;
+	OutputHistory output_history;
 	gdouble analogue_input;
 	guchar memory[MEMORY_SIZE];
 	guchar lookup_table[LOOKUP_TABLE_SIZE];
-	MCUSStackFrame *stack;
+	MCUSStackFrame stack[STACK_SIZE]; /* stack[0] is the bottom of the stack */
+	guint stack_depth;
+	guint max_stack_depth;
+
+	/* Predecoded form of memory, indexed by address; rebuilt whenever the memory is changed */
+	DecodedInstruction decoded[MEMORY_SIZE];
+	FusedInstruction fused[MEMORY_SIZE];
+	guchar block_lengths[MEMORY_SIZE]; /* number of instructions in the basic block starting at each address, or 0 */
+	guint16 block_cycles[MEMORY_SIZE]; /* clock cycles taken by each basic block, other than by waiting in wait1ms */
+	CountedLoop counted_loops[MEMORY_SIZE]; /* counted loop starting at each address */
+
+	/* Bitmap of addresses with breakpoints set on them */
+	guint32 breakpoints[MEMORY_SIZE / 32];
+
+	/* Address (or -1) and maximum stack depth at which a run stops with %MCUS_SIMULATION_STOP_ON_TARGET; see mcus_simulation_set_run_target() */
+	gint target_address;
+	guint target_stack_depth;
+
+	/* Address (or -1) the simulation last came to rest at: where a run stopped at a breakpoint, an input or the run target, or where it was
+	 * paused, stepped or seeked to. A run starting there executes the instruction rather than stopping at it again; see run_instructions(). */
+	gint resume_address;
 
-	/* Simulation metadata */
-	guint iteration;
+	/* Bitmap of the addresses a run may stop at: those with breakpoints, and the target address. Fused sequences, basic blocks, counted
+	 * loops and translated code never span these. */
+	guint32 stops[MEMORY_SIZE / 32];
+
+	/* Watchpoints, in the order they were added, and the ID to give the next one */
+	Watchpoint watchpoints[MAX_WATCHPOINTS];
+	guint n_watchpoints;
+	guint next_watchpoint_id;
+
+	/* Native translation of the memory, created when first needed by the JIT engine */
+	MCUSSimulationEngine engine;
+	MCUSJit *jit;
+	gboolean jit_valid;
+
+	/* Translated module loaded for the native engine, and whether it was translated from the current memory */
+	MCUSNative *native;
+	gboolean native_valid;
+
+	/* Simulation metadata. Virtual time is measured in clock cycles, and is independent of how long the host takes to execute them. */
+	guint64 iteration;
+	guint64 cycles;
 	MCUSSimulationState state;
 	gulong clock_speed;
 	guint iteration_event;
+
+	/* Real-time pacing: cycles are owed at clock_speed from pacing_start_time (monotonic time, in microseconds), and pacing_cycles have
+	 * elapsed since then */
+	gint64 pacing_start_time;
+	guint64 pacing_cycles;
+	gulong max_batch_time; /* microseconds */
+	gint64 achieved_clock_speed_start_time;
+	guint64 achieved_clock_speed_cycles;
+	gdouble achieved_clock_speed;
+
+	/* Function generator driving the analogue input */
+	gboolean function_generator_enabled;
+	MCUSSimulationWaveform waveform;
+	gdouble waveform_frequency, waveform_amplitude, waveform_offset, waveform_phase;
+	gboolean fine_grained_notifications;
+
+	/* Worker thread executing instructions while running, and the timer reading its state. While the worker's running, it owns the journal,
+	 * JIT and native module, and they're %NULL here; see start_worker(). */
+	gboolean threaded;
+	Worker *worker;
+	guint frame_event;
+
+	/* Journal of the instructions executed, for seeking back through the history; or %NULL if it's disabled */
+	MCUSJournal *journal;
+	guint history_size;
 };
 
 enum {
@@ -76,11 +237,19 @@ enum {
 	PROP_OUTPUT_PORT,
 	PROP_ANALOGUE_INPUT,
 	PROP_ITERATION,
+	PROP_CYCLES,
 	PROP_STATE,
 	PROP_CLOCK_SPEED,
 	PROP_MEMORY,
 	PROP_LOOKUP_TABLE,
-	PROP_REGISTERS
+	PROP_REGISTERS,
+	PROP_FINE_GRAINED_NOTIFICATIONS,
+	PROP_MAX_STACK_DEPTH,
+	PROP_ENGINE,
+	PROP_ACHIEVED_CLOCK_SPEED,
+	PROP_MAX_BATCH_TIME,
+	PROP_THREADED,
+	PROP_HISTORY_SIZE
 };
 
 enum {
@@ -89,6 +258,7 @@ enum {
 	SIGNAL_STACK_PUSHED,
 	SIGNAL_STACK_POPPED,
 	SIGNAL_STACK_EMPTIED,
+	SIGNAL_CHANGED,
 	LAST_SIGNAL
 };
 
@@ -168,9 +338,23 @@ mcus_simulation_class_init (MCUSSimulationClass *klass)
 	 * The current (zero-based) iteration of the simulation.
 	 **/
 	g_object_class_install_property (gobject_class, PROP_ITERATION,
-				g_param_spec_uint ("iteration",
+				g_param_spec_uint64 ("iteration",
 					"Iteration", "The current (zero-based) iteration of the simulation.",
-					0, G_MAXUINT, 0,
+					0, G_MAXUINT64, 0,
+					G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * MCUSSimulation:cycles:
+	 *
+	 * The number of clock cycles which have elapsed in the simulation: its virtual time, in units of 1/#MCUSSimulation:clock-speed seconds.
+	 * Each instruction takes the number of cycles given for its opcode in the instruction set, except that the built-in wait1ms subroutine
+	 * takes a millisecond's worth of cycles at the current clock speed. Virtual time advances in the same way however the instructions are
+	 * executed, and without waiting for real time to pass.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_CYCLES,
+				g_param_spec_uint64 ("cycles",
+					"Cycles", "The number of clock cycles which have elapsed in the simulation.",
+					0, G_MAXUINT64, 0,
 					G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
 	/**
@@ -195,6 +379,60 @@ mcus_simulation_class_init (MCUSSimulationClass *klass)
 					1, G_MAXULONG, DEFAULT_CLOCK_SPEED,
 					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+	/**
+	 * MCUSSimulation:achieved-clock-speed:
+	 *
+	 * The clock speed actually achieved while running in real time, in Hertz, averaged over roughly the last second. This falls short of
+	 * #MCUSSimulation:clock-speed if the host can't execute instructions quickly enough.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_ACHIEVED_CLOCK_SPEED,
+				g_param_spec_double ("achieved-clock-speed",
+					"Achieved Clock Speed", "The clock speed actually achieved while running in real time, in Hertz.",
+					0.0, G_MAXDOUBLE, 0.0,
+					G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * MCUSSimulation:max-batch-time:
+	 *
+	 * The maximum time to spend executing each batch of instructions while running in real time, in microseconds. If the cycles owed
+	 * for the clock speed can't be executed within this time, the rest are dropped, so that the main loop stays responsive.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_MAX_BATCH_TIME,
+				g_param_spec_ulong ("max-batch-time",
+					"Maximum Batch Time", "The maximum time to spend executing each batch of instructions, in microseconds.",
+					1, G_MAXULONG, DEFAULT_MAX_BATCH_TIME,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * MCUSSimulation:threaded:
+	 *
+	 * Whether to execute instructions on a worker thread while running in real time, rather than in the main loop. The state of the
+	 * simulation is still only updated (and notified) in the main loop, about once a frame, while the worker's running. If threads aren't
+	 * available, instructions are executed in the main loop regardless.
+	 *
+	 * This is off by default, so that the state can be read at any time while running; interactive users should turn it on.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_THREADED,
+				g_param_spec_boolean ("threaded",
+					"Threaded", "Whether to execute instructions on a worker thread while running in real time.",
+					FALSE,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * MCUSSimulation:history-size:
+	 *
+	 * The size of the journal of executed instructions, in bytes, which mcus_simulation_seek() uses to move back (and forward again) through
+	 * the simulation's history. Once the journal's full, the oldest instructions are forgotten. Sizes smaller than 64KiB are rounded up, and a
+	 * size of 0 disables the journal.
+	 *
+	 * While the journal's enabled, every instruction is executed by the interpreter, regardless of #MCUSSimulation:engine.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_HISTORY_SIZE,
+				g_param_spec_uint ("history-size",
+					"History Size", "The size of the journal of executed instructions, in bytes.",
+					0, G_MAXUINT, 0,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
 	/**
 	 * MCUSSimulation:memory:
 	 *
@@ -225,6 +463,48 @@ mcus_simulation_class_init (MCUSSimulationClass *klass)
 					"Registers", "The statically allocated block of memory for the microcontroller's registers.",
 					G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+	/**
+	 * MCUSSimulation:fine-grained-notifications:
+	 *
+	 * Whether to notify of changes to #MCUSSimulation:program-counter, #MCUSSimulation:zero-flag, #MCUSSimulation:registers,
+	 * #MCUSSimulation:output-port, #MCUSSimulation:iteration and #MCUSSimulation:cycles individually, as well as through
+	 * #MCUSSimulation::changed.
+	 *
+	 * This is off by default, since the notifications are comparatively expensive when the simulation is running quickly.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_FINE_GRAINED_NOTIFICATIONS,
+				g_param_spec_boolean ("fine-grained-notifications",
+					"Fine-Grained Notifications", "Whether to notify of changes to the hardware properties individually.",
+					FALSE,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * MCUSSimulation:max-stack-depth:
+	 *
+	 * The maximum number of frames which can be pushed onto the stack before a %MCUS_SIMULATION_ERROR_STACK_OVERFLOW error is raised.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_MAX_STACK_DEPTH,
+				g_param_spec_uint ("max-stack-depth",
+					"Maximum Stack Depth", "The maximum number of frames which can be pushed onto the stack.",
+					1, STACK_SIZE, DEFAULT_MAX_STACK_DEPTH,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * MCUSSimulation:engine:
+	 *
+	 * The engine used to execute instructions in mcus_simulation_run(). The interpreter executes them one at a time, and is the reference the
+	 * other engines are checked against; every other engine also executes common sequences of instructions as single operations, and
+	 * fast-forwards through counted loops (see mcus_simulation_run()). Single
+	 * iterations are always executed by the interpreter. If the JIT
+	 * engine is selected but isn't supported on this platform, or the native engine is selected but no module matching the memory has been
+	 * loaded with mcus_simulation_load_native(), the interpreter is used instead.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_ENGINE,
+				g_param_spec_enum ("engine",
+					"Engine", "The engine used to execute instructions in batch runs.",
+					MCUS_TYPE_SIMULATION_ENGINE, MCUS_SIMULATION_ENGINE_INTERPRETER,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
 	/**
 	 * MCUSSimulation::iteration-started:
 	 * @simulation: the #MCUSSimulation which has started an iteration
@@ -247,6 +527,9 @@ mcus_simulation_class_init (MCUSSimulationClass *klass)
 	 * Emitted when an iteration of the simulation has been finished and output data is ready to be pushed to the UI.
 	 *
 	 * If an error occurred during the iteration, it is returned in @error. Otherwise, @error is %NULL.
+	 *
+	 * While the simulation is running in real time, instructions are executed in batches with mcus_simulation_run(), and this signal is
+	 * only emitted if a batch fails, with the error.
 	 **/
 	signals[SIGNAL_ITERATION_FINISHED] = g_signal_new ("iteration-finished",
 				G_TYPE_FROM_CLASS (klass),
@@ -300,6 +583,22 @@ mcus_simulation_class_init (MCUSSimulationClass *klass)
 				NULL, NULL,
 				g_cclosure_marshal_VOID__VOID,
 				G_TYPE_NONE, 0);
+
+	/**
+	 * MCUSSimulation::changed:
+	 * @simulation: the #MCUSSimulation whose state has changed
+	 * @change_set: an #MCUSSimulationChangeSet describing the changes
+	 *
+	 * Emitted once for each iteration, batch run or reset of the simulation which changed any of the program counter, zero flag, registers,
+	 * output port, iteration, cycle count or stack. @change_set gives the fields which changed, and their values before and after the change.
+	 **/
+	signals[SIGNAL_CHANGED] = g_signal_new ("changed",
+				G_TYPE_FROM_CLASS (klass),
+				G_SIGNAL_RUN_LAST,
+				0,
+				NULL, NULL,
+				g_cclosure_marshal_VOID__POINTER,
+				G_TYPE_NONE, 1, G_TYPE_POINTER /* MCUSSimulationChangeSet */);
 }
 
 static void
@@ -309,6 +608,14 @@ mcus_simulation_init (MCUSSimulation *self)
 
 	self->priv->state = MCUS_SIMULATION_STOPPED;
 	self->priv->clock_speed = DEFAULT_CLOCK_SPEED;
+	self->priv->max_batch_time = DEFAULT_MAX_BATCH_TIME;
+	self->priv->max_stack_depth = DEFAULT_MAX_STACK_DEPTH;
+	self->priv->target_address = -1;
+	self->priv->resume_address = -1;
+	self->priv->next_watchpoint_id = 1;
+
+	reset_output_history (self->priv);
+	decode_memory (self);
 }
 
 static void
@@ -318,7 +625,9 @@ mcus_simulation_finalize (GObject *object)
 
 	if (self->priv->state != MCUS_SIMULATION_STOPPED)
 		mcus_simulation_finish (self);
-	free_stack (self);
+	mcus_jit_free (self->priv->jit);
+	mcus_native_free (self->priv->native);
+	mcus_journal_free (self->priv->journal);
 
 	/* Chain up to the parent class */
 	G_OBJECT_CLASS (mcus_simulation_parent_class)->finalize (object);
@@ -346,7 +655,10 @@ mcus_simulation_get_property (GObject *object, guint property_id, GValue *value,
 			g_value_set_double (value, priv->analogue_input);
 			break;
 		case PROP_ITERATION:
-			g_value_set_uint (value, priv->iteration);
+			g_value_set_uint64 (value, priv->iteration);
+			break;
+		case PROP_CYCLES:
+			g_value_set_uint64 (value, priv->cycles);
 			break;
 		case PROP_STATE:
 			g_value_set_enum (value, priv->state);
@@ -363,6 +675,27 @@ mcus_simulation_get_property (GObject *object, guint property_id, GValue *value,
 		case PROP_REGISTERS:
 			g_value_set_pointer (value, priv->registers);
 			break;
+		case PROP_FINE_GRAINED_NOTIFICATIONS:
+			g_value_set_boolean (value, priv->fine_grained_notifications);
+			break;
+		case PROP_MAX_STACK_DEPTH:
+			g_value_set_uint (value, priv->max_stack_depth);
+			break;
+		case PROP_ENGINE:
+			g_value_set_enum (value, priv->engine);
+			break;
+		case PROP_ACHIEVED_CLOCK_SPEED:
+			g_value_set_double (value, priv->achieved_clock_speed);
+			break;
+		case PROP_MAX_BATCH_TIME:
+			g_value_set_ulong (value, priv->max_batch_time);
+			break;
+		case PROP_THREADED:
+			g_value_set_boolean (value, priv->threaded);
+			break;
+		case PROP_HISTORY_SIZE:
+			g_value_set_uint (value, mcus_simulation_get_history_size (MCUS_SIMULATION (object)));
+			break;
 		default:
 			/* We don't have any other property... */
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -383,6 +716,24 @@ mcus_simulation_set_property (GObject *object, guint property_id, const GValue *
 		case PROP_CLOCK_SPEED:
 			mcus_simulation_set_clock_speed (MCUS_SIMULATION (object), g_value_get_ulong (value));
 			break;
+		case PROP_FINE_GRAINED_NOTIFICATIONS:
+			mcus_simulation_set_fine_grained_notifications (MCUS_SIMULATION (object), g_value_get_boolean (value));
+			break;
+		case PROP_MAX_STACK_DEPTH:
+			mcus_simulation_set_max_stack_depth (MCUS_SIMULATION (object), g_value_get_uint (value));
+			break;
+		case PROP_ENGINE:
+			mcus_simulation_set_engine (MCUS_SIMULATION (object), g_value_get_enum (value));
+			break;
+		case PROP_MAX_BATCH_TIME:
+			mcus_simulation_set_max_batch_time (MCUS_SIMULATION (object), g_value_get_ulong (value));
+			break;
+		case PROP_THREADED:
+			mcus_simulation_set_threaded (MCUS_SIMULATION (object), g_value_get_boolean (value));
+			break;
+		case PROP_HISTORY_SIZE:
+			mcus_simulation_set_history_size (MCUS_SIMULATION (object), g_value_get_uint (value));
+			break;
 		default:
 			/* We don't have any other property... */
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -397,25 +748,396 @@ mcus_simulation_new (void)
 }
 
 static void
-free_stack (MCUSSimulation *self)
+empty_stack (MCUSSimulation *self)
 {
-	MCUSStackFrame *stack_frame = self->priv->stack;
-	while (stack_frame != NULL) {
-		MCUSStackFrame *prev_frame;
-		prev_frame = stack_frame->prev;
-		g_slice_free (MCUSStackFrame, stack_frame);
-		stack_frame = prev_frame;
-	}
-	self->priv->stack = NULL;
+	self->priv->stack_depth = 0;
 
 	g_signal_emit (self, signals[SIGNAL_STACK_EMPTIED], 0);
 }
 
+/**
+ * mcus_decode_memory:
+ * @memory: a memory image, with %MEMORY_SIZE bytes
+ * @decoded: return location for the decoded image, with %MEMORY_SIZE entries
+ *
+ * Decodes the instruction starting at every address in @memory, so that it can be executed without fetching and decoding the opcode and
+ * operands again. Every address is decoded (rather than just following the program from %PROGRAM_START_ADDRESS) so that jumps into the
+ * middle of an instruction behave exactly as they would if the memory were read at execution time.
+ **/
+void
+mcus_decode_memory (const guchar *memory, DecodedInstruction *decoded)
+{
+	guint address;
+
+	for (address = 0; address < MEMORY_SIZE; address++, decoded++) {
+		guchar opcode = memory[address];
+
+		decoded->opcode = opcode;
+		decoded->operand1 = (address + 1 < MEMORY_SIZE) ? memory[address + 1] : 0;
+		decoded->operand2 = (address + 2 < MEMORY_SIZE) ? memory[address + 2] : 0;
+
+		if (opcode > OPCODE_SHR) {
+			decoded->operation = DECODED_INVALID;
+			decoded->next_program_counter = address;
+			decoded->cycles = 0;
+			continue;
+		}
+
+		/* The decoded operations for real opcodes share their values. The built-in subroutines take as long as the RCALL to them. */
+		decoded->operation = opcode;
+		decoded->next_program_counter = address + mcus_instruction_data[opcode].size;
+		decoded->cycles = mcus_instruction_data[opcode].cycles;
+
+		switch (opcode) {
+		case OPCODE_MOVI:
+		case OPCODE_INC:
+		case OPCODE_DEC:
+		case OPCODE_IN:
+		case OPCODE_OUT:
+		case OPCODE_SHL:
+		case OPCODE_SHR:
+			/* Register operands which are out of range would index past the end of the register file */
+			if (decoded->operand1 >= REGISTER_COUNT)
+				decoded->operation = DECODED_INVALID_REGISTER;
+			break;
+		case OPCODE_MOV:
+		case OPCODE_ADD:
+		case OPCODE_SUB:
+		case OPCODE_AND:
+		case OPCODE_EOR:
+			if (decoded->operand1 >= REGISTER_COUNT || decoded->operand2 >= REGISTER_COUNT)
+				decoded->operation = DECODED_INVALID_REGISTER;
+			break;
+		case OPCODE_RCALL:
+			/* Resolve calls to the built-in subroutines. The compiler encodes these relative to the RCALL itself: a call to the RCALL's own
+			 * address is readtable, one to its operand is wait1ms, and one to the address just after it is readadc. */
+			if (decoded->operand1 == address)
+				decoded->operation = DECODED_READTABLE;
+			else if (decoded->operand1 == address + 1)
+				decoded->operation = DECODED_WAIT1MS;
+			else if (decoded->operand1 == address + 2)
+				decoded->operation = DECODED_READADC;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* Decode the memory, and invalidate everything derived from the old decoding */
+static void
+decode_memory (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+
+	/* Any native translation of the old memory is now out of date */
+	priv->jit_valid = FALSE;
+	priv->native_valid = (priv->native != NULL && mcus_native_matches_memory (priv->native, priv->memory) == TRUE) ? TRUE : FALSE;
+
+	mcus_decode_memory (priv->memory, priv->decoded);
+	fuse_memory (self);
+	find_basic_blocks (self);
+	find_counted_loops (self);
+}
+
+/* Returns TRUE if a run could stop at any instruction in the sequence of @length instructions starting at @address, other than the first; i.e.
+ * if any of them has a breakpoint on it or is the run target */
+static gboolean
+sequence_has_interior_stop (MCUSSimulationPrivate *priv, guchar address, guint length)
+{
+	guint i;
+
+	for (i = 1; i < length; i++) {
+		address = priv->decoded[address].next_program_counter;
+		if (STOP_IS_SET (priv, address))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Find the sequences of instructions in the decoded memory which can be fused into single operations. Sequences which contain a breakpoint
+ * or the run target (other than on their first instruction) aren't fused, so that execution can stop there. */
+static void
+fuse_memory (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	guint address;
+
+	for (address = 0; address < MEMORY_SIZE; address++) {
+		FusedInstruction *fused = &(priv->fused[address]);
+		const DecodedInstruction *first, *second, *third, *fourth;
+
+		fused->operation = FUSED_NONE;
+		fused->length = 1;
+		fused->cycles = 0;
+
+		first = &(priv->decoded[address]);
+		second = &(priv->decoded[first->next_program_counter]);
+		third = &(priv->decoded[second->next_program_counter]);
+		fourth = &(priv->decoded[third->next_program_counter]);
+
+		if (first->operation == DECODED_DEC && second->operation == DECODED_JNZ) {
+			fused->operation = FUSED_DEC_JNZ;
+			fused->length = 2;
+		} else if (first->operation == DECODED_MOV && second->operation == DECODED_EOR && third->operation == DECODED_OUT) {
+			if (fourth->operation == DECODED_ADD) {
+				fused->operation = FUSED_MOV_EOR_OUT_ADD;
+				fused->length = 4;
+			} else {
+				fused->operation = FUSED_MOV_EOR_OUT;
+				fused->length = 3;
+			}
+		}
+
+		if (fused->operation != FUSED_NONE && sequence_has_interior_stop (priv, address, fused->length) == TRUE) {
+			fused->operation = FUSED_NONE;
+			fused->length = 1;
+		} else if (fused->operation != FUSED_NONE) {
+			fused->cycles = first->cycles + second->cycles + ((fused->length > 2) ? third->cycles : 0) +
+			                ((fused->length > 3) ? fourth->cycles : 0);
+		}
+	}
+}
+
+/* Returns TRUE if the decoded operation can be part of a basic block (as anything other than its terminating jump). Instructions which read
+ * inputs, touch the stack or can fail are always executed individually. */
+static inline gboolean
+is_block_operation (guchar operation)
+{
+	switch (operation) {
+	case DECODED_MOVI:
+	case DECODED_MOV:
+	case DECODED_ADD:
+	case DECODED_SUB:
+	case DECODED_AND:
+	case DECODED_EOR:
+	case DECODED_INC:
+	case DECODED_DEC:
+	case DECODED_OUT:
+	case DECODED_SHL:
+	case DECODED_SHR:
+	case DECODED_READTABLE:
+	case DECODED_WAIT1MS:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* Find the basic block starting at every address in the decoded memory: the run of straight-line instructions up to and including the next jump,
+ * stopping early before any instruction which can't be part of a block or which a run could stop at. Blocks are found from every address, rather
+ * than just from jump targets, so that jumps into the middle of a block (or instruction) behave exactly as they do in the interpreter. */
+static void
+find_basic_blocks (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	guint address;
+
+	for (address = 0; address < MEMORY_SIZE; address++) {
+		guchar program_counter = address;
+		guint length = 0, cycles = 0;
+
+		while (length < G_MAXUINT8) {
+			const DecodedInstruction *instruction = &(priv->decoded[program_counter]);
+
+			if (length > 0 && STOP_IS_SET (priv, program_counter))
+				break;
+
+			if (instruction->operation == DECODED_JP || instruction->operation == DECODED_JZ || instruction->operation == DECODED_JNZ) {
+				length++;
+				cycles += instruction->cycles;
+				break;
+			} else if (is_block_operation (instruction->operation) == FALSE) {
+				break;
+			}
+
+			length++;
+			cycles += instruction->cycles;
+			program_counter = instruction->next_program_counter;
+		}
+
+		priv->block_lengths[address] = length;
+		priv->block_cycles[address] = cycles;
+	}
+}
+
+typedef enum {
+	LOOP_UNANALYSED = 0,
+	LOOP_ANALYSING,
+	LOOP_ANALYSED
+} LoopAnalysisStatus;
+
+/* Analyse the code starting at @start to see whether it's a counted loop, filling in priv->counted_loops[@start]. The analysis of each address
+ * is context-free, so it's memoised in @status; loops found to be in the middle of being analysed are cycles, and aren't counted. */
+static gboolean
+analyse_counted_loop (MCUSSimulationPrivate *priv, guchar start, guchar *status)
+{
+	CountedLoop *loop = &(priv->counted_loops[start]);
+	guchar known_mask = 0, known[REGISTER_COUNT] = { 0, };
+	guchar program_counter = start;
+	guint64 length = 0, cycles = 0;
+	guint steps;
+
+	if (status[start] == LOOP_ANALYSED)
+		return (loop->pass_length > 0) ? TRUE : FALSE;
+	else if (status[start] == LOOP_ANALYSING)
+		return FALSE;
+
+	status[start] = LOOP_ANALYSING;
+	loop->pass_length = 0;
+
+	for (steps = 0; steps < MEMORY_SIZE; steps++) {
+		const DecodedInstruction *instruction = &(priv->decoded[program_counter]);
+		const DecodedInstruction *next = &(priv->decoded[instruction->next_program_counter]);
+		const CountedLoop *inner;
+		guint passes, i;
+
+		/* Passes are executed at once, so they can't contain breakpoints or the run target */
+		if (STOP_IS_SET (priv, program_counter))
+			break;
+
+		if (instruction->operation == DECODED_DEC && next->operation == DECODED_JNZ && next->operand1 == start) {
+			/* The end of the loop; the counter mustn't be written by the body too */
+			if (STOP_IS_SET (priv, instruction->next_program_counter) || (known_mask & (1 << instruction->operand1)) != 0)
+				break;
+
+			loop->pass_length = length + 2;
+			loop->pass_cycles = cycles + instruction->cycles + next->cycles;
+			loop->counter = instruction->operand1;
+			loop->exit_address = next->next_program_counter;
+			loop->effect_mask = known_mask;
+			memcpy (loop->effect_values, known, sizeof (guchar) * REGISTER_COUNT);
+			break;
+		} else if (instruction->operation == DECODED_MOVI) {
+			known[instruction->operand1] = instruction->operand2;
+			known_mask |= 1 << instruction->operand1;
+			length++;
+			cycles += instruction->cycles;
+			program_counter = instruction->next_program_counter;
+		} else if (program_counter != start && analyse_counted_loop (priv, program_counter, status) == TRUE) {
+			/* An inner loop only takes the same length every pass if its counter's set within this loop's body */
+			inner = &(priv->counted_loops[program_counter]);
+			if ((known_mask & (1 << inner->counter)) == 0)
+				break;
+
+			passes = (known[inner->counter] == 0) ? 256 : known[inner->counter];
+			length += passes * inner->pass_length;
+			cycles += passes * inner->pass_cycles;
+			if (length > MAX_COUNTED_LOOP_PASS_LENGTH || cycles > MAX_COUNTED_LOOP_PASS_LENGTH)
+				break;
+
+			for (i = 0; i < REGISTER_COUNT; i++) {
+				if ((inner->effect_mask & (1 << i)) != 0)
+					known[i] = inner->effect_values[i];
+			}
+			known[inner->counter] = 0;
+			known_mask |= inner->effect_mask | (1 << inner->counter);
+
+			program_counter = inner->exit_address;
+		} else {
+			break;
+		}
+	}
+
+	status[start] = LOOP_ANALYSED;
+
+	return (loop->pass_length > 0) ? TRUE : FALSE;
+}
+
+/* Find the counted loops in the decoded memory, such as nested delay loops:
+ *	MOVI S1, FF
+ *  outer:
+ *	MOVI S0, FF
+ *  inner:
+ *	DEC S0
+ *	JNZ inner
+ *	DEC S1
+ *	JNZ outer
+ */
+static void
+find_counted_loops (MCUSSimulation *self)
+{
+	guchar status[MEMORY_SIZE] = { LOOP_UNANALYSED, };
+	guint address;
+
+	for (address = 0; address < MEMORY_SIZE; address++)
+		analyse_counted_loop (self->priv, address, status);
+}
+
+/* Record the values of the fields covered by change sets before they're modified */
+static void
+begin_changes (MCUSSimulationPrivate *priv, MCUSSimulationChangeSet *change_set)
+{
+	change_set->old_program_counter = priv->program_counter;
+	change_set->old_zero_flag = priv->zero_flag;
+	memcpy (change_set->old_registers, priv->registers, sizeof (guchar) * REGISTER_COUNT);
+	change_set->old_output_port = priv->output_port;
+	change_set->old_iteration = priv->iteration;
+	change_set->old_cycles = priv->cycles;
+}
+
+/* Work out which fields have changed since begin_changes() was called, and announce them through the changed signal (and individual property
+ * notifications, if they've been requested). @forced_flags are announced as changed regardless of their values. */
+static void
+end_changes (MCUSSimulation *self, MCUSSimulationChangeSet *change_set, MCUSSimulationChangeFlags forced_flags)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	MCUSSimulationChangeFlags flags = forced_flags;
+
+	change_set->new_program_counter = priv->program_counter;
+	change_set->new_zero_flag = priv->zero_flag;
+	memcpy (change_set->new_registers, priv->registers, sizeof (guchar) * REGISTER_COUNT);
+	change_set->new_output_port = priv->output_port;
+	change_set->new_iteration = priv->iteration;
+	change_set->new_cycles = priv->cycles;
+
+	if (change_set->old_program_counter != change_set->new_program_counter)
+		flags |= MCUS_SIMULATION_CHANGED_PROGRAM_COUNTER;
+	if (change_set->old_zero_flag != change_set->new_zero_flag)
+		flags |= MCUS_SIMULATION_CHANGED_ZERO_FLAG;
+	if (memcmp (change_set->old_registers, change_set->new_registers, sizeof (guchar) * REGISTER_COUNT) != 0)
+		flags |= MCUS_SIMULATION_CHANGED_REGISTERS;
+	if (change_set->old_output_port != change_set->new_output_port)
+		flags |= MCUS_SIMULATION_CHANGED_OUTPUT_PORT;
+	if (change_set->old_iteration != change_set->new_iteration)
+		flags |= MCUS_SIMULATION_CHANGED_ITERATION;
+	if (change_set->old_cycles != change_set->new_cycles)
+		flags |= MCUS_SIMULATION_CHANGED_CYCLES;
+
+	change_set->flags = flags;
+
+	if (flags == 0)
+		return;
+
+	if (priv->fine_grained_notifications == TRUE) {
+		GObject *obj = G_OBJECT (self);
+
+		g_object_freeze_notify (obj);
+		if (flags & MCUS_SIMULATION_CHANGED_PROGRAM_COUNTER)
+			g_object_notify (obj, "program-counter");
+		if (flags & MCUS_SIMULATION_CHANGED_ZERO_FLAG)
+			g_object_notify (obj, "zero-flag");
+		if (flags & MCUS_SIMULATION_CHANGED_REGISTERS)
+			g_object_notify (obj, "registers");
+		if (flags & MCUS_SIMULATION_CHANGED_OUTPUT_PORT)
+			g_object_notify (obj, "output-port");
+		if (flags & MCUS_SIMULATION_CHANGED_ITERATION)
+			g_object_notify (obj, "iteration");
+		if (flags & MCUS_SIMULATION_CHANGED_CYCLES)
+			g_object_notify (obj, "cycles");
+		g_object_thaw_notify (obj);
+	}
+
+	g_signal_emit (self, signals[SIGNAL_CHANGED], 0, change_set);
+}
+
 static void
 reset (MCUSSimulation *self, gboolean reset_memory)
 {
 	GObject *obj = G_OBJECT (self);
 	MCUSSimulationPrivate *priv = self->priv;
+	MCUSSimulationChangeSet change_set;
 
 	g_object_freeze_notify (obj);
 
@@ -426,29 +1148,35 @@ reset (MCUSSimulation *self, gboolean reset_memory)
 
 		memset (priv->lookup_table, 0, sizeof (guchar) * LOOKUP_TABLE_SIZE);
 		g_object_notify (obj, "lookup-table");
+
+		decode_memory (self);
 	}
 
 	/* Set up various properties */
-	priv->program_counter = PROGRAM_START_ADDRESS;
-	g_object_notify (obj, "program-counter");
+	begin_changes (priv, &change_set);
 
+	priv->program_counter = PROGRAM_START_ADDRESS;
+	priv->resume_address = -1;
 	priv->zero_flag = 0;
-	g_object_notify (obj, "zero-flag");
-
 	memset (priv->registers, 0, sizeof (guchar) * REGISTER_COUNT);
-	g_object_notify (obj, "registers");
-
 	priv->output_port = 0;
-	g_object_notify (obj, "output-port");
-
 	priv->iteration = 0;
-	g_object_notify (obj, "iteration");
+	priv->cycles = 0;
+	reset_output_history (priv);
+
+	if (priv->journal != NULL)
+		mcus_journal_clear (priv->journal);
+
+	/* Announce all the fields, since whoever's listening may never have seen them before */
+	end_changes (self, &change_set, MCUS_SIMULATION_CHANGED_PROGRAM_COUNTER | MCUS_SIMULATION_CHANGED_ZERO_FLAG |
+	                                MCUS_SIMULATION_CHANGED_REGISTERS | MCUS_SIMULATION_CHANGED_OUTPUT_PORT |
+	                                MCUS_SIMULATION_CHANGED_ITERATION | MCUS_SIMULATION_CHANGED_CYCLES);
 
 	g_object_thaw_notify (obj);
 
 	/* Empty the stack after all the notifications, so that the signal handler for the resulting signal can read a consistent
 	 * state from the rest of the microcontroller */
-	free_stack (self);
+	empty_stack (self);
 }
 
 /* Reset the simulated microcontroller as if it was rebooted */
@@ -461,18 +1189,9 @@ mcus_simulation_reset (MCUSSimulation *self)
 	reset (self, TRUE);
 }
 
-static gboolean
-simulation_iterate_cb (MCUSSimulation *self)
-{
-	/* Remove the timeout event if we're not running */
-	if (self->priv->state != MCUS_SIMULATION_RUNNING)
-		return FALSE;
-
-	if (mcus_simulation_iterate (self, NULL) == FALSE)
-		return FALSE;
-
-	return TRUE;
-}
+static void start_pacing (MCUSSimulation *self);
+static gboolean stop_worker (MCUSSimulation *self);
+static void stop_pacing (MCUSSimulation *self);
 
 void
 mcus_simulation_start (MCUSSimulation *self)
@@ -482,455 +1201,3165 @@ mcus_simulation_start (MCUSSimulation *self)
 	g_return_if_fail (MCUS_IS_SIMULATION (self));
 	g_return_if_fail (priv->state == MCUS_SIMULATION_STOPPED);
 
-	/* Reset the microcontroller state */
+	/* Reset the microcontroller state and decode the program */
 	reset (self, FALSE);
+	decode_memory (self);
 
 	priv->state = MCUS_SIMULATION_RUNNING;
 	g_object_notify (G_OBJECT (self), "state");
 
-	/* Add the timeout for the simulation iterations */
-	priv->iteration_event = g_timeout_add (1000 / priv->clock_speed, (GSourceFunc) simulation_iterate_cb, self);
+	/* Start executing instructions in real time */
+	start_pacing (self);
 }
 
-/* Returns FALSE on error or if the simulation's ended */
-gboolean
-mcus_simulation_iterate (MCUSSimulation *self, GError **error)
+/* Sample the function generator at virtual time @cycles, if it's enabled. Returns TRUE if the analogue input changed. */
+static gboolean
+update_analogue_input (MCUSSimulationPrivate *priv, guint64 cycles)
 {
-	guchar opcode, operand1, operand2;
-	MCUSStackFrame *stack_frame;
-	MCUSSimulationState old_state;
-	MCUSSimulationPrivate *priv = self->priv;
+	gdouble t, analogue_input, sine;
 
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
-	g_return_val_if_fail (priv->state != MCUS_SIMULATION_STOPPED, FALSE);
+	if (priv->function_generator_enabled == FALSE)
+		return FALSE;
 
-	/* If iterate() is called while we're paused, we temporarily go to the running state */
-	old_state = priv->state;
-	if (old_state == MCUS_SIMULATION_PAUSED) {
-		priv->state = MCUS_SIMULATION_RUNNING;
-		g_object_notify (G_OBJECT (self), "state");
+	t = (gdouble) cycles / priv->clock_speed;
+
+	switch (priv->waveform) {
+	case MCUS_SIMULATION_WAVEFORM_SINE:
+		analogue_input = priv->waveform_amplitude * sin (2.0 * G_PI * priv->waveform_frequency * t + priv->waveform_phase) +
+		                 priv->waveform_offset;
+		break;
+	case MCUS_SIMULATION_WAVEFORM_SQUARE:
+		sine = sin (2.0 * G_PI * priv->waveform_frequency * t + priv->waveform_phase);
+		analogue_input = (sine > 0) ? 1.0 : (sine == 0) ? 0.0 : -1.0;
+		analogue_input = priv->waveform_amplitude * analogue_input + priv->waveform_offset;
+		break;
+	case MCUS_SIMULATION_WAVEFORM_TRIANGLE:
+		analogue_input = priv->waveform_amplitude * asin (sin (2.0 * G_PI * priv->waveform_frequency * t + priv->waveform_phase)) +
+		                 priv->waveform_offset;
+		break;
+	case MCUS_SIMULATION_WAVEFORM_SAWTOOTH:
+		t *= priv->waveform_frequency;
+		analogue_input = priv->waveform_amplitude * 2.0 * (t - floor (t + 0.5)) + priv->waveform_offset;
+		break;
+	case MCUS_SIMULATION_WAVEFORM_CONSTANT:
+	default:
+		analogue_input = priv->waveform_offset;
+		break;
 	}
 
-	/* Can't check it with >= as it does a check against guchar, which
-	 * is always true due to the datatype's range. */
-	if (priv->program_counter + 1 > MEMORY_SIZE) {
-		GError *real_error = g_error_new (MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_MEMORY_OVERFLOW,
-		                                  _("The program counter overflowed available memory in simulation iteration %u."),
-		                                  priv->iteration);
-		g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, real_error);
-		g_propagate_error (error, real_error);
+	/* Clamp the value to the range of the ADC */
+	analogue_input = CLAMP (analogue_input, 0.0, ANALOGUE_INPUT_MAX_VOLTAGE);
 
-		mcus_simulation_finish (self);
+	if (analogue_input == priv->analogue_input)
 		return FALSE;
-	}
 
-	/* Signal the start of the iteration */
-	g_signal_emit (self, signals[SIGNAL_ITERATION_STARTED], 0);
+	priv->analogue_input = analogue_input;
 
-	/* Fetch and decode the instruction */
-	opcode = priv->memory[priv->program_counter];
-	operand1 = (priv->program_counter + 1 < MEMORY_SIZE) ? priv->memory[priv->program_counter + 1] : 0;
-	operand2 = (priv->program_counter + 2 < MEMORY_SIZE) ? priv->memory[priv->program_counter + 2] : 0;
+	return TRUE;
+}
 
-	g_object_freeze_notify (G_OBJECT (self));
+/* The number of cycles taken by a call to the built-in wait1ms subroutine: a millisecond at the current clock speed, but no less than the call
+ * itself takes */
+static inline guint64
+wait_1ms_cycles (MCUSSimulationPrivate *priv)
+{
+	return MAX ((priv->clock_speed + 999) / 1000, mcus_instruction_data[OPCODE_RCALL].cycles);
+}
 
-	switch (opcode) {
-	case OPCODE_HALT:
-		g_object_thaw_notify (G_OBJECT (self));
-		g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, NULL);
+/* The length of the window over which the output port is averaged, in cycles at the current clock speed */
+static inline guint64
+output_window_length (MCUSSimulationPrivate *priv)
+{
+	return MAX ((guint64) priv->clock_speed * PERSISTENCE_OF_VISION / 1000, 1);
+}
 
-		mcus_simulation_finish (self);
+/* Start the output history afresh at the current time, as if the output port had held its current value for the whole of the previous window */
+static void
+reset_output_history (MCUSSimulationPrivate *priv)
+{
+	OutputHistory *history = &(priv->output_history);
+
+	memset (history, 0, sizeof (OutputHistory));
+	history->window_start = history->last_change = priv->cycles;
+	history->window_length = output_window_length (priv);
+	history->previous_window_length = history->window_length;
+	history->previous_cycles[priv->output_port] = history->previous_window_length;
+}
+
+/* Account for the output port having held its current value from the last change up to virtual time @cycles, rolling the history over into
+ * new windows as necessary */
+static void
+account_output_port (MCUSSimulationPrivate *priv, guint64 cycles)
+{
+	OutputHistory *history = &(priv->output_history);
+
+	if (cycles <= history->last_change)
+		return;
+
+	while (cycles - history->window_start >= history->window_length) {
+		guint64 window_end = history->window_start + history->window_length;
+
+		history->cycles[priv->output_port] += window_end - history->last_change;
+
+		memcpy (history->previous_cycles, history->cycles, sizeof (history->cycles));
+		memset (history->cycles, 0, sizeof (history->cycles));
+		history->previous_window_length = history->window_length;
+		history->window_start = history->last_change = window_end;
+		history->window_length = output_window_length (priv);
+
+		/* Skip straight to the last whole window if the output port's been held for several; the one before it is all the same */
+		if (cycles - window_end >= 2 * history->window_length) {
+			history->window_start += ((cycles - window_end) / history->window_length - 1) * history->window_length;
+			history->last_change = history->window_start;
+		}
+	}
+
+	history->cycles[priv->output_port] += cycles - history->last_change;
+	history->last_change = cycles;
+}
+
+/* Write @value to the output port at virtual time @cycles (the start of the instruction writing it). Returns TRUE if the value changed. */
+static inline gboolean
+write_output_port (MCUSSimulationPrivate *priv, guchar value, guint64 cycles)
+{
+	if (value == priv->output_port)
 		return FALSE;
-	case OPCODE_MOVI:
-		priv->registers[operand1] = operand2;
-		g_object_notify (G_OBJECT (self), "registers");
+
+	account_output_port (priv, cycles);
+	priv->output_port = value;
+
+	return TRUE;
+}
+
+typedef enum {
+	EXECUTE_CONTINUE,
+	EXECUTE_HALT,
+	EXECUTE_ERROR
+} ExecuteResult;
+
+/* Execute a single decoded instruction against the simulated hardware, updating the program counter. No signals are emitted and no properties
+ * are notified; that's left to the callers. The instruction's own cycles are also left to the callers to add to priv->cycles, but any extra
+ * cycles spent waiting in wait1ms are added here. On EXECUTE_ERROR, @error is set; on EXECUTE_HALT, the program counter is left pointing at the
+ * HALT instruction. */
+static inline ExecuteResult
+execute (MCUSSimulationPrivate *priv, const DecodedInstruction *instruction, GError **error)
+{
+	MCUSStackFrame *stack_frame;
+
+	switch (instruction->operation) {
+	case DECODED_HALT:
+		return EXECUTE_HALT;
+	case DECODED_MOVI:
+		priv->registers[instruction->operand1] = instruction->operand2;
 		break;
-	case OPCODE_MOV:
-		priv->registers[operand1] = priv->registers[operand2];
-		g_object_notify (G_OBJECT (self), "registers");
+	case DECODED_MOV:
+		priv->registers[instruction->operand1] = priv->registers[instruction->operand2];
 		break;
-	case OPCODE_ADD:
-		priv->registers[operand1] += priv->registers[operand2];
-		priv->zero_flag = (priv->registers[operand1] == 0) ? TRUE : FALSE;
-		g_object_notify (G_OBJECT (self), "zero-flag");
-		g_object_notify (G_OBJECT (self), "registers");
+	case DECODED_ADD:
+		priv->registers[instruction->operand1] += priv->registers[instruction->operand2];
+		priv->zero_flag = (priv->registers[instruction->operand1] == 0) ? TRUE : FALSE;
 		break;
-	case OPCODE_SUB:
-		priv->registers[operand1] -= priv->registers[operand2];
-		priv->zero_flag = (priv->registers[operand1] == 0) ? TRUE : FALSE;
-		g_object_notify (G_OBJECT (self), "zero-flag");
-		g_object_notify (G_OBJECT (self), "registers");
+	case DECODED_SUB:
+		priv->registers[instruction->operand1] -= priv->registers[instruction->operand2];
+		priv->zero_flag = (priv->registers[instruction->operand1] == 0) ? TRUE : FALSE;
 		break;
-	case OPCODE_AND:
-		priv->registers[operand1] &= priv->registers[operand2];
-		priv->zero_flag = (priv->registers[operand1] == 0) ? TRUE : FALSE;
-		g_object_notify (G_OBJECT (self), "zero-flag");
-		g_object_notify (G_OBJECT (self), "registers");
+	case DECODED_AND:
+		priv->registers[instruction->operand1] &= priv->registers[instruction->operand2];
+		priv->zero_flag = (priv->registers[instruction->operand1] == 0) ? TRUE : FALSE;
 		break;
-	case OPCODE_EOR:
-		priv->registers[operand1] ^= priv->registers[operand2];
-		priv->zero_flag = (priv->registers[operand1] == 0) ? TRUE : FALSE;
-		g_object_notify (G_OBJECT (self), "zero-flag");
-		g_object_notify (G_OBJECT (self), "registers");
+	case DECODED_EOR:
+		priv->registers[instruction->operand1] ^= priv->registers[instruction->operand2];
+		priv->zero_flag = (priv->registers[instruction->operand1] == 0) ? TRUE : FALSE;
 		break;
-	case OPCODE_INC:
-		priv->registers[operand1] += 1;
-		priv->zero_flag = (priv->registers[operand1] == 0) ? TRUE : FALSE;
-		g_object_notify (G_OBJECT (self), "zero-flag");
-		g_object_notify (G_OBJECT (self), "registers");
+	case DECODED_INC:
+		priv->registers[instruction->operand1] += 1;
+		priv->zero_flag = (priv->registers[instruction->operand1] == 0) ? TRUE : FALSE;
 		break;
-	case OPCODE_DEC:
-		priv->registers[operand1] -= 1;
-		priv->zero_flag = (priv->registers[operand1] == 0) ? TRUE : FALSE;
-		g_object_notify (G_OBJECT (self), "zero-flag");
-		g_object_notify (G_OBJECT (self), "registers");
+	case DECODED_DEC:
+		priv->registers[instruction->operand1] -= 1;
+		priv->zero_flag = (priv->registers[instruction->operand1] == 0) ? TRUE : FALSE;
 		break;
-	case OPCODE_IN:
-		priv->registers[operand1] = priv->input_port; /* only one operand is stored */
-		g_object_notify (G_OBJECT (self), "registers");
+	case DECODED_IN:
+		priv->registers[instruction->operand1] = priv->input_port; /* only one operand is stored */
 		break;
-	case OPCODE_OUT:
-		priv->output_port = priv->registers[operand1]; /* only one operand is stored */
-		g_object_notify (G_OBJECT (self), "output-port");
+	case DECODED_OUT:
+		write_output_port (priv, priv->registers[instruction->operand1], priv->cycles); /* only one operand is stored */
 		break;
-	case OPCODE_JP:
-		priv->program_counter = operand1;
-		g_object_notify (G_OBJECT (self), "program-counter");
-		goto update_and_exit;
-	case OPCODE_JZ:
+	case DECODED_JP:
+		priv->program_counter = instruction->operand1;
+		return EXECUTE_CONTINUE;
+	case DECODED_JZ:
 		if (priv->zero_flag == TRUE) {
-			priv->program_counter = operand1;
-			g_object_notify (G_OBJECT (self), "program-counter");
-			goto update_and_exit;
+			priv->program_counter = instruction->operand1;
+			return EXECUTE_CONTINUE;
 		}
 		break;
-	case OPCODE_JNZ:
+	case DECODED_JNZ:
 		if (priv->zero_flag == FALSE) {
-			priv->program_counter = operand1;
-			g_object_notify (G_OBJECT (self), "program-counter");
-			goto update_and_exit;
+			priv->program_counter = instruction->operand1;
+			return EXECUTE_CONTINUE;
+		}
+		break;
+	case DECODED_READTABLE:
+		priv->registers[0] = priv->lookup_table[priv->registers[7]];
+		break;
+	case DECODED_WAIT1MS:
+		/* Time passes virtually, rather than blocking the host */
+		priv->cycles += wait_1ms_cycles (priv) - instruction->cycles;
+		break;
+	case DECODED_READADC:
+		update_analogue_input (priv, priv->cycles);
+		priv->registers[0] = 255.0 * priv->analogue_input / ANALOGUE_INPUT_MAX_VOLTAGE;
+		break;
+	case DECODED_RCALL:
+		/* Check for overflows */
+		if (priv->stack_depth >= priv->max_stack_depth) {
+			g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_STACK_OVERFLOW,
+			             _("The stack pointer overflowed available stack space in simulation iteration %" G_GUINT64_FORMAT "."),
+			             priv->iteration);
+			return EXECUTE_ERROR;
+		}
+
+		/* If we're just calling a normal subroutine, push the
+		 * current state as a new frame onto the stack */
+		stack_frame = &(priv->stack[priv->stack_depth++]);
+		stack_frame->program_counter = instruction->next_program_counter;
+		memcpy (stack_frame->registers, priv->registers, sizeof (guchar) * REGISTER_COUNT);
+
+		/* Jump to the subroutine */
+		priv->program_counter = instruction->operand1;
+		return EXECUTE_CONTINUE;
+	case DECODED_RET:
+		/* Check for underflows */
+		if (priv->stack_depth == 0) {
+			g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_STACK_UNDERFLOW,
+			             _("The stack pointer underflowed available stack space in simulation iteration %" G_GUINT64_FORMAT "."),
+			             priv->iteration);
+			return EXECUTE_ERROR;
+		}
+
+		/* Pop the old state off the stack */
+		stack_frame = &(priv->stack[--priv->stack_depth]);
+		priv->program_counter = stack_frame->program_counter;
+		memcpy (priv->registers, stack_frame->registers, sizeof (guchar) * REGISTER_COUNT);
+
+		return EXECUTE_CONTINUE;
+	case DECODED_SHL:
+		priv->registers[instruction->operand1] <<= 1;
+		priv->zero_flag = (priv->registers[instruction->operand1] == 0) ? TRUE : FALSE;
+		break;
+	case DECODED_SHR:
+		priv->registers[instruction->operand1] >>= 1;
+		priv->zero_flag = (priv->registers[instruction->operand1] == 0) ? TRUE : FALSE;
+		break;
+	case DECODED_INVALID_REGISTER:
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_REGISTER,
+		             _("An invalid register \"%02X\" was used at address %02X in simulation iteration %" G_GUINT64_FORMAT "."),
+		             (guint) ((instruction->operand1 >= REGISTER_COUNT) ? instruction->operand1 : instruction->operand2),
+		             (guint) priv->program_counter,
+		             priv->iteration);
+		return EXECUTE_ERROR;
+	case DECODED_INVALID:
+	default:
+		/* We've encountered some data? */
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_OPCODE,
+		             _("An invalid opcode \"%02X\" was encountered at address %02X in simulation iteration %" G_GUINT64_FORMAT "."),
+		             (guint) instruction->opcode,
+		             (guint) priv->program_counter,
+		             priv->iteration);
+		return EXECUTE_ERROR;
+	}
+
+	/* Don't forget to increment the PC */
+	priv->program_counter = instruction->next_program_counter;
+
+	return EXECUTE_CONTINUE;
+}
+
+/* Execute a fused sequence of instructions, as found by fuse_memory(). The architectural result (including the zero flag) is identical to that
+ * of executing the instructions individually; none of them can fail. */
+static inline void
+execute_fused (MCUSSimulationPrivate *priv, const FusedInstruction *fused)
+{
+	const DecodedInstruction *first, *second, *third, *fourth;
+	guchar *registers = priv->registers;
+
+	first = &(priv->decoded[priv->program_counter]);
+	second = &(priv->decoded[first->next_program_counter]);
+
+	switch (fused->operation) {
+	case FUSED_DEC_JNZ:
+		registers[first->operand1] -= 1;
+		priv->zero_flag = (registers[first->operand1] == 0) ? TRUE : FALSE;
+		priv->program_counter = (priv->zero_flag == FALSE) ? second->operand1 : second->next_program_counter;
+		break;
+	case FUSED_MOV_EOR_OUT:
+		third = &(priv->decoded[second->next_program_counter]);
+
+		registers[first->operand1] = registers[first->operand2];
+		registers[second->operand1] ^= registers[second->operand2];
+		priv->zero_flag = (registers[second->operand1] == 0) ? TRUE : FALSE;
+		write_output_port (priv, registers[third->operand1], priv->cycles + first->cycles + second->cycles);
+		priv->program_counter = third->next_program_counter;
+		break;
+	case FUSED_MOV_EOR_OUT_ADD:
+		third = &(priv->decoded[second->next_program_counter]);
+		fourth = &(priv->decoded[third->next_program_counter]);
+
+		registers[first->operand1] = registers[first->operand2];
+		registers[second->operand1] ^= registers[second->operand2];
+		write_output_port (priv, registers[third->operand1], priv->cycles + first->cycles + second->cycles);
+		registers[fourth->operand1] += registers[fourth->operand2];
+		priv->zero_flag = (registers[fourth->operand1] == 0) ? TRUE : FALSE;
+		priv->program_counter = fourth->next_program_counter;
+		break;
+	case FUSED_NONE:
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+/* Execute as many whole passes of the counted loop at the program counter as are left, or as fit in @max_instructions. The architectural
+ * result is identical to that of executing the instructions individually. Returns the number of passes executed, which is 0 if not even one
+ * pass fits. */
+static inline guint
+execute_counted_loop (MCUSSimulationPrivate *priv, const CountedLoop *loop, guint64 max_instructions)
+{
+	guint passes, executed_passes, i;
+
+	passes = (priv->registers[loop->counter] == 0) ? 256 : priv->registers[loop->counter];
+	executed_passes = MIN (passes, max_instructions / loop->pass_length);
+
+	if (executed_passes == 0)
+		return 0;
+
+	for (i = 0; i < REGISTER_COUNT; i++) {
+		if ((loop->effect_mask & (1 << i)) != 0)
+			priv->registers[i] = loop->effect_values[i];
+	}
+
+	priv->registers[loop->counter] -= executed_passes;
+
+	/* The last instruction executed was the JNZ, with the zero flag set by the DEC before it */
+	if (executed_passes == passes) {
+		priv->zero_flag = TRUE;
+		priv->program_counter = loop->exit_address;
+	} else {
+		priv->zero_flag = FALSE;
+	}
+
+	return executed_passes;
+}
+
+/* Materialise a lazily-evaluated zero flag from the register which was last written by a flag-producing instruction */
+#define MATERIALISE_ZERO_FLAG() G_STMT_START { \
+	if (flag_register >= 0) { \
+		priv->zero_flag = (registers[flag_register] == 0) ? TRUE : FALSE; \
+		flag_register = -1; \
+	} \
+} G_STMT_END
+
+/* Execute the basic block of @length instructions at the program counter, as found by find_basic_blocks(). As with execute(), only the extra
+ * cycles spent waiting in wait1ms are added to priv->cycles. Rather than computing the zero
+ * flag after every arithmetic instruction, only the register it would be computed from is recorded, and the flag is materialised when it's
+ * read by a conditional jump, when that register is overwritten by an instruction which doesn't set the flag, or at the end of the block.
+ * The architectural result is identical to that of executing the instructions individually. Returns TRUE if the output port was written
+ * with a different value. */
+static inline gboolean
+execute_basic_block (MCUSSimulationPrivate *priv, guint length)
+{
+	guchar *registers = priv->registers;
+	guchar program_counter = priv->program_counter;
+	gint flag_register = -1;
+	gboolean output_changed = FALSE;
+	guint offset = 0; /* cycles into the block, other than by waiting in wait1ms (which are added to priv->cycles as they happen) */
+
+	for (; length > 0; length--) {
+		const DecodedInstruction *instruction = &(priv->decoded[program_counter]);
+		guchar d = instruction->operand1;
+		guint64 cycles = priv->cycles + offset;
+
+		offset += instruction->cycles;
+
+		switch (instruction->operation) {
+		case DECODED_MOVI:
+			if (flag_register == d)
+				MATERIALISE_ZERO_FLAG ();
+			registers[d] = instruction->operand2;
+			break;
+		case DECODED_MOV:
+			if (flag_register == d)
+				MATERIALISE_ZERO_FLAG ();
+			registers[d] = registers[instruction->operand2];
+			break;
+		case DECODED_ADD:
+			registers[d] += registers[instruction->operand2];
+			flag_register = d;
+			break;
+		case DECODED_SUB:
+			registers[d] -= registers[instruction->operand2];
+			flag_register = d;
+			break;
+		case DECODED_AND:
+			registers[d] &= registers[instruction->operand2];
+			flag_register = d;
+			break;
+		case DECODED_EOR:
+			registers[d] ^= registers[instruction->operand2];
+			flag_register = d;
+			break;
+		case DECODED_INC:
+			registers[d] += 1;
+			flag_register = d;
+			break;
+		case DECODED_DEC:
+			registers[d] -= 1;
+			flag_register = d;
+			break;
+		case DECODED_SHL:
+			registers[d] <<= 1;
+			flag_register = d;
+			break;
+		case DECODED_SHR:
+			registers[d] >>= 1;
+			flag_register = d;
+			break;
+		case DECODED_OUT:
+			if (write_output_port (priv, registers[d], cycles) == TRUE)
+				output_changed = TRUE;
+			break;
+		case DECODED_READTABLE:
+			if (flag_register == 0)
+				MATERIALISE_ZERO_FLAG ();
+			registers[0] = priv->lookup_table[registers[7]];
+			break;
+		case DECODED_WAIT1MS:
+			priv->cycles += wait_1ms_cycles (priv) - instruction->cycles;
+			break;
+		case DECODED_JP:
+			program_counter = d;
+			continue;
+		case DECODED_JZ:
+			MATERIALISE_ZERO_FLAG ();
+			program_counter = (priv->zero_flag == TRUE) ? d : instruction->next_program_counter;
+			continue;
+		case DECODED_JNZ:
+			MATERIALISE_ZERO_FLAG ();
+			program_counter = (priv->zero_flag == FALSE) ? d : instruction->next_program_counter;
+			continue;
+		default:
+			g_assert_not_reached ();
 		}
+
+		program_counter = instruction->next_program_counter;
+	}
+
+	MATERIALISE_ZERO_FLAG ();
+	priv->program_counter = program_counter;
+
+	return output_changed;
+}
+
+#undef MATERIALISE_ZERO_FLAG
+
+/* Copy the parts of the state which are journalled; the stack is shared, rather than copied */
+static inline void
+get_journal_state (MCUSSimulationPrivate *priv, MCUSJournalState *state)
+{
+	state->program_counter = priv->program_counter;
+	state->zero_flag = priv->zero_flag;
+	memcpy (state->registers, priv->registers, sizeof (guchar) * REGISTER_COUNT);
+	state->output_port = priv->output_port;
+	state->iteration = priv->iteration;
+	state->cycles = priv->cycles;
+	state->stack_depth = priv->stack_depth;
+	state->stack = priv->stack;
+}
+
+static inline void
+set_journal_state (MCUSSimulationPrivate *priv, const MCUSJournalState *state)
+{
+	priv->program_counter = state->program_counter;
+	priv->zero_flag = state->zero_flag;
+	memcpy (priv->registers, state->registers, sizeof (guchar) * REGISTER_COUNT);
+	priv->output_port = state->output_port;
+	priv->iteration = state->iteration;
+	priv->cycles = state->cycles;
+	priv->stack_depth = state->stack_depth;
+}
+
+/* Returns FALSE on error or if the simulation's ended */
+gboolean
+mcus_simulation_iterate (MCUSSimulation *self, GError **error)
+{
+	const DecodedInstruction *instruction;
+	MCUSSimulationState old_state;
+	MCUSSimulationChangeSet change_set;
+	MCUSJournalState journal_before, journal_after;
+	GError *child_error = NULL;
+	gboolean restart_worker;
+	MCUSSimulationPrivate *priv = self->priv;
+
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	g_return_val_if_fail (priv->state != MCUS_SIMULATION_STOPPED, FALSE);
+
+	/* Take the state back from the worker thread, if it's running; see mcus_simulation_run() */
+	restart_worker = stop_worker (self);
+	if (priv->state == MCUS_SIMULATION_STOPPED)
+		return FALSE;
+
+	/* If iterate() is called while we're paused, we temporarily go to the running state */
+	old_state = priv->state;
+	if (old_state == MCUS_SIMULATION_PAUSED) {
+		priv->state = MCUS_SIMULATION_RUNNING;
+		g_object_notify (G_OBJECT (self), "state");
+	}
+
+	/* Can't check it with >= as it does a check against guchar, which
+	 * is always true due to the datatype's range. */
+	if (priv->program_counter + 1 > MEMORY_SIZE) {
+		GError *real_error = g_error_new (MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_MEMORY_OVERFLOW,
+		                                  _("The program counter overflowed available memory in simulation iteration %" G_GUINT64_FORMAT "."),
+		                                  priv->iteration);
+		g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, real_error);
+		g_propagate_error (error, real_error);
+
+		mcus_simulation_finish (self);
+		return FALSE;
+	}
+
+	/* Signal the start of the iteration, and sample the analogue input */
+	g_signal_emit (self, signals[SIGNAL_ITERATION_STARTED], 0);
+
+	if (update_analogue_input (priv, priv->cycles) == TRUE)
+		g_object_notify (G_OBJECT (self), "analogue-input");
+
+	/* The instruction was fetched and decoded when the memory was last changed */
+	instruction = &(priv->decoded[priv->program_counter]);
+
+	begin_changes (priv, &change_set);
+
+	if (priv->journal != NULL)
+		get_journal_state (priv, &journal_before);
+
+	switch (execute (priv, instruction, &child_error)) {
+	case EXECUTE_HALT:
+		g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, NULL);
+
+		mcus_simulation_finish (self);
+		return FALSE;
+	case EXECUTE_ERROR:
+		g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, child_error);
+		g_propagate_error (error, child_error);
+
+		mcus_simulation_finish (self);
+		return FALSE;
+	case EXECUTE_CONTINUE:
+	default:
 		break;
-	case OPCODE_RCALL:
-		/* Check for calling the built-in subroutines */
-		if (operand1 == priv->program_counter) {
-			/* readtable */
-			priv->registers[0] = priv->lookup_table[priv->registers[7]];
-			g_object_notify (G_OBJECT (self), "registers");
-			break;
-		} else if (operand1 == priv->program_counter + 1) {
-			/* wait1ms */
-			g_usleep (1000);
-			break;
-		} else if (operand1 == priv->program_counter + 2) {
-			/* readadc */
-			priv->registers[0] = 255.0 * priv->analogue_input / ANALOGUE_INPUT_MAX_VOLTAGE;
-			g_object_notify (G_OBJECT (self), "registers");
+	}
+
+	/* Signal that the stack's changed */
+	if (instruction->operation == DECODED_RCALL)
+		g_signal_emit (self, signals[SIGNAL_STACK_PUSHED], 0, mcus_simulation_get_stack_head (self));
+	else if (instruction->operation == DECODED_RET)
+		g_signal_emit (self, signals[SIGNAL_STACK_POPPED], 0, mcus_simulation_get_stack_head (self));
+
+	/* Reset the simulation state if we changed it to step forward */
+	if (old_state == MCUS_SIMULATION_PAUSED) {
+		priv->state = MCUS_SIMULATION_PAUSED;
+		g_object_notify (G_OBJECT (self), "state");
+	}
+
+	/* Announce the changes made by the iteration, and that we've finished it */
+	priv->iteration++;
+	priv->cycles += instruction->cycles;
+	priv->resume_address = priv->program_counter;
+	account_output_port (priv, priv->cycles);
+
+	if (priv->journal != NULL) {
+		get_journal_state (priv, &journal_after);
+		mcus_journal_record (priv->journal, &journal_before, &journal_after, priv->decoded);
+	}
+
+	end_changes (self, &change_set,
+	             (instruction->operation == DECODED_RCALL || instruction->operation == DECODED_RET) ? MCUS_SIMULATION_CHANGED_STACK : 0);
+	g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, NULL);
+
+	if (restart_worker == TRUE && priv->state == MCUS_SIMULATION_RUNNING)
+		start_pacing (self);
+
+	return TRUE;
+}
+
+/* Re-announce the whole stack, from the bottom frame upwards, after it's been modified without emitting per-frame signals */
+static void
+resynchronise_stack (MCUSSimulation *self)
+{
+	guint i;
+
+	g_signal_emit (self, signals[SIGNAL_STACK_EMPTIED], 0);
+
+	for (i = 0; i < self->priv->stack_depth; i++)
+		g_signal_emit (self, signals[SIGNAL_STACK_PUSHED], 0, &(self->priv->stack[i]));
+}
+
+/* Returns the JIT, having translated the current memory if necessary, or %NULL if the JIT isn't supported */
+static MCUSJit *
+ensure_jit (MCUSSimulationPrivate *priv)
+{
+	if (priv->jit == NULL) {
+		priv->jit = mcus_jit_new ();
+		if (priv->jit == NULL)
+			return NULL;
+	}
+
+	if (priv->jit_valid == FALSE) {
+		mcus_jit_translate (priv->jit, priv->decoded, priv->stops);
+		priv->jit_valid = TRUE;
+	}
+
+	return priv->jit;
+}
+
+/* Host interface for translated modules */
+typedef struct {
+	MCUSSimulationPrivate *priv;
+	MCUSNativeState *state;
+	gboolean output_changed;
+} NativeHost;
+
+static guchar
+native_read_input (NativeHost *host)
+{
+	return host->priv->input_port;
+}
+
+static void
+native_write_output (NativeHost *host, guchar value)
+{
+	/* As with native_read_adc(), the module's added the cycles it's taken so far to its state before calling this */
+	if (write_output_port (host->priv, value, host->priv->cycles + host->state->cycles) == TRUE)
+		host->output_changed = TRUE;
+}
+
+static guchar
+native_read_adc (NativeHost *host)
+{
+	/* The module only adds the cycles it's taken to the priv's count once it returns */
+	update_analogue_input (host->priv, host->priv->cycles + host->state->cycles);
+	return 255.0 * host->priv->analogue_input / ANALOGUE_INPUT_MAX_VOLTAGE;
+}
+
+static void
+native_wait_1ms (NativeHost *host)
+{
+	host->priv->cycles += wait_1ms_cycles (host->priv) - mcus_instruction_data[OPCODE_RCALL].cycles;
+}
+
+static gboolean
+has_breakpoints (MCUSSimulationPrivate *priv)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (priv->breakpoints); i++) {
+		if (priv->breakpoints[i] != 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static inline guint
+read_watched_location (MCUSSimulationPrivate *priv, const Watchpoint *watchpoint)
+{
+	switch (watchpoint->location) {
+	case WATCH_REGISTER:
+		return priv->registers[watchpoint->register_number];
+	case WATCH_ZERO_FLAG:
+		return (priv->zero_flag == TRUE) ? 1 : 0;
+	case WATCH_OUTPUT_PORT:
+		return priv->output_port;
+	case WATCH_STACK_DEPTH:
+		return priv->stack_depth;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+/* Compare the watched locations against their previous @values (updating @values to match), and return the ID of the first watchpoint which
+ * has triggered, or 0 */
+static guint
+check_watchpoints (MCUSSimulationPrivate *priv, guint *values)
+{
+	guint i, triggered = 0;
+
+	for (i = 0; i < priv->n_watchpoints; i++) {
+		const Watchpoint *watchpoint = &(priv->watchpoints[i]);
+		guint value = read_watched_location (priv, watchpoint);
+		gboolean satisfied;
+
+		if (value == values[i])
+			continue;
+		values[i] = value;
+
+		switch (watchpoint->comparison) {
+		case WATCH_ANY_CHANGE:
+			satisfied = TRUE;
+			break;
+		case WATCH_EQUAL:
+			satisfied = (value == watchpoint->operand);
+			break;
+		case WATCH_NOT_EQUAL:
+			satisfied = (value != watchpoint->operand);
 			break;
+		case WATCH_LESS:
+			satisfied = (value < watchpoint->operand);
+			break;
+		case WATCH_LESS_EQUAL:
+			satisfied = (value <= watchpoint->operand);
+			break;
+		case WATCH_GREATER:
+			satisfied = (value > watchpoint->operand);
+			break;
+		case WATCH_GREATER_EQUAL:
+			satisfied = (value >= watchpoint->operand);
+			break;
+		default:
+			g_assert_not_reached ();
 		}
 
-		/* If we're just calling a normal subroutine, push the
-		 * current state as a new frame onto the stack */
-		stack_frame = g_slice_new (MCUSStackFrame);
-		stack_frame->prev = priv->stack;
-		stack_frame->program_counter = priv->program_counter + mcus_instruction_data[opcode].size;
-		memcpy (stack_frame->registers, priv->registers, sizeof (guchar) * REGISTER_COUNT);
+		if (satisfied == TRUE && triggered == 0)
+			triggered = watchpoint->id;
+	}
+
+	return triggered;
+}
+
+/* Interpret up to @max_instructions instructions one at a time, with no checks between them: for runs with the interpreter engine which don't
+ * stop on anything other than the instruction limit, HALT or an error, and aren't recorded in the journal. Adds to @retired, and sets
+ * @output_changed and @stack_changed (but never clears them). */
+static MCUSSimulationStopReason
+interpret_instructions (MCUSSimulationPrivate *priv, guint64 max_instructions, guint64 *retired, gboolean *output_changed, gboolean *stack_changed,
+                        GError **error)
+{
+	while (*retired < max_instructions) {
+		const DecodedInstruction *instruction = &(priv->decoded[priv->program_counter]);
+		guchar old_output_port = priv->output_port;
+		ExecuteResult result;
+
+		result = execute (priv, instruction, error);
+
+		if (G_UNLIKELY (result != EXECUTE_CONTINUE))
+			return (result == EXECUTE_HALT) ? MCUS_SIMULATION_STOP_REASON_HALT : MCUS_SIMULATION_STOP_REASON_ERROR;
+
+		if (instruction->operation == DECODED_OUT && priv->output_port != old_output_port)
+			*output_changed = TRUE;
+		else if (instruction->operation == DECODED_RCALL || instruction->operation == DECODED_RET)
+			*stack_changed = TRUE;
+
+		(*retired)++;
+		priv->iteration++;
+		priv->cycles += instruction->cycles;
+	}
+
+	return MCUS_SIMULATION_STOP_REASON_LIMIT;
+}
+
+/* Execute up to @max_instructions instructions against @priv, as described for mcus_simulation_run(), filling in @summary. No signals are
+ * emitted and no properties are notified, and the simulation isn't finished on HALT or an error, so this can be used on the worker thread
+ * with its own copy of the state. On %MCUS_SIMULATION_STOP_REASON_ERROR, @error is set. */
+static void
+run_instructions (MCUSSimulationPrivate *priv, guint64 max_instructions, MCUSSimulationStopFlags stop_flags, MCUSSimulationRunSummary *summary,
+                  gboolean *stack_changed_out, GError **error)
+{
+	MCUSSimulationStopReason stop_reason = MCUS_SIMULATION_STOP_REASON_LIMIT;
+	guint64 retired, old_cycles;
+	gboolean output_changed = FALSE, stack_changed = FALSE;
+	gboolean stop_on_breakpoint, stop_on_input, stop_on_target, checking_stops, watching, recording, use_fast_paths, optimising, use_basic_blocks;
+	guint watched_values[MAX_WATCHPOINTS], watchpoint = 0;
+	MCUSJournalState journal_before, journal_after;
+	MCUSJit *jit = NULL;
+	MCUSNative *native = NULL;
+	MCUSNativeState native_state;
+	NativeHost native_host;
+	GError *child_error = NULL;
+
+	stop_on_breakpoint = ((stop_flags & MCUS_SIMULATION_STOP_ON_BREAKPOINT) && has_breakpoints (priv) == TRUE) ? TRUE : FALSE;
+	stop_on_input = (stop_flags & MCUS_SIMULATION_STOP_ON_INPUT) ? TRUE : FALSE;
+	stop_on_target = ((stop_flags & MCUS_SIMULATION_STOP_ON_TARGET) && priv->target_address >= 0) ? TRUE : FALSE;
+	watching = ((stop_flags & MCUS_SIMULATION_STOP_ON_WATCHPOINT) && priv->n_watchpoints > 0) ? TRUE : FALSE;
+
+	/* If there's nothing to stop on, the main loop below tests only this one flag for stops before each instruction. It still has to look
+	 * for a faster way of executing the instructions at each address, and for the watchpoints and journal, so the interpreter engine runs
+	 * without any of those in a loop of its own. */
+	checking_stops = (stop_on_breakpoint == TRUE || stop_on_input == TRUE || stop_on_target == TRUE) ? TRUE : FALSE;
+
+	recording = (priv->journal != NULL) ? TRUE : FALSE;
+
+	/* Watchpoints are checked, and the journal's written, after every instruction, so while either's needed, instructions have to be
+	 * interpreted one at a time */
+	use_fast_paths = (watching == FALSE && recording == FALSE) ? TRUE : FALSE;
+
+	/* The interpreter engine executes instructions strictly one at a time, so that the other engines, which also execute fused sequences as
+	 * single operations and fast-forward through counted loops, can be checked against it */
+	optimising = (use_fast_paths == TRUE && priv->engine != MCUS_SIMULATION_ENGINE_INTERPRETER) ? TRUE : FALSE;
+	use_basic_blocks = (use_fast_paths == TRUE && priv->engine == MCUS_SIMULATION_ENGINE_BASIC_BLOCK) ? TRUE : FALSE;
+
+	if (use_fast_paths == TRUE && priv->engine == MCUS_SIMULATION_ENGINE_JIT)
+		jit = ensure_jit (priv);
+
+	if (watching == TRUE) {
+		guint i;
+
+		for (i = 0; i < priv->n_watchpoints; i++)
+			watched_values[i] = read_watched_location (priv, &(priv->watchpoints[i]));
+	}
+
+	/* Translated modules know nothing of breakpoints or the run target, and read inputs themselves, so can only be used if none of them needs
+	 * checking */
+	if (priv->engine == MCUS_SIMULATION_ENGINE_NATIVE && priv->native_valid == TRUE && checking_stops == FALSE && use_fast_paths == TRUE) {
+		native = priv->native;
+
+		native_host.priv = priv;
+		native_host.state = &native_state;
+		native_host.output_changed = FALSE;
+
+		native_state.lookup_table = priv->lookup_table;
+		native_state.host_data = &native_host;
+		native_state.read_input = (guchar (*) (gpointer)) native_read_input;
+		native_state.write_output = (void (*) (gpointer, guchar)) native_write_output;
+		native_state.read_adc = (guchar (*) (gpointer)) native_read_adc;
+		native_state.wait_1ms = (void (*) (gpointer)) native_wait_1ms;
+	}
+
+	old_cycles = priv->cycles;
+
+	retired = 0;
+
+	if (checking_stops == FALSE && use_fast_paths == TRUE && optimising == FALSE)
+		stop_reason = interpret_instructions (priv, max_instructions, &retired, &output_changed, &stack_changed, &child_error);
+
+	while (stop_reason == MCUS_SIMULATION_STOP_REASON_LIMIT && retired < max_instructions) {
+		const DecodedInstruction *instruction = &(priv->decoded[priv->program_counter]);
+		const FusedInstruction *fused = &(priv->fused[priv->program_counter]);
+		ExecuteResult result;
+		guchar old_output_port;
+
+		/* The instruction the simulation last stopped at isn't checked again on resuming, or it would never get past it. Any other
+		 * instruction is, including the first of a run which carries on from where a batch ran out. */
+		if (G_UNLIKELY (checking_stops == TRUE) && (retired > 0 || priv->program_counter != priv->resume_address)) {
+			if (stop_on_breakpoint == TRUE && BREAKPOINT_IS_SET (priv, priv->program_counter)) {
+				stop_reason = MCUS_SIMULATION_STOP_REASON_BREAKPOINT;
+				break;
+			} else if (stop_on_target == TRUE && priv->program_counter == priv->target_address &&
+			           priv->stack_depth <= priv->target_stack_depth) {
+				stop_reason = MCUS_SIMULATION_STOP_REASON_TARGET;
+				break;
+			} else if (stop_on_input == TRUE &&
+			           (instruction->operation == DECODED_IN || instruction->operation == DECODED_READADC)) {
+				stop_reason = MCUS_SIMULATION_STOP_REASON_INPUT;
+				break;
+			}
+		}
+
+		/* Fast-forward through counted loops */
+		if (optimising == TRUE && priv->counted_loops[priv->program_counter].pass_length > 0) {
+			const CountedLoop *loop = &(priv->counted_loops[priv->program_counter]);
+			guint passes = execute_counted_loop (priv, loop, max_instructions - retired);
+
+			if (passes > 0) {
+				retired += passes * loop->pass_length;
+				priv->iteration += passes * loop->pass_length;
+				priv->cycles += passes * loop->pass_cycles;
+				continue;
+			}
+		}
+
+		/* Run translated code for as long as possible. It exits before any instruction with a breakpoint on it, or which reads an input
+		 * or touches the output port or stack, so the checks above and the interpreter below still apply to those. Everything it
+		 * translates takes a single cycle. */
+		if (jit != NULL && mcus_jit_is_translated (jit, priv->program_counter)) {
+			guint64 executed = mcus_jit_execute (jit, &(priv->program_counter), priv->registers, &(priv->zero_flag),
+			                                     max_instructions - retired);
+
+			retired += executed;
+			priv->iteration += executed;
+			priv->cycles += executed;
+			continue;
+		}
+
+		/* Similarly for a translated module, which returns to us before any untranslated instruction. It executes nothing if the budget
+		 * is too small for the whole of the basic block at the program counter, in which case it's executed by the interpreter. */
+		if (native != NULL && mcus_native_is_entry_point (native, priv->program_counter)) {
+			guint64 executed;
+
+			memcpy (native_state.registers, priv->registers, sizeof (guchar) * REGISTER_COUNT);
+			native_state.zero_flag = priv->zero_flag;
+			native_state.program_counter = priv->program_counter;
+			native_state.budget = max_instructions - retired;
+			native_state.cycles = 0;
+
+			executed = mcus_native_execute (native, &native_state);
+
+			memcpy (priv->registers, native_state.registers, sizeof (guchar) * REGISTER_COUNT);
+			priv->zero_flag = native_state.zero_flag;
+			priv->program_counter = native_state.program_counter;
+
+			if (executed > 0) {
+				retired += executed;
+				priv->iteration += executed;
+				priv->cycles += native_state.cycles;
+				continue;
+			}
+		}
+
+		/* Execute a whole basic block at once if it fits in what's left of the instruction budget. Blocks never contain breakpoints (other
+		 * than on their first instruction) or instructions which read inputs. */
+		if (use_basic_blocks == TRUE && priv->block_lengths[priv->program_counter] > 0 &&
+		    max_instructions - retired >= priv->block_lengths[priv->program_counter]) {
+			guint length = priv->block_lengths[priv->program_counter];
+			guint cycles = priv->block_cycles[priv->program_counter];
+
+			if (execute_basic_block (priv, length) == TRUE)
+				output_changed = TRUE;
+
+			retired += length;
+			priv->iteration += length;
+			priv->cycles += cycles;
+			continue;
+		}
+
+		old_output_port = priv->output_port;
+
+		/* Execute a whole fused sequence at once if it fits in what's left of the instruction budget. None of the fused sequences read
+		 * inputs or touch the stack, and they never contain breakpoints. */
+		if (optimising == TRUE && fused->operation != FUSED_NONE && max_instructions - retired >= fused->length) {
+			execute_fused (priv, fused);
+
+			if (priv->output_port != old_output_port)
+				output_changed = TRUE;
+
+			retired += fused->length;
+			priv->iteration += fused->length;
+			priv->cycles += fused->cycles;
+			continue;
+		}
+
+		if (G_UNLIKELY (recording == TRUE))
+			get_journal_state (priv, &journal_before);
+
+		result = execute (priv, instruction, &child_error);
+
+		if (G_UNLIKELY (result != EXECUTE_CONTINUE)) {
+			stop_reason = (result == EXECUTE_HALT) ? MCUS_SIMULATION_STOP_REASON_HALT : MCUS_SIMULATION_STOP_REASON_ERROR;
+			break;
+		}
+
+		if (instruction->operation == DECODED_OUT && priv->output_port != old_output_port)
+			output_changed = TRUE;
+		else if (instruction->operation == DECODED_RCALL || instruction->operation == DECODED_RET)
+			stack_changed = TRUE;
+
+		retired++;
+		priv->iteration++;
+		priv->cycles += instruction->cycles;
+
+		if (G_UNLIKELY (recording == TRUE)) {
+			get_journal_state (priv, &journal_after);
+			mcus_journal_record (priv->journal, &journal_before, &journal_after, priv->decoded);
+		}
+
+		/* Stop just after an instruction which triggered a watchpoint */
+		if (G_UNLIKELY (watching == TRUE) && (watchpoint = check_watchpoints (priv, watched_values)) != 0) {
+			stop_reason = MCUS_SIMULATION_STOP_REASON_WATCHPOINT;
+			break;
+		}
+	}
+
+	if (native != NULL && native_host.output_changed == TRUE)
+		output_changed = TRUE;
+
+	account_output_port (priv, priv->cycles);
+
+	/* Running out of instructions isn't a stop, so if the run got anywhere, the next one checks its first instruction */
+	if (stop_reason == MCUS_SIMULATION_STOP_REASON_BREAKPOINT || stop_reason == MCUS_SIMULATION_STOP_REASON_INPUT ||
+	    stop_reason == MCUS_SIMULATION_STOP_REASON_TARGET)
+		priv->resume_address = priv->program_counter;
+	else if (retired > 0)
+		priv->resume_address = -1;
+
+	summary->instructions_retired = retired;
+	summary->cycles_elapsed = priv->cycles - old_cycles;
+	summary->stop_reason = stop_reason;
+	summary->program_counter = priv->program_counter;
+	summary->output_changed = output_changed;
+	summary->watchpoint = watchpoint;
+	*stack_changed_out = stack_changed;
+
+	if (stop_reason == MCUS_SIMULATION_STOP_REASON_ERROR)
+		g_propagate_error (error, child_error);
+}
+
+/**
+ * mcus_simulation_run:
+ * @self: an #MCUSSimulation
+ * @max_instructions: the maximum number of instructions to execute
+ * @stop_flags: the conditions (other than the instruction limit, HALT and errors) under which to stop early
+ * @summary: return location for a summary of the run, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Executes up to @max_instructions instructions in a tight loop, without emitting the #MCUSSimulation::iteration-started or
+ * #MCUSSimulation::iteration-finished signals, or notifying of property changes, for each instruction. A single #MCUSSimulation::changed
+ * signal is emitted once the run has finished, and the stack signals are re-emitted for the whole stack if it was modified.
+ *
+ * Execution stops at the instruction limit, on a HALT instruction or an error (in both of which cases the simulation is finished), or,
+ * depending on @stop_flags, just before executing an instruction which has a breakpoint set on it (see mcus_simulation_set_breakpoint()),
+ * which reads an input (IN or readadc), or which is the run target (see mcus_simulation_set_run_target()). The breakpoint, input and target
+ * checks are only skipped for the first instruction of the run if the simulation previously stopped at it (on one of those checks, or by
+ * being paused, stepped, seeked or restored there), so that the run can be resumed from it; a run which carries on from one which reached
+ * @max_instructions checks its first instruction as normal.
+ * Also depending on @stop_flags, execution stops just after an instruction which triggers a watchpoint (see
+ * mcus_simulation_add_watchpoint()), whose ID is returned in @summary. If none of these checks are needed, none are made.
+ *
+ * HALT instructions are not counted as retired, matching #MCUSSimulation:iteration. The cycles taken by the retired instructions are added
+ * to #MCUSSimulation:cycles, and returned in @summary; calls to wait1ms take their millisecond in virtual time only, so don't block.
+ *
+ * Unless #MCUSSimulation:engine is the interpreter, pure counted loops (such as nested delay loops made of MOVI, DEC and JNZ instructions)
+ * are executed in constant time, rather than instruction by instruction, with the same effect on the registers, zero flag,
+ * #MCUSSimulation:iteration and #MCUSSimulation:cycles.
+ *
+ * The simulation must not be stopped. Its state is left untouched unless the run finishes the simulation.
+ *
+ * Return value: %TRUE on success (including on HALT), %FALSE if an error occurred
+ **/
+gboolean
+mcus_simulation_run (MCUSSimulation *self, guint64 max_instructions, MCUSSimulationStopFlags stop_flags, MCUSSimulationRunSummary *summary,
+                     GError **error)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	MCUSSimulationRunSummary run_summary;
+	MCUSSimulationChangeSet change_set;
+	gboolean stack_changed, restart_worker;
+	gdouble old_analogue_input;
+	GError *child_error = NULL;
+
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	g_return_val_if_fail (priv->state != MCUS_SIMULATION_STOPPED, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	/* The worker thread owns the state while it's running, so take it back for the duration of the run. If the program finished on the
+	 * worker thread in the meantime, there's nothing left to run. */
+	restart_worker = stop_worker (self);
+	if (priv->state == MCUS_SIMULATION_STOPPED) {
+		if (summary != NULL) {
+			summary->instructions_retired = 0;
+			summary->cycles_elapsed = 0;
+			summary->stop_reason = MCUS_SIMULATION_STOP_REASON_HALT;
+			summary->program_counter = priv->program_counter;
+			summary->output_changed = FALSE;
+			summary->watchpoint = 0;
+		}
+
+		return TRUE;
+	}
+
+	begin_changes (priv, &change_set);
+	old_analogue_input = priv->analogue_input;
+
+	run_instructions (priv, max_instructions, stop_flags, &run_summary, &stack_changed, &child_error);
+
+	/* Announce everything which changed during the run. The output port is forced as changed if it was written to with different values
+	 * during the run, even if it ended up back at its old value. */
+	if (stack_changed == TRUE)
+		resynchronise_stack (self);
+	if (priv->analogue_input != old_analogue_input)
+		g_object_notify (G_OBJECT (self), "analogue-input");
+	end_changes (self, &change_set, ((run_summary.output_changed == TRUE) ? MCUS_SIMULATION_CHANGED_OUTPUT_PORT : 0) |
+	                                ((stack_changed == TRUE) ? MCUS_SIMULATION_CHANGED_STACK : 0));
+
+	if (summary != NULL)
+		*summary = run_summary;
+
+	if (run_summary.stop_reason == MCUS_SIMULATION_STOP_REASON_HALT) {
+		mcus_simulation_finish (self);
+	} else if (run_summary.stop_reason == MCUS_SIMULATION_STOP_REASON_ERROR) {
+		g_propagate_error (error, child_error);
+		mcus_simulation_finish (self);
+		return FALSE;
+	} else if (restart_worker == TRUE) {
+		start_pacing (self);
+	}
+
+	return TRUE;
+}
+
+/* Pacing, shared between the main loop pacer and the worker thread. Cycles are owed at priv->clock_speed from priv->pacing_start_time. */
+
+static void
+reset_pacing (MCUSSimulationPrivate *priv)
+{
+	priv->pacing_start_time = g_get_monotonic_time ();
+	priv->pacing_cycles = 0;
+	priv->achieved_clock_speed_start_time = priv->pacing_start_time;
+	priv->achieved_clock_speed_cycles = 0;
+}
+
+/* Returns the number of cycles owed at monotonic time @now */
+static guint64
+get_owed_cycles (MCUSSimulationPrivate *priv, gint64 now)
+{
+	gdouble owed_total = floor ((gdouble) (now - priv->pacing_start_time) * priv->clock_speed / G_USEC_PER_SEC);
+
+	return (owed_total > priv->pacing_cycles) ? (guint64) owed_total - priv->pacing_cycles : 0;
+}
+
+/* Account for @cycles having elapsed in a batch */
+static inline void
+add_paced_cycles (MCUSSimulationPrivate *priv, guint64 cycles)
+{
+	priv->pacing_cycles += cycles;
+	priv->achieved_clock_speed_cycles += cycles;
+}
+
+/* Finish a batch, which left @owed cycles unexecuted. If the host couldn't keep up, the cycles which are still owed are dropped, rather than
+ * trying to catch up with them later. Returns TRUE if the achieved clock speed was updated. */
+static gboolean
+end_paced_batch (MCUSSimulationPrivate *priv, guint64 owed)
+{
+	gint64 now = g_get_monotonic_time ();
+
+	if (owed > 0) {
+		priv->pacing_start_time = now;
+		priv->pacing_cycles = 0;
+	}
+
+	if (now - priv->achieved_clock_speed_start_time < ACHIEVED_CLOCK_SPEED_WINDOW)
+		return FALSE;
+
+	priv->achieved_clock_speed = priv->achieved_clock_speed_cycles * (gdouble) G_USEC_PER_SEC / (now - priv->achieved_clock_speed_start_time);
+	priv->achieved_clock_speed_start_time = now;
+	priv->achieved_clock_speed_cycles = 0;
+
+	return TRUE;
+}
+
+/* Returns the number of microseconds until the next cycle is owed, but no fewer than PACING_INTERVAL */
+static gint64
+get_pacing_interval (MCUSSimulationPrivate *priv)
+{
+	gint64 next_due;
+
+	next_due = priv->pacing_start_time + (gint64) ceil ((priv->pacing_cycles + 1) * (gdouble) G_USEC_PER_SEC / priv->clock_speed);
+
+	return MAX (next_due - g_get_monotonic_time (), PACING_INTERVAL * 1000);
+}
+
+static void
+schedule_pacing (MCUSSimulation *self);
+
+/* Pause the running simulation after it's stopped at a breakpoint or watchpoint. Returns FALSE if it stopped for any other reason. */
+static gboolean
+pause_at_stop (MCUSSimulation *self, MCUSSimulationStopReason stop_reason)
+{
+	if (stop_reason != MCUS_SIMULATION_STOP_REASON_BREAKPOINT && stop_reason != MCUS_SIMULATION_STOP_REASON_WATCHPOINT)
+		return FALSE;
+
+	self->priv->state = MCUS_SIMULATION_PAUSED;
+	g_object_notify (G_OBJECT (self), "state");
+
+	return TRUE;
+}
+
+/* Wake up to execute the cycles owed since the pacer last woke. The number owed is worked out from the monotonic clock, so timer jitter and
+ * the time taken to execute the batches don't make the long-run clock speed drift. */
+static gboolean
+simulation_pace_cb (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	gint64 deadline;
+	guint64 owed, chunk;
+	GError *error = NULL;
+
+	priv->iteration_event = 0;
+
+	if (priv->state != MCUS_SIMULATION_RUNNING)
+		return FALSE;
+
+	/* Execute in chunks of about a millisecond of simulated time, so the batch can be cut short if it's taking too long. Every instruction
+	 * takes at least one cycle, so a chunk of instructions covers at least as many cycles; any overshoot (such as from a wait1ms) is made up
+	 * for by owing less on the next wake. */
+	deadline = g_get_monotonic_time () + priv->max_batch_time;
+	owed = get_owed_cycles (priv, g_get_monotonic_time ());
+	chunk = MAX (priv->clock_speed / 1000, 1);
+
+	while (owed > 0) {
+		MCUSSimulationRunSummary summary;
+
+		if (mcus_simulation_run (self, MIN (owed, chunk), REAL_TIME_STOP_FLAGS, &summary, &error) == FALSE) {
+			g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, error);
+			g_error_free (error);
+			return FALSE;
+		}
+
+		owed -= MIN (owed, summary.cycles_elapsed);
+		add_paced_cycles (priv, summary.cycles_elapsed);
+
+		if (pause_at_stop (self, summary.stop_reason) == TRUE)
+			return FALSE;
+
+		/* Stop if the program's halted, or the simulation was paused or restarted by a signal handler */
+		if (priv->state != MCUS_SIMULATION_RUNNING || priv->iteration_event != 0)
+			return FALSE;
+
+		if (g_get_monotonic_time () >= deadline)
+			break;
+	}
+
+	if (end_paced_batch (priv, owed) == TRUE)
+		g_object_notify (G_OBJECT (self), "achieved-clock-speed");
+
+	schedule_pacing (self);
+
+	return FALSE;
+}
+
+/* Schedule the pacer to wake when the next cycle is owed, but no more often than every PACING_INTERVAL */
+static void
+schedule_pacing (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+
+	priv->iteration_event = g_timeout_add ((get_pacing_interval (priv) + 999) / 1000, (GSourceFunc) simulation_pace_cb, self);
+}
+
+/* The worker thread. While the simulation's running with #MCUSSimulation:threaded set, instructions are executed on a thread of their own
+ * rather than in the main loop, so that the simulated clock doesn't stall while the UI redraws, and the UI doesn't stall while instructions are
+ * executed. The worker executes against its own copy of the private state, which nothing else touches until it's been joined again; the
+ * journal, JIT and native module it points to are handed over to it for as long as it runs.
+ *
+ * The worker publishes its state after every batch of instructions through a seqlock, which the main thread reads on a timer at frame rate and
+ * announces through the usual signals. Changes to the inputs made on the main thread are passed to the worker through a single-producer,
+ * single-consumer queue. Anything else which changes the state or configuration of the simulation stops the worker first, and restarts it
+ * afterwards. */
+
+/* The hardware state published by the worker */
+typedef struct {
+	guchar program_counter;
+	gboolean zero_flag;
+	guchar registers[REGISTER_COUNT];
+	guchar output_port;
+	OutputHistory output_history;
+	gdouble analogue_input;
+	guint64 iteration;
+	guint64 cycles;
+	gdouble achieved_clock_speed;
+	guint output_changes; /* number of batches which wrote a different value to the output port */
+	guint stack_changes; /* number of batches which modified the stack */
+	guint commands_run; /* number of commands from the main thread which had been run */
+	MCUSSimulationStopReason stop_reason; /* %MCUS_SIMULATION_STOP_REASON_LIMIT until the program halts, errors or stops at a breakpoint */
+	guint stack_depth;
+	MCUSStackFrame stack[STACK_SIZE];
+} WorkerSnapshot;
+
+typedef enum {
+	COMMAND_SET_INPUT_PORT,
+	COMMAND_SET_ANALOGUE_INPUT,
+	COMMAND_SET_FUNCTION_GENERATOR,
+	COMMAND_SET_MAX_BATCH_TIME
+} WorkerCommandType;
+
+typedef struct {
+	WorkerCommandType type;
+	guchar input_port;
+	gdouble analogue_input;
+	MCUSSimulationWaveform waveform;
+	gdouble frequency, amplitude, offset, phase;
+	gulong max_batch_time;
+} WorkerCommand;
+
+#define WORKER_COMMAND_QUEUE_SIZE 64 /* must be a power of two */
+
+struct _Worker {
+	GThread *thread;
+	MCUSSimulationPrivate *core;
+	GError *error;
+
+	/* Only used to sleep between batches, and to be woken early by commands or being stopped */
+	GMutex *mutex;
+	GCond *cond;
+	gboolean stop_requested;
+
+	/* Queue of commands from the main thread; command_tail is only written by the main thread, and command_head only by the worker. Both
+	 * increase indefinitely, and are reduced modulo the queue size to index it. */
+	WorkerCommand commands[WORKER_COMMAND_QUEUE_SIZE];
+	volatile gint command_head;
+	volatile gint command_tail;
+
+	/* State published by the worker. The sequence number is odd while the snapshot is being written. */
+	volatile gint sequence;
+	WorkerSnapshot snapshot;
+
+	/* Only used by the worker */
+	guint output_changes;
+	guint stack_changes;
+
+	/* Only used by the main thread: the last snapshot it read */
+	gint read_sequence;
+	guint read_output_changes;
+	guint read_stack_changes;
+};
+
+static void
+run_worker_commands (Worker *worker)
+{
+	MCUSSimulationPrivate *core = worker->core;
+	gint head = worker->command_head, tail = g_atomic_int_get (&(worker->command_tail));
+
+	for (; head != tail; head++) {
+		const WorkerCommand *command = &(worker->commands[(guint) head % WORKER_COMMAND_QUEUE_SIZE]);
+
+		switch (command->type) {
+		case COMMAND_SET_INPUT_PORT:
+			core->input_port = command->input_port;
+			break;
+		case COMMAND_SET_ANALOGUE_INPUT:
+			core->analogue_input = command->analogue_input;
+			core->function_generator_enabled = FALSE;
+			break;
+		case COMMAND_SET_FUNCTION_GENERATOR:
+			core->function_generator_enabled = TRUE;
+			core->waveform = command->waveform;
+			core->waveform_frequency = command->frequency;
+			core->waveform_amplitude = command->amplitude;
+			core->waveform_offset = command->offset;
+			core->waveform_phase = command->phase;
+			break;
+		case COMMAND_SET_MAX_BATCH_TIME:
+			core->max_batch_time = command->max_batch_time;
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+	}
+
+	g_atomic_int_set (&(worker->command_head), head);
+}
+
+static void
+publish_worker_snapshot (Worker *worker, MCUSSimulationStopReason stop_reason)
+{
+	MCUSSimulationPrivate *core = worker->core;
+	WorkerSnapshot *snapshot = &(worker->snapshot);
+
+	g_atomic_int_inc (&(worker->sequence));
+
+	snapshot->program_counter = core->program_counter;
+	snapshot->zero_flag = core->zero_flag;
+	memcpy (snapshot->registers, core->registers, sizeof (guchar) * REGISTER_COUNT);
+	snapshot->output_port = core->output_port;
+	snapshot->output_history = core->output_history;
+	snapshot->analogue_input = core->analogue_input;
+	snapshot->iteration = core->iteration;
+	snapshot->cycles = core->cycles;
+	snapshot->achieved_clock_speed = core->achieved_clock_speed;
+	snapshot->output_changes = worker->output_changes;
+	snapshot->stack_changes = worker->stack_changes;
+	snapshot->commands_run = worker->command_head;
+	snapshot->stop_reason = stop_reason;
+	snapshot->stack_depth = core->stack_depth;
+	memcpy (snapshot->stack, core->stack, sizeof (MCUSStackFrame) * core->stack_depth);
+
+	g_atomic_int_inc (&(worker->sequence));
+}
+
+/* Read the latest snapshot published by the worker into @snapshot. Returns FALSE if nothing's been published since it was last read. */
+static gboolean
+read_worker_snapshot (Worker *worker, WorkerSnapshot *snapshot)
+{
+	gint sequence;
+
+	do {
+		/* Wait for the worker to finish writing the snapshot if it's in the middle of it */
+		while ((sequence = g_atomic_int_get (&(worker->sequence))) % 2 != 0)
+			g_thread_yield ();
+
+		if (sequence == worker->read_sequence)
+			return FALSE;
+
+		memcpy (snapshot, &(worker->snapshot), sizeof (WorkerSnapshot));
+	} while (g_atomic_int_get (&(worker->sequence)) != sequence);
+
+	worker->read_sequence = sequence;
+
+	return TRUE;
+}
+
+/* Wait on @cond until it's signalled or the monotonic clock reaches @end_time (as returned by g_get_monotonic_time()). Returns FALSE once
+ * @end_time's passed. */
+static gboolean
+cond_wait_until (GCond *cond, GMutex *mutex, gint64 end_time)
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+	return g_cond_wait_until (cond, mutex, end_time);
+#else
+	GTimeVal wake_time;
+	gint64 remaining = end_time - g_get_monotonic_time ();
+
+	if (remaining <= 0)
+		return FALSE;
+
+	/* g_cond_timed_wait() only takes a wall-clock time, so wait for no more than PACING_INTERVAL at a time and then check the monotonic
+	 * clock again; that way, a step in the wall clock can at worst make a single wait wake early or late */
+	g_get_current_time (&wake_time);
+	g_time_val_add (&wake_time, MIN (remaining, PACING_INTERVAL * 1000));
+	g_cond_timed_wait (cond, mutex, &wake_time);
+
+	return TRUE;
+#endif
+}
+
+static gpointer
+worker_thread (Worker *worker)
+{
+	MCUSSimulationPrivate *core = worker->core;
+
+	reset_pacing (core);
+
+	while (TRUE) {
+		MCUSSimulationRunSummary summary;
+		gboolean stack_changed, stop_requested;
+		gint64 deadline;
+		guint64 owed, chunk;
+		gint64 wake_time;
+
+		run_worker_commands (worker);
+
+		/* Execute the cycles owed in chunks, exactly as simulation_pace_cb() does */
+		deadline = g_get_monotonic_time () + core->max_batch_time;
+		owed = get_owed_cycles (core, g_get_monotonic_time ());
+		chunk = MAX (core->clock_speed / 1000, 1);
+
+		while (owed > 0) {
+			run_instructions (core, MIN (owed, chunk), REAL_TIME_STOP_FLAGS, &summary, &stack_changed, &(worker->error));
+
+			owed -= MIN (owed, summary.cycles_elapsed);
+			add_paced_cycles (core, summary.cycles_elapsed);
+
+			if (summary.output_changed == TRUE)
+				worker->output_changes++;
+			if (stack_changed == TRUE)
+				worker->stack_changes++;
+
+			if (summary.stop_reason != MCUS_SIMULATION_STOP_REASON_LIMIT) {
+				publish_worker_snapshot (worker, summary.stop_reason);
+				return NULL;
+			}
+
+			if (g_get_monotonic_time () >= deadline)
+				break;
+		}
+
+		end_paced_batch (core, owed);
+		publish_worker_snapshot (worker, MCUS_SIMULATION_STOP_REASON_LIMIT);
+
+		/* Sleep until the next cycle's owed, or until there's a command to run or we're stopped. This is timed on the monotonic clock, as
+		 * the pacing is, so that changes to the system clock don't make the worker oversleep or spin. */
+		wake_time = g_get_monotonic_time () + get_pacing_interval (core);
+
+		g_mutex_lock (worker->mutex);
+		while (worker->stop_requested == FALSE &&
+		       g_atomic_int_get (&(worker->command_tail)) == worker->command_head &&
+		       cond_wait_until (worker->cond, worker->mutex, wake_time) == TRUE);
+		stop_requested = worker->stop_requested;
+		g_mutex_unlock (worker->mutex);
+
+		if (stop_requested == TRUE)
+			return NULL;
+	}
+}
+
+static void
+push_worker_command (Worker *worker, const WorkerCommand *command)
+{
+	gint tail = worker->command_tail;
+
+	/* Wait for the worker to make room if the queue's full; it empties it as soon as it's woken */
+	while ((guint) tail - (guint) g_atomic_int_get (&(worker->command_head)) >= WORKER_COMMAND_QUEUE_SIZE) {
+		g_mutex_lock (worker->mutex);
+		g_cond_signal (worker->cond);
+		g_mutex_unlock (worker->mutex);
+		g_thread_yield ();
+	}
+
+	worker->commands[(guint) tail % WORKER_COMMAND_QUEUE_SIZE] = *command;
+	g_atomic_int_set (&(worker->command_tail), tail + 1);
+
+	g_mutex_lock (worker->mutex);
+	g_cond_signal (worker->cond);
+	g_mutex_unlock (worker->mutex);
+}
+
+/* Copy a snapshot published by the worker into the simulation's state, and announce the changes */
+static void
+apply_worker_snapshot (MCUSSimulation *self, Worker *worker, const WorkerSnapshot *snapshot)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	MCUSSimulationChangeSet change_set;
+	gboolean output_changed, stack_changed;
+	gdouble old_analogue_input = priv->analogue_input;
+
+	output_changed = (snapshot->output_changes != worker->read_output_changes) ? TRUE : FALSE;
+	stack_changed = (snapshot->stack_changes != worker->read_stack_changes) ? TRUE : FALSE;
+	worker->read_output_changes = snapshot->output_changes;
+	worker->read_stack_changes = snapshot->stack_changes;
+
+	begin_changes (priv, &change_set);
+
+	priv->program_counter = snapshot->program_counter;
+	priv->zero_flag = snapshot->zero_flag;
+	memcpy (priv->registers, snapshot->registers, sizeof (guchar) * REGISTER_COUNT);
+	priv->output_port = snapshot->output_port;
+	priv->output_history = snapshot->output_history;
+	priv->iteration = snapshot->iteration;
+	priv->cycles = snapshot->cycles;
+	priv->stack_depth = snapshot->stack_depth;
+	memcpy (priv->stack, snapshot->stack, sizeof (MCUSStackFrame) * snapshot->stack_depth);
+
+	/* The analogue input's only taken from the worker once it's caught up with the commands we've sent it, so that it doesn't jump back to
+	 * an old value while it's being changed */
+	if (snapshot->commands_run == (guint) worker->command_tail)
+		priv->analogue_input = snapshot->analogue_input;
+
+	if (stack_changed == TRUE)
+		resynchronise_stack (self);
+	if (priv->analogue_input != old_analogue_input)
+		g_object_notify (G_OBJECT (self), "analogue-input");
+	end_changes (self, &change_set, ((output_changed == TRUE) ? MCUS_SIMULATION_CHANGED_OUTPUT_PORT : 0) |
+	                                ((stack_changed == TRUE) ? MCUS_SIMULATION_CHANGED_STACK : 0));
+
+	if (snapshot->achieved_clock_speed != priv->achieved_clock_speed) {
+		priv->achieved_clock_speed = snapshot->achieved_clock_speed;
+		g_object_notify (G_OBJECT (self), "achieved-clock-speed");
+	}
+}
+
+/* Stop and join the worker thread, if it's running, and take its final state. If the program had halted or errored on the worker, the
+ * simulation is finished; if it had stopped at a breakpoint or watchpoint, the simulation's paused. Returns TRUE if the worker was running
+ * and the simulation's still running, so the worker should be restarted (with start_pacing()) once the main thread's finished with the
+ * state. */
+static gboolean
+stop_worker (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	Worker *worker = priv->worker;
+	MCUSSimulationStopReason stop_reason;
+	GError *error;
+
+	if (worker == NULL)
+		return FALSE;
+
+	if (priv->frame_event != 0)
+		g_source_remove (priv->frame_event);
+	priv->frame_event = 0;
+
+	g_mutex_lock (worker->mutex);
+	worker->stop_requested = TRUE;
+	g_cond_signal (worker->cond);
+	g_mutex_unlock (worker->mutex);
+
+	g_thread_join (worker->thread);
+	priv->worker = NULL;
+
+	/* Run any commands the worker didn't get round to, so that its final state is up to date */
+	stop_reason = worker->snapshot.stop_reason;
+	run_worker_commands (worker);
+	publish_worker_snapshot (worker, stop_reason);
+	apply_worker_snapshot (self, worker, &(worker->snapshot));
+
+	/* Take back the journal, JIT and native module (see start_worker()); the worker may have created or retranslated the JIT */
+	priv->journal = worker->core->journal;
+	priv->jit = worker->core->jit;
+	priv->jit_valid = worker->core->jit_valid;
+	priv->native = worker->core->native;
+	priv->resume_address = worker->core->resume_address;
+
+	error = worker->error;
+
+	g_mutex_free (worker->mutex);
+	g_cond_free (worker->cond);
+	g_free (worker->core);
+	g_slice_free (Worker, worker);
+
+	if (stop_reason == MCUS_SIMULATION_STOP_REASON_LIMIT)
+		return TRUE;
+	else if (pause_at_stop (self, stop_reason) == TRUE)
+		return FALSE;
+
+	if (error != NULL) {
+		g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, error);
+		g_error_free (error);
+	}
+
+	mcus_simulation_finish (self);
+
+	return FALSE;
+}
+
+/* Read the worker's state at frame rate */
+static gboolean
+simulation_frame_cb (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	WorkerSnapshot snapshot;
+
+	if (read_worker_snapshot (priv->worker, &snapshot) == FALSE)
+		return TRUE;
+
+	/* If the program's halted, errored or stopped at a breakpoint, the worker's stopped, so join it and finish or pause the simulation */
+	if (snapshot.stop_reason != MCUS_SIMULATION_STOP_REASON_LIMIT) {
+		priv->frame_event = 0;
+		stop_worker (self);
+		return FALSE;
+	}
+
+	apply_worker_snapshot (self, priv->worker, &snapshot);
+
+	return TRUE;
+}
+
+static gboolean
+start_worker (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	Worker *worker;
+	GError *error = NULL;
+
+	worker = g_slice_new0 (Worker);
+	worker->core = g_memdup (priv, sizeof (MCUSSimulationPrivate));
+	worker->mutex = g_mutex_new ();
+
+	/* The copy shares the journal, JIT and native module with us, so hand them over to the worker until stop_worker() takes them back,
+	 * rather than leaving both threads able to touch them. Everything which uses them stops the worker first. */
+	priv->journal = NULL;
+	priv->jit = NULL;
+	priv->native = NULL;
+	worker->cond = g_cond_new ();
+
+	worker->thread = g_thread_create ((GThreadFunc) worker_thread, worker, TRUE, &error);
+
+	if (worker->thread == NULL) {
+		g_warning ("Error starting simulation thread: %s", error->message);
+		g_error_free (error);
+
+		priv->journal = worker->core->journal;
+		priv->jit = worker->core->jit;
+		priv->native = worker->core->native;
+
+		g_mutex_free (worker->mutex);
+		g_cond_free (worker->cond);
+		g_free (worker->core);
+		g_slice_free (Worker, worker);
+
+		return FALSE;
+	}
+
+	priv->worker = worker;
+	priv->frame_event = g_timeout_add (FRAME_INTERVAL, (GSourceFunc) simulation_frame_cb, self);
+
+	return TRUE;
+}
+
+/* Start (or restart) executing instructions in real time, on the worker thread if possible, or from the main loop otherwise */
+static void
+start_pacing (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+
+	if (priv->iteration_event != 0)
+		g_source_remove (priv->iteration_event);
+	priv->iteration_event = 0;
+
+	/* Stopping the worker may finish the simulation, if the program's halted in the meantime */
+	stop_worker (self);
+	if (priv->state != MCUS_SIMULATION_RUNNING)
+		return;
+
+	if (priv->threaded == TRUE && g_thread_supported () && start_worker (self) == TRUE)
+		return;
+
+	reset_pacing (priv);
+	schedule_pacing (self);
+}
+
+static void
+stop_pacing (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+
+	if (priv->iteration_event != 0)
+		g_source_remove (priv->iteration_event);
+	priv->iteration_event = 0;
+
+	stop_worker (self);
+
+	if (priv->achieved_clock_speed != 0.0) {
+		priv->achieved_clock_speed = 0.0;
+		g_object_notify (G_OBJECT (self), "achieved-clock-speed");
+	}
+}
+
+void
+mcus_simulation_pause (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (priv->state == MCUS_SIMULATION_RUNNING);
+
+	/* Stop executing instructions. If the program finished on the worker thread in the meantime, the simulation's been finished. */
+	stop_pacing (self);
+	if (priv->state == MCUS_SIMULATION_STOPPED)
+		return;
+
+	priv->resume_address = priv->program_counter;
+	priv->state = MCUS_SIMULATION_PAUSED;
+	g_object_notify (G_OBJECT (self), "state");
+}
+
+void
+mcus_simulation_resume (MCUSSimulation *self)
+{
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (self->priv->state == MCUS_SIMULATION_PAUSED);
+
+	self->priv->state = MCUS_SIMULATION_RUNNING;
+	g_object_notify (G_OBJECT (self), "state");
+
+	/* Resume executing instructions in real time, without trying to catch up with the time spent paused */
+	start_pacing (self);
+}
+
+void
+mcus_simulation_finish (MCUSSimulation *self)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (priv->state != MCUS_SIMULATION_STOPPED);
+
+	/* Stop executing instructions; this finishes the simulation itself if the program had already finished on the worker thread */
+	stop_pacing (self);
+	if (priv->state == MCUS_SIMULATION_STOPPED)
+		return;
+
+	/* Stop the simulation */
+	priv->state = MCUS_SIMULATION_STOPPED;
+	g_object_notify (G_OBJECT (self), "state");
+}
+
+/**
+ * mcus_simulation_get_memory:
+ * @self: an #MCUSSimulation
+ *
+ * Returns the block of memory which is used by the simulated microcontroller to store compiled programs. This memory is statically allocated,
+ * and should not be freed. It may, however, be modified by the caller, but mcus_simulation_notify_memory() must be called afterwards.
+ *
+ * Return value: the microcontroller's memory
+ **/
+guchar *
+mcus_simulation_get_memory (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
+	return self->priv->memory;
+}
+
+/**
+ * mcus_simulation_notify_memory:
+ * @self: an #MCUSSimulation
+ *
+ * This notifies the simulation that its program memory has been modified. This should be called and only be called after modifying the memory
+ * returned by mcus_simulation_get_memory().
+ **/
+void
+mcus_simulation_notify_memory (MCUSSimulation *self)
+{
+	gboolean restart_worker;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+
+	restart_worker = stop_worker (self);
+	decode_memory (self);
+	g_object_notify (G_OBJECT (self), "memory");
+
+	/* The journal can't undo instructions which are no longer in memory */
+	if (self->priv->journal != NULL)
+		mcus_journal_clear (self->priv->journal);
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
+}
+
+/**
+ * mcus_simulation_get_lookup_table:
+ * @self: an #MCUSSimulation
+ *
+ * Returns the block of memory which is used by the simulated microcontroller to store lookup tables. This memory is statically allocated,
+ * and should not be freed. It may, however, be modified by the caller, but mcus_simulation_notify_lookup_table() must be called afterwards.
+ *
+ * Return value: the microcontroller's lookup table memory
+ **/
+guchar *
+mcus_simulation_get_lookup_table (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
+	return self->priv->lookup_table;
+}
+
+/**
+ * mcus_simulation_notify_lookup_table:
+ * @self: an #MCUSSimulation
+ *
+ * This notifies the simulation that its lookup table memory has been modified. This should be called and only be called after modifying the memory
+ * returned by mcus_simulation_get_lookup_table().
+ **/
+void
+mcus_simulation_notify_lookup_table (MCUSSimulation *self)
+{
+	gboolean restart_worker;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+
+	/* The worker thread has its own copy of the lookup table */
+	restart_worker = stop_worker (self);
+	g_object_notify (G_OBJECT (self), "lookup-table");
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
+}
+
+guchar *
+mcus_simulation_get_registers (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
+	return self->priv->registers;
+}
+
+/**
+ * mcus_simulation_get_stack_head:
+ * @self: an #MCUSSimulation
+ *
+ * Returns the frame at the top of the stack, or %NULL if the stack is empty. The frame is owned by the simulation, and is only valid until
+ * the stack is next modified.
+ *
+ * Return value: the top stack frame, or %NULL
+ **/
+MCUSStackFrame *
+mcus_simulation_get_stack_head (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
+
+	if (self->priv->stack_depth == 0)
+		return NULL;
+	return &(self->priv->stack[self->priv->stack_depth - 1]);
+}
+
+/**
+ * mcus_simulation_get_stack_depth:
+ * @self: an #MCUSSimulation
+ *
+ * Returns the number of frames currently on the stack.
+ *
+ * Return value: the stack depth
+ **/
+guint
+mcus_simulation_get_stack_depth (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->stack_depth;
+}
+
+/**
+ * mcus_simulation_get_stack_frame:
+ * @self: an #MCUSSimulation
+ * @index: the index of the frame to return, where 0 is the bottom of the stack
+ *
+ * Returns the stack frame at @index, which must be less than the value returned by mcus_simulation_get_stack_depth(). The frame is owned by
+ * the simulation, and is only valid until the stack is next modified.
+ *
+ * Return value: the stack frame at @index
+ **/
+MCUSStackFrame *
+mcus_simulation_get_stack_frame (MCUSSimulation *self, guint index)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
+	g_return_val_if_fail (index < self->priv->stack_depth, NULL);
+
+	return &(self->priv->stack[index]);
+}
+
+guint64
+mcus_simulation_get_iteration (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->iteration;
+}
+
+/**
+ * mcus_simulation_get_cycles:
+ * @self: an #MCUSSimulation
+ *
+ * Returns the number of clock cycles which have elapsed in the simulation since it was last reset. See #MCUSSimulation:cycles.
+ *
+ * Return value: the simulation's virtual time, in clock cycles
+ **/
+guint64
+mcus_simulation_get_cycles (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->cycles;
+}
+
+guchar
+mcus_simulation_get_program_counter (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->program_counter;
+}
+
+gboolean
+mcus_simulation_get_zero_flag (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	return self->priv->zero_flag;
+}
+
+guchar
+mcus_simulation_get_output_port (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->output_port;
+}
+
+/**
+ * mcus_simulation_get_output_duty_cycles:
+ * @self: an #MCUSSimulation
+ * @duty_cycles: an array of %OUTPUT_PORT_VALUES elements to fill in
+ *
+ * Fills in @duty_cycles with the proportion of the last %PERSISTENCE_OF_VISION milliseconds of virtual time for which the output port held
+ * each of its values, indexed by value. The proportions add up to 1.0.
+ *
+ * They're measured from the cycles at which the output port was written, so outputs which are multiplexed faster than the interface is
+ * updated can be shown at the brightness they'd have on the real hardware.
+ **/
+void
+mcus_simulation_get_output_duty_cycles (MCUSSimulation *self, gdouble *duty_cycles)
+{
+	const OutputHistory *history;
+	gdouble previous_weight;
+	guint i;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (duty_cycles != NULL);
+
+	/* The sliding window covers the current window so far, and the rest of its length from the end of the previous window */
+	history = &(self->priv->output_history);
+	previous_weight = (gdouble) (history->window_length - (history->last_change - history->window_start)) / history->window_length;
+
+	for (i = 0; i < OUTPUT_PORT_VALUES; i++) {
+		duty_cycles[i] = previous_weight * history->previous_cycles[i] / history->previous_window_length +
+		                 (gdouble) history->cycles[i] / history->window_length;
+	}
+}
+
+/**
+ * mcus_simulation_get_output_bit_duty_cycles:
+ * @self: an #MCUSSimulation
+ * @duty_cycles: an array of 8 elements to fill in
+ *
+ * Fills in @duty_cycles with the proportion of the persistence-of-vision window for which each bit of the output port was set, indexed by
+ * bit, with bit 0 being the least significant. See mcus_simulation_get_output_duty_cycles().
+ **/
+void
+mcus_simulation_get_output_bit_duty_cycles (MCUSSimulation *self, gdouble *duty_cycles)
+{
+	gdouble value_duty_cycles[OUTPUT_PORT_VALUES];
+	guint i, value;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (duty_cycles != NULL);
+
+	mcus_simulation_get_output_duty_cycles (self, value_duty_cycles);
+
+	for (i = 0; i < 8; i++)
+		duty_cycles[i] = 0.0;
+
+	for (value = 0; value < OUTPUT_PORT_VALUES; value++) {
+		if (value_duty_cycles[value] == 0.0)
+			continue;
+
+		for (i = 0; i < 8; i++) {
+			if (value & (1 << i))
+				duty_cycles[i] += value_duty_cycles[value];
+		}
+	}
+}
+
+guchar
+mcus_simulation_get_input_port (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->input_port;
+}
+
+void
+mcus_simulation_set_input_port (MCUSSimulation *self, guchar input_port)
+{
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+
+	self->priv->input_port = input_port;
+
+	if (self->priv->worker != NULL) {
+		WorkerCommand command;
+
+		command.type = COMMAND_SET_INPUT_PORT;
+		command.input_port = input_port;
+		push_worker_command (self->priv->worker, &command);
+	}
+
+	g_object_notify (G_OBJECT (self), "input-port");
+}
+
+gdouble
+mcus_simulation_get_analogue_input (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0.0);
+	return self->priv->analogue_input;
+}
+
+void
+mcus_simulation_set_analogue_input (MCUSSimulation *self, gdouble analogue_input)
+{
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (analogue_input >= 0.0 && analogue_input <= 5.0);
+
+	self->priv->analogue_input = analogue_input;
+	self->priv->function_generator_enabled = FALSE;
+
+	if (self->priv->worker != NULL) {
+		WorkerCommand command;
+
+		command.type = COMMAND_SET_ANALOGUE_INPUT;
+		command.analogue_input = analogue_input;
+		push_worker_command (self->priv->worker, &command);
+	}
+
+	g_object_notify (G_OBJECT (self), "analogue-input");
+}
+
+/**
+ * mcus_simulation_set_function_generator:
+ * @self: an #MCUSSimulation
+ * @waveform: the shape of the waveform to generate
+ * @frequency: the frequency of the waveform, in Hertz
+ * @amplitude: the amplitude of the waveform, in Volts
+ * @offset: the DC offset of the waveform (or the constant value, for %MCUS_SIMULATION_WAVEFORM_CONSTANT), in Volts
+ * @phase: the phase of the waveform, in radians
+ *
+ * Drives #MCUSSimulation:analogue-input from a function generator, until the analogue input is next set directly with
+ * mcus_simulation_set_analogue_input(). The waveform is sampled in simulated time (#MCUSSimulation:cycles divided by
+ * #MCUSSimulation:clock-speed) whenever the ADC is read, so it's reproduced exactly however the instructions are executed.
+ **/
+void
+mcus_simulation_set_function_generator (MCUSSimulation *self, MCUSSimulationWaveform waveform, gdouble frequency, gdouble amplitude,
+                                        gdouble offset, gdouble phase)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+
+	priv->function_generator_enabled = TRUE;
+	priv->waveform = waveform;
+	priv->waveform_frequency = frequency;
+	priv->waveform_amplitude = amplitude;
+	priv->waveform_offset = offset;
+	priv->waveform_phase = phase;
+
+	if (priv->worker != NULL) {
+		WorkerCommand command;
+
+		command.type = COMMAND_SET_FUNCTION_GENERATOR;
+		command.waveform = waveform;
+		command.frequency = frequency;
+		command.amplitude = amplitude;
+		command.offset = offset;
+		command.phase = phase;
+		push_worker_command (priv->worker, &command);
+	}
+
+	if (update_analogue_input (priv, priv->cycles) == TRUE)
+		g_object_notify (G_OBJECT (self), "analogue-input");
+}
+
+MCUSSimulationState
+mcus_simulation_get_state (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), MCUS_SIMULATION_STOPPED);
+	return self->priv->state;
+}
+
+gulong
+mcus_simulation_get_clock_speed (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->clock_speed;
+}
+
+void
+mcus_simulation_set_clock_speed (MCUSSimulation *self, gulong clock_speed)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (clock_speed >= 1 && clock_speed <= MAX_CLOCK_SPEED);
+
+	/* Set the clock speed */
+	priv->clock_speed = clock_speed;
+
+	/* Restart pacing at the new speed if we're running */
+	if (priv->state == MCUS_SIMULATION_RUNNING)
+		start_pacing (self);
+}
+
+gdouble
+mcus_simulation_get_achieved_clock_speed (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0.0);
+	return self->priv->achieved_clock_speed;
+}
+
+gulong
+mcus_simulation_get_max_batch_time (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->max_batch_time;
+}
+
+void
+mcus_simulation_set_max_batch_time (MCUSSimulation *self, gulong max_batch_time)
+{
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (max_batch_time >= 1);
+
+	self->priv->max_batch_time = max_batch_time;
+
+	/* This may be adjusted every frame, so is passed to the worker rather than restarting it */
+	if (self->priv->worker != NULL) {
+		WorkerCommand command;
+
+		command.type = COMMAND_SET_MAX_BATCH_TIME;
+		command.max_batch_time = max_batch_time;
+		push_worker_command (self->priv->worker, &command);
+	}
+
+	g_object_notify (G_OBJECT (self), "max-batch-time");
+}
+
+guint
+mcus_simulation_get_max_stack_depth (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->max_stack_depth;
+}
+
+/* Frames already on the stack are kept if the maximum depth is reduced below the current depth, but no more can be pushed until enough have
+ * been popped. */
+void
+mcus_simulation_set_max_stack_depth (MCUSSimulation *self, guint max_stack_depth)
+{
+	gboolean restart_worker;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (max_stack_depth >= 1 && max_stack_depth <= STACK_SIZE);
+
+	restart_worker = stop_worker (self);
+	self->priv->max_stack_depth = max_stack_depth;
+	g_object_notify (G_OBJECT (self), "max-stack-depth");
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
+}
+
+MCUSSimulationEngine
+mcus_simulation_get_engine (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), MCUS_SIMULATION_ENGINE_INTERPRETER);
+	return self->priv->engine;
+}
+
+void
+mcus_simulation_set_engine (MCUSSimulation *self, MCUSSimulationEngine engine)
+{
+	gboolean restart_worker;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+
+	restart_worker = stop_worker (self);
+	self->priv->engine = engine;
+	g_object_notify (G_OBJECT (self), "engine");
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
+}
+
+/**
+ * mcus_simulation_load_native:
+ * @self: an #MCUSSimulation
+ * @filename: the filename of a compiled translated program
+ * @error: a #GError, or %NULL
+ *
+ * Loads a program which was translated to C with <literal>mcus --translate</literal> (see mcus_translate_to_c()) and compiled to a shared
+ * module, replacing any previously-loaded module. The module is used by mcus_simulation_run() when #MCUSSimulation:engine is
+ * %MCUS_SIMULATION_ENGINE_NATIVE, but only while the simulation's memory matches the program it was translated from; at other times the
+ * interpreter is used instead.
+ *
+ * Return value: %TRUE on success, %FALSE otherwise
+ **/
+gboolean
+mcus_simulation_load_native (MCUSSimulation *self, const gchar *filename, GError **error)
+{
+	MCUSSimulationPrivate *priv = self->priv;
+	MCUSNative *native;
+	gboolean restart_worker;
+
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	native = mcus_native_load (filename, error);
+	if (native == NULL)
+		return FALSE;
+
+	/* The worker thread may be executing the old module */
+	restart_worker = stop_worker (self);
+
+	mcus_native_free (priv->native);
+	priv->native = native;
+	priv->native_valid = mcus_native_matches_memory (native, priv->memory);
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
+
+	return TRUE;
+}
+
+/**
+ * mcus_simulation_check_native:
+ * @self: an #MCUSSimulation
+ * @error: a #GError, or %NULL
+ *
+ * Checks that a module has been loaded with mcus_simulation_load_native(), and that it was translated from the program currently in the
+ * simulation's memory, so that it will actually be used by the native engine. If not, %MCUS_SIMULATION_ERROR_INVALID_MODULE or
+ * %MCUS_SIMULATION_ERROR_MODULE_MISMATCH respectively is set in @error.
+ *
+ * Return value: %TRUE if the loaded module will be used, %FALSE otherwise
+ **/
+gboolean
+mcus_simulation_check_native (MCUSSimulation *self, GError **error)
+{
+	MCUSSimulationPrivate *priv;
+	MCUSNative *native;
+
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	priv = self->priv;
+
+	/* The worker thread owns the module while it's running, but never replaces it */
+	native = (priv->worker != NULL) ? priv->worker->core->native : priv->native;
+
+	if (native == NULL) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_MODULE,
+		             _("No translated program has been loaded."));
+		return FALSE;
+	} else if (priv->native_valid == FALSE) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_MODULE_MISMATCH,
+		             _("The loaded module was translated from a different program."));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean
+mcus_simulation_get_fine_grained_notifications (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	return self->priv->fine_grained_notifications;
+}
+
+void
+mcus_simulation_set_fine_grained_notifications (MCUSSimulation *self, gboolean fine_grained_notifications)
+{
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+
+	self->priv->fine_grained_notifications = fine_grained_notifications;
+	g_object_notify (G_OBJECT (self), "fine-grained-notifications");
+}
+
+gboolean
+mcus_simulation_get_threaded (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	return self->priv->threaded;
+}
+
+void
+mcus_simulation_set_threaded (MCUSSimulation *self, gboolean threaded)
+{
+	MCUSSimulationPrivate *priv;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+
+	priv = self->priv;
+	priv->threaded = threaded;
+
+	/* Move execution to or from the worker thread if we're running */
+	if (priv->state == MCUS_SIMULATION_RUNNING)
+		start_pacing (self);
+
+	g_object_notify (G_OBJECT (self), "threaded");
+}
+
+guint
+mcus_simulation_get_history_size (MCUSSimulation *self)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
+	return self->priv->history_size;
+}
+
+/* Replaces the journal, forgetting the history recorded so far */
+void
+mcus_simulation_set_history_size (MCUSSimulation *self, guint history_size)
+{
+	MCUSSimulationPrivate *priv;
+	gboolean restart_worker;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+
+	priv = self->priv;
+
+	/* The worker thread owns the journal while it's running */
+	restart_worker = stop_worker (self);
+
+	mcus_journal_free (priv->journal);
+	priv->journal = (history_size > 0) ? mcus_journal_new (history_size) : NULL;
+	priv->history_size = (priv->journal != NULL) ? mcus_journal_get_size (priv->journal) : 0;
+
+	g_object_notify (G_OBJECT (self), "history-size");
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
+}
+
+/**
+ * mcus_simulation_get_history_range:
+ * @self: an #MCUSSimulation
+ * @start_iteration: return location for the earliest iteration which can be seeked to, or %NULL
+ * @end_iteration: return location for the latest iteration which can be seeked to, or %NULL
+ *
+ * Gets the range of iterations which are held in the journal, and so can be passed to mcus_simulation_seek(). The range always includes the
+ * current iteration if it's non-empty. The simulation must not be running.
+ *
+ * Return value: %TRUE if there's any history to seek through, %FALSE if the journal's empty or disabled
+ **/
+gboolean
+mcus_simulation_get_history_range (MCUSSimulation *self, guint64 *start_iteration, guint64 *end_iteration)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	g_return_val_if_fail (self->priv->state != MCUS_SIMULATION_RUNNING, FALSE);
+
+	if (self->priv->journal == NULL)
+		return FALSE;
+
+	return mcus_journal_get_range (self->priv->journal, start_iteration, end_iteration);
+}
+
+/**
+ * mcus_simulation_seek:
+ * @self: an #MCUSSimulation
+ * @iteration: the iteration to move to
+ *
+ * Moves the simulation backwards or forwards through its history to the start of @iteration, restoring the program counter, zero flag,
+ * registers, output port, stack and virtual time to what they were then. @iteration must be in the range returned by
+ * mcus_simulation_get_history_range(). Seeking takes time proportional to the number of instructions between @iteration and the nearest
+ * keyframe in the journal (or the current iteration), rather than to the length of the history.
+ *
+ * The simulation must not be running. If it's stopped (having finished), it's paused, so that execution can be continued from @iteration. Any
+ * instruction executed after seeking backwards replaces the history after @iteration.
+ *
+ * Return value: %TRUE on success, %FALSE if @iteration isn't in the history
+ **/
+gboolean
+mcus_simulation_seek (MCUSSimulation *self, guint64 iteration)
+{
+	MCUSSimulationPrivate *priv;
+	MCUSSimulationChangeSet change_set;
+	MCUSJournalState state;
+	guint64 start_iteration, end_iteration;
+
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	g_return_val_if_fail (self->priv->state != MCUS_SIMULATION_RUNNING, FALSE);
+
+	priv = self->priv;
+
+	if (priv->journal == NULL || mcus_journal_get_range (priv->journal, &start_iteration, &end_iteration) == FALSE ||
+	    iteration < start_iteration || iteration > end_iteration) {
+		return FALSE;
+	}
+
+	begin_changes (priv, &change_set);
+
+	get_journal_state (priv, &state);
+	mcus_journal_seek (priv->journal, iteration, &state, priv->decoded);
+	set_journal_state (priv, &state);
+	priv->resume_address = priv->program_counter;
+
+	/* The output history and function generator are derived from the virtual time, so start them afresh from the new time */
+	reset_output_history (priv);
+	if (update_analogue_input (priv, priv->cycles) == TRUE)
+		g_object_notify (G_OBJECT (self), "analogue-input");
+
+	if (priv->state == MCUS_SIMULATION_STOPPED) {
+		priv->state = MCUS_SIMULATION_PAUSED;
+		g_object_notify (G_OBJECT (self), "state");
+	}
+
+	resynchronise_stack (self);
+	end_changes (self, &change_set, MCUS_SIMULATION_CHANGED_STACK);
+
+	return TRUE;
+}
+
+/* Snapshots are laid out as below, with every multi-byte field little-endian (and the analogue input and function generator parameters stored
+ * as the bits of IEEE 754 doubles), so that they don't depend on the host and can be read in place, such as from a memory-mapped file. The
+ * whole stack array's stored, whatever its depth, so that every field has a fixed offset; each frame is its program counter followed by its
+ * registers. The clock speed and function generator are stored because they determine the analogue input at each cycle. Any change to the
+ * layout must bump SNAPSHOT_VERSION. */
+#define SNAPSHOT_MAGIC "MCUSSNAP"
+#define SNAPSHOT_VERSION 2
+
+enum {
+	SNAPSHOT_OFFSET_MAGIC = 0, /* 8 bytes */
+	SNAPSHOT_OFFSET_VERSION = 8, /* guint32 */
+	SNAPSHOT_OFFSET_LENGTH = 12, /* guint32; the length of the whole snapshot */
+	SNAPSHOT_OFFSET_ITERATION = 16, /* guint64 */
+	SNAPSHOT_OFFSET_CYCLES = 24, /* guint64 */
+	SNAPSHOT_OFFSET_ANALOGUE_INPUT = 32, /* gdouble */
+	SNAPSHOT_OFFSET_PROGRAM_COUNTER = 40,
+	SNAPSHOT_OFFSET_ZERO_FLAG = 41,
+	SNAPSHOT_OFFSET_INPUT_PORT = 42,
+	SNAPSHOT_OFFSET_OUTPUT_PORT = 43,
+	SNAPSHOT_OFFSET_REGISTERS = 44, /* REGISTER_COUNT bytes */
+	SNAPSHOT_OFFSET_STACK_DEPTH = SNAPSHOT_OFFSET_REGISTERS + REGISTER_COUNT, /* guint16, then 2 bytes of padding */
+	SNAPSHOT_OFFSET_MEMORY = SNAPSHOT_OFFSET_STACK_DEPTH + 4, /* MEMORY_SIZE bytes */
+	SNAPSHOT_OFFSET_LOOKUP_TABLE = SNAPSHOT_OFFSET_MEMORY + MEMORY_SIZE, /* LOOKUP_TABLE_SIZE bytes */
+	SNAPSHOT_OFFSET_STACK = SNAPSHOT_OFFSET_LOOKUP_TABLE + LOOKUP_TABLE_SIZE, /* STACK_SIZE frames */
+	SNAPSHOT_OFFSET_CLOCK_SPEED = SNAPSHOT_OFFSET_STACK + STACK_SIZE * (1 + REGISTER_COUNT), /* guint64 */
+	SNAPSHOT_OFFSET_FUNCTION_GENERATOR_ENABLED = SNAPSHOT_OFFSET_CLOCK_SPEED + 8,
+	SNAPSHOT_OFFSET_WAVEFORM = SNAPSHOT_OFFSET_FUNCTION_GENERATOR_ENABLED + 1, /* then 6 bytes of padding */
+	SNAPSHOT_OFFSET_WAVEFORM_FREQUENCY = SNAPSHOT_OFFSET_WAVEFORM + 7, /* gdouble */
+	SNAPSHOT_OFFSET_WAVEFORM_AMPLITUDE = SNAPSHOT_OFFSET_WAVEFORM_FREQUENCY + 8, /* gdouble */
+	SNAPSHOT_OFFSET_WAVEFORM_OFFSET = SNAPSHOT_OFFSET_WAVEFORM_AMPLITUDE + 8, /* gdouble */
+	SNAPSHOT_OFFSET_WAVEFORM_PHASE = SNAPSHOT_OFFSET_WAVEFORM_OFFSET + 8, /* gdouble */
+	SNAPSHOT_LENGTH = SNAPSHOT_OFFSET_WAVEFORM_PHASE + 8
+};
+
+static inline void
+write_snapshot_uint (guchar *snapshot, guint offset, guint64 value, guint length)
+{
+	guint i;
+
+	for (i = 0; i < length; i++, value >>= 8)
+		snapshot[offset + i] = value & 0xff;
+}
+
+static inline guint64
+read_snapshot_uint (const guchar *snapshot, guint offset, guint length)
+{
+	guint64 value = 0;
+
+	while (length-- > 0)
+		value = (value << 8) | snapshot[offset + length];
+
+	return value;
+}
+
+typedef union {
+	gdouble value;
+	guint64 bits;
+} SnapshotDouble;
+
+static inline void
+write_snapshot_double (guchar *snapshot, guint offset, gdouble value)
+{
+	SnapshotDouble d;
+
+	d.value = value;
+	write_snapshot_uint (snapshot, offset, d.bits, 8);
+}
+
+static inline gdouble
+read_snapshot_double (const guchar *snapshot, guint offset)
+{
+	SnapshotDouble d;
+
+	d.bits = read_snapshot_uint (snapshot, offset, 8);
+	return d.value;
+}
+
+/**
+ * mcus_simulation_snapshot:
+ * @self: an #MCUSSimulation
+ * @length: return location for the length of the snapshot, in bytes
+ *
+ * Captures the whole state of the simulated microcontroller (its program counter, zero flag, registers, ports, analogue input, stack, memory
+ * and lookup table), its iteration and cycle counts, its clock speed and the settings of its function generator (see
+ * mcus_simulation_set_function_generator()), as a flat, versioned blob which can be passed to mcus_simulation_restore() to return to that
+ * state later, or in another simulation. Settings which don't affect the results of execution, such as #MCUSSimulation:engine,
+ * #MCUSSimulation:threaded and the history size, aren't captured. The blob contains no pointers and doesn't depend on the host, so it can be
+ * written to disk as-is and later restored from a memory-mapped copy of the file; see mcus_simulation_save_snapshot().
+ *
+ * The simulation can be in any state; if it's running, the state at the end of the last batch of instructions is captured.
+ *
+ * Return value: a newly-allocated snapshot; free with g_free()
+ **/
+guchar *
+mcus_simulation_snapshot (MCUSSimulation *self, gsize *length)
+{
+	MCUSSimulationPrivate *priv;
+	guchar *snapshot;
+	gboolean restart_worker;
+	guint i;
+
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
+	g_return_val_if_fail (length != NULL, NULL);
+
+	priv = self->priv;
+
+	/* Take the state back from the worker thread, if it's running */
+	restart_worker = stop_worker (self);
+
+	snapshot = g_malloc0 (SNAPSHOT_LENGTH);
+
+	memcpy (snapshot + SNAPSHOT_OFFSET_MAGIC, SNAPSHOT_MAGIC, sizeof (SNAPSHOT_MAGIC) - 1);
+	write_snapshot_uint (snapshot, SNAPSHOT_OFFSET_VERSION, SNAPSHOT_VERSION, 4);
+	write_snapshot_uint (snapshot, SNAPSHOT_OFFSET_LENGTH, SNAPSHOT_LENGTH, 4);
+	write_snapshot_uint (snapshot, SNAPSHOT_OFFSET_ITERATION, priv->iteration, 8);
+	write_snapshot_uint (snapshot, SNAPSHOT_OFFSET_CYCLES, priv->cycles, 8);
+
+	write_snapshot_double (snapshot, SNAPSHOT_OFFSET_ANALOGUE_INPUT, priv->analogue_input);
+
+	snapshot[SNAPSHOT_OFFSET_PROGRAM_COUNTER] = priv->program_counter;
+	snapshot[SNAPSHOT_OFFSET_ZERO_FLAG] = (priv->zero_flag == TRUE) ? 1 : 0;
+	snapshot[SNAPSHOT_OFFSET_INPUT_PORT] = priv->input_port;
+	snapshot[SNAPSHOT_OFFSET_OUTPUT_PORT] = priv->output_port;
+	memcpy (snapshot + SNAPSHOT_OFFSET_REGISTERS, priv->registers, sizeof (guchar) * REGISTER_COUNT);
+	write_snapshot_uint (snapshot, SNAPSHOT_OFFSET_STACK_DEPTH, priv->stack_depth, 2);
+	memcpy (snapshot + SNAPSHOT_OFFSET_MEMORY, priv->memory, sizeof (guchar) * MEMORY_SIZE);
+	memcpy (snapshot + SNAPSHOT_OFFSET_LOOKUP_TABLE, priv->lookup_table, sizeof (guchar) * LOOKUP_TABLE_SIZE);
+
+	for (i = 0; i < priv->stack_depth; i++) {
+		guchar *frame = snapshot + SNAPSHOT_OFFSET_STACK + i * (1 + REGISTER_COUNT);
+
+		frame[0] = priv->stack[i].program_counter;
+		memcpy (frame + 1, priv->stack[i].registers, sizeof (guchar) * REGISTER_COUNT);
+	}
+
+	write_snapshot_uint (snapshot, SNAPSHOT_OFFSET_CLOCK_SPEED, priv->clock_speed, 8);
+	snapshot[SNAPSHOT_OFFSET_FUNCTION_GENERATOR_ENABLED] = (priv->function_generator_enabled == TRUE) ? 1 : 0;
+	snapshot[SNAPSHOT_OFFSET_WAVEFORM] = priv->waveform;
+	write_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_FREQUENCY, priv->waveform_frequency);
+	write_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_AMPLITUDE, priv->waveform_amplitude);
+	write_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_OFFSET, priv->waveform_offset);
+	write_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_PHASE, priv->waveform_phase);
+
+	if (restart_worker == TRUE && priv->state == MCUS_SIMULATION_RUNNING)
+		start_pacing (self);
+
+	*length = SNAPSHOT_LENGTH;
+	return snapshot;
+}
+
+/**
+ * mcus_simulation_restore:
+ * @self: an #MCUSSimulation
+ * @snapshot: a snapshot from mcus_simulation_snapshot()
+ * @length: the length of @snapshot, in bytes
+ * @error: a #GError, or %NULL
+ *
+ * Returns the simulation to the state captured in @snapshot, which is validated first; if it's invalid, or from an incompatible version of
+ * MCUS, %MCUS_SIMULATION_ERROR_INVALID_SNAPSHOT is returned and the simulation is left untouched. @snapshot is only read during the call, and
+ * needn't be aligned.
+ *
+ * The clock speed and function generator settings are replaced by those in @snapshot, so that the restored simulation runs exactly as the
+ * original would have. The simulation's history (see mcus_simulation_seek()) is forgotten. If the simulation was stopped, it's paused, so
+ * that execution can be continued from the restored state with mcus_simulation_resume(), mcus_simulation_iterate() or
+ * mcus_simulation_run(); otherwise, it's left running or paused.
+ *
+ * Return value: %TRUE on success, %FALSE otherwise
+ **/
+gboolean
+mcus_simulation_restore (MCUSSimulation *self, const guchar *snapshot, gsize length, GError **error)
+{
+	MCUSSimulationPrivate *priv;
+	MCUSSimulationChangeSet change_set;
+	GObject *obj;
+	gboolean restart_worker, restart_pacing;
+	guint stack_depth, i;
+	guchar input_port;
+	guint64 clock_speed;
+	gdouble analogue_input;
+
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	g_return_val_if_fail (snapshot != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	priv = self->priv;
+	obj = G_OBJECT (self);
+
+	if (length < SNAPSHOT_OFFSET_ITERATION || memcmp (snapshot + SNAPSHOT_OFFSET_MAGIC, SNAPSHOT_MAGIC, sizeof (SNAPSHOT_MAGIC) - 1) != 0) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_SNAPSHOT, _("The data is not a simulation snapshot."));
+		return FALSE;
+	} else if (read_snapshot_uint (snapshot, SNAPSHOT_OFFSET_VERSION, 4) != SNAPSHOT_VERSION) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_SNAPSHOT,
+		             _("The simulation snapshot is version %u, but only version %u is supported."),
+		             (guint) read_snapshot_uint (snapshot, SNAPSHOT_OFFSET_VERSION, 4), SNAPSHOT_VERSION);
+		return FALSE;
+	}
+
+	/* Check everything which could leave the simulation in an impossible state */
+	if (length != SNAPSHOT_LENGTH || read_snapshot_uint (snapshot, SNAPSHOT_OFFSET_LENGTH, 4) != SNAPSHOT_LENGTH) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_SNAPSHOT, _("The simulation snapshot is corrupt."));
+		return FALSE;
+	}
+
+	analogue_input = read_snapshot_double (snapshot, SNAPSHOT_OFFSET_ANALOGUE_INPUT);
+	stack_depth = read_snapshot_uint (snapshot, SNAPSHOT_OFFSET_STACK_DEPTH, 2);
+	clock_speed = read_snapshot_uint (snapshot, SNAPSHOT_OFFSET_CLOCK_SPEED, 8);
+
+	if (stack_depth > STACK_SIZE || !(analogue_input >= 0.0 && analogue_input <= ANALOGUE_INPUT_MAX_VOLTAGE) ||
+	    clock_speed < 1 || clock_speed > MAX_CLOCK_SPEED || snapshot[SNAPSHOT_OFFSET_FUNCTION_GENERATOR_ENABLED] > 1 ||
+	    snapshot[SNAPSHOT_OFFSET_WAVEFORM] > MCUS_SIMULATION_WAVEFORM_SAWTOOTH ||
+	    !isfinite (read_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_FREQUENCY)) ||
+	    !isfinite (read_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_AMPLITUDE)) ||
+	    !isfinite (read_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_OFFSET)) ||
+	    !isfinite (read_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_PHASE))) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_SNAPSHOT, _("The simulation snapshot is corrupt."));
+		return FALSE;
+	}
+
+	/* Take the state back from the worker thread, if it's running */
+	restart_worker = stop_worker (self);
+
+	g_object_freeze_notify (obj);
 
-		priv->stack = stack_frame;
+	if (memcmp (priv->memory, snapshot + SNAPSHOT_OFFSET_MEMORY, sizeof (guchar) * MEMORY_SIZE) != 0) {
+		memcpy (priv->memory, snapshot + SNAPSHOT_OFFSET_MEMORY, sizeof (guchar) * MEMORY_SIZE);
+		decode_memory (self);
+		g_object_notify (obj, "memory");
+	}
 
-		/* Signal that the stack's changed */
-		g_signal_emit (self, signals[SIGNAL_STACK_PUSHED], 0, stack_frame);
+	if (memcmp (priv->lookup_table, snapshot + SNAPSHOT_OFFSET_LOOKUP_TABLE, sizeof (guchar) * LOOKUP_TABLE_SIZE) != 0) {
+		memcpy (priv->lookup_table, snapshot + SNAPSHOT_OFFSET_LOOKUP_TABLE, sizeof (guchar) * LOOKUP_TABLE_SIZE);
+		g_object_notify (obj, "lookup-table");
+	}
 
-		/* Jump to the subroutine */
-		priv->program_counter = operand1;
-		g_object_notify (G_OBJECT (self), "program-counter");
-		goto update_and_exit;
-	case OPCODE_RET:
-		/* Check for underflows */
-		if (priv->stack == NULL) {
-			GError *real_error = g_error_new (MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_STACK_UNDERFLOW,
-			                                  _("The stack pointer underflowed available stack space in simulation iteration %u."),
-			                                  priv->iteration);
-			g_object_thaw_notify (G_OBJECT (self));
-			g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, real_error);
-			g_propagate_error (error, real_error);
-
-			mcus_simulation_finish (self);
-			return FALSE;
-		}
+	input_port = snapshot[SNAPSHOT_OFFSET_INPUT_PORT];
+	if (priv->input_port != input_port) {
+		priv->input_port = input_port;
+		g_object_notify (obj, "input-port");
+	}
 
-		/* Pop the old state off the stack */
-		stack_frame = priv->stack;
-		priv->stack = stack_frame->prev;
-		priv->program_counter = stack_frame->program_counter;
-		g_object_notify (G_OBJECT (self), "program-counter");
-		memcpy (priv->registers, stack_frame->registers, sizeof (guchar) * REGISTER_COUNT);
-		g_object_notify (G_OBJECT (self), "registers");
-		g_slice_free (MCUSStackFrame, stack_frame);
-
-		/* Signal that the stack's changed */
-		g_signal_emit (self, signals[SIGNAL_STACK_POPPED], 0, priv->stack);
-
-		goto update_and_exit;
-	case OPCODE_SHL:
-		priv->registers[operand1] <<= 1;
-		priv->zero_flag = (priv->registers[operand1] == 0) ? TRUE : FALSE;
-		g_object_notify (G_OBJECT (self), "zero-flag");
-		g_object_notify (G_OBJECT (self), "registers");
-		break;
-	case OPCODE_SHR:
-		priv->registers[operand1] >>= 1;
-		priv->zero_flag = (priv->registers[operand1] == 0) ? TRUE : FALSE;
-		g_object_notify (G_OBJECT (self), "zero-flag");
-		g_object_notify (G_OBJECT (self), "registers");
-		break;
-	default: {
-		/* We've encountered some data? */
-		GError *real_error = g_error_new (MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_OPCODE,
-		                                  _("An invalid opcode \"%02X\" was encountered at address %02X in simulation iteration %u."),
-		                                  (guint) opcode,
-		                                  (guint) priv->program_counter,
-		                                  priv->iteration);
-		g_object_thaw_notify (G_OBJECT (self));
-		g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, real_error);
-		g_propagate_error (error, real_error);
+	if (priv->analogue_input != analogue_input) {
+		priv->analogue_input = analogue_input;
+		g_object_notify (obj, "analogue-input");
+	}
 
-		mcus_simulation_finish (self);
-		return FALSE;
-	}}
+	/* The pacing's based on the clock speed, so has to be restarted if it's changed while running */
+	restart_pacing = restart_worker;
+	if (priv->clock_speed != clock_speed) {
+		priv->clock_speed = clock_speed;
+		restart_pacing = TRUE;
+		g_object_notify (obj, "clock-speed");
+	}
 
-	/* Don't forget to increment the PC */
-	priv->program_counter += mcus_instruction_data[opcode].size;
-	g_object_notify (G_OBJECT (self), "program-counter");
+	priv->function_generator_enabled = (snapshot[SNAPSHOT_OFFSET_FUNCTION_GENERATOR_ENABLED] != 0) ? TRUE : FALSE;
+	priv->waveform = snapshot[SNAPSHOT_OFFSET_WAVEFORM];
+	priv->waveform_frequency = read_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_FREQUENCY);
+	priv->waveform_amplitude = read_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_AMPLITUDE);
+	priv->waveform_offset = read_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_OFFSET);
+	priv->waveform_phase = read_snapshot_double (snapshot, SNAPSHOT_OFFSET_WAVEFORM_PHASE);
 
-update_and_exit:
-	g_object_thaw_notify (G_OBJECT (self));
+	begin_changes (priv, &change_set);
 
-	/* Reset the simulation state if we changed it to step forward */
-	if (old_state == MCUS_SIMULATION_PAUSED) {
+	priv->program_counter = snapshot[SNAPSHOT_OFFSET_PROGRAM_COUNTER];
+	priv->resume_address = priv->program_counter;
+	priv->zero_flag = (snapshot[SNAPSHOT_OFFSET_ZERO_FLAG] != 0) ? TRUE : FALSE;
+	priv->output_port = snapshot[SNAPSHOT_OFFSET_OUTPUT_PORT];
+	memcpy (priv->registers, snapshot + SNAPSHOT_OFFSET_REGISTERS, sizeof (guchar) * REGISTER_COUNT);
+	priv->iteration = read_snapshot_uint (snapshot, SNAPSHOT_OFFSET_ITERATION, 8);
+	priv->cycles = read_snapshot_uint (snapshot, SNAPSHOT_OFFSET_CYCLES, 8);
+
+	priv->stack_depth = stack_depth;
+	for (i = 0; i < stack_depth; i++) {
+		const guchar *frame = snapshot + SNAPSHOT_OFFSET_STACK + i * (1 + REGISTER_COUNT);
+
+		priv->stack[i].program_counter = frame[0];
+		memcpy (priv->stack[i].registers, frame + 1, sizeof (guchar) * REGISTER_COUNT);
+	}
+
+	/* Nothing which happened before now can be undone to reach the restored state */
+	if (priv->journal != NULL)
+		mcus_journal_clear (priv->journal);
+	reset_output_history (priv);
+
+	if (priv->state == MCUS_SIMULATION_STOPPED) {
 		priv->state = MCUS_SIMULATION_PAUSED;
-		g_object_notify (G_OBJECT (self), "state");
+		g_object_notify (obj, "state");
 	}
 
-	/* Announce that we've finished the iteration */
-	g_signal_emit (self, signals[SIGNAL_ITERATION_FINISHED], 0, NULL);
-	priv->iteration++;
+	/* Announce all the fields, as in reset() */
+	resynchronise_stack (self);
+	end_changes (self, &change_set, MCUS_SIMULATION_CHANGED_PROGRAM_COUNTER | MCUS_SIMULATION_CHANGED_ZERO_FLAG |
+	                                MCUS_SIMULATION_CHANGED_REGISTERS | MCUS_SIMULATION_CHANGED_OUTPUT_PORT |
+	                                MCUS_SIMULATION_CHANGED_ITERATION | MCUS_SIMULATION_CHANGED_CYCLES | MCUS_SIMULATION_CHANGED_STACK);
+
+	g_object_thaw_notify (obj);
+
+	if (restart_pacing == TRUE && priv->state == MCUS_SIMULATION_RUNNING)
+		start_pacing (self);
 
 	return TRUE;
 }
 
-void
-mcus_simulation_pause (MCUSSimulation *self)
+/**
+ * mcus_simulation_save_snapshot:
+ * @self: an #MCUSSimulation
+ * @filename: the file to save the snapshot to
+ * @error: a #GError, or %NULL
+ *
+ * Saves a snapshot of the simulation (see mcus_simulation_snapshot()) to @filename, replacing it atomically if it already exists.
+ *
+ * Return value: %TRUE on success, %FALSE otherwise
+ **/
+gboolean
+mcus_simulation_save_snapshot (MCUSSimulation *self, const gchar *filename, GError **error)
 {
-	MCUSSimulationPrivate *priv = self->priv;
+	guchar *snapshot;
+	gsize length;
+	gboolean success;
 
-	g_return_if_fail (MCUS_IS_SIMULATION (self));
-	g_return_if_fail (priv->state == MCUS_SIMULATION_RUNNING);
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-	/* Stop timeouts */
-	if (priv->iteration_event != 0)
-		g_source_remove (priv->iteration_event);
-	priv->iteration_event = 0;
+	snapshot = mcus_simulation_snapshot (self, &length);
+	success = g_file_set_contents (filename, (const gchar*) snapshot, length, error);
+	g_free (snapshot);
 
-	priv->state = MCUS_SIMULATION_PAUSED;
-	g_object_notify (G_OBJECT (self), "state");
+	return success;
 }
 
-void
-mcus_simulation_resume (MCUSSimulation *self)
+/**
+ * mcus_simulation_load_snapshot:
+ * @self: an #MCUSSimulation
+ * @filename: a file saved with mcus_simulation_save_snapshot()
+ * @error: a #GError, or %NULL
+ *
+ * Restores the simulation from the snapshot saved in @filename, which is memory-mapped rather than read. See mcus_simulation_restore().
+ *
+ * Return value: %TRUE on success, %FALSE otherwise
+ **/
+gboolean
+mcus_simulation_load_snapshot (MCUSSimulation *self, const gchar *filename, GError **error)
 {
-	g_return_if_fail (MCUS_IS_SIMULATION (self));
-	g_return_if_fail (self->priv->state == MCUS_SIMULATION_PAUSED);
+	GMappedFile *file;
+	gboolean success;
 
-	self->priv->state = MCUS_SIMULATION_RUNNING;
-	g_object_notify (G_OBJECT (self), "state");
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	file = g_mapped_file_new (filename, FALSE, error);
+	if (file == NULL)
+		return FALSE;
 
-	/* Resume the timeouts for simulation iterations */
-	self->priv->iteration_event = g_timeout_add (1000 / self->priv->clock_speed, (GSourceFunc) simulation_iterate_cb, self);
+	success = mcus_simulation_restore (self, (const guchar*) g_mapped_file_get_contents (file), g_mapped_file_get_length (file), error);
+	g_mapped_file_unref (file);
+
+	return success;
 }
 
-void
-mcus_simulation_finish (MCUSSimulation *self)
+/* Rebuild the bitmap of addresses a run may stop at from the breakpoints and run target, and everything derived from it */
+static void
+update_stops (MCUSSimulation *self)
 {
 	MCUSSimulationPrivate *priv = self->priv;
 
+	memcpy (priv->stops, priv->breakpoints, sizeof (priv->stops));
+	if (priv->target_address >= 0)
+		priv->stops[priv->target_address / 32] |= (1U << (priv->target_address % 32));
+
+	/* Instruction sequences can't be fused, grouped into blocks or translated across stops */
+	fuse_memory (self);
+	find_basic_blocks (self);
+	find_counted_loops (self);
+	priv->jit_valid = FALSE;
+}
+
+/**
+ * mcus_simulation_set_breakpoint:
+ * @self: an #MCUSSimulation
+ * @address: the memory address of the instruction to break at
+ * @enabled: %TRUE to set a breakpoint at @address, %FALSE to clear it
+ *
+ * Sets or clears a breakpoint on the instruction at @address. Breakpoints only have an effect on mcus_simulation_run() when it's passed
+ * %MCUS_SIMULATION_STOP_ON_BREAKPOINT. Breakpoints persist across resets of the simulation.
+ **/
+void
+mcus_simulation_set_breakpoint (MCUSSimulation *self, guchar address, gboolean enabled)
+{
+	gboolean restart_worker;
+
 	g_return_if_fail (MCUS_IS_SIMULATION (self));
-	g_return_if_fail (priv->state != MCUS_SIMULATION_STOPPED);
 
-	/* Stop timeouts */
-	if (priv->iteration_event != 0)
-		g_source_remove (priv->iteration_event);
-	priv->iteration_event = 0;
+	restart_worker = stop_worker (self);
 
-	/* Stop the simulation */
-	priv->state = MCUS_SIMULATION_STOPPED;
-	g_object_notify (G_OBJECT (self), "state");
+	if (enabled == TRUE)
+		self->priv->breakpoints[address / 32] |= (1U << (address % 32));
+	else
+		self->priv->breakpoints[address / 32] &= ~(1U << (address % 32));
+
+	update_stops (self);
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
 }
 
 /**
- * mcus_simulation_get_memory:
+ * mcus_simulation_get_breakpoint:
  * @self: an #MCUSSimulation
+ * @address: a memory address
  *
- * Returns the block of memory which is used by the simulated microcontroller to store compiled programs. This memory is statically allocated,
- * and should not be freed. It may, however, be modified by the caller, but mcus_simulation_notify_memory() must be called afterwards.
+ * Returns whether a breakpoint is set on the instruction at @address.
  *
- * Return value: the microcontroller's memory
+ * Return value: %TRUE if a breakpoint is set at @address, %FALSE otherwise
  **/
-guchar *
-mcus_simulation_get_memory (MCUSSimulation *self)
+gboolean
+mcus_simulation_get_breakpoint (MCUSSimulation *self, guchar address)
 {
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
-	return self->priv->memory;
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
+	return BREAKPOINT_IS_SET (self->priv, address);
 }
 
 /**
- * mcus_simulation_notify_memory:
+ * mcus_simulation_clear_breakpoints:
  * @self: an #MCUSSimulation
  *
- * This notifies the simulation that its program memory has been modified. This should be called and only be called after modifying the memory
- * returned by mcus_simulation_get_memory().
+ * Clears all the breakpoints set with mcus_simulation_set_breakpoint().
  **/
 void
-mcus_simulation_notify_memory (MCUSSimulation *self)
+mcus_simulation_clear_breakpoints (MCUSSimulation *self)
 {
+	gboolean restart_worker;
+
 	g_return_if_fail (MCUS_IS_SIMULATION (self));
-	g_object_notify (G_OBJECT (self), "memory");
+
+	if (has_breakpoints (self->priv) == FALSE)
+		return;
+
+	restart_worker = stop_worker (self);
+
+	memset (self->priv->breakpoints, 0, sizeof (self->priv->breakpoints));
+	update_stops (self);
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
 }
 
 /**
- * mcus_simulation_get_lookup_table:
+ * mcus_simulation_set_run_target:
  * @self: an #MCUSSimulation
+ * @address: the memory address of the instruction to stop at, or -1 to clear the run target
+ * @max_stack_depth: the maximum stack depth at which to stop at @address
  *
- * Returns the block of memory which is used by the simulated microcontroller to store lookup tables. This memory is statically allocated,
- * and should not be freed. It may, however, be modified by the caller, but mcus_simulation_notify_lookup_table() must be called afterwards.
+ * Sets the run target, at which mcus_simulation_run() stops (with %MCUS_SIMULATION_STOP_REASON_TARGET) when it's passed
+ * %MCUS_SIMULATION_STOP_ON_TARGET. The run stops just before executing the instruction at @address, but only if the stack is at most
+ * @max_stack_depth frames deep at that point; so, for example, passing the current stack depth and the address after an RCALL steps over the
+ * subroutine call, even if the subroutine's recursive.
  *
- * Return value: the microcontroller's lookup table memory
+ * A run to the target can be made in batches of calls to mcus_simulation_run(); a batch which uses up its instructions just as it reaches
+ * @address stops there at the start of the next. If the simulation's already stopped at @address, the run executes the instruction and
+ * only stops when it next comes back to it.
+ *
+ * Like breakpoints, the run target is respected by all the engines, so runs to it can be executed at full speed.
  **/
-guchar *
-mcus_simulation_get_lookup_table (MCUSSimulation *self)
+void
+mcus_simulation_set_run_target (MCUSSimulation *self, gint address, guint max_stack_depth)
 {
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
-	return self->priv->lookup_table;
+	MCUSSimulationPrivate *priv;
+	gboolean restart_worker;
+
+	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	g_return_if_fail (address >= -1 && address < MEMORY_SIZE);
+
+	priv = self->priv;
+
+	if (address == priv->target_address && max_stack_depth == priv->target_stack_depth)
+		return;
+
+	restart_worker = stop_worker (self);
+
+	priv->target_stack_depth = max_stack_depth;
+	if (address != priv->target_address) {
+		priv->target_address = address;
+		update_stops (self);
+	}
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
 }
 
 /**
- * mcus_simulation_notify_lookup_table:
+ * mcus_simulation_get_run_target:
  * @self: an #MCUSSimulation
+ * @max_stack_depth: return location for the maximum stack depth at which to stop at the run target, or %NULL
  *
- * This notifies the simulation that its lookup table memory has been modified. This should be called and only be called after modifying the memory
- * returned by mcus_simulation_get_lookup_table().
+ * Returns the run target set with mcus_simulation_set_run_target().
+ *
+ * Return value: the address of the run target, or -1 if there isn't one
  **/
-void
-mcus_simulation_notify_lookup_table (MCUSSimulation *self)
+gint
+mcus_simulation_get_run_target (MCUSSimulation *self, guint *max_stack_depth)
 {
-	g_return_if_fail (MCUS_IS_SIMULATION (self));
-	g_object_notify (G_OBJECT (self), "lookup-table");
-}
+	g_return_val_if_fail (MCUS_IS_SIMULATION (self), -1);
 
-guchar *
-mcus_simulation_get_registers (MCUSSimulation *self)
-{
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
-	return self->priv->registers;
+	if (max_stack_depth != NULL)
+		*max_stack_depth = self->priv->target_stack_depth;
+
+	return self->priv->target_address;
 }
 
-MCUSStackFrame *
-mcus_simulation_get_stack_head (MCUSSimulation *self)
+/* Compile a watchpoint expression, as described for mcus_simulation_add_watchpoint(), into @watchpoint (except for its ID) */
+static gboolean
+compile_watchpoint (const gchar *expression, Watchpoint *watchpoint, GError **error)
 {
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), NULL);
-	return self->priv->stack;
+	const gchar *i = expression;
+	gchar *end;
+	guint64 operand, max_operand;
+
+	/* In EBNF:
+	 * location ::= "S" , ( "0" | "1" | ... | "6" | "7" ) | "Z" | "Q" | "SP"
+	 * comparison ::= "==" | "!=" | "<" | "<=" | ">" | ">="
+	 * value ::= [ "0x" ] , hex-digit , { hex-digit }
+	 * expression ::= location , [ comparison , value ] */
+	while (g_ascii_isspace (*i) == TRUE)
+		i++;
+
+	if (g_ascii_toupper (i[0]) == 'S' && g_ascii_toupper (i[1]) == 'P') {
+		watchpoint->location = WATCH_STACK_DEPTH;
+		max_operand = STACK_SIZE;
+		i += 2;
+	} else if (g_ascii_toupper (i[0]) == 'S' && i[1] >= '0' && i[1] < '0' + REGISTER_COUNT) {
+		watchpoint->location = WATCH_REGISTER;
+		watchpoint->register_number = i[1] - '0';
+		max_operand = G_MAXUINT8;
+		i += 2;
+	} else if (g_ascii_toupper (i[0]) == 'Z') {
+		watchpoint->location = WATCH_ZERO_FLAG;
+		max_operand = 1;
+		i++;
+	} else if (g_ascii_toupper (i[0]) == 'Q') {
+		watchpoint->location = WATCH_OUTPUT_PORT;
+		max_operand = G_MAXUINT8;
+		i++;
+	} else {
+		goto invalid;
+	}
+
+	/* Catch things like "S10" or "Queue" */
+	if (g_ascii_isalnum (*i) == TRUE)
+		goto invalid;
+
+	while (g_ascii_isspace (*i) == TRUE)
+		i++;
+
+	/* Without a comparison, any change to the location triggers the watchpoint */
+	if (*i == '\0') {
+		watchpoint->comparison = WATCH_ANY_CHANGE;
+		watchpoint->operand = 0;
+		return TRUE;
+	}
+
+	if (i[0] == '=' && i[1] == '=') {
+		watchpoint->comparison = WATCH_EQUAL;
+		i += 2;
+	} else if (i[0] == '!' && i[1] == '=') {
+		watchpoint->comparison = WATCH_NOT_EQUAL;
+		i += 2;
+	} else if (i[0] == '<' && i[1] == '=') {
+		watchpoint->comparison = WATCH_LESS_EQUAL;
+		i += 2;
+	} else if (i[0] == '>' && i[1] == '=') {
+		watchpoint->comparison = WATCH_GREATER_EQUAL;
+		i += 2;
+	} else if (i[0] == '<') {
+		watchpoint->comparison = WATCH_LESS;
+		i++;
+	} else if (i[0] == '>') {
+		watchpoint->comparison = WATCH_GREATER;
+		i++;
+	} else {
+		goto invalid;
+	}
+
+	while (g_ascii_isspace (*i) == TRUE)
+		i++;
+
+	/* Values are in hexadecimal, as constants are in programs */
+	if (g_ascii_isxdigit (*i) == FALSE)
+		goto invalid;
+
+	operand = g_ascii_strtoull (i, &end, 16);
+
+	for (i = end; g_ascii_isspace (*i) == TRUE; i++);
+	if (*i != '\0')
+		goto invalid;
+
+	if (operand > max_operand) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_WATCHPOINT,
+		             _("The value in watchpoint \"%s\" is out of range. It must be at most %02X."), expression, (guint) max_operand);
+		return FALSE;
+	}
+
+	watchpoint->operand = operand;
+
+	return TRUE;
+
+invalid:
+	g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_INVALID_WATCHPOINT,
+	             _("The watchpoint \"%s\" is invalid. It must be a register (\"S0\" to \"S7\"), \"Z\", \"Q\" or \"SP\", optionally "
+	               "followed by a comparison against a hexadecimal value, such as \"S3 == 7F\"."), expression);
+	return FALSE;
 }
 
+/**
+ * mcus_simulation_add_watchpoint:
+ * @self: an #MCUSSimulation
+ * @expression: the location to watch, and an optional condition
+ * @error: a #GError, or %NULL
+ *
+ * Adds a watchpoint, at which mcus_simulation_run() stops (with %MCUS_SIMULATION_STOP_REASON_WATCHPOINT) when it's passed
+ * %MCUS_SIMULATION_STOP_ON_WATCHPOINT. The run stops just after any instruction which changes the value of the watched location.
+ *
+ * @expression names the location: a register ("S0" to "S7"), the zero flag ("Z"), the output port ("Q") or the stack depth ("SP"). It may be
+ * followed by a comparison ("==", "!=", "<", "<=", ">" or ">=") against a hexadecimal value, optionally prefixed by "0x", such as
+ * "S3 == 0x7F"; in which case the watchpoint only triggers if the location's new value satisfies the comparison. The expression's compiled
+ * when the watchpoint's added, so only the comparison itself is evaluated as instructions are executed.
+ *
+ * While any watchpoints are set, runs which stop on them execute every instruction individually in the interpreter, whatever the
+ * #MCUSSimulation:engine. Watchpoints persist across resets of the simulation.
+ *
+ * Return value: the ID of the new watchpoint, or 0 on error
+ **/
 guint
-mcus_simulation_get_iteration (MCUSSimulation *self)
+mcus_simulation_add_watchpoint (MCUSSimulation *self, const gchar *expression, GError **error)
 {
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
-	return self->priv->iteration;
-}
+	MCUSSimulationPrivate *priv;
+	Watchpoint watchpoint;
+	gboolean restart_worker;
 
-guchar
-mcus_simulation_get_program_counter (MCUSSimulation *self)
-{
 	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
-	return self->priv->program_counter;
-}
+	g_return_val_if_fail (expression != NULL, 0);
+	g_return_val_if_fail (error == NULL || *error == NULL, 0);
 
-gboolean
-mcus_simulation_get_zero_flag (MCUSSimulation *self)
-{
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), FALSE);
-	return self->priv->zero_flag;
-}
+	priv = self->priv;
 
-guchar
-mcus_simulation_get_output_port (MCUSSimulation *self)
-{
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
-	return self->priv->output_port;
-}
+	if (priv->n_watchpoints >= MAX_WATCHPOINTS) {
+		g_set_error (error, MCUS_SIMULATION_ERROR, MCUS_SIMULATION_ERROR_TOO_MANY_WATCHPOINTS,
+		             _("No more than %u watchpoints can be set at once."), MAX_WATCHPOINTS);
+		return 0;
+	}
 
-guchar
-mcus_simulation_get_input_port (MCUSSimulation *self)
-{
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
-	return self->priv->input_port;
-}
+	if (compile_watchpoint (expression, &watchpoint, error) == FALSE)
+		return 0;
 
-void
-mcus_simulation_set_input_port (MCUSSimulation *self, guchar input_port)
-{
-	g_return_if_fail (MCUS_IS_SIMULATION (self));
+	restart_worker = stop_worker (self);
 
-	self->priv->input_port = input_port;
-	g_object_notify (G_OBJECT (self), "input-port");
-}
+	watchpoint.id = priv->next_watchpoint_id++;
+	priv->watchpoints[priv->n_watchpoints++] = watchpoint;
 
-gdouble
-mcus_simulation_get_analogue_input (MCUSSimulation *self)
-{
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0.0);
-	return self->priv->analogue_input;
+	if (restart_worker == TRUE)
+		start_pacing (self);
+
+	return watchpoint.id;
 }
 
+/**
+ * mcus_simulation_remove_watchpoint:
+ * @self: an #MCUSSimulation
+ * @id: the ID of the watchpoint to remove
+ *
+ * Removes a watchpoint added with mcus_simulation_add_watchpoint().
+ **/
 void
-mcus_simulation_set_analogue_input (MCUSSimulation *self, gdouble analogue_input)
+mcus_simulation_remove_watchpoint (MCUSSimulation *self, guint id)
 {
+	MCUSSimulationPrivate *priv;
+	gboolean restart_worker;
+	guint i;
+
 	g_return_if_fail (MCUS_IS_SIMULATION (self));
-	g_return_if_fail (analogue_input >= 0.0 && analogue_input <= 5.0);
+	g_return_if_fail (id != 0);
 
-	self->priv->analogue_input = analogue_input;
-	g_object_notify (G_OBJECT (self), "analogue-input");
-}
+	priv = self->priv;
 
-MCUSSimulationState
-mcus_simulation_get_state (MCUSSimulation *self)
-{
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), MCUS_SIMULATION_STOPPED);
-	return self->priv->state;
-}
+	for (i = 0; i < priv->n_watchpoints; i++) {
+		if (priv->watchpoints[i].id == id)
+			break;
+	}
 
-gulong
-mcus_simulation_get_clock_speed (MCUSSimulation *self)
-{
-	g_return_val_if_fail (MCUS_IS_SIMULATION (self), 0);
-	return self->priv->clock_speed;
+	g_return_if_fail (i < priv->n_watchpoints);
+
+	restart_worker = stop_worker (self);
+
+	g_memmove (&(priv->watchpoints[i]), &(priv->watchpoints[i + 1]), sizeof (Watchpoint) * (priv->n_watchpoints - i - 1));
+	priv->n_watchpoints--;
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
 }
 
+/**
+ * mcus_simulation_clear_watchpoints:
+ * @self: an #MCUSSimulation
+ *
+ * Removes all the watchpoints added with mcus_simulation_add_watchpoint().
+ **/
 void
-mcus_simulation_set_clock_speed (MCUSSimulation *self, gulong clock_speed)
+mcus_simulation_clear_watchpoints (MCUSSimulation *self)
 {
-	MCUSSimulationPrivate *priv = self->priv;
+	gboolean restart_worker;
 
 	g_return_if_fail (MCUS_IS_SIMULATION (self));
-	g_return_if_fail (clock_speed <= MAX_CLOCK_SPEED);
 
-	/* Set the clock speed */
-	priv->clock_speed = clock_speed;
+	if (self->priv->n_watchpoints == 0)
+		return;
 
-	/* Change the events if we're running */
-	if (priv->state == MCUS_SIMULATION_RUNNING) {
-		if (priv->iteration_event != 0)
-			g_source_remove (priv->iteration_event);
-		priv->iteration_event = g_timeout_add (1000 / clock_speed, (GSourceFunc) simulation_iterate_cb, self);
-	}
+	restart_worker = stop_worker (self);
+	self->priv->n_watchpoints = 0;
+
+	if (restart_worker == TRUE)
+		start_pacing (self);
 }
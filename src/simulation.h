@@ -30,13 +30,15 @@ G_BEGIN_DECLS
 #define REGISTER_COUNT 8
 #define LOOKUP_TABLE_SIZE 256
 #define MEMORY_SIZE 256
+#define STACK_SIZE 256 /* maximum number of frames */
+#define OUTPUT_PORT_VALUES 256
+#define MAX_CLOCK_SPEED 100000000 /* Hz; this is also in the UI file */
 
 typedef struct _MCUSStackFrame MCUSStackFrame;
 
 struct _MCUSStackFrame {
 	guchar program_counter;
 	guchar registers[REGISTER_COUNT];
-	MCUSStackFrame *prev;
 };
 
 typedef enum {
@@ -45,11 +47,78 @@ typedef enum {
 	MCUS_SIMULATION_RUNNING
 } MCUSSimulationState;
 
+typedef enum {
+	MCUS_SIMULATION_ENGINE_INTERPRETER,
+	MCUS_SIMULATION_ENGINE_JIT,
+	MCUS_SIMULATION_ENGINE_NATIVE,
+	MCUS_SIMULATION_ENGINE_BASIC_BLOCK
+} MCUSSimulationEngine;
+
+typedef enum {
+	MCUS_SIMULATION_WAVEFORM_CONSTANT,
+	MCUS_SIMULATION_WAVEFORM_SINE,
+	MCUS_SIMULATION_WAVEFORM_SQUARE,
+	MCUS_SIMULATION_WAVEFORM_TRIANGLE,
+	MCUS_SIMULATION_WAVEFORM_SAWTOOTH
+} MCUSSimulationWaveform;
+
+typedef enum {
+	MCUS_SIMULATION_STOP_ON_BREAKPOINT = 1 << 0,
+	MCUS_SIMULATION_STOP_ON_INPUT = 1 << 1,
+	MCUS_SIMULATION_STOP_ON_TARGET = 1 << 2,
+	MCUS_SIMULATION_STOP_ON_WATCHPOINT = 1 << 3
+} MCUSSimulationStopFlags;
+
+typedef enum {
+	MCUS_SIMULATION_STOP_REASON_LIMIT,
+	MCUS_SIMULATION_STOP_REASON_HALT,
+	MCUS_SIMULATION_STOP_REASON_ERROR,
+	MCUS_SIMULATION_STOP_REASON_BREAKPOINT,
+	MCUS_SIMULATION_STOP_REASON_INPUT,
+	MCUS_SIMULATION_STOP_REASON_TARGET,
+	MCUS_SIMULATION_STOP_REASON_WATCHPOINT
+} MCUSSimulationStopReason;
+
+typedef struct {
+	guint64 instructions_retired;
+	guint64 cycles_elapsed;
+	MCUSSimulationStopReason stop_reason;
+	guchar program_counter; /* the address of the next instruction to be executed */
+	gboolean output_changed;
+	guint watchpoint; /* the ID of the watchpoint which stopped the run, for %MCUS_SIMULATION_STOP_REASON_WATCHPOINT */
+} MCUSSimulationRunSummary;
+
+typedef enum {
+	MCUS_SIMULATION_CHANGED_PROGRAM_COUNTER = 1 << 0,
+	MCUS_SIMULATION_CHANGED_ZERO_FLAG = 1 << 1,
+	MCUS_SIMULATION_CHANGED_REGISTERS = 1 << 2,
+	MCUS_SIMULATION_CHANGED_OUTPUT_PORT = 1 << 3,
+	MCUS_SIMULATION_CHANGED_ITERATION = 1 << 4,
+	MCUS_SIMULATION_CHANGED_STACK = 1 << 5,
+	MCUS_SIMULATION_CHANGED_CYCLES = 1 << 6
+} MCUSSimulationChangeFlags;
+
+typedef struct {
+	MCUSSimulationChangeFlags flags;
+	guchar old_program_counter, new_program_counter;
+	gboolean old_zero_flag, new_zero_flag;
+	guchar old_registers[REGISTER_COUNT], new_registers[REGISTER_COUNT];
+	guchar old_output_port, new_output_port;
+	guint64 old_iteration, new_iteration;
+	guint64 old_cycles, new_cycles;
+} MCUSSimulationChangeSet;
+
 enum {
 	MCUS_SIMULATION_ERROR_MEMORY_OVERFLOW,
 	MCUS_SIMULATION_ERROR_STACK_OVERFLOW,
 	MCUS_SIMULATION_ERROR_STACK_UNDERFLOW,
-	MCUS_SIMULATION_ERROR_INVALID_OPCODE
+	MCUS_SIMULATION_ERROR_INVALID_OPCODE,
+	MCUS_SIMULATION_ERROR_INVALID_MODULE,
+	MCUS_SIMULATION_ERROR_INVALID_WATCHPOINT,
+	MCUS_SIMULATION_ERROR_TOO_MANY_WATCHPOINTS,
+	MCUS_SIMULATION_ERROR_INVALID_SNAPSHOT,
+	MCUS_SIMULATION_ERROR_MODULE_MISMATCH,
+	MCUS_SIMULATION_ERROR_INVALID_REGISTER
 };
 
 GQuark mcus_simulation_error_quark (void) G_GNUC_CONST;
@@ -80,6 +149,8 @@ void mcus_simulation_reset (MCUSSimulation *self);
 
 void mcus_simulation_start (MCUSSimulation *self);
 gboolean mcus_simulation_iterate (MCUSSimulation *self, GError **error);
+gboolean mcus_simulation_run (MCUSSimulation *self, guint64 max_instructions, MCUSSimulationStopFlags stop_flags, MCUSSimulationRunSummary *summary,
+                              GError **error);
 void mcus_simulation_pause (MCUSSimulation *self);
 void mcus_simulation_resume (MCUSSimulation *self);
 void mcus_simulation_finish (MCUSSimulation *self);
@@ -92,22 +163,69 @@ void mcus_simulation_notify_lookup_table (MCUSSimulation *self);
 
 guchar *mcus_simulation_get_registers (MCUSSimulation *self);
 MCUSStackFrame *mcus_simulation_get_stack_head (MCUSSimulation *self);
+guint mcus_simulation_get_stack_depth (MCUSSimulation *self);
+MCUSStackFrame *mcus_simulation_get_stack_frame (MCUSSimulation *self, guint index);
 
-guint mcus_simulation_get_iteration (MCUSSimulation *self);
+guint64 mcus_simulation_get_iteration (MCUSSimulation *self);
+guint64 mcus_simulation_get_cycles (MCUSSimulation *self);
 guchar mcus_simulation_get_program_counter (MCUSSimulation *self);
 gboolean mcus_simulation_get_zero_flag (MCUSSimulation *self);
 guchar mcus_simulation_get_output_port (MCUSSimulation *self);
+void mcus_simulation_get_output_duty_cycles (MCUSSimulation *self, gdouble *duty_cycles);
+void mcus_simulation_get_output_bit_duty_cycles (MCUSSimulation *self, gdouble *duty_cycles);
 
 guchar mcus_simulation_get_input_port (MCUSSimulation *self);
 void mcus_simulation_set_input_port (MCUSSimulation *self, guchar input_port);
 
 gdouble mcus_simulation_get_analogue_input (MCUSSimulation *self);
 void mcus_simulation_set_analogue_input (MCUSSimulation *self, gdouble analogue_input);
+void mcus_simulation_set_function_generator (MCUSSimulation *self, MCUSSimulationWaveform waveform, gdouble frequency, gdouble amplitude,
+                                             gdouble offset, gdouble phase);
 
 MCUSSimulationState mcus_simulation_get_state (MCUSSimulation *self);
 
 gulong mcus_simulation_get_clock_speed (MCUSSimulation *self);
 void mcus_simulation_set_clock_speed (MCUSSimulation *self, gulong clock_speed);
+gdouble mcus_simulation_get_achieved_clock_speed (MCUSSimulation *self);
+
+gulong mcus_simulation_get_max_batch_time (MCUSSimulation *self);
+void mcus_simulation_set_max_batch_time (MCUSSimulation *self, gulong max_batch_time);
+
+guint mcus_simulation_get_max_stack_depth (MCUSSimulation *self);
+void mcus_simulation_set_max_stack_depth (MCUSSimulation *self, guint max_stack_depth);
+
+MCUSSimulationEngine mcus_simulation_get_engine (MCUSSimulation *self);
+void mcus_simulation_set_engine (MCUSSimulation *self, MCUSSimulationEngine engine);
+
+gboolean mcus_simulation_load_native (MCUSSimulation *self, const gchar *filename, GError **error);
+gboolean mcus_simulation_check_native (MCUSSimulation *self, GError **error);
+
+gboolean mcus_simulation_get_fine_grained_notifications (MCUSSimulation *self);
+void mcus_simulation_set_fine_grained_notifications (MCUSSimulation *self, gboolean fine_grained_notifications);
+
+gboolean mcus_simulation_get_threaded (MCUSSimulation *self);
+void mcus_simulation_set_threaded (MCUSSimulation *self, gboolean threaded);
+
+guint mcus_simulation_get_history_size (MCUSSimulation *self);
+void mcus_simulation_set_history_size (MCUSSimulation *self, guint history_size);
+gboolean mcus_simulation_get_history_range (MCUSSimulation *self, guint64 *start_iteration, guint64 *end_iteration);
+gboolean mcus_simulation_seek (MCUSSimulation *self, guint64 iteration);
+
+guchar *mcus_simulation_snapshot (MCUSSimulation *self, gsize *length) G_GNUC_WARN_UNUSED_RESULT G_GNUC_MALLOC;
+gboolean mcus_simulation_restore (MCUSSimulation *self, const guchar *snapshot, gsize length, GError **error);
+gboolean mcus_simulation_save_snapshot (MCUSSimulation *self, const gchar *filename, GError **error);
+gboolean mcus_simulation_load_snapshot (MCUSSimulation *self, const gchar *filename, GError **error);
+
+void mcus_simulation_set_breakpoint (MCUSSimulation *self, guchar address, gboolean enabled);
+gboolean mcus_simulation_get_breakpoint (MCUSSimulation *self, guchar address);
+void mcus_simulation_clear_breakpoints (MCUSSimulation *self);
+
+guint mcus_simulation_add_watchpoint (MCUSSimulation *self, const gchar *expression, GError **error);
+void mcus_simulation_remove_watchpoint (MCUSSimulation *self, guint id);
+void mcus_simulation_clear_watchpoints (MCUSSimulation *self);
+
+void mcus_simulation_set_run_target (MCUSSimulation *self, gint address, guint max_stack_depth);
+gint mcus_simulation_get_run_target (MCUSSimulation *self, guint *max_stack_depth);
 
 G_END_DECLS
 
@@ -0,0 +1,394 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ * 
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib/gprintf.h>
+#include <gtk/gtk.h>
+#include <string.h>
+
+#include "stack-model.h"
+#include "simulation.h"
+
+static void mcus_stack_model_tree_model_init (GtkTreeModelIface *iface);
+static void mcus_stack_model_dispose (GObject *object);
+static void mcus_stack_model_get_property (GObject *object, guint property_id, GValue *value, GParamSpec *pspec);
+static void mcus_stack_model_set_property (GObject *object, guint property_id, const GValue *value, GParamSpec *pspec);
+
+struct _MCUSStackModelPrivate {
+	MCUSSimulation *simulation;
+	gint stamp;
+
+	/* The frames currently exposed as rows, copied from the simulation's stack each time the model's updated. The rows can't be read
+	 * from the simulation's stack directly, since it may have changed depth since rows were last inserted or deleted. */
+	MCUSStackFrame frames[STACK_SIZE];
+	guint depth;
+};
+
+enum {
+	PROP_SIMULATION = 1
+};
+
+G_DEFINE_TYPE_WITH_CODE (MCUSStackModel, mcus_stack_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL, mcus_stack_model_tree_model_init))
+
+static void
+mcus_stack_model_class_init (MCUSStackModelClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+	g_type_class_add_private (klass, sizeof (MCUSStackModelPrivate));
+
+	gobject_class->get_property = mcus_stack_model_get_property;
+	gobject_class->set_property = mcus_stack_model_set_property;
+	gobject_class->dispose = mcus_stack_model_dispose;
+
+	/**
+	 * MCUSStackModel:simulation:
+	 *
+	 * The simulation whose stack is exposed by the model.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_SIMULATION,
+				g_param_spec_object ("simulation",
+					"Simulation", "The simulation whose stack is exposed by the model.",
+					MCUS_TYPE_SIMULATION,
+					G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+mcus_stack_model_init (MCUSStackModel *self)
+{
+	self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, MCUS_TYPE_STACK_MODEL, MCUSStackModelPrivate);
+	self->priv->stamp = g_random_int ();
+}
+
+static void
+mcus_stack_model_dispose (GObject *object)
+{
+	MCUSStackModelPrivate *priv = MCUS_STACK_MODEL (object)->priv;
+
+	if (priv->simulation != NULL)
+		g_object_unref (priv->simulation);
+	priv->simulation = NULL;
+
+	/* Chain up to the parent class */
+	G_OBJECT_CLASS (mcus_stack_model_parent_class)->dispose (object);
+}
+
+static void
+mcus_stack_model_get_property (GObject *object, guint property_id, GValue *value, GParamSpec *pspec)
+{
+	MCUSStackModelPrivate *priv = MCUS_STACK_MODEL (object)->priv;
+
+	switch (property_id) {
+		case PROP_SIMULATION:
+			g_value_set_object (value, priv->simulation);
+			break;
+		default:
+			/* We don't have any other property... */
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+			break;
+	}
+}
+
+static void
+mcus_stack_model_set_property (GObject *object, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+	MCUSStackModelPrivate *priv = MCUS_STACK_MODEL (object)->priv;
+
+	switch (property_id) {
+		case PROP_SIMULATION:
+			priv->simulation = g_value_dup_object (value);
+			break;
+		default:
+			/* We don't have any other property... */
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+			break;
+	}
+}
+
+/* Rows are listed with the top of the stack first. Iterators store the index of their frame from the bottom of the stack, so they stay valid
+ * as frames are pushed and popped above them. */
+#define ROW_TO_FRAME(priv, row) ((priv)->depth - 1 - (row))
+#define FRAME_TO_ROW(priv, frame) ((priv)->depth - 1 - (frame))
+
+static GtkTreeModelFlags
+mcus_stack_model_get_flags (GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint
+mcus_stack_model_get_n_columns (GtkTreeModel *tree_model)
+{
+	return MCUS_STACK_MODEL_N_COLUMNS;
+}
+
+static GType
+mcus_stack_model_get_column_type (GtkTreeModel *tree_model, gint index_)
+{
+	switch (index_) {
+		case MCUS_STACK_MODEL_COLUMN_INDEX:
+			return G_TYPE_UINT;
+		case MCUS_STACK_MODEL_COLUMN_PROGRAM_COUNTER:
+			return G_TYPE_UCHAR;
+		case MCUS_STACK_MODEL_COLUMN_REGISTERS:
+			return G_TYPE_STRING;
+		default:
+			g_return_val_if_reached (G_TYPE_INVALID);
+	}
+}
+
+static gboolean
+set_iter (MCUSStackModel *self, GtkTreeIter *iter, gint row)
+{
+	MCUSStackModelPrivate *priv = self->priv;
+
+	if (row < 0 || (guint) row >= priv->depth) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	iter->stamp = priv->stamp;
+	iter->user_data = GUINT_TO_POINTER (ROW_TO_FRAME (priv, row));
+
+	return TRUE;
+}
+
+static gboolean
+mcus_stack_model_get_iter (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	g_return_val_if_fail (gtk_tree_path_get_depth (path) > 0, FALSE);
+
+	if (gtk_tree_path_get_depth (path) != 1)
+		return FALSE;
+
+	return set_iter (MCUS_STACK_MODEL (tree_model), iter, gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+mcus_stack_model_get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	MCUSStackModelPrivate *priv = MCUS_STACK_MODEL (tree_model)->priv;
+
+	g_return_val_if_fail (iter->stamp == priv->stamp, NULL);
+
+	return gtk_tree_path_new_from_indices (FRAME_TO_ROW (priv, GPOINTER_TO_UINT (iter->user_data)), -1);
+}
+
+static void
+mcus_stack_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value)
+{
+	MCUSStackModelPrivate *priv = MCUS_STACK_MODEL (tree_model)->priv;
+	guint frame_index = GPOINTER_TO_UINT (iter->user_data);
+	const MCUSStackFrame *frame;
+
+	g_return_if_fail (iter->stamp == priv->stamp);
+	g_return_if_fail (frame_index < priv->depth);
+
+	frame = &(priv->frames[frame_index]);
+	g_value_init (value, mcus_stack_model_get_column_type (tree_model, column));
+
+	switch (column) {
+		case MCUS_STACK_MODEL_COLUMN_INDEX:
+			g_value_set_uint (value, frame_index);
+			break;
+		case MCUS_STACK_MODEL_COLUMN_PROGRAM_COUNTER:
+			g_value_set_uchar (value, frame->program_counter);
+			break;
+		case MCUS_STACK_MODEL_COLUMN_REGISTERS: {
+			/* Build a string representing the registers; 3 characters for each register. This is only done for rows which are
+			 * actually displayed. */
+			gchar register_text[3 * REGISTER_COUNT], *f;
+			guint i;
+
+			f = register_text;
+			for (i = 0; i < REGISTER_COUNT; i++) {
+				g_sprintf (f, "%02X", frame->registers[i]);
+				*(f + 2) = ' ';
+				f += 3;
+			}
+			*(f - 1) = '\0';
+
+			g_value_set_string (value, register_text);
+			break;
+		}
+		default:
+			g_assert_not_reached ();
+	}
+}
+
+static gboolean
+mcus_stack_model_iter_next (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	MCUSStackModelPrivate *priv = MCUS_STACK_MODEL (tree_model)->priv;
+	guint frame_index = GPOINTER_TO_UINT (iter->user_data);
+
+	g_return_val_if_fail (iter->stamp == priv->stamp, FALSE);
+
+	/* The next row is the frame below this one */
+	if (frame_index == 0 || frame_index >= priv->depth) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	iter->user_data = GUINT_TO_POINTER (frame_index - 1);
+
+	return TRUE;
+}
+
+static gboolean
+mcus_stack_model_iter_children (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	if (parent != NULL) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	return set_iter (MCUS_STACK_MODEL (tree_model), iter, 0);
+}
+
+static gboolean
+mcus_stack_model_iter_has_child (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+static gint
+mcus_stack_model_iter_n_children (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return (iter == NULL) ? (gint) MCUS_STACK_MODEL (tree_model)->priv->depth : 0;
+}
+
+static gboolean
+mcus_stack_model_iter_nth_child (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+	if (parent != NULL) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	return set_iter (MCUS_STACK_MODEL (tree_model), iter, n);
+}
+
+static gboolean
+mcus_stack_model_iter_parent (GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+	iter->stamp = 0;
+	return FALSE;
+}
+
+static void
+mcus_stack_model_tree_model_init (GtkTreeModelIface *iface)
+{
+	iface->get_flags = mcus_stack_model_get_flags;
+	iface->get_n_columns = mcus_stack_model_get_n_columns;
+	iface->get_column_type = mcus_stack_model_get_column_type;
+	iface->get_iter = mcus_stack_model_get_iter;
+	iface->get_path = mcus_stack_model_get_path;
+	iface->get_value = mcus_stack_model_get_value;
+	iface->iter_next = mcus_stack_model_iter_next;
+	iface->iter_children = mcus_stack_model_iter_children;
+	iface->iter_has_child = mcus_stack_model_iter_has_child;
+	iface->iter_n_children = mcus_stack_model_iter_n_children;
+	iface->iter_nth_child = mcus_stack_model_iter_nth_child;
+	iface->iter_parent = mcus_stack_model_iter_parent;
+}
+
+/**
+ * mcus_stack_model_new:
+ * @simulation: the #MCUSSimulation whose stack should be exposed
+ *
+ * Creates a new #GtkTreeModel listing the frames on @simulation's stack, with the top of the stack first. The model only changes when
+ * mcus_stack_model_update() is called.
+ *
+ * Return value: a new #MCUSStackModel
+ **/
+MCUSStackModel *
+mcus_stack_model_new (MCUSSimulation *simulation)
+{
+	g_return_val_if_fail (MCUS_IS_SIMULATION (simulation), NULL);
+
+	return g_object_new (MCUS_TYPE_STACK_MODEL, "simulation", simulation, NULL);
+}
+
+MCUSSimulation *
+mcus_stack_model_get_simulation (MCUSStackModel *self)
+{
+	g_return_val_if_fail (MCUS_IS_STACK_MODEL (self), NULL);
+	return self->priv->simulation;
+}
+
+/**
+ * mcus_stack_model_update:
+ * @self: an #MCUSStackModel
+ *
+ * Brings the model up to date with the simulation's stack, emitting signals only for the rows which have been inserted, deleted or changed since
+ * the model was last updated. This should be called at most once per refresh of the display, rather than every time the stack changes, so that
+ * the cost of displaying the stack doesn't depend on how often the program calls subroutines.
+ **/
+void
+mcus_stack_model_update (MCUSStackModel *self)
+{
+	MCUSStackModelPrivate *priv;
+	GtkTreeModel *tree_model = GTK_TREE_MODEL (self);
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	guint i, depth, common_depth;
+
+	g_return_if_fail (MCUS_IS_STACK_MODEL (self));
+
+	priv = self->priv;
+	depth = mcus_simulation_get_stack_depth (priv->simulation);
+	common_depth = MIN (depth, priv->depth);
+
+	/* Update the frames which are still on the stack, in case they've been popped and replaced since the last update */
+	for (i = 0; i < common_depth; i++) {
+		MCUSStackFrame *frame = mcus_simulation_get_stack_frame (priv->simulation, i);
+
+		if (memcmp (&(priv->frames[i]), frame, sizeof (MCUSStackFrame)) == 0)
+			continue;
+
+		priv->frames[i] = *frame;
+
+		path = gtk_tree_path_new_from_indices (FRAME_TO_ROW (priv, i), -1);
+		set_iter (self, &iter, FRAME_TO_ROW (priv, i));
+		gtk_tree_model_row_changed (tree_model, path, &iter);
+		gtk_tree_path_free (path);
+	}
+
+	/* Remove the frames which have been popped, from the top down */
+	while (priv->depth > depth) {
+		priv->depth--;
+
+		path = gtk_tree_path_new_first ();
+		gtk_tree_model_row_deleted (tree_model, path);
+		gtk_tree_path_free (path);
+	}
+
+	/* Add the frames which have been pushed, from the bottom up */
+	while (priv->depth < depth) {
+		priv->frames[priv->depth] = *mcus_simulation_get_stack_frame (priv->simulation, priv->depth);
+		priv->depth++;
+
+		path = gtk_tree_path_new_first ();
+		set_iter (self, &iter, 0);
+		gtk_tree_model_row_inserted (tree_model, path, &iter);
+		gtk_tree_path_free (path);
+	}
+}
@@ -0,0 +1,64 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MCUS_STACK_MODEL_H
+#define MCUS_STACK_MODEL_H
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+
+#include "simulation.h"
+
+G_BEGIN_DECLS
+
+enum {
+	MCUS_STACK_MODEL_COLUMN_INDEX = 0, /* guint */
+	MCUS_STACK_MODEL_COLUMN_PROGRAM_COUNTER, /* guchar */
+	MCUS_STACK_MODEL_COLUMN_REGISTERS, /* gchararray */
+	MCUS_STACK_MODEL_N_COLUMNS
+};
+
+#define MCUS_TYPE_STACK_MODEL		(mcus_stack_model_get_type ())
+#define MCUS_STACK_MODEL(o)		(G_TYPE_CHECK_INSTANCE_CAST ((o), MCUS_TYPE_STACK_MODEL, MCUSStackModel))
+#define MCUS_STACK_MODEL_CLASS(k)	(G_TYPE_CHECK_CLASS_CAST((k), MCUS_TYPE_STACK_MODEL, MCUSStackModelClass))
+#define MCUS_IS_STACK_MODEL(o)		(G_TYPE_CHECK_INSTANCE_TYPE ((o), MCUS_TYPE_STACK_MODEL))
+#define MCUS_IS_STACK_MODEL_CLASS(k)	(G_TYPE_CHECK_CLASS_TYPE ((k), MCUS_TYPE_STACK_MODEL))
+#define MCUS_STACK_MODEL_GET_CLASS(o)	(G_TYPE_INSTANCE_GET_CLASS ((o), MCUS_TYPE_STACK_MODEL, MCUSStackModelClass))
+
+typedef struct _MCUSStackModelPrivate	MCUSStackModelPrivate;
+
+typedef struct {
+	GObject parent;
+	MCUSStackModelPrivate *priv;
+} MCUSStackModel;
+
+typedef struct {
+	GObjectClass parent;
+} MCUSStackModelClass;
+
+GType mcus_stack_model_get_type (void) G_GNUC_CONST;
+
+MCUSStackModel *mcus_stack_model_new (MCUSSimulation *simulation) G_GNUC_WARN_UNUSED_RESULT;
+MCUSSimulation *mcus_stack_model_get_simulation (MCUSStackModel *self);
+void mcus_stack_model_update (MCUSStackModel *self);
+
+G_END_DECLS
+
+#endif /* !MCUS_STACK_MODEL_H */
@@ -0,0 +1,319 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * An ahead-of-time translator from an assembled memory image to a C translation unit, which can be compiled to a shared module with the system
+ * C compiler and loaded by the simulation (see mcus_simulation_load_native()).
+ *
+ * Only the code which is reachable from PROGRAM_START_ADDRESS is translated. It's split into basic blocks, each of which is translated to its
+ * own function; blocks are chained through a constant table of function pointers indexed by address, rather than a switch on the opcode. The
+ * stack instructions (RCALL and RET), HALT and invalid opcodes aren't translated: blocks end just before them, and the simulation executes
+ * them itself before re-entering the translated code at the next block. I/O, the ADC and the delay subroutine go through the host interface
+ * in MCUSNativeState.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "simulation-private.h"
+#include "simulation-native.h"
+#include "translator.h"
+
+/* The layout of MCUSNativeState, as written into the translated code. This must be kept in sync with simulation-native.h. */
+static const gchar *preamble =
+	"typedef struct {\n"
+	"\tunsigned char registers[8];\n"
+	"\tunsigned char zero_flag;\n"
+	"\tunsigned char program_counter;\n"
+	"\tunsigned long long budget;\n"
+	"\tunsigned long long cycles;\n"
+	"\tconst unsigned char *lookup_table;\n"
+	"\tvoid *host_data;\n"
+	"\tunsigned char (*read_input) (void *host_data);\n"
+	"\tvoid (*write_output) (void *host_data, unsigned char value);\n"
+	"\tunsigned char (*read_adc) (void *host_data);\n"
+	"\tvoid (*wait_1ms) (void *host_data);\n"
+	"} MCUSNativeState;\n"
+	"\n"
+	"typedef int (*MCUSNativeBlock) (MCUSNativeState *state);\n"
+	"\n";
+
+/* Returns TRUE if the decoded operation can be executed by translated code */
+static gboolean
+is_translatable (const DecodedInstruction *instruction)
+{
+	switch (instruction->operation) {
+	case DECODED_HALT:
+	case DECODED_RCALL:
+	case DECODED_RET:
+	case DECODED_INVALID:
+	case DECODED_INVALID_REGISTER:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+/* Finds the basic block leaders by following control flow from the start of the program. Addresses the simulation resumes at after executing
+ * an untranslated instruction are leaders too, as are the fall-through addresses of conditional jumps. */
+static void
+find_leaders (const DecodedInstruction *decoded, gboolean *leaders)
+{
+	gboolean reached[MEMORY_SIZE] = { FALSE, };
+	guchar worklist[MEMORY_SIZE];
+	guint worklist_length = 0, address;
+
+#define REACH(A) G_STMT_START { \
+	if (reached[(A)] == FALSE) { \
+		reached[(A)] = TRUE; \
+		worklist[worklist_length++] = (A); \
+	} \
+} G_STMT_END
+
+	memset (leaders, 0, sizeof (gboolean) * MEMORY_SIZE);
+
+	leaders[PROGRAM_START_ADDRESS] = TRUE;
+	REACH (PROGRAM_START_ADDRESS);
+
+	while (worklist_length > 0) {
+		const DecodedInstruction *instruction = &(decoded[worklist[--worklist_length]]);
+
+		switch (instruction->operation) {
+		case DECODED_JP:
+			leaders[instruction->operand1] = TRUE;
+			REACH (instruction->operand1);
+			break;
+		case DECODED_JZ:
+		case DECODED_JNZ:
+		case DECODED_RCALL:
+			leaders[instruction->operand1] = TRUE;
+			leaders[instruction->next_program_counter] = TRUE;
+			REACH (instruction->operand1);
+			REACH (instruction->next_program_counter);
+			break;
+		case DECODED_HALT:
+		case DECODED_RET:
+		case DECODED_INVALID:
+		case DECODED_INVALID_REGISTER:
+			break;
+		default:
+			REACH (instruction->next_program_counter);
+			break;
+		}
+	}
+
+#undef REACH
+
+	/* Only translatable instructions can start a block */
+	for (address = 0; address < MEMORY_SIZE; address++) {
+		if (reached[address] == FALSE || is_translatable (&(decoded[address])) == FALSE)
+			leaders[address] = FALSE;
+	}
+}
+
+/* Appends the C for a single instruction, other than a jump */
+static void
+translate_instruction (GString *output, const DecodedInstruction *instruction)
+{
+	guint d = instruction->operand1, s = instruction->operand2;
+
+	switch (instruction->operation) {
+	case DECODED_MOVI:
+		g_string_append_printf (output, "\tr[%u] = 0x%02X;\n", d, s);
+		break;
+	case DECODED_MOV:
+		g_string_append_printf (output, "\tr[%u] = r[%u];\n", d, s);
+		break;
+	case DECODED_ADD:
+		g_string_append_printf (output, "\tr[%u] += r[%u];\n\tstate->zero_flag = (r[%u] == 0);\n", d, s, d);
+		break;
+	case DECODED_SUB:
+		g_string_append_printf (output, "\tr[%u] -= r[%u];\n\tstate->zero_flag = (r[%u] == 0);\n", d, s, d);
+		break;
+	case DECODED_AND:
+		g_string_append_printf (output, "\tr[%u] &= r[%u];\n\tstate->zero_flag = (r[%u] == 0);\n", d, s, d);
+		break;
+	case DECODED_EOR:
+		g_string_append_printf (output, "\tr[%u] ^= r[%u];\n\tstate->zero_flag = (r[%u] == 0);\n", d, s, d);
+		break;
+	case DECODED_INC:
+		g_string_append_printf (output, "\tr[%u]++;\n\tstate->zero_flag = (r[%u] == 0);\n", d, d);
+		break;
+	case DECODED_DEC:
+		g_string_append_printf (output, "\tr[%u]--;\n\tstate->zero_flag = (r[%u] == 0);\n", d, d);
+		break;
+	case DECODED_SHL:
+		g_string_append_printf (output, "\tr[%u] <<= 1;\n\tstate->zero_flag = (r[%u] == 0);\n", d, d);
+		break;
+	case DECODED_SHR:
+		g_string_append_printf (output, "\tr[%u] >>= 1;\n\tstate->zero_flag = (r[%u] == 0);\n", d, d);
+		break;
+	case DECODED_IN:
+		g_string_append_printf (output, "\tr[%u] = state->read_input (state->host_data);\n", d);
+		break;
+	case DECODED_OUT:
+		g_string_append_printf (output, "\tstate->write_output (state->host_data, r[%u]);\n", d);
+		break;
+	case DECODED_READTABLE:
+		g_string_append (output, "\tr[0] = state->lookup_table[r[7]];\n");
+		break;
+	case DECODED_WAIT1MS:
+		g_string_append (output, "\tstate->wait_1ms (state->host_data);\n");
+		break;
+	case DECODED_READADC:
+		g_string_append (output, "\tr[0] = state->read_adc (state->host_data);\n");
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+/* Appends the function for the basic block starting at @leader */
+static void
+translate_block (GString *output, const DecodedInstruction *decoded, const gboolean *leaders, guchar leader)
+{
+	GString *body = g_string_new (NULL);
+	const DecodedInstruction *instruction;
+	guint length = 0, cycles = 0;
+	guchar address = leader;
+	gboolean uses_registers = FALSE;
+
+	/* Translate the block body first, so that its length is known for the budget check. The cycles taken are added up as the block goes,
+	 * but only need to be added to the state before the ADC is read (which samples the analogue input at the current cycle), before the
+	 * output port is written (which is timed for persistence of vision) and at the end of the block. */
+	while (TRUE) {
+		instruction = &(decoded[address]);
+		length++;
+
+		if ((instruction->operation == DECODED_READADC || instruction->operation == DECODED_OUT) && cycles > 0) {
+			g_string_append_printf (body, "\tstate->cycles += %u;\n", cycles);
+			cycles = 0;
+		}
+
+		cycles += instruction->cycles;
+
+		if (instruction->operation == DECODED_JP) {
+			g_string_append_printf (body, "\tstate->program_counter = 0x%02X;\n", instruction->operand1);
+			break;
+		} else if (instruction->operation == DECODED_JZ || instruction->operation == DECODED_JNZ) {
+			g_string_append_printf (body, "\tstate->program_counter = state->zero_flag ? 0x%02X : 0x%02X;\n",
+			                        (instruction->operation == DECODED_JZ) ? instruction->operand1 : instruction->next_program_counter,
+			                        (instruction->operation == DECODED_JZ) ? instruction->next_program_counter : instruction->operand1);
+			break;
+		}
+
+		translate_instruction (body, instruction);
+		if (instruction->operation != DECODED_WAIT1MS)
+			uses_registers = TRUE;
+		address = instruction->next_program_counter;
+
+		/* Fall through into the next block, or back to the simulation for an untranslatable instruction */
+		if (leaders[address] == TRUE || is_translatable (&(decoded[address])) == FALSE || length == MEMORY_SIZE) {
+			g_string_append_printf (body, "\tstate->program_counter = 0x%02X;\n", address);
+			break;
+		}
+	}
+
+	g_string_append_printf (body, "\tstate->cycles += %u;\n", cycles);
+
+	g_string_append_printf (output,
+	                        "static int\n"
+	                        "block_%02X (MCUSNativeState *state)\n"
+	                        "{\n"
+	                        "%s"
+	                        "\tif (state->budget < %u)\n"
+	                        "\t\treturn 0;\n"
+	                        "\tstate->budget -= %u;\n"
+	                        "\n"
+	                        "%s"
+	                        "\treturn 1;\n"
+	                        "}\n\n",
+	                        leader, (uses_registers == TRUE) ? "\tunsigned char *r = state->registers;\n\n" : "",
+	                        length, length, body->str);
+
+	g_string_free (body, TRUE);
+}
+
+/**
+ * mcus_translate_to_c:
+ * @memory: the memory image of an assembled program, with %MEMORY_SIZE bytes
+ *
+ * Translates the program in @memory to a self-contained C translation unit, which can be compiled to a shared module with a command such as
+ * <literal>cc -shared -fPIC -O2 -o program.so program.c</literal> and then loaded with mcus_simulation_load_native().
+ *
+ * Return value: the C source of the translation; free with g_free()
+ **/
+gchar *
+mcus_translate_to_c (const guchar *memory)
+{
+	DecodedInstruction decoded[MEMORY_SIZE];
+	gboolean leaders[MEMORY_SIZE];
+	GString *output;
+	guint address;
+
+	g_return_val_if_fail (memory != NULL, NULL);
+
+	mcus_decode_memory (memory, decoded);
+	find_leaders (decoded, leaders);
+
+	output = g_string_new ("/* Translated from an assembled program by MCUS. Do not edit: regenerate it with mcus --translate instead. */\n\n");
+	g_string_append (output, preamble);
+
+	/* Identification of the module, checked when it's loaded */
+	g_string_append_printf (output, "const unsigned int mcus_native_abi_version = %u;\n\n", MCUS_NATIVE_ABI_VERSION);
+	g_string_append (output, "const unsigned char mcus_native_memory[256] = {");
+	for (address = 0; address < MEMORY_SIZE; address++)
+		g_string_append_printf (output, "%s0x%02X,", (address % 16 == 0) ? "\n\t" : " ", memory[address]);
+	g_string_append (output, "\n};\n\n");
+
+	/* Basic blocks */
+	for (address = 0; address < MEMORY_SIZE; address++) {
+		if (leaders[address] == TRUE)
+			translate_block (output, decoded, leaders, address);
+	}
+
+	/* Dispatch table and entry points */
+	g_string_append (output, "static const MCUSNativeBlock blocks[256] = {\n");
+	for (address = 0; address < MEMORY_SIZE; address++) {
+		if (leaders[address] == TRUE)
+			g_string_append_printf (output, "\tblock_%02X,\n", address);
+		else
+			g_string_append (output, "\t0,\n");
+	}
+	g_string_append (output, "};\n\n");
+
+	g_string_append (output, "const unsigned char mcus_native_entry_points[256] = {");
+	for (address = 0; address < MEMORY_SIZE; address++)
+		g_string_append_printf (output, "%s%u,", (address % 32 == 0) ? "\n\t" : " ", (leaders[address] == TRUE) ? 1 : 0);
+	g_string_append (output, "\n};\n\n");
+
+	g_string_append (output,
+	                 "unsigned long long\n"
+	                 "mcus_native_run (MCUSNativeState *state)\n"
+	                 "{\n"
+	                 "\tunsigned long long budget = state->budget;\n"
+	                 "\tMCUSNativeBlock block;\n"
+	                 "\n"
+	                 "\twhile ((block = blocks[state->program_counter]) != 0 && block (state) != 0);\n"
+	                 "\n"
+	                 "\treturn budget - state->budget;\n"
+	                 "}\n");
+
+	return g_string_free (output, FALSE);
+}
@@ -30,6 +30,8 @@
 
 #define MAX_WIDTH_BYTES 16 /* maximum number of bytes to display on a line */
 
+static const gchar hex_digits[] = "0123456789ABCDEF";
+
 static void mcus_byte_array_dispose (GObject *object);
 static void mcus_byte_array_finalize (GObject *object);
 static void mcus_byte_array_get_property (GObject *object, guint property_id, GValue *value, GParamSpec *pspec);
@@ -41,6 +43,7 @@ static void mcus_byte_array_style_set (GtkWidget *widget, GtkStyle *previous_sty
 static void ensure_layout (MCUSByteArray *self);
 static gint get_width_pu (MCUSByteArray *self);
 static void get_layout_location (MCUSByteArray *self, gint *xp, gint *yp);
+static void rebuild_text (MCUSByteArray *self);
 
 struct _MCUSByteArrayPrivate {
 	const guchar *array;
@@ -53,7 +56,9 @@ struct _MCUSByteArrayPrivate {
 	PangoAttribute *highlight_attr; /* owned by @attr_list */
 	PangoFontDescription *font_desc;
 	guint width_chars; /* number of characters in one line of the array */
-	gchar *text;
+	gchar *text; /* preallocated for the number of bytes displayed; bytes are updated in place */
+	guchar *shadow; /* copy of the bytes last displayed, to diff the array against */
+	guint shown_length; /* number of bytes in @shadow */
 };
 
 enum {
@@ -142,6 +147,7 @@ mcus_byte_array_finalize (GObject *object)
 	MCUSByteArrayPrivate *priv = MCUS_BYTE_ARRAY (object)->priv;
 
 	g_free (priv->text);
+	g_free (priv->shadow);
 	pango_font_description_free (priv->font_desc);
 
 	/* Chain up to the parent class */
@@ -398,13 +404,44 @@ mcus_byte_array_new (const guchar *array, guint array_length)
 	                     NULL);
 }
 
-void
-mcus_byte_array_update (MCUSByteArray *self)
+/* Invalidate the area showing the byte at @index, given the location of the layout */
+static void
+invalidate_byte (MCUSByteArray *self, guint index, gint layout_x, gint layout_y)
+{
+	PangoRectangle pos;
+	GdkRectangle rect;
+
+	/* Each byte's two characters wide; allow an extra pixel all round for antialiasing */
+	pango_layout_index_to_pos (self->priv->layout, index * 3, &pos);
+
+	rect.x = layout_x + PANGO_PIXELS_FLOOR (pos.x) - 1;
+	rect.y = layout_y + PANGO_PIXELS_FLOOR (pos.y) - 1;
+	rect.width = PANGO_PIXELS_CEIL (pos.width * 2) + 2;
+	rect.height = PANGO_PIXELS_CEIL (pos.height) + 2;
+
+	gdk_window_invalidate_rect (gtk_widget_get_window (GTK_WIDGET (self)), &rect, FALSE);
+}
+
+/* Format the byte at @index into the text */
+static inline void
+format_byte (MCUSByteArrayPrivate *priv, guint index)
+{
+	priv->text[index * 3] = hex_digits[priv->shadow[index] >> 4];
+	priv->text[index * 3 + 1] = hex_digits[priv->shadow[index] & 0x0F];
+}
+
+/* Rebuild the text and the shadow copy of the array from scratch, after the array or the number of bytes displayed have changed */
+static void
+rebuild_text (MCUSByteArray *self)
 {
 	guint text_length, i;
 	gchar *f;
 	MCUSByteArrayPrivate *priv = self->priv;
 
+	g_free (priv->shadow);
+	priv->shadow = NULL;
+	priv->shown_length = 0;
+
 	/* Free everything if there's nothing to display */
 	if (priv->display_length == 0 || priv->array == NULL) {
 		g_free (priv->text);
@@ -415,18 +452,21 @@ mcus_byte_array_update (MCUSByteArray *self)
 	/* Update the text; two hex characters per byte, plus a space, newline or nul */
 	text_length = priv->display_length * 3;
 
-	/* Add a extra character (three bytes) for ellipsisation */
+	/* Add an extra character (three bytes, plus the nul) for ellipsisation */
 	if (priv->display_length < priv->array_length)
-		text_length += 3;
+		text_length += 4;
 
 	/* Allocate storage */
 	g_free (priv->text);
 	priv->text = g_malloc (sizeof (gchar) * text_length);
 
+	priv->shown_length = MIN (priv->display_length, priv->array_length);
+	priv->shadow = g_memdup (priv->array, sizeof (guchar) * priv->shown_length);
+
 	/* Set the text */
 	f = priv->text;
-	for (i = 0; i < MIN (priv->display_length, priv->array_length); i++) {
-		g_sprintf (f, "%02X", priv->array[i]);
+	for (i = 0; i < priv->shown_length; i++) {
+		format_byte (priv, i);
 		*(f + 2) = ' ';
 		f += 3;
 
@@ -448,6 +488,52 @@ update_layout:
 	gtk_widget_queue_draw (GTK_WIDGET (self));
 }
 
+/**
+ * mcus_byte_array_update:
+ * @self: an #MCUSByteArray
+ *
+ * Updates the display after the contents of the array have changed. Only the bytes which differ from those last displayed are reformatted
+ * and redrawn, so this is cheap to call frequently.
+ **/
+void
+mcus_byte_array_update (MCUSByteArray *self)
+{
+	MCUSByteArrayPrivate *priv;
+	gboolean changed = FALSE, drawable;
+	gint layout_x = 0, layout_y = 0;
+	guint i;
+
+	g_return_if_fail (MCUS_IS_BYTE_ARRAY (self));
+
+	priv = self->priv;
+
+	if (priv->text == NULL) {
+		rebuild_text (self);
+		return;
+	}
+
+	drawable = gtk_widget_is_drawable (GTK_WIDGET (self));
+	if (drawable == TRUE && priv->shown_length > 0)
+		get_layout_location (self, &layout_x, &layout_y);
+
+	/* Diff the array against what was last displayed. The text's laid out in a monospace font, so changing the bytes in it doesn't move
+	 * any of the others, and only the changed bytes need redrawing. */
+	for (i = 0; i < priv->shown_length; i++) {
+		if (G_LIKELY (priv->array[i] == priv->shadow[i]))
+			continue;
+
+		priv->shadow[i] = priv->array[i];
+		format_byte (priv, i);
+
+		if (drawable == TRUE)
+			invalidate_byte (self, i, layout_x, layout_y);
+		changed = TRUE;
+	}
+
+	if (changed == TRUE)
+		pango_layout_set_text (priv->layout, priv->text, -1);
+}
+
 const guchar *
 mcus_byte_array_get_array (MCUSByteArray *self, guint *array_length)
 {
@@ -467,7 +553,7 @@ mcus_byte_array_set_array (MCUSByteArray *self, const guchar *array, guint array
 	self->priv->array = array;
 	self->priv->array_length = array_length;
 
-	mcus_byte_array_update (self);
+	rebuild_text (self);
 	gtk_widget_queue_resize (GTK_WIDGET (self));
 
 	g_object_freeze_notify (G_OBJECT (self));
@@ -500,7 +586,7 @@ mcus_byte_array_set_display_length (MCUSByteArray *self, guint display_length)
 	if (priv->display_length < MAX_WIDTH_BYTES && priv->display_length < priv->array_length)
 		priv->width_chars = priv->display_length * 3 + 1;
 
-	mcus_byte_array_update (self);
+	rebuild_text (self);
 	gtk_widget_queue_resize (GTK_WIDGET (self));
 
 	g_object_notify (G_OBJECT (self), "display-length");
@@ -517,12 +603,14 @@ void
 mcus_byte_array_set_highlight_byte (MCUSByteArray *self, gint highlight_byte)
 {
 	MCUSByteArrayPrivate *priv = self->priv;
+	gint old_highlight_byte;
 
 	g_return_if_fail (MCUS_IS_BYTE_ARRAY (self));
 	g_return_if_fail (highlight_byte >= -1);
 
 	ensure_layout (self);
 
+	old_highlight_byte = priv->highlight_byte;
 	priv->highlight_byte = highlight_byte;
 
 	/* Update the Pango attribute which actually highlights the byte */
@@ -534,7 +622,17 @@ mcus_byte_array_set_highlight_byte (MCUSByteArray *self, gint highlight_byte)
 		pango_layout_set_attributes (priv->layout, priv->attr_list);
 	}
 
-	gtk_widget_queue_draw (GTK_WIDGET (self));
+	/* Only the old and new highlighted bytes need redrawing */
+	if (gtk_widget_is_drawable (GTK_WIDGET (self)) == TRUE) {
+		gint layout_x, layout_y;
+
+		get_layout_location (self, &layout_x, &layout_y);
+
+		if (old_highlight_byte != -1 && (guint) old_highlight_byte < priv->shown_length)
+			invalidate_byte (self, old_highlight_byte, layout_x, layout_y);
+		if (highlight_byte != -1 && (guint) highlight_byte < priv->shown_length)
+			invalidate_byte (self, highlight_byte, layout_x, layout_y);
+	}
 
 	g_object_notify (G_OBJECT (self), "highlight-byte");
 }
@@ -0,0 +1,626 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <gtk/gtk.h>
+#include <atk/atk.h>
+#include <math.h>
+
+#include "led-bar.h"
+
+#define MINIMUM_SIZE 30 /* of each LED */
+#define LED_SPACING 6 /* between each LED */
+#define BRIGHTNESS_LEVELS 255 /* brightnesses are rounded to this many levels, so that imperceptible changes don't cause redraws */
+
+static void mcus_led_bar_get_property (GObject *object, guint property_id, GValue *value, GParamSpec *pspec);
+static void mcus_led_bar_set_property (GObject *object, guint property_id, const GValue *value, GParamSpec *pspec);
+static void mcus_led_bar_size_request (GtkWidget *widget, GtkRequisition *requisition);
+static gint mcus_led_bar_expose_event (GtkWidget *widget, GdkEventExpose *event);
+static AtkObject *mcus_led_bar_get_accessible (GtkWidget *widget);
+static GType mcus_led_bar_accessible_get_type (void) G_GNUC_CONST;
+
+struct _MCUSLEDBarPrivate {
+	gdouble brightnesses[LED_BAR_LEDS]; /* indexed by bit; from 0.0 (off) to 1.0 (fully on) */
+};
+
+enum {
+	PROP_VALUE = 1
+};
+
+G_DEFINE_TYPE (MCUSLEDBar, mcus_led_bar, GTK_TYPE_WIDGET)
+
+MCUSLEDBar *
+mcus_led_bar_new (void)
+{
+	return g_object_new (MCUS_TYPE_LED_BAR, NULL);
+}
+
+static void
+mcus_led_bar_class_init (MCUSLEDBarClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+	g_type_class_add_private (klass, sizeof (MCUSLEDBarPrivate));
+
+	gobject_class->get_property = mcus_led_bar_get_property;
+	gobject_class->set_property = mcus_led_bar_set_property;
+
+	widget_class->size_request = mcus_led_bar_size_request;
+	widget_class->expose_event = mcus_led_bar_expose_event;
+	widget_class->get_accessible = mcus_led_bar_get_accessible;
+
+	/**
+	 * MCUSLEDBar:value:
+	 *
+	 * The byte displayed on the LEDs, with the most significant bit on the left. Each bit is enabled if its LED is at least half on.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_VALUE,
+				g_param_spec_uchar ("value",
+					"Value", "The byte displayed on the LEDs.",
+					0, G_MAXUINT8, 0,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+mcus_led_bar_init (MCUSLEDBar *self)
+{
+	self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, MCUS_TYPE_LED_BAR, MCUSLEDBarPrivate);
+
+	/* We don't have a window of our own; we use our parent's */
+	gtk_widget_set_has_window (GTK_WIDGET (self), FALSE);
+}
+
+static void
+mcus_led_bar_get_property (GObject *object, guint property_id, GValue *value, GParamSpec *pspec)
+{
+	switch (property_id) {
+		case PROP_VALUE:
+			g_value_set_uchar (value, mcus_led_bar_get_value (MCUS_LED_BAR (object)));
+			break;
+		default:
+			/* We don't have any other property... */
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+			break;
+	}
+}
+
+static void
+mcus_led_bar_set_property (GObject *object, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+	switch (property_id) {
+		case PROP_VALUE:
+			mcus_led_bar_set_value (MCUS_LED_BAR (object), g_value_get_uchar (value));
+			break;
+		default:
+			/* We don't have any other property... */
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+			break;
+	}
+}
+
+static void
+mcus_led_bar_size_request (GtkWidget *widget, GtkRequisition *requisition)
+{
+	g_return_if_fail (requisition != NULL);
+	g_return_if_fail (MCUS_IS_LED_BAR (widget));
+
+	requisition->width = MINIMUM_SIZE * LED_BAR_LEDS + LED_SPACING * (LED_BAR_LEDS - 1);
+	requisition->height = MINIMUM_SIZE;
+}
+
+/* Get the area of the widget's window covered by the LED for bit @led. The LEDs are laid out with the most significant bit first. */
+static void
+get_led_area (MCUSLEDBar *self, guint led, GdkRectangle *area)
+{
+	GtkAllocation allocation;
+	gint cell_width, column;
+
+	gtk_widget_get_allocation (GTK_WIDGET (self), &allocation);
+
+	cell_width = MAX ((allocation.width - LED_SPACING * (LED_BAR_LEDS - 1)) / LED_BAR_LEDS, 0);
+	if (gtk_widget_get_direction (GTK_WIDGET (self)) == GTK_TEXT_DIR_RTL)
+		column = led;
+	else
+		column = LED_BAR_LEDS - 1 - led;
+
+	area->width = area->height = MIN (cell_width, allocation.height);
+	area->x = allocation.x + column * (cell_width + LED_SPACING) + (cell_width - area->width) / 2;
+	area->y = allocation.y + (allocation.height - area->height) / 2;
+}
+
+static gint
+mcus_led_bar_expose_event (GtkWidget *widget, GdkEventExpose *event)
+{
+	cairo_t *cr;
+	MCUSLEDBarPrivate *priv;
+	GdkColor lit, fill, stroke;
+	GdkRectangle area, intersection;
+	GtkStyle *style;
+	guint i;
+
+	g_return_val_if_fail (event != NULL, FALSE);
+	g_return_val_if_fail (MCUS_IS_LED_BAR (widget), FALSE);
+
+	priv = MCUS_LED_BAR (widget)->priv;
+
+	/* Prepare our custom colours. Each LED's filled with a blend of the lit and unlit colours according to its brightness. */
+	lit.red = 29555; /* Tango's medium "chameleon" --- 73d216 */
+	lit.green = 53970;
+	lit.blue = 5654;
+	stroke.red = 34952; /* Tango's lightest "aluminium" --- 888a85 */
+	stroke.green = 35466;
+	stroke.blue = 34181;
+
+	/* Draw! */
+	cr = gdk_cairo_create (gtk_widget_get_window (widget));
+
+	/* Clip to the exposed area */
+	cairo_rectangle (cr, event->area.x, event->area.y, event->area.width, event->area.height);
+	cairo_clip (cr);
+
+	style = gtk_widget_get_style (widget);
+	cairo_set_line_width (cr, style->xthickness);
+
+	/* Draw only the LEDs which have been exposed; normally, those which have changed */
+	for (i = 0; i < LED_BAR_LEDS; i++) {
+		get_led_area (MCUS_LED_BAR (widget), i, &area);
+		if (gdk_rectangle_intersect (&(event->area), &area, &intersection) == FALSE)
+			continue;
+
+		fill.red = stroke.red + (lit.red - stroke.red) * priv->brightnesses[i];
+		fill.green = stroke.green + (lit.green - stroke.green) * priv->brightnesses[i];
+		fill.blue = stroke.blue + (lit.blue - stroke.blue) * priv->brightnesses[i];
+
+		/* Ensure the borders aren't clipped */
+		cairo_new_sub_path (cr);
+		cairo_arc (cr,
+		           area.x + area.width / 2.0,
+		           area.y + area.height / 2.0,
+		           area.width / 2.0 - style->xthickness,
+		           0, 2 * M_PI);
+		gdk_cairo_set_source_color (cr, &fill);
+		cairo_fill_preserve (cr);
+		gdk_cairo_set_source_color (cr, &stroke);
+		cairo_stroke (cr);
+	}
+
+	cairo_destroy (cr);
+
+	return TRUE;
+}
+
+guchar
+mcus_led_bar_get_value (MCUSLEDBar *self)
+{
+	guchar value = 0;
+	guint i;
+
+	g_return_val_if_fail (MCUS_IS_LED_BAR (self), 0);
+
+	for (i = 0; i < LED_BAR_LEDS; i++) {
+		if (self->priv->brightnesses[i] >= 0.5)
+			value |= 1 << i;
+	}
+
+	return value;
+}
+
+/**
+ * mcus_led_bar_set_value:
+ * @self: an #MCUSLEDBar
+ * @value: the byte to display
+ *
+ * Displays @value on the LEDs, one bit per LED, with each LED either fully on or off. Only the LEDs which change are redrawn.
+ **/
+void
+mcus_led_bar_set_value (MCUSLEDBar *self, guchar value)
+{
+	gdouble brightnesses[LED_BAR_LEDS];
+	guint i;
+
+	g_return_if_fail (MCUS_IS_LED_BAR (self));
+
+	for (i = 0; i < LED_BAR_LEDS; i++)
+		brightnesses[i] = (value & (1 << i)) ? 1.0 : 0.0;
+
+	mcus_led_bar_set_brightnesses (self, brightnesses);
+}
+
+gdouble
+mcus_led_bar_get_brightness (MCUSLEDBar *self, guint led)
+{
+	g_return_val_if_fail (MCUS_IS_LED_BAR (self), 0.0);
+	g_return_val_if_fail (led < LED_BAR_LEDS, 0.0);
+
+	return self->priv->brightnesses[led];
+}
+
+/**
+ * mcus_led_bar_set_brightnesses:
+ * @self: an #MCUSLEDBar
+ * @brightnesses: an array of %LED_BAR_LEDS brightnesses, indexed by bit
+ *
+ * Sets the brightness of every LED at once, from 0.0 (off) to 1.0 (fully on); for example, to the proportion of the time each bit of the
+ * output port is set for. Only the LEDs whose brightness has changed perceptibly are redrawn, all in the same expose.
+ **/
+void
+mcus_led_bar_set_brightnesses (MCUSLEDBar *self, const gdouble *brightnesses)
+{
+	MCUSLEDBarPrivate *priv;
+	GdkRectangle area;
+	guchar old_value;
+	guint i;
+
+	g_return_if_fail (MCUS_IS_LED_BAR (self));
+	g_return_if_fail (brightnesses != NULL);
+
+	priv = self->priv;
+	old_value = mcus_led_bar_get_value (self);
+
+	for (i = 0; i < LED_BAR_LEDS; i++) {
+		gdouble brightness = floor (CLAMP (brightnesses[i], 0.0, 1.0) * BRIGHTNESS_LEVELS + 0.5) / BRIGHTNESS_LEVELS;
+
+		if (brightness == priv->brightnesses[i])
+			continue;
+
+		priv->brightnesses[i] = brightness;
+
+		/* Ensure the LED's redrawn */
+		if (gtk_widget_is_drawable (GTK_WIDGET (self)) == TRUE) {
+			get_led_area (self, i, &area);
+			gdk_window_invalidate_rect (gtk_widget_get_window (GTK_WIDGET (self)), &area, FALSE);
+		}
+	}
+
+	if (mcus_led_bar_get_value (self) != old_value)
+		g_object_notify (G_OBJECT (self), "value");
+}
+
+/* Accessibility stuff. The bar's accessible has a child for each LED, which is described the same way as an MCUSLED. */
+typedef struct {
+	AtkObject parent;
+	guint led;
+} MCUSLEDBarLEDAccessible;
+
+typedef struct {
+	AtkObjectClass parent;
+} MCUSLEDBarLEDAccessibleClass;
+
+static GType mcus_led_bar_led_accessible_get_type (void) G_GNUC_CONST;
+static void mcus_led_bar_led_accessible_image_interface_init (AtkImageIface *iface);
+static void mcus_led_bar_led_accessible_component_interface_init (AtkComponentIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (MCUSLEDBarLEDAccessible, mcus_led_bar_led_accessible, ATK_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (ATK_TYPE_IMAGE, mcus_led_bar_led_accessible_image_interface_init)
+                         G_IMPLEMENT_INTERFACE (ATK_TYPE_COMPONENT, mcus_led_bar_led_accessible_component_interface_init))
+
+/* Returns the bar an LED's accessible belongs to, or %NULL if it's been destroyed */
+static MCUSLEDBar *
+get_led_bar (AtkObject *accessible)
+{
+	AtkObject *parent = atk_object_get_parent (accessible);
+
+	if (parent == NULL || GTK_ACCESSIBLE (parent)->widget == NULL)
+		return NULL;
+
+	return MCUS_LED_BAR (GTK_ACCESSIBLE (parent)->widget);
+}
+
+static AtkObject *
+mcus_led_bar_led_accessible_new (AtkObject *parent, guint led)
+{
+	MCUSLEDBarLEDAccessible *accessible;
+	gchar *name;
+
+	accessible = g_object_new (mcus_led_bar_led_accessible_get_type (), NULL);
+	accessible->led = led;
+
+	atk_object_set_parent (ATK_OBJECT (accessible), parent);
+	atk_object_set_role (ATK_OBJECT (accessible), ATK_ROLE_IMAGE);
+
+	/* Translators: this is the accessible name of one of the LEDs in a row of them, numbered by the bit it displays */
+	name = g_strdup_printf (_("Bit %u"), led);
+	atk_object_set_name (ATK_OBJECT (accessible), name);
+	g_free (name);
+
+	if (led == LED_BAR_LEDS - 1)
+		atk_object_set_description (ATK_OBJECT (accessible), _("Most significant bit"));
+	else if (led == 0)
+		atk_object_set_description (ATK_OBJECT (accessible), _("Least significant bit"));
+
+	return ATK_OBJECT (accessible);
+}
+
+static gint
+mcus_led_bar_led_accessible_get_index_in_parent (AtkObject *accessible)
+{
+	/* The most significant bit comes first */
+	return LED_BAR_LEDS - 1 - ((MCUSLEDBarLEDAccessible *) accessible)->led;
+}
+
+static AtkStateSet *
+mcus_led_bar_led_accessible_ref_state_set (AtkObject *accessible)
+{
+	AtkStateSet *state_set;
+	MCUSLEDBar *bar = get_led_bar (accessible);
+
+	state_set = ATK_OBJECT_CLASS (mcus_led_bar_led_accessible_parent_class)->ref_state_set (accessible);
+
+	if (bar == NULL) {
+		atk_state_set_add_state (state_set, ATK_STATE_DEFUNCT);
+	} else if (gtk_widget_is_drawable (GTK_WIDGET (bar)) == TRUE) {
+		atk_state_set_add_state (state_set, ATK_STATE_VISIBLE);
+		atk_state_set_add_state (state_set, ATK_STATE_SHOWING);
+	}
+
+	return state_set;
+}
+
+static void
+mcus_led_bar_led_accessible_class_init (MCUSLEDBarLEDAccessibleClass *klass)
+{
+	AtkObjectClass *atk_class = ATK_OBJECT_CLASS (klass);
+
+	atk_class->get_index_in_parent = mcus_led_bar_led_accessible_get_index_in_parent;
+	atk_class->ref_state_set = mcus_led_bar_led_accessible_ref_state_set;
+}
+
+static void
+mcus_led_bar_led_accessible_init (MCUSLEDBarLEDAccessible *self)
+{
+	/* Nothing to see here */
+}
+
+static void
+mcus_led_bar_led_accessible_component_get_extents (AtkComponent *component, gint *x, gint *y, gint *width, gint *height, AtkCoordType coord_type)
+{
+	MCUSLEDBar *bar = get_led_bar (ATK_OBJECT (component));
+	GdkWindow *window;
+	GdkRectangle area;
+	gint window_x, window_y;
+
+	if (bar == NULL || gtk_widget_get_window (GTK_WIDGET (bar)) == NULL) {
+		*x = *y = *width = *height = 0;
+		return;
+	}
+
+	get_led_area (bar, ((MCUSLEDBarLEDAccessible *) component)->led, &area);
+
+	/* The area's relative to the bar's window; convert it to the requested coordinates */
+	window = gtk_widget_get_window (GTK_WIDGET (bar));
+	gdk_window_get_origin (window, &window_x, &window_y);
+
+	if (coord_type == ATK_XY_WINDOW) {
+		gint toplevel_x, toplevel_y;
+
+		gdk_window_get_origin (gdk_window_get_toplevel (window), &toplevel_x, &toplevel_y);
+		window_x -= toplevel_x;
+		window_y -= toplevel_y;
+	}
+
+	*x = window_x + area.x;
+	*y = window_y + area.y;
+	*width = area.width;
+	*height = area.height;
+}
+
+static void
+mcus_led_bar_led_accessible_component_interface_init (AtkComponentIface *iface)
+{
+	iface->get_extents = mcus_led_bar_led_accessible_component_get_extents;
+}
+
+static void
+mcus_led_bar_led_accessible_image_get_size (AtkImage *image, gint *width, gint *height)
+{
+	MCUSLEDBar *bar = get_led_bar (ATK_OBJECT (image));
+
+	if (!bar) {
+		*width = *height = 0;
+	} else {
+		GdkRectangle area;
+		get_led_area (bar, ((MCUSLEDBarLEDAccessible *) image)->led, &area);
+
+		*width = area.width;
+		*height = area.height;
+	}
+}
+
+static const gchar *
+mcus_led_bar_led_accessible_image_get_description (AtkImage *image)
+{
+	MCUSLEDBar *bar = get_led_bar (ATK_OBJECT (image));
+
+	if (bar == NULL)
+		return NULL;
+
+	return (mcus_led_bar_get_value (bar) & (1 << ((MCUSLEDBarLEDAccessible *) image)->led)) ? _("LED on") : _("LED off");
+}
+
+static void
+mcus_led_bar_led_accessible_image_interface_init (AtkImageIface *iface)
+{
+	iface->get_image_size = mcus_led_bar_led_accessible_image_get_size;
+	iface->get_image_description = mcus_led_bar_led_accessible_image_get_description;
+}
+
+static AtkObject *
+mcus_led_bar_accessible_new (GObject *object)
+{
+	AtkObject *accessible;
+
+	g_return_val_if_fail (GTK_IS_WIDGET (object), NULL);
+
+	accessible = g_object_new (mcus_led_bar_accessible_get_type (), NULL);
+	atk_object_initialize (accessible, object);
+
+	return accessible;
+}
+
+static void
+mcus_led_bar_accessible_factory_class_init (AtkObjectFactoryClass *klass)
+{
+	klass->create_accessible = mcus_led_bar_accessible_new;
+	klass->get_accessible_type = mcus_led_bar_accessible_get_type;
+}
+
+static GType
+mcus_led_bar_accessible_factory_get_type (void)
+{
+	static GType type = 0;
+
+	if (!type) {
+		const GTypeInfo tinfo = {
+			sizeof (AtkObjectFactoryClass),
+			NULL,           /* base_init */
+			NULL,           /* base_finalize */
+			(GClassInitFunc) mcus_led_bar_accessible_factory_class_init,
+			NULL,           /* class_finalize */
+			NULL,           /* class_data */
+			sizeof (AtkObjectFactory),
+			0,             /* n_preallocs */
+			NULL, NULL
+		};
+
+		type = g_type_register_static (ATK_TYPE_OBJECT_FACTORY, "MCUSLEDBarAccessibleFactory", &tinfo, 0);
+	}
+
+	return type;
+}
+
+static AtkObjectClass *a11y_parent_class = NULL;
+
+static void
+free_led_accessibles (AtkObject **leds)
+{
+	guint i;
+
+	for (i = 0; i < LED_BAR_LEDS; i++)
+		g_object_unref (leds[i]);
+	g_free (leds);
+}
+
+static void
+mcus_led_bar_accessible_initialize (AtkObject *accessible, gpointer widget)
+{
+	AtkObject **leds;
+	guint i;
+
+	atk_object_set_name (accessible, _("LED bar widget"));
+	atk_object_set_description (accessible, _("Provides visual output of a byte, one bit per LED"));
+
+	a11y_parent_class->initialize (accessible, widget);
+
+	/* Create an accessible for each LED, indexed by bit */
+	leds = g_new (AtkObject*, LED_BAR_LEDS);
+	for (i = 0; i < LED_BAR_LEDS; i++)
+		leds[i] = mcus_led_bar_led_accessible_new (accessible, i);
+	g_object_set_data_full (G_OBJECT (accessible), "mcus-led-bar-leds", leds, (GDestroyNotify) free_led_accessibles);
+}
+
+static gint
+mcus_led_bar_accessible_get_n_children (AtkObject *accessible)
+{
+	return (GTK_ACCESSIBLE (accessible)->widget != NULL) ? LED_BAR_LEDS : 0;
+}
+
+static AtkObject *
+mcus_led_bar_accessible_ref_child (AtkObject *accessible, gint i)
+{
+	AtkObject **leds;
+
+	if (GTK_ACCESSIBLE (accessible)->widget == NULL || i < 0 || i >= LED_BAR_LEDS)
+		return NULL;
+
+	/* The most significant bit comes first */
+	leds = g_object_get_data (G_OBJECT (accessible), "mcus-led-bar-leds");
+	return g_object_ref (leds[LED_BAR_LEDS - 1 - i]);
+}
+
+static void
+mcus_led_bar_accessible_class_init (AtkObjectClass *klass)
+{
+	a11y_parent_class = g_type_class_peek_parent (klass);
+	klass->initialize = mcus_led_bar_accessible_initialize;
+	klass->get_n_children = mcus_led_bar_accessible_get_n_children;
+	klass->ref_child = mcus_led_bar_accessible_ref_child;
+}
+
+static GType
+mcus_led_bar_accessible_get_type (void)
+{
+	static GType type = 0;
+
+	if (G_UNLIKELY (type == 0)) {
+		GType parent_atk_type;
+		GTypeInfo tinfo = { 0 };
+		GTypeQuery query;
+		AtkObjectFactory *factory;
+
+		if ((type = g_type_from_name ("MCUSLEDBarAccessible")))
+			return type;
+
+		factory = atk_registry_get_factory (atk_get_default_registry (), GTK_TYPE_WIDGET);
+		if (!factory)
+			return G_TYPE_INVALID;
+
+		parent_atk_type = atk_object_factory_get_accessible_type (factory);
+		if (!parent_atk_type)
+			return G_TYPE_INVALID;
+
+		/* Figure out the size of the class and instance we are deriving from */
+		g_type_query (parent_atk_type, &query);
+
+		tinfo.class_init = (GClassInitFunc) mcus_led_bar_accessible_class_init;
+		tinfo.class_size = query.class_size;
+		tinfo.instance_size = query.instance_size;
+
+		/* Register the type */
+		type = g_type_register_static (parent_atk_type, "MCUSLEDBarAccessible", &tinfo, 0);
+	}
+
+	return type;
+}
+
+static AtkObject *
+mcus_led_bar_get_accessible (GtkWidget *widget)
+{
+	static gboolean first_time = TRUE;
+
+	if (first_time) {
+		AtkObjectFactory *factory;
+		AtkRegistry *registry;
+		GType derived_type, derived_atk_type;
+
+		/* Figure out whether accessibility is enabled by looking at the type of the accessible object which would be created for
+		 * the parent type of MCUSLEDBar. */
+		derived_type = g_type_parent (MCUS_TYPE_LED_BAR);
+
+		registry = atk_get_default_registry ();
+		factory = atk_registry_get_factory (registry, derived_type);
+		derived_atk_type = atk_object_factory_get_accessible_type (factory);
+		if (g_type_is_a (derived_atk_type, GTK_TYPE_ACCESSIBLE))
+			atk_registry_set_factory_type (registry, MCUS_TYPE_LED_BAR, mcus_led_bar_accessible_factory_get_type ());
+		first_time = FALSE;
+	}
+
+	return GTK_WIDGET_CLASS (mcus_led_bar_parent_class)->get_accessible (widget);
+}
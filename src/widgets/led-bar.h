@@ -0,0 +1,59 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * MCUS
+ * Copyright (C) Philip Withnall 2008–2010 <philip@tecnocode.co.uk>
+ *
+ * MCUS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MCUS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MCUS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MCUS_LED_BAR_H
+#define MCUS_LED_BAR_H
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define LED_BAR_LEDS 8
+
+#define MCUS_TYPE_LED_BAR		(mcus_led_bar_get_type ())
+#define MCUS_LED_BAR(o)			(G_TYPE_CHECK_INSTANCE_CAST ((o), MCUS_TYPE_LED_BAR, MCUSLEDBar))
+#define MCUS_LED_BAR_CLASS(k)		(G_TYPE_CHECK_CLASS_CAST((k), MCUS_TYPE_LED_BAR, MCUSLEDBarClass))
+#define MCUS_IS_LED_BAR(o)		(G_TYPE_CHECK_INSTANCE_TYPE ((o), MCUS_TYPE_LED_BAR))
+#define MCUS_IS_LED_BAR_CLASS(k)	(G_TYPE_CHECK_CLASS_TYPE ((k), MCUS_TYPE_LED_BAR))
+#define MCUS_LED_BAR_GET_CLASS(o)	(G_TYPE_INSTANCE_GET_CLASS ((o), MCUS_TYPE_LED_BAR, MCUSLEDBarClass))
+
+typedef struct _MCUSLEDBarPrivate	MCUSLEDBarPrivate;
+
+typedef struct {
+	GtkWidget parent;
+	MCUSLEDBarPrivate *priv;
+} MCUSLEDBar;
+
+typedef struct {
+	GtkWidgetClass parent;
+} MCUSLEDBarClass;
+
+G_MODULE_EXPORT GType mcus_led_bar_get_type (void) G_GNUC_CONST;
+MCUSLEDBar *mcus_led_bar_new (void) G_GNUC_WARN_UNUSED_RESULT;
+
+guchar mcus_led_bar_get_value (MCUSLEDBar *self);
+void mcus_led_bar_set_value (MCUSLEDBar *self, guchar value);
+gdouble mcus_led_bar_get_brightness (MCUSLEDBar *self, guint led);
+void mcus_led_bar_set_brightnesses (MCUSLEDBar *self, const gdouble *brightnesses);
+
+G_END_DECLS
+
+#endif /* !MCUS_LED_BAR_H */
@@ -27,6 +27,7 @@
 #include "led.h"
 
 #define MINIMUM_SIZE 30
+#define BRIGHTNESS_LEVELS 255 /* brightnesses are rounded to this many levels, so that imperceptible changes don't cause redraws */
 
 static void mcus_led_get_property (GObject *object, guint property_id, GValue *value, GParamSpec *pspec);
 static void mcus_led_set_property (GObject *object, guint property_id, const GValue *value, GParamSpec *pspec);
@@ -37,12 +38,13 @@ static AtkObject *mcus_led_get_accessible (GtkWidget *widget);
 static GType mcus_led_accessible_get_type (void) G_GNUC_CONST;
 
 struct _MCUSLEDPrivate {
-	gboolean enabled;
+	gdouble brightness;
 	gdouble render_size;
 };
 
 enum {
-	PROP_ENABLED = 1
+	PROP_ENABLED = 1,
+	PROP_BRIGHTNESS
 };
 
 G_DEFINE_TYPE (MCUSLED, mcus_led, GTK_TYPE_WIDGET)
@@ -74,6 +76,18 @@ mcus_led_class_init (MCUSLEDClass *klass)
 					"Enabled", "Whether the LED is enabled.",
 					FALSE,
 					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * MCUSLED:brightness:
+	 *
+	 * The brightness of the LED, from 0.0 (off) to 1.0 (fully on). This is the proportion of the time the LED's lit for, when it's being
+	 * switched on and off too quickly to see.
+	 **/
+	g_object_class_install_property (gobject_class, PROP_BRIGHTNESS,
+				g_param_spec_double ("brightness",
+					"Brightness", "The brightness of the LED.",
+					0.0, 1.0, 0.0,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -92,7 +106,10 @@ mcus_led_get_property (GObject *object, guint property_id, GValue *value, GParam
 
 	switch (property_id) {
 		case PROP_ENABLED:
-			g_value_set_boolean (value, priv->enabled);
+			g_value_set_boolean (value, mcus_led_get_enabled (MCUS_LED (object)));
+			break;
+		case PROP_BRIGHTNESS:
+			g_value_set_double (value, priv->brightness);
 			break;
 		default:
 			/* We don't have any other property... */
@@ -108,6 +125,9 @@ mcus_led_set_property (GObject *object, guint property_id, const GValue *value,
 		case PROP_ENABLED:
 			mcus_led_set_enabled (MCUS_LED (object), g_value_get_boolean (value));
 			break;
+		case PROP_BRIGHTNESS:
+			mcus_led_set_brightness (MCUS_LED (object), g_value_get_double (value));
+			break;
 		default:
 			/* We don't have any other property... */
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -154,7 +174,7 @@ mcus_led_expose_event (GtkWidget *widget, GdkEventExpose *event)
 {
 	cairo_t *cr;
 	MCUSLEDPrivate *priv;
-	GdkColor fill, stroke;
+	GdkColor lit, fill, stroke;
 	GtkAllocation allocation;
 	GtkStyle *style;
 
@@ -163,14 +183,18 @@ mcus_led_expose_event (GtkWidget *widget, GdkEventExpose *event)
 
 	priv = MCUS_LED (widget)->priv;
 
-	/* Prepare our custom colours */
-	fill.red = 29555; /* Tango's medium "chameleon" --- 73d216 */
-	fill.green = 53970;
-	fill.blue = 5654;
+	/* Prepare our custom colours. The LED's filled with a blend of the lit and unlit colours according to its brightness. */
+	lit.red = 29555; /* Tango's medium "chameleon" --- 73d216 */
+	lit.green = 53970;
+	lit.blue = 5654;
 	stroke.red = 34952; /* Tango's lightest "aluminium" --- 888a85 */
 	stroke.green = 35466;
 	stroke.blue = 34181;
 
+	fill.red = stroke.red + (lit.red - stroke.red) * priv->brightness;
+	fill.green = stroke.green + (lit.green - stroke.green) * priv->brightness;
+	fill.blue = stroke.blue + (lit.blue - stroke.blue) * priv->brightness;
+
 	/* Draw! */
 	cr = gdk_cairo_create (gtk_widget_get_window (widget));
 
@@ -188,7 +212,7 @@ mcus_led_expose_event (GtkWidget *widget, GdkEventExpose *event)
 	           allocation.y + allocation.height / 2.0,
 	           priv->render_size / 2.0,
 	           0, 2 * M_PI);
-	gdk_cairo_set_source_color (cr, priv->enabled ? &fill : &stroke);
+	gdk_cairo_set_source_color (cr, &fill);
 	cairo_fill_preserve (cr);
 	gdk_cairo_set_source_color (cr, &stroke);
 	cairo_stroke (cr);
@@ -203,7 +227,7 @@ mcus_led_get_enabled (MCUSLED *self)
 {
 	g_return_val_if_fail (MCUS_IS_LED (self), -1);
 
-	return self->priv->enabled;
+	return (self->priv->brightness >= 0.5) ? TRUE : FALSE;
 }
 
 void
@@ -211,7 +235,27 @@ mcus_led_set_enabled (MCUSLED *self, gboolean enabled)
 {
 	g_return_if_fail (MCUS_IS_LED (self));
 
-	self->priv->enabled = enabled ? TRUE : FALSE;
+	mcus_led_set_brightness (self, enabled ? 1.0 : 0.0);
+}
+
+gdouble
+mcus_led_get_brightness (MCUSLED *self)
+{
+	g_return_val_if_fail (MCUS_IS_LED (self), 0.0);
+
+	return self->priv->brightness;
+}
+
+void
+mcus_led_set_brightness (MCUSLED *self, gdouble brightness)
+{
+	g_return_if_fail (MCUS_IS_LED (self));
+
+	brightness = floor (CLAMP (brightness, 0.0, 1.0) * BRIGHTNESS_LEVELS + 0.5) / BRIGHTNESS_LEVELS;
+	if (brightness == self->priv->brightness)
+		return;
+
+	self->priv->brightness = brightness;
 
 	/* Ensure we're redrawn */
 	gtk_widget_queue_draw (GTK_WIDGET (self));
@@ -300,7 +344,7 @@ static const gchar *
 mcus_led_accessible_image_get_description (AtkImage *image)
 {
 	MCUSLED *self = MCUS_LED (GTK_ACCESSIBLE (image)->widget);
-	return self->priv->enabled ? _("LED on") : _("LED off");
+	return mcus_led_get_enabled (self) ? _("LED on") : _("LED off");
 }
 
 static void
@@ -50,6 +50,9 @@ MCUSLED *mcus_led_new (void) G_GNUC_WARN_UNUSED_RESULT;
 gboolean mcus_led_get_enabled (MCUSLED *self);
 void mcus_led_set_enabled (MCUSLED *self, gboolean enabled);
 
+gdouble mcus_led_get_brightness (MCUSLED *self);
+void mcus_led_set_brightness (MCUSLED *self, gdouble brightness);
+
 G_END_DECLS
 
 #endif /* !MCUS_LED_H */
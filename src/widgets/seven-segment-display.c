@@ -54,6 +54,9 @@
 /* Separation between segments at the joints */
 #define SEGMENT_SEPARATION 0.2
 
+/* Segment brightnesses are rounded to this many levels, so that imperceptible changes don't cause redraws */
+#define BRIGHTNESS_LEVELS 255
+
 enum {
 	SEGMENT_A_ACTIVE = 1 << 0,
 	SEGMENT_B_ACTIVE = 1 << 1,
@@ -86,16 +89,22 @@ static void mcus_seven_segment_display_finalize (GObject *object);
 static void mcus_seven_segment_display_size_request (GtkWidget *widget, GtkRequisition *requisition);
 static void mcus_seven_segment_display_size_allocate (GtkWidget *widget, GtkAllocation *allocation);
 static gint mcus_seven_segment_display_expose_event (GtkWidget *widget, GdkEventExpose *event);
+static void mcus_seven_segment_display_style_set (GtkWidget *widget, GtkStyle *previous_style);
+static void mcus_seven_segment_display_unrealize (GtkWidget *widget);
+static void free_surfaces (MCUSSevenSegmentDisplayPrivate *priv);
 static AtkObject *mcus_seven_segment_display_get_accessible (GtkWidget *widget);
 static GType mcus_seven_segment_display_accessible_get_type (void) G_GNUC_CONST;
 
 struct _MCUSSevenSegmentDisplayPrivate {
 	guint8 segments;
+	gdouble brightnesses[MAX_SEGMENTS]; /* from 0.0 (off) to 1.0 (fully on); a segment's enabled in the mask if it's at least half on */
 	gint digit;
 	gdouble render_width;
 	gdouble render_height;
 	gdouble render_x;
 	gdouble render_y;
+	cairo_surface_t *unlit_surface; /* cached rendering of the display with no segments lit, or %NULL */
+	cairo_surface_t *lit_surfaces[MAX_SEGMENTS]; /* cached rendering of each segment lit, on a transparent background */
 	gchar *description; /* accessible description of the SSD's state */
 };
 
@@ -134,6 +143,8 @@ mcus_seven_segment_display_class_init (MCUSSevenSegmentDisplayClass *klass)
 	widget_class->size_request = mcus_seven_segment_display_size_request;
 	widget_class->size_allocate = mcus_seven_segment_display_size_allocate;
 	widget_class->expose_event = mcus_seven_segment_display_expose_event;
+	widget_class->style_set = mcus_seven_segment_display_style_set;
+	widget_class->unrealize = mcus_seven_segment_display_unrealize;
 	widget_class->get_accessible = mcus_seven_segment_display_get_accessible;
 
 	g_object_class_install_property (gobject_class, PROP_DIGIT,
@@ -240,9 +251,10 @@ mcus_seven_segment_display_set_property (GObject *object, guint property_id, con
 
 	switch (property_id) {
 		case PROP_DIGIT:
-			self->priv->digit = g_value_get_int (value);
-			if (self->priv->digit != -1)
-				mcus_seven_segment_display_set_digit (self, self->priv->digit);
+			if (g_value_get_int (value) != -1)
+				mcus_seven_segment_display_set_digit (self, g_value_get_int (value));
+			else
+				mcus_seven_segment_display_set_segment_mask (self, self->priv->segments);
 			break;
 		case PROP_SEGMENT_A_ENABLED:
 			mcus_seven_segment_display_set_segment (self, SEGMENT_A, g_value_get_boolean (value));
@@ -281,6 +293,7 @@ mcus_seven_segment_display_finalize (GObject *object)
 	MCUSSevenSegmentDisplayPrivate *priv = MCUS_SEVEN_SEGMENT_DISPLAY (object)->priv;
 
 	g_free (priv->description);
+	free_surfaces (priv);
 
 	/* Chain up to the parent class */
 	G_OBJECT_CLASS (mcus_seven_segment_display_parent_class)->finalize (object);
@@ -301,14 +314,20 @@ mcus_seven_segment_display_size_allocate (GtkWidget *widget, GtkAllocation *allo
 {
 	MCUSSevenSegmentDisplayPrivate *priv;
 	GtkStyle *style;
+	GtkAllocation old_allocation;
 
 	g_return_if_fail (allocation != NULL);
 	g_return_if_fail (MCUS_IS_SEVEN_SEGMENT_DISPLAY (widget));
 
-	GTK_WIDGET_CLASS (mcus_seven_segment_display_parent_class)->size_allocate (widget, allocation);
-
 	priv = MCUS_SEVEN_SEGMENT_DISPLAY (widget)->priv;
 
+	/* The cached rendering's only valid for the size it was drawn at */
+	gtk_widget_get_allocation (widget, &old_allocation);
+	if (allocation->width != old_allocation.width || allocation->height != old_allocation.height)
+		free_surfaces (priv);
+
+	GTK_WIDGET_CLASS (mcus_seven_segment_display_parent_class)->size_allocate (widget, allocation);
+
 	/* Sort out sizes, ratios, etc. */
 	if (allocation->height < allocation->width * WIDTH_HEIGHT_RATIO) {
 		priv->render_width = allocation->height;
@@ -329,8 +348,43 @@ mcus_seven_segment_display_size_allocate (GtkWidget *widget, GtkAllocation *allo
 }
 
 static void
-draw_segment (cairo_t *cr, GdkColor *fill_colour, GdkColor *stroke_colour, gboolean enabled)
+mcus_seven_segment_display_style_set (GtkWidget *widget, GtkStyle *previous_style)
+{
+	/* The casing's drawn in the style's colours */
+	free_surfaces (MCUS_SEVEN_SEGMENT_DISPLAY (widget)->priv);
+
+	if (GTK_WIDGET_CLASS (mcus_seven_segment_display_parent_class)->style_set != NULL)
+		GTK_WIDGET_CLASS (mcus_seven_segment_display_parent_class)->style_set (widget, previous_style);
+}
+
+static void
+mcus_seven_segment_display_unrealize (GtkWidget *widget)
+{
+	/* The cached rendering's specific to the window it was drawn for */
+	free_surfaces (MCUS_SEVEN_SEGMENT_DISPLAY (widget)->priv);
+
+	GTK_WIDGET_CLASS (mcus_seven_segment_display_parent_class)->unrealize (widget);
+}
+
+/* Blend between the @lit and @unlit colours according to @brightness */
+static void
+blend_colour (GdkColor *colour, const GdkColor *lit, const GdkColor *unlit, gdouble brightness)
+{
+	colour->red = unlit->red + (lit->red - unlit->red) * brightness;
+	colour->green = unlit->green + (lit->green - unlit->green) * brightness;
+	colour->blue = unlit->blue + (lit->blue - unlit->blue) * brightness;
+}
+
+/* Draw @segment, unless only @lit_segment is being drawn and it's a different one; see draw_display() */
+static void
+draw_segment (cairo_t *cr, MCUSSevenSegmentDisplaySegment segment, gint lit_segment, GdkColor *fill_colour, GdkColor *stroke_colour,
+              gdouble brightness)
 {
+	GdkColor colour;
+
+	if (lit_segment != -1 && lit_segment != (gint) segment)
+		return;
+
 	cairo_save (cr);
 
 	cairo_move_to (cr, -SEGMENT_LENGTH / 2.0 + SEGMENT_CHAMFER, SEGMENT_WIDTH / 2.0);
@@ -341,7 +395,8 @@ draw_segment (cairo_t *cr, GdkColor *fill_colour, GdkColor *stroke_colour, gbool
 	cairo_line_to (cr, -SEGMENT_LENGTH / 2.0, 0);
 	cairo_line_to (cr, -SEGMENT_LENGTH / 2.0 + SEGMENT_CHAMFER, SEGMENT_WIDTH / 2.0);
 
-	gdk_cairo_set_source_color (cr, enabled ? fill_colour : stroke_colour);
+	blend_colour (&colour, fill_colour, stroke_colour, brightness);
+	gdk_cairo_set_source_color (cr, &colour);
 	cairo_fill_preserve (cr);
 	gdk_cairo_set_source_color (cr, stroke_colour);
 	cairo_stroke (cr);
@@ -349,20 +404,16 @@ draw_segment (cairo_t *cr, GdkColor *fill_colour, GdkColor *stroke_colour, gbool
 	cairo_restore (cr);
 }
 
-static gint
-mcus_seven_segment_display_expose_event (GtkWidget *widget, GdkEventExpose *event)
+/* Draw the display at its allocated size, with its origin at the top-left of its allocation. If @lit_segment is -1, the casing and all the
+ * segments are drawn unlit; otherwise, only @lit_segment is drawn, lit, on a transparent background. These are drawn once per allocation and
+ * cached in surfaces, which are composited by the expose handler. */
+static void
+draw_display (GtkWidget *widget, cairo_t *cr, gint lit_segment)
 {
-	cairo_t *cr;
 	MCUSSevenSegmentDisplayPrivate *priv;
-	GdkColor segment_fill, segment_stroke;
+	GdkColor segment_fill, segment_stroke, fill;
 	GtkStyle *style;
-	GtkAllocation allocation;
-
-	g_return_val_if_fail (event != NULL, FALSE);
-	g_return_val_if_fail (MCUS_IS_SEVEN_SEGMENT_DISPLAY (widget), FALSE);
-
-	if (gtk_widget_is_drawable (widget) == FALSE)
-		return FALSE;
+	gdouble brightness = (lit_segment == -1) ? 0.0 : 1.0;
 
 	priv = MCUS_SEVEN_SEGMENT_DISPLAY (widget)->priv;
 
@@ -374,39 +425,36 @@ mcus_seven_segment_display_expose_event (GtkWidget *widget, GdkEventExpose *even
 	segment_stroke.green = 35466;
 	segment_stroke.blue = 34181;
 
-	/* Draw! */
-	cr = gdk_cairo_create (gtk_widget_get_window (widget));
-
-	/* Clip to the exposed area */
-	cairo_rectangle (cr, event->area.x, event->area.y, event->area.width, event->area.height);
-	cairo_clip (cr);
-
 	/* Sort out sizes, ratios, etc. */
 	style = gtk_widget_get_style (widget);
-	gtk_widget_get_allocation (widget, &allocation);
-	cairo_translate (cr, allocation.x + priv->render_x, allocation.y + priv->render_y);
+	cairo_translate (cr, priv->render_x, priv->render_y);
 	cairo_set_line_width (cr, style->xthickness / (priv->render_width / EXTERNAL_WIDTH)); /* make sure the thickness isn't scaled */
 	cairo_scale (cr, priv->render_width / EXTERNAL_WIDTH, priv->render_height / EXTERNAL_HEIGHT);
 
 	/* Draw the body of the display */
-	cairo_rectangle (cr, 0.0, 0.0, EXTERNAL_WIDTH, EXTERNAL_HEIGHT);
-	gdk_cairo_set_source_color (cr, &(style->mid[GTK_STATE_NORMAL]));
-	cairo_fill_preserve (cr);
-	gdk_cairo_set_source_color (cr, &(style->dark[GTK_STATE_NORMAL]));
-	cairo_stroke (cr);
+	if (lit_segment == -1) {
+		cairo_rectangle (cr, 0.0, 0.0, EXTERNAL_WIDTH, EXTERNAL_HEIGHT);
+		gdk_cairo_set_source_color (cr, &(style->mid[GTK_STATE_NORMAL]));
+		cairo_fill_preserve (cr);
+		gdk_cairo_set_source_color (cr, &(style->dark[GTK_STATE_NORMAL]));
+		cairo_stroke (cr);
+	}
 
 	/* Draw the decimal point */
-	cairo_arc (cr, EXTERNAL_WIDTH - (EXTERNAL_HEIGHT - INTERNAL_HEIGHT) / 2.0 + SEGMENT_SEPARATION * 2.0,
-	               EXTERNAL_HEIGHT - (EXTERNAL_HEIGHT - INTERNAL_HEIGHT) / 2.0,
-	               DOT_RADIUS, 0.0, 2.0 * M_PI);
-	gdk_cairo_set_source_color (cr, priv->segments & POINT_ACTIVE ? &segment_fill : &segment_stroke);
-	cairo_fill_preserve (cr);
-	gdk_cairo_set_source_color (cr, &segment_stroke);
-	cairo_stroke (cr);
+	if (lit_segment == -1 || lit_segment == SEGMENT_POINT) {
+		cairo_arc (cr, EXTERNAL_WIDTH - (EXTERNAL_HEIGHT - INTERNAL_HEIGHT) / 2.0 + SEGMENT_SEPARATION * 2.0,
+		               EXTERNAL_HEIGHT - (EXTERNAL_HEIGHT - INTERNAL_HEIGHT) / 2.0,
+		               DOT_RADIUS, 0.0, 2.0 * M_PI);
+		blend_colour (&fill, &segment_fill, &segment_stroke, brightness);
+		gdk_cairo_set_source_color (cr, &fill);
+		cairo_fill_preserve (cr);
+		gdk_cairo_set_source_color (cr, &segment_stroke);
+		cairo_stroke (cr);
+	}
 
 	/* Start with the middle segment (G) */
 	cairo_translate (cr, EXTERNAL_WIDTH / 2.0, EXTERNAL_HEIGHT / 2.0);
-	draw_segment (cr, &segment_fill, &segment_stroke, priv->segments & SEGMENT_G_ACTIVE);
+	draw_segment (cr, SEGMENT_G, lit_segment, &segment_fill, &segment_stroke, brightness);
 
 	/* The other segments are angled */
 	cairo_rotate (cr, SEGMENT_ANGLE);
@@ -415,14 +463,14 @@ mcus_seven_segment_display_expose_event (GtkWidget *widget, GdkEventExpose *even
 	cairo_translate (cr, 0.0, -SEGMENT_LENGTH - SEGMENT_SEPARATION * 2.0);
 	cairo_save (cr);
 	cairo_rotate (cr, -SEGMENT_ANGLE);
-	draw_segment (cr, &segment_fill, &segment_stroke, priv->segments & SEGMENT_A_ACTIVE);
+	draw_segment (cr, SEGMENT_A, lit_segment, &segment_fill, &segment_stroke, brightness);
 	cairo_restore (cr);
 
 	/* Segment D */
 	cairo_translate (cr, 0.0, SEGMENT_LENGTH * 2.0 + SEGMENT_SEPARATION * 4.0);
 	cairo_save (cr);
 	cairo_rotate (cr, -SEGMENT_ANGLE);
-	draw_segment (cr, &segment_fill, &segment_stroke, priv->segments & SEGMENT_D_ACTIVE);
+	draw_segment (cr, SEGMENT_D, lit_segment, &segment_fill, &segment_stroke, brightness);
 	cairo_restore (cr);
 
 	/* Segments F, B, E and C are vertical */
@@ -430,23 +478,104 @@ mcus_seven_segment_display_expose_event (GtkWidget *widget, GdkEventExpose *even
 
 	/* Segment E */
 	cairo_translate (cr, -SEGMENT_LENGTH / 2.0 + SEGMENT_SEPARATION, SEGMENT_LENGTH / 2.0 + SEGMENT_SEPARATION);
-	draw_segment (cr, &segment_fill, &segment_stroke, priv->segments & SEGMENT_E_ACTIVE);
+	draw_segment (cr, SEGMENT_E, lit_segment, &segment_fill, &segment_stroke, brightness);
 
 	/* Segment C */
 	cairo_rotate (cr, -SEGMENT_ANGLE);
 	cairo_translate (cr, SEGMENT_SEPARATION, -SEGMENT_LENGTH - SEGMENT_SEPARATION * 2.0);
 	cairo_rotate (cr, SEGMENT_ANGLE);
-	draw_segment (cr, &segment_fill, &segment_stroke, priv->segments & SEGMENT_C_ACTIVE);
+	draw_segment (cr, SEGMENT_C, lit_segment, &segment_fill, &segment_stroke, brightness);
 
 	/* Segment B */
 	cairo_translate (cr, -SEGMENT_LENGTH - SEGMENT_SEPARATION * 2.0, 0.0);
-	draw_segment (cr, &segment_fill, &segment_stroke, priv->segments & SEGMENT_B_ACTIVE);
+	draw_segment (cr, SEGMENT_B, lit_segment, &segment_fill, &segment_stroke, brightness);
 
 	/* Segment F */
 	cairo_rotate (cr, -SEGMENT_ANGLE);
 	cairo_translate (cr, 0.0, SEGMENT_LENGTH + SEGMENT_SEPARATION * 2.0);
 	cairo_rotate (cr, SEGMENT_ANGLE);
-	draw_segment (cr, &segment_fill, &segment_stroke, priv->segments & SEGMENT_F_ACTIVE);
+	draw_segment (cr, SEGMENT_F, lit_segment, &segment_fill, &segment_stroke, brightness);
+}
+
+/* Throw away the cached rendering of the display, so that it's redrawn on the next expose */
+static void
+free_surfaces (MCUSSevenSegmentDisplayPrivate *priv)
+{
+	guint i;
+
+	if (priv->unlit_surface != NULL)
+		cairo_surface_destroy (priv->unlit_surface);
+	priv->unlit_surface = NULL;
+
+	for (i = 0; i < MAX_SEGMENTS; i++) {
+		if (priv->lit_surfaces[i] != NULL)
+			cairo_surface_destroy (priv->lit_surfaces[i]);
+		priv->lit_surfaces[i] = NULL;
+	}
+}
+
+/* Render the display into a new surface similar to @target, the size of the widget's allocation */
+static cairo_surface_t *
+create_surface (GtkWidget *widget, cairo_surface_t *target, gint lit_segment)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	GtkAllocation allocation;
+
+	gtk_widget_get_allocation (widget, &allocation);
+
+	surface = cairo_surface_create_similar (target, CAIRO_CONTENT_COLOR_ALPHA, allocation.width, allocation.height);
+	cr = cairo_create (surface);
+	draw_display (widget, cr, lit_segment);
+	cairo_destroy (cr);
+
+	return surface;
+}
+
+static gint
+mcus_seven_segment_display_expose_event (GtkWidget *widget, GdkEventExpose *event)
+{
+	cairo_t *cr;
+	MCUSSevenSegmentDisplayPrivate *priv;
+	GtkAllocation allocation;
+	guint i;
+
+	g_return_val_if_fail (event != NULL, FALSE);
+	g_return_val_if_fail (MCUS_IS_SEVEN_SEGMENT_DISPLAY (widget), FALSE);
+
+	if (gtk_widget_is_drawable (widget) == FALSE)
+		return FALSE;
+
+	priv = MCUS_SEVEN_SEGMENT_DISPLAY (widget)->priv;
+
+	/* Draw! */
+	cr = gdk_cairo_create (gtk_widget_get_window (widget));
+
+	/* Clip to the exposed area */
+	cairo_rectangle (cr, event->area.x, event->area.y, event->area.width, event->area.height);
+	cairo_clip (cr);
+
+	/* Build the cached rendering of the display the first time it's exposed at this size: the casing with all the segments unlit, and each
+	 * segment lit on its own */
+	if (priv->unlit_surface == NULL) {
+		priv->unlit_surface = create_surface (widget, cairo_get_target (cr), -1);
+		for (i = 0; i < MAX_SEGMENTS; i++)
+			priv->lit_surfaces[i] = create_surface (widget, cairo_get_target (cr), i);
+	}
+
+	/* Composite the lit segments over the unlit display according to their brightness */
+	gtk_widget_get_allocation (widget, &allocation);
+
+	cairo_set_source_surface (cr, priv->unlit_surface, allocation.x, allocation.y);
+	cairo_paint (cr);
+
+	for (i = 0; i < MAX_SEGMENTS; i++) {
+		if (priv->brightnesses[i] == 0.0)
+			continue;
+
+		cairo_set_source_surface (cr, priv->lit_surfaces[i], allocation.x, allocation.y);
+		cairo_paint_with_alpha (cr, priv->brightnesses[i]);
+	}
 
 	cairo_destroy (cr);
 
@@ -486,6 +615,36 @@ update_accessible_description (MCUSSevenSegmentDisplay *self)
 	                                           (segments & POINT_ACTIVE) ? _(".") : "");
 }
 
+/* Display @segments fully lit (as @digit, or -1 if they're not a digit), only redrawing if that changes what's shown */
+static void
+set_segments (MCUSSevenSegmentDisplay *self, guint8 segments, gint digit)
+{
+	MCUSSevenSegmentDisplayPrivate *priv = self->priv;
+	gboolean changed = FALSE;
+	guint i;
+
+	for (i = 0; i < MAX_SEGMENTS; i++) {
+		gdouble brightness = (segments & (1 << i)) ? 1.0 : 0.0;
+
+		if (brightness != priv->brightnesses[i]) {
+			priv->brightnesses[i] = brightness;
+			changed = TRUE;
+		}
+	}
+
+	if (segments != priv->segments || digit != priv->digit) {
+		priv->segments = segments;
+		priv->digit = digit;
+
+		/* Update the accessible description */
+		update_accessible_description (self);
+	}
+
+	/* Ensure we're redrawn */
+	if (changed == TRUE)
+		gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
 guint8
 mcus_seven_segment_display_get_segment_mask (MCUSSevenSegmentDisplay *self)
 {
@@ -499,14 +658,7 @@ mcus_seven_segment_display_set_segment_mask (MCUSSevenSegmentDisplay *self, guin
 {
 	g_return_if_fail (MCUS_IS_SEVEN_SEGMENT_DISPLAY (self));
 
-	self->priv->segments = segment_mask;
-	self->priv->digit = -1;
-
-	/* Update the accessible description */
-	update_accessible_description (self);
-
-	/* Ensure we're redrawn */
-	gtk_widget_queue_draw (GTK_WIDGET (self));
+	set_segments (self, segment_mask, -1);
 }
 
 gint
@@ -523,16 +675,8 @@ mcus_seven_segment_display_set_digit (MCUSSevenSegmentDisplay *self, guint digit
 	g_return_if_fail (/*digit >= 0 && */digit <= 9);
 	g_return_if_fail (MCUS_IS_SEVEN_SEGMENT_DISPLAY (self));
 
-	self->priv->digit = digit;
-
 	/* Preserve the state of the point */
-	self->priv->segments = segment_digit_map[digit] | (self->priv->segments & POINT_ACTIVE);
-
-	/* Update the accessible description */
-	update_accessible_description (self);
-
-	/* Ensure we're redrawn */
-	gtk_widget_queue_draw (GTK_WIDGET (self));
+	set_segments (self, segment_digit_map[digit] | (self->priv->segments & POINT_ACTIVE), digit);
 }
 
 gboolean
@@ -549,16 +693,90 @@ mcus_seven_segment_display_set_segment (MCUSSevenSegmentDisplay *self, MCUSSeven
 	g_return_if_fail (MCUS_IS_SEVEN_SEGMENT_DISPLAY (self));
 
 	if (enabled == TRUE)
-		self->priv->segments |= 1 << segment;
+		set_segments (self, self->priv->segments | (1 << segment), -1);
 	else
-		self->priv->segments &= ~(1 << segment);
-	self->priv->digit = -1;
+		set_segments (self, self->priv->segments & ~(1 << segment), -1);
+}
+
+gdouble
+mcus_seven_segment_display_get_segment_brightness (MCUSSevenSegmentDisplay *self, MCUSSevenSegmentDisplaySegment segment)
+{
+	g_return_val_if_fail (MCUS_IS_SEVEN_SEGMENT_DISPLAY (self), 0.0);
+	g_return_val_if_fail (segment < MAX_SEGMENTS, 0.0);
+
+	return self->priv->brightnesses[segment];
+}
+
+/**
+ * mcus_seven_segment_display_set_segment_brightnesses:
+ * @self: an #MCUSSevenSegmentDisplay
+ * @brightnesses: an array of %MAX_SEGMENTS brightnesses, indexed by #MCUSSevenSegmentDisplaySegment
+ *
+ * Sets the brightness of every segment at once, from 0.0 (off) to 1.0 (fully on); for example, to the proportion of the time each is lit
+ * for when the display's being multiplexed. Segments which are at least half on are enabled in the segment mask, and if they form a digit,
+ * that becomes the display's digit. The display's only redrawn if a segment's brightness has changed perceptibly.
+ **/
+void
+mcus_seven_segment_display_set_segment_brightnesses (MCUSSevenSegmentDisplay *self, const gdouble *brightnesses)
+{
+	MCUSSevenSegmentDisplayPrivate *priv;
+	gboolean changed = FALSE;
+	guint8 segments = 0;
+	gint digit = -1;
+	guint i;
+
+	g_return_if_fail (MCUS_IS_SEVEN_SEGMENT_DISPLAY (self));
+	g_return_if_fail (brightnesses != NULL);
+
+	priv = self->priv;
 
-	/* Update the accessible description */
-	update_accessible_description (self);
+	for (i = 0; i < MAX_SEGMENTS; i++) {
+		gdouble brightness = floor (CLAMP (brightnesses[i], 0.0, 1.0) * BRIGHTNESS_LEVELS + 0.5) / BRIGHTNESS_LEVELS;
+
+		if (brightness != priv->brightnesses[i]) {
+			priv->brightnesses[i] = brightness;
+			changed = TRUE;
+		}
+
+		if (brightness >= 0.5)
+			segments |= 1 << i;
+	}
+
+	/* Describe the display as a digit if that's what it's showing */
+	for (i = 0; i < G_N_ELEMENTS (segment_digit_map); i++) {
+		if ((segments & ~POINT_ACTIVE) == segment_digit_map[i]) {
+			digit = i;
+			break;
+		}
+	}
+
+	if (segments != priv->segments || digit != priv->digit) {
+		priv->segments = segments;
+		priv->digit = digit;
+
+		/* Update the accessible description */
+		update_accessible_description (self);
+	}
 
 	/* Ensure we're redrawn */
-	gtk_widget_queue_draw (GTK_WIDGET (self));
+	if (changed == TRUE)
+		gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+/**
+ * mcus_seven_segment_display_digit_to_segment_mask:
+ * @digit: a digit, from 0 to 9
+ *
+ * Returns the segments which are enabled to display @digit, as used by mcus_seven_segment_display_set_digit(). The point isn't enabled.
+ *
+ * Return value: the segment mask for @digit
+ **/
+guint8
+mcus_seven_segment_display_digit_to_segment_mask (guint digit)
+{
+	g_return_val_if_fail (/*digit >= 0 && */digit <= 9, 0);
+
+	return segment_digit_map[digit];
 }
 
 /* Accessibility stuff */
@@ -65,6 +65,10 @@ gint mcus_seven_segment_display_get_digit (MCUSSevenSegmentDisplay *self);
 void mcus_seven_segment_display_set_digit (MCUSSevenSegmentDisplay *self, guint digit);
 gboolean mcus_seven_segment_display_get_segment (MCUSSevenSegmentDisplay *self, MCUSSevenSegmentDisplaySegment segment);
 void mcus_seven_segment_display_set_segment (MCUSSevenSegmentDisplay *self, MCUSSevenSegmentDisplaySegment segment, gboolean enabled);
+gdouble mcus_seven_segment_display_get_segment_brightness (MCUSSevenSegmentDisplay *self, MCUSSevenSegmentDisplaySegment segment);
+void mcus_seven_segment_display_set_segment_brightnesses (MCUSSevenSegmentDisplay *self, const gdouble *brightnesses);
+
+guint8 mcus_seven_segment_display_digit_to_segment_mask (guint digit) G_GNUC_CONST;
 
 G_END_DECLS
 